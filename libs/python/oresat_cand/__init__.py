@@ -7,9 +7,11 @@ from .errors import (
     MessageUnpackCandError,
     MessageVersionCandError,
     SdoAbortCandError,
+    ShmCandError,
     UnknownIdCandError,
 )
 from .node_client import ManagerNodeClient, NodeClient, NodeState
+from .od_shm import OdShm
 
 try:
     from ._version import version as __version__
@@ -29,7 +31,9 @@ __all__ = [
     "MessageUnpackCandError",
     "NodeClient",
     "NodeState",
+    "OdShm",
     "SdoAbortCandError",
+    "ShmCandError",
     "UnknownIdCandError",
     "__version__",
 ]
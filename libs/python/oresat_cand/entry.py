@@ -1,6 +1,7 @@
 from __future__ import annotations
 
 import struct
+import zlib
 from dataclasses import dataclass
 from enum import Enum
 
@@ -32,6 +33,11 @@ class DataType(DataTypeDef, Enum):
     def size(self) -> int:
         return 0 if self.fmt is None else struct.calcsize(self.fmt)
 
+    @property
+    def is_numeric(self) -> bool:
+        """Bools, ints and floats, the types oresat-cand marks PDO mappable."""
+        return self not in [DataType.STR, DataType.BYTES, DataType.DOMAIN]
+
 
 @dataclass
 class EntryBitFieldDef:
@@ -140,3 +146,50 @@ class Entry(EntryDef, Enum):
         except Exception as e:
             raise ValueError(f"{self.name} encode {e}") from e
         return raw
+
+
+class EntryKeyTable:
+    """Key table for compact OD write messages.
+
+    Keys are the positions of numeric entries with index >= 0x4000 sorted by index and subindex,
+    skipping subindex 0 of records and arrays. This must match the table oresat-cand builds from
+    the same OD config, which is checked with the table crc sent in each message and sent to the
+    daemon by NodeClient, it only sends compact messages while every client's crc matches.
+    """
+
+    def __init__(self, entries: list[Entry]):
+        indexes_with_subs = {e.index for e in entries if e.subindex != 0}
+        keyed = {}
+        for entry in entries:
+            if entry.index < 0x4000 or not entry.data_type.is_numeric:
+                continue
+            if entry.subindex == 0 and entry.index in indexes_with_subs:
+                continue
+            keyed[(entry.index, entry.subindex)] = entry
+        self.entries = [keyed[k] for k in sorted(keyed)]
+        self._keys = {entry: key for key, entry in enumerate(self.entries)}
+
+        self.crc = 0
+        for entry in self.entries:
+            raw = struct.pack("<HBB", entry.index, entry.subindex, entry.data_type.size)
+            self.crc = zlib.crc32(raw, self.crc)
+
+    def __len__(self) -> int:
+        return len(self.entries)
+
+    def key(self, entry: Entry) -> int:
+        return self._keys[entry]
+
+    def encode(self, entry: Entry, value: bool | int | float) -> int:
+        """Encode a value to a zigzag encoded key table value."""
+        bits = entry.data_type.size * 8
+        raw = int.from_bytes(entry.encode(value), "little")
+        sign = raw >> (bits - 1)
+        return ((raw << 1) ^ (-sign)) & ((1 << bits) - 1)
+
+    def decode(self, key: int, value: int) -> tuple[Entry, bool | int | float]:
+        """Decode a zigzag encoded key table value."""
+        entry = self.entries[key]
+        bits = entry.data_type.size * 8
+        raw = ((value >> 1) ^ (-(value & 1))) & ((1 << bits) - 1)
+        return entry, entry.decode(raw.to_bytes(entry.data_type.size, "little"))
@@ -52,3 +52,7 @@ class UnknownIdCandError(CandError):
     def __init__(self, id: int):
         super().__init__(f"unknown message id {id}")
         self.id = id
+
+
+class ShmCandError(CandError):
+    """The OD snapshot in shared memory could not be read."""
@@ -6,7 +6,7 @@ from typing import ClassVar
 
 from oresat_cand.errors import MessagePackCandError, MessageUnpackCandError, MessageVersionCandError
 
-PROTOCAL_VERSION = 0  # Bump on breaking changes to message formats
+PROTOCAL_VERSION = 1  # Bump on breaking changes to message formats
 PROTOCAL_VERSION_RAW = PROTOCAL_VERSION.to_bytes(1, "little")
 
 # custom struck-like formats
@@ -18,6 +18,10 @@ DYN_FMT_SIZE = 1
 @dataclass
 class Message:
     _fmt: ClassVar[list[str]]
+    # fixed size formats at the end of a message that are not always sent (like the rx time of
+    # RPDO mapped od writes), only unpacked when present and only packed when not all 0; their
+    # fields must default to 0
+    _optional_fmt: ClassVar[list[str]] = []
     id: ClassVar[int]
 
     def pack(self) -> bytes:
@@ -38,6 +42,8 @@ class Message:
                     count = len(fmt)
                     raw += struct.pack("<" + fmt, *values[offset : offset + count])
                     offset += count
+            if any(values[offset:]):
+                raw += struct.pack("<" + "".join(self._optional_fmt), *values[offset:])
         except Exception as e:
             raise MessagePackCandError(self.__class__.__name__, values, str(e))
         return raw
@@ -66,6 +72,12 @@ class Message:
                     size = struct.calcsize("<" + fmt)
                     values += struct.unpack("<" + fmt, raw[offset : offset + size])
                     offset += size
+            for fmt in cls._optional_fmt:
+                size = struct.calcsize("<" + fmt)
+                if len(raw) < offset + size:
+                    break
+                values += struct.unpack("<" + fmt, raw[offset : offset + size])
+                offset += size
         except Exception as e:
             raise MessageUnpackCandError(cls.__name__, raw, str(e))
         return cls(*values[2:])
@@ -86,13 +98,97 @@ class TpdoSendMessage(Message):
     num: int
 
 
+TPDO_SEND_MULTI_MAX = 64
+
+
+@dataclass
+class TpdoSendMultiMessage(Message):
+    _fmt: ClassVar[list[str]] = ["Q"]
+    id: ClassVar[int] = 0x10
+    tpdos: int  # bit n requests tpdo n
+
+
 @dataclass
 class OdWriteMessage(Message):
     _fmt: ClassVar[list[str]] = ["HB", DYN_BYTES_FMT]
+    _optional_fmt: ClassVar[list[str]] = ["Q"]
     id: ClassVar[int] = 0x2
     index: int
     subindex: int
     raw: bytes
+    rx_time_ns: int = 0  # only set by the daemon for RPDO mapped entries
+
+
+def varint_encode(value: int) -> bytes:
+    raw = b""
+    while value >= 0x80:
+        raw += bytes([(value & 0x7F) | 0x80])
+        value >>= 7
+    return raw + bytes([value])
+
+
+def varint_decode(raw: bytes, offset: int) -> tuple[int, int]:
+    """Returns the value and the offset after it."""
+    value = 0
+    shift = 0
+    while True:
+        byte = raw[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, offset
+        shift += 7
+
+
+@dataclass
+class OdWriteCompactMessage(Message):
+    """Batch of numeric OD writes keyed by an EntryKeyTable, values are zigzag encoded."""
+
+    _fmt: ClassVar[list[str]] = ["I"]
+    id: ClassVar[int] = 0xD
+    table_crc: int
+    values: list[tuple[int, int]]  # (key, value) pairs sorted by key
+
+    def pack(self) -> bytes:
+        raw = PROTOCAL_VERSION_RAW + bytes([self.id])
+        try:
+            raw += struct.pack("<I", self.table_crc)
+            last_key = 0
+            for key, value in self.values:
+                raw += varint_encode(key - last_key) + varint_encode(value)
+                last_key = key
+        except Exception as e:
+            raise MessagePackCandError(self.__class__.__name__, astuple(self), str(e))
+        return raw
+
+    @classmethod
+    def unpack(cls, raw: bytes) -> OdWriteCompactMessage:
+        if raw[0] != PROTOCAL_VERSION:
+            raise MessageVersionCandError(PROTOCAL_VERSION, raw[0])
+        if raw[1] != cls.id:
+            raise MessageVersionCandError(cls.id, raw[0])
+        try:
+            table_crc = struct.unpack("<I", raw[2:6])[0]
+            values = []
+            key = 0
+            offset = 6
+            while offset < len(raw):
+                delta, offset = varint_decode(raw, offset)
+                value, offset = varint_decode(raw, offset)
+                key += delta
+                values.append((key, value))
+        except Exception as e:
+            raise MessageUnpackCandError(cls.__name__, raw, str(e))
+        return cls(table_crc, values)
+
+
+@dataclass
+class OdCompactTableMessage(Message):
+    """A client's compact table crc, the reply and the daemon's broadcasts have the daemon's."""
+
+    _fmt: ClassVar[list[str]] = ["I"]
+    id: ClassVar[int] = 0x13
+    table_crc: int  # 0 from a daemon that sends no compact messages
 
 
 @dataclass
@@ -124,19 +220,21 @@ class AddFileMessage(Message):
 
 @dataclass
 class HbRecvMessage(Message):
-    _fmt: ClassVar[list[str]] = ["BB"]
+    _fmt: ClassVar[list[str]] = ["BBQ"]
     id: ClassVar[int] = 0x6
     node_id: int
     state: int
+    rx_time_ns: int = 0
 
 
 @dataclass
 class EmcyRecvMessage(Message):
-    _fmt: ClassVar[list[str]] = ["BHI"]
+    _fmt: ClassVar[list[str]] = ["BHIQ"]
     id: ClassVar[int] = 0x7
     node_id: int
     code: int
     info: int
+    rx_time_ns: int = 0
 
 
 @dataclass
@@ -152,6 +250,80 @@ class BusStateMessage(Message):
     state: int
 
 
+BUS_STATS_CLASS_NAMES = ["nmt", "sync", "emcy", "time", "pdo", "sdo", "hb", "other"]
+
+
+@dataclass
+class BusStatsMessage(Message):
+    """Periodic bus statistics, counts are for the interval; nodes maps node id to frame count."""
+
+    _fmt: ClassVar[list[str]] = ["BIH8H7HB"]  # followed by the node id, frame count pairs
+    id: ClassVar[int] = 0xF
+    state: int
+    interval_ms: int
+    load: int  # 0.1 % units
+    frames: dict[str, int]
+    tx_frames: int
+    err_frames: int
+    err_passive: int
+    bus_off: int
+    tx_overflow: int
+    rx_overflow: int
+    tx_dropped: int
+    nodes: dict[int, int]
+
+    @property
+    def load_percent(self) -> float:
+        return self.load / 10
+
+    def pack(self) -> bytes:
+        raw = PROTOCAL_VERSION_RAW + bytes([self.id])
+        try:
+            frames = [self.frames.get(name, 0) for name in BUS_STATS_CLASS_NAMES]
+            raw += struct.pack(
+                "<" + self._fmt[0],
+                self.state,
+                self.interval_ms,
+                self.load,
+                *frames,
+                self.tx_frames,
+                self.err_frames,
+                self.err_passive,
+                self.bus_off,
+                self.tx_overflow,
+                self.rx_overflow,
+                self.tx_dropped,
+                len(self.nodes),
+            )
+            for node_id, count in sorted(self.nodes.items()):
+                raw += struct.pack("<BH", node_id, count)
+        except Exception as e:
+            raise MessagePackCandError(self.__class__.__name__, astuple(self), str(e))
+        return raw
+
+    @classmethod
+    def unpack(cls, raw: bytes) -> BusStatsMessage:
+        if raw[0] != PROTOCAL_VERSION:
+            raise MessageVersionCandError(PROTOCAL_VERSION, raw[0])
+        if raw[1] != cls.id:
+            raise MessageVersionCandError(cls.id, raw[0])
+        try:
+            offset = 2
+            size = struct.calcsize("<" + cls._fmt[0])
+            values = struct.unpack("<" + cls._fmt[0], raw[offset : offset + size])
+            offset += size
+            state, interval_ms, load = values[:3]
+            frames = dict(zip(BUS_STATS_CLASS_NAMES, values[3:11]))
+            nodes = {}
+            for _ in range(values[18]):
+                node_id, count = struct.unpack("<BH", raw[offset : offset + 3])
+                nodes[node_id] = count
+                offset += 3
+        except Exception as e:
+            raise MessageUnpackCandError(cls.__name__, raw, str(e))
+        return cls(state, interval_ms, load, frames, *values[11:18], nodes)
+
+
 @dataclass
 class SdoReadToFileMessage(Message):
     _fmt: ClassVar[list[str]] = ["B", DYN_STR_FMT]
@@ -175,6 +347,102 @@ class ConfigMessage(Message):
     file: str
 
 
+LATENCY_STATS_NAMES = [
+    "rt_cycle",
+    "rt_jitter",
+    "sdo_server",
+    "sdo_client",
+    "ipc_sdo_read",
+    "ipc_sdo_write",
+    "ipc_add_file",
+    "ipc_sdo_read_to_file",
+    "ipc_sdo_write_from_file",
+    "ipc_other",
+]
+
+
+@dataclass
+class LatencySummary:
+    """Summary of one latency histogram, all values other than count are in microseconds."""
+
+    count: int
+    mean: int
+    p50: int
+    p90: int
+    p99: int
+    p999: int
+    max: int
+
+
+@dataclass
+class LatencyStatsMessage(Message):
+    """Request with no stats, the reply has a summary per histogram in LATENCY_STATS_NAMES order."""
+
+    _fmt: ClassVar[list[str]] = ["?B"]
+    id: ClassVar[int] = 0xE
+    reset: bool
+    stats: list[LatencySummary]
+
+    SUMMARY_FMT: ClassVar[str] = "<7I"
+
+    def pack(self) -> bytes:
+        raw = PROTOCAL_VERSION_RAW + bytes([self.id])
+        try:
+            raw += struct.pack("<?B", self.reset, len(self.stats))
+            for stat in self.stats:
+                raw += struct.pack(self.SUMMARY_FMT, *astuple(stat))
+        except Exception as e:
+            raise MessagePackCandError(self.__class__.__name__, astuple(self), str(e))
+        return raw
+
+    @classmethod
+    def unpack(cls, raw: bytes) -> LatencyStatsMessage:
+        if raw[0] != PROTOCAL_VERSION:
+            raise MessageVersionCandError(PROTOCAL_VERSION, raw[0])
+        if raw[1] != cls.id:
+            raise MessageVersionCandError(cls.id, raw[0])
+        try:
+            reset, length = struct.unpack("<?B", raw[2:4])
+            size = struct.calcsize(cls.SUMMARY_FMT)
+            stats = [
+                LatencySummary(
+                    *struct.unpack(cls.SUMMARY_FMT, raw[4 + i * size : 4 + (i + 1) * size])
+                )
+                for i in range(length)
+            ]
+        except Exception as e:
+            raise MessageUnpackCandError(cls.__name__, raw, str(e))
+        return cls(reset, stats)
+
+
+SCHEDULE_OD_WRITE = 0
+SCHEDULE_TPDO = 1
+SCHEDULE_OS_COMMAND = 2
+
+
+def unix_to_scet(t: float) -> int:
+    """Unix time in seconds to a raw ECSS SCET, seconds in the low 32 bits then microseconds."""
+    coarse, fine = divmod(round(t * 1_000_000), 1_000_000)
+    return coarse | (fine << 32)
+
+
+@dataclass
+class ScheduleMessage(Message):
+    _fmt: ClassVar[list[str]] = ["IQB", DYN_BYTES_FMT]
+    id: ClassVar[int] = 0x11
+    action_id: int  # to cancel it by, 0 for none
+    scet: int
+    type: int
+    data: bytes
+
+
+@dataclass
+class ScheduleCancelMessage(Message):
+    _fmt: ClassVar[list[str]] = ["I"]
+    id: ClassVar[int] = 0x12
+    action_id: int  # 0 cancels all of them
+
+
 @dataclass
 class ErrorMessage(Message):
     _fmt: ClassVar[list[str]] = ["i"]
@@ -11,25 +11,39 @@ from typing import Any, Callable
 import zmq
 from zmq.utils.monitor import recv_monitor_message
 
-from .entry import Entry
+from .entry import Entry, EntryKeyTable
 from .errors import GenericCandError, SdoAbortCandError, UnknownIdCandError
 from .message import (
+    LATENCY_STATS_NAMES,
+    SCHEDULE_OD_WRITE,
+    SCHEDULE_OS_COMMAND,
+    SCHEDULE_TPDO,
+    TPDO_SEND_MULTI_MAX,
     AddFileMessage,
     BusStateMessage,
+    BusStatsMessage,
     ConfigMessage,
     EmcyRecvMessage,
     EmcySendMessage,
     ErrorMessage,
     HbRecvMessage,
+    LatencyStatsMessage,
+    LatencySummary,
+    OdCompactTableMessage,
+    OdWriteCompactMessage,
     OdWriteMessage,
     SdoAbortErrorMessage,
     SdoReadMessage,
     SdoReadToFileMessage,
     SdoWriteFromFileMessage,
+    ScheduleCancelMessage,
+    ScheduleMessage,
     SdoWriteMessage,
     SyncSendMessage,
     TpdoSendMessage,
+    TpdoSendMultiMessage,
     UnknownIdErrorMessage,
+    unix_to_scet,
 )
 
 logger = logging.getLogger(__name__)
@@ -53,6 +67,7 @@ class BusState(Enum):
 class LocalData:
     value: int | float | str | bytes | None
     write_cb: Callable[[Any], None] | None = None
+    rx_time_ns: int = 0
 
 
 class NodeClientBase:
@@ -61,14 +76,20 @@ class NodeClientBase:
     def __init__(self, entries: Entry, addr: str, od_config_path: str | Path | None = None):
         self._data = {entry: LocalData(entry.default) for entry in list(entries)}
         self._lookup_entry = {(entry.index, entry.subindex): entry for entry in self._data.keys()}
+        self._key_table = EntryKeyTable(list(self._data.keys()))
+        self._key_table_mismatch_logged = False
         self._od_path = od_config_path
         self._addr = addr
 
         self._od_checked = False
         self._connected = False
         self._bus_state = BusState.NOT_FOUND
+        self._bus_stats: BusStatsMessage | None = None
+        self._bus_stats_cb: Callable | None = None
         self._emcy_cb: Callable | None = None
         self._hb_cb: Callable | None = None
+        self._emcy_cb_rx_time = False
+        self._hb_cb_rx_time = False
 
         self._context = zmq.Context()
 
@@ -97,6 +118,14 @@ class NodeClientBase:
     def bus_state(self) -> BusState:
         return self._bus_state
 
+    @property
+    def bus_stats(self) -> BusStatsMessage | None:
+        """The latest bus statistics snapshot, None until the first one is received."""
+        return self._bus_stats
+
+    def add_bus_stats_callback(self, bus_stats_cb: Callable[[BusStatsMessage], None]):
+        self._bus_stats_cb = bus_stats_cb
+
     def _monitor_thread_run(self):
         while self._monitor_socket.poll():
             event = recv_monitor_message(self._monitor_socket)["event"]
@@ -109,6 +138,7 @@ class NodeClientBase:
                         continue
                     raw = entry.encode(data.value)
                     self._broadcast(OdWriteMessage(entry.index, entry.subindex, raw))
+                self._send_key_table_crc()
                 if self._od_path and not self._od_checked:
                     self._check_od_config(self._od_path)
                     path = self._od_path if isinstance(self._od_path, str) else str(self._od_path)
@@ -129,27 +159,53 @@ class NodeClientBase:
             if msg_recv[1] == OdWriteMessage.id:
                 try:
                     msg_req = OdWriteMessage.unpack(msg_recv)
-                    entry = self._lookup_entry[(msg_req.index, msg_req.subindex)]
-                    value = entry.decode(msg_req.raw)
-                    if value == self._data[entry].value:
+                    entry = self._lookup_entry.get((msg_req.index, msg_req.subindex))
+                    if entry is None:
+                        continue  # a daemon entry (e.g. updater status) the app does not track
+                    if msg_req.rx_time_ns:
+                        self._data[entry].rx_time_ns = msg_req.rx_time_ns
+                    self._update_value(entry, entry.decode(msg_req.raw))
+                except Exception as e:
+                    logger.error(f"write callback error: {e}")
+            elif msg_recv[1] == OdWriteCompactMessage.id:
+                try:
+                    msg_req = OdWriteCompactMessage.unpack(msg_recv)
+                    if msg_req.table_crc != self._key_table.crc:
+                        # only until the daemon has this client's crc, then it sends per entry
+                        if not self._key_table_mismatch_logged:
+                            logger.error(
+                                f"compact od write table crc 0x{msg_req.table_crc:08X} does not "
+                                f"match local entries 0x{self._key_table.crc:08X}"
+                            )
+                            self._key_table_mismatch_logged = True
                         continue
-                    self._data[entry].value = value
-                    if self._data[entry].write_cb is not None:
-                        self._data[entry].write_cb(value)
+                    for key, raw_value in msg_req.values:
+                        entry, value = self._key_table.decode(key, raw_value)
+                        self._update_value(entry, value)
                 except Exception as e:
                     logger.error(f"write callback error: {e}")
+            elif msg_recv[1] == OdCompactTableMessage.id:
+                # a client came or went, the daemon wants every crc again; not on this thread, as
+                # the reply can wait behind another request
+                Thread(target=self._send_key_table_crc, daemon=True).start()
             elif msg_recv[1] == HbRecvMessage.id:
                 if self._hb_cb:
                     try:
                         msg_req = HbRecvMessage.unpack(msg_recv)
-                        self._hb_cb(msg_req.node_id, NodeState(msg_req.state))
+                        args = (msg_req.node_id, NodeState(msg_req.state))
+                        if self._hb_cb_rx_time:
+                            args += (msg_req.rx_time_ns,)
+                        self._hb_cb(*args)
                     except Exception as e:
                         logger.error(f"heartbeat callback error: {e}")
             elif msg_recv[1] == EmcyRecvMessage.id:
                 if self._emcy_cb:
                     try:
                         msg_req = EmcyRecvMessage.unpack(msg_recv)
-                        self._emcy_cb(msg_req.node_id, msg_req.code, msg_req.info)
+                        args = (msg_req.node_id, msg_req.code, msg_req.info)
+                        if self._emcy_cb_rx_time:
+                            args += (msg_req.rx_time_ns,)
+                        self._emcy_cb(*args)
                     except Exception as e:
                         logger.error(f"emcy callback error: {e}")
             elif msg_recv[1] == BusStateMessage.id:
@@ -158,6 +214,38 @@ class NodeClientBase:
                     self._bus_state = BusState(msg_req.state)
                 except Exception as e:
                     logger.error(f"bus state callback error: {e}")
+            elif msg_recv[1] == BusStatsMessage.id:
+                try:
+                    msg_req = BusStatsMessage.unpack(msg_recv)
+                    self._bus_state = BusState(msg_req.state)
+                    self._bus_stats = msg_req
+                    if self._bus_stats_cb:
+                        self._bus_stats_cb(msg_req)
+                except Exception as e:
+                    logger.error(f"bus stats callback error: {e}")
+
+    def _send_key_table_crc(self):
+        """Tell the daemon the compact table crc, it only sends compact od writes while every
+        client's matches."""
+        try:
+            res_msg = self._send_and_recv(OdCompactTableMessage(self._key_table.crc))
+        except UnknownIdCandError:
+            return  # an older daemon without the check
+        except Exception as e:
+            logger.error(f"sending the compact table crc failed: {e}")
+            return
+        if res_msg.table_crc not in [0, self._key_table.crc]:
+            logger.warning(
+                f"compact od write table crc 0x{res_msg.table_crc:08X} does not match local "
+                f"entries 0x{self._key_table.crc:08X}, od writes are sent per entry"
+            )
+
+    def _update_value(self, entry: Entry, value: Any):
+        if value == self._data[entry].value:
+            return
+        self._data[entry].value = value
+        if self._data[entry].write_cb is not None:
+            self._data[entry].write_cb(value)
 
     def _send_and_recv(self, req_msg):
         self._command_socket_lock.acquire()
@@ -199,16 +287,16 @@ class NodeClientBase:
         self._broadcast(EmcySendMessage(code, info))
 
     def send_tpdo(self, tpdo: int | Enum | list[int] | list[Enum]):
-        def _send_tpdo(num: int | Enum):
-            if isinstance(num, Enum):
-                num = num.value
-            self._broadcast(TpdoSendMessage(num))
-
+        """Request TPDOs be sent; a list is sent as one message when every number fits the bitmap."""
         if isinstance(tpdo, (int, Enum)):
-            _send_tpdo(tpdo)
-        else:
-            for t in tpdo:
-                _send_tpdo(t)
+            tpdo = [tpdo]
+        nums = [t.value if isinstance(t, Enum) else t for t in tpdo]
+
+        if len(nums) == 1 or any(n >= TPDO_SEND_MULTI_MAX for n in nums):
+            for num in nums:
+                self._broadcast(TpdoSendMessage(num))
+        elif nums:
+            self._broadcast(TpdoSendMultiMessage(sum(1 << n for n in set(nums))))
 
     def od_write(self, entry: Entry, value: Any):
         if isinstance(value, Enum):
@@ -220,6 +308,29 @@ class NodeClientBase:
         raw = entry.encode(value)
         self._broadcast(OdWriteMessage(entry.index, entry.subindex, raw))
 
+    def schedule_od_write(self, at: float, entry: Entry, value: Any, action_id: int = 0):
+        """Have the daemon write the entry at unix time at, without the app waking up for it."""
+        if isinstance(value, Enum):
+            value = value.value
+        if not isinstance(value, entry.data_type.py_types):
+            raise ValueError(f"value {value} ({type(value)}) invalid for {entry.data_type}")
+        data = entry.index.to_bytes(2, "little") + bytes([entry.subindex]) + entry.encode(value)
+        self._broadcast(ScheduleMessage(action_id, unix_to_scet(at), SCHEDULE_OD_WRITE, data))
+
+    def schedule_tpdo(self, at: float, tpdo: int | Enum, action_id: int = 0):
+        """Have the daemon send the TPDO at unix time at."""
+        num = tpdo.value if isinstance(tpdo, Enum) else tpdo
+        self._broadcast(ScheduleMessage(action_id, unix_to_scet(at), SCHEDULE_TPDO, bytes([num])))
+
+    def schedule_os_command(self, at: float, command: str, action_id: int = 0):
+        """Have the daemon run the os command at unix time at."""
+        data = command.encode("utf-8")
+        self._broadcast(ScheduleMessage(action_id, unix_to_scet(at), SCHEDULE_OS_COMMAND, data))
+
+    def cancel_scheduled(self, action_id: int = 0):
+        """Cancel the pending scheduled actions with the id, all of them with 0."""
+        self._broadcast(ScheduleCancelMessage(action_id))
+
     def od_write_multi(self, data: dict[Entry, Any]):
         for entry, value in data.items():
             self.od_write(entry, value)
@@ -235,6 +346,15 @@ class NodeClientBase:
             raise ValueError(f"{entry.name} write callback is already set")
         self._data[entry].write_cb = write_cb
 
+    def od_rx_time_ns(self, entry: Entry) -> int:
+        """Kernel rx time in unix ns of the last RPDO write of the entry, 0 if unknown."""
+        return self._data[entry].rx_time_ns
+
+    def latency_stats(self, reset: bool = False) -> dict[str, LatencySummary]:
+        """Get the daemon's latency histogram summaries by name, optionally clearing them after."""
+        res_msg = self._send_and_recv(LatencyStatsMessage(reset, []))
+        return dict(zip(LATENCY_STATS_NAMES, res_msg.stats))
+
     def _check_od_config(self, config_path: str | Path):
         if isinstance(config_path, str):
             config_path = Path(config_path)
@@ -300,11 +420,15 @@ class ManagerNodeClient(NodeClientBase):
         req_msg = SdoReadToFileMessage(node_id.value, str(file_path))
         self._send_and_recv(req_msg)
 
-    def add_heartbeat_callback(self, hb_cb: Callable[[int, NodeState], None]):
+    def add_heartbeat_callback(self, hb_cb: Callable[..., None], with_rx_time: bool = False):
+        """hb_cb(node_id, state), plus the kernel rx time in unix ns if with_rx_time."""
         self._hb_cb = hb_cb
+        self._hb_cb_rx_time = with_rx_time
 
-    def add_emcy_callback(self, emcy_cb: Callable[[int, int, int], None]):
+    def add_emcy_callback(self, emcy_cb: Callable[..., None], with_rx_time: bool = False):
+        """emcy_cb(node_id, code, info), plus the kernel rx time in unix ns if with_rx_time."""
         self._emcy_cb = emcy_cb
+        self._emcy_cb_rx_time = with_rx_time
 
     def send_sync(self):
         self._broadcast(SyncSendMessage())
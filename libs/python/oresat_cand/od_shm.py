@@ -0,0 +1,155 @@
+from __future__ import annotations
+
+import ctypes
+import ctypes.util
+import errno
+import os
+from typing import Any
+
+from .entry import DataType, Entry
+from .errors import ShmCandError
+
+SHM_NAME = "/oresat-cand-od"
+SHM_MAGIC = 0x4D53444F
+SHM_VERSION = 1
+SHM_LIB_NAME = "oresat-cand-od-shm"
+SHM_LIB_ENV = "ORESAT_CAND_OD_SHM_LIB"  # path to the lib, for one not on the library path
+
+
+# same layout as od_shm.h in oresat-cand
+class _Header(ctypes.Structure):
+    _fields_ = [
+        ("magic", ctypes.c_uint32),
+        ("version", ctypes.c_uint16),
+        ("entry_size", ctypes.c_uint16),
+        ("entries_len", ctypes.c_uint32),
+        ("data_offset", ctypes.c_uint32),
+        ("data_len", ctypes.c_uint32),
+        ("table_crc", ctypes.c_uint32),
+        ("start_ns", ctypes.c_uint64),
+    ]
+
+
+class _Entry(ctypes.Structure):
+    _fields_ = [
+        ("seq", ctypes.c_uint32),
+        ("index", ctypes.c_uint16),
+        ("subindex", ctypes.c_uint8),
+        ("reserved", ctypes.c_uint8),
+        ("offset", ctypes.c_uint32),
+        ("len", ctypes.c_uint32),
+    ]
+
+
+class _Shm(ctypes.Structure):
+    _fields_ = [
+        ("base", ctypes.c_void_p),
+        ("len", ctypes.c_size_t),
+        ("header", ctypes.POINTER(_Header)),
+        ("entries", ctypes.POINTER(_Entry)),
+        ("data", ctypes.c_void_p),
+    ]
+
+
+_lib = None
+
+
+def _load_lib() -> ctypes.CDLL:
+    global _lib
+    if _lib is None:
+        path = os.environ.get(SHM_LIB_ENV) or ctypes.util.find_library(SHM_LIB_NAME)
+        try:
+            lib = ctypes.CDLL(path or f"lib{SHM_LIB_NAME}.so")
+        except OSError as e:
+            raise ShmCandError(f"od snapshot reader lib{SHM_LIB_NAME}.so not found: {e}") from None
+        lib.od_shm_open.argtypes = [ctypes.POINTER(_Shm), ctypes.c_char_p]
+        lib.od_shm_open.restype = ctypes.c_int
+        lib.od_shm_close.argtypes = [ctypes.POINTER(_Shm)]
+        lib.od_shm_close.restype = None
+        lib.od_shm_read_pos.argtypes = [
+            ctypes.POINTER(_Shm),
+            ctypes.c_uint32,
+            ctypes.c_void_p,
+            ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_uint32),
+        ]
+        lib.od_shm_read_pos.restype = ctypes.c_int
+        _lib = lib
+    return _lib
+
+
+class OdShm:
+    """Reads the OD snapshot oresat-cand keeps in shared memory.
+
+    Has the current value of every app entry (index >= 0x4000) without any IPC messages or a
+    NodeClient. Each value has a sequence count that is odd while the daemon writes it, a read is
+    retried if the count was odd or changed. Reads go through oresat-cand's C reader
+    (liboresat-cand-od-shm) for its memory ordering, Python has no acquire loads. Writes still go
+    through NodeClient.od_write().
+    """
+
+    def __init__(self, name: str = SHM_NAME):
+        self._lib = _load_lib()
+        self._shm = _Shm()
+        r = self._lib.od_shm_open(ctypes.byref(self._shm), name.encode())
+        if r == -errno.EPROTO:
+            raise ShmCandError("unknown od snapshot layout or the daemon stopped")
+        elif r < 0:
+            raise OSError(-r, os.strerror(-r), name)
+
+        header = self._shm.header.contents
+        self.table_crc = header.table_crc
+        self.start_ns = header.start_ns
+        # (index, subindex): (position in the table, len)
+        self._table = {}
+        for pos in range(header.entries_len):
+            entry = self._shm.entries[pos]
+            self._table[(entry.index, entry.subindex)] = (pos, entry.len)
+
+    def __enter__(self) -> OdShm:
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        if self._shm.base:
+            self._lib.od_shm_close(ctypes.byref(self._shm))
+
+    def __contains__(self, entry: Entry) -> bool:
+        return (entry.index, entry.subindex) in self._table
+
+    def read_raw(self, index: int, subindex: int) -> tuple[bytes, int]:
+        """Read the raw value of an entry, returns it with its sequence count."""
+        try:
+            pos, length = self._table[(index, subindex)]
+        except KeyError:
+            raise ValueError(f"no entry 0x{index:X} 0x{subindex:X} in the od snapshot") from None
+        if not self._shm.base:
+            raise ShmCandError("od snapshot is closed")
+        buf = ctypes.create_string_buffer(length)
+        seq = ctypes.c_uint32()
+        r = self._lib.od_shm_read_pos(ctypes.byref(self._shm), pos, buf, length, ctypes.byref(seq))
+        if r == -errno.ESTALE:
+            raise ShmCandError("od snapshot is stale, oresat-cand stopped")
+        elif r == -errno.EAGAIN:
+            raise ShmCandError(f"write to 0x{index:X} 0x{subindex:X} never finished")
+        elif r < 0:
+            raise ShmCandError(f"od snapshot read of 0x{index:X} 0x{subindex:X} failed: {r}")
+        return buf.raw[:r], seq.value
+
+    def read(self, entry: Entry, use_enum: bool = True) -> Any:
+        """Read the current value of an entry, like NodeClient.od_read()."""
+        raw, _ = self.read_raw(entry.index, entry.subindex)
+        if entry.data_type == DataType.STR:
+            raw = raw.split(b"\0", 1)[0]
+        elif entry.data_type.size:
+            raw = raw[: entry.data_type.size]
+        value = entry.decode(raw)
+        if use_enum and entry.enum and isinstance(value, int) and value in entry.enum:
+            value = entry.enum(value)
+        return value
+
+    def seq(self, entry: Entry) -> int:
+        """Sequence count of an entry, it changes with every write to it."""
+        return self.read_raw(entry.index, entry.subindex)[1]
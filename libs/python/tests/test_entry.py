@@ -1,7 +1,7 @@
 import unittest
 from enum import Enum
 
-from oresat_cand.entry import DataType, Entry, EntryBitField
+from oresat_cand.entry import DataType, Entry, EntryBitField, EntryKeyTable
 
 
 class TestDataBitField(EntryBitField):
@@ -36,6 +36,17 @@ class TestDataEntry(Entry):
     ENTRY_BOOL_2 = 0x6000, 0xD, DataType.BOOL, 1
 
 
+class TestKeyTableEntry(Entry):
+    RECORD_LEN = 0x4001, 0x0, DataType.UINT8, 3
+    RECORD_INT8 = 0x4001, 0x1, DataType.INT8, -1
+    RECORD_STR = 0x4001, 0x2, DataType.STR, ""
+    RECORD_BYTES = 0x4001, 0x4, DataType.BYTES, b"\x00\x00\x00\x00"  # 4 bytes, still not numeric
+    RECORD_FLOAT64 = 0x4001, 0x3, DataType.FLOAT64, 1.5
+    VAR_UINT16 = 0x4000, 0x0, DataType.UINT16, 2
+    VAR_INT64 = 0x4002, 0x0, DataType.INT64, -2
+    STD_UINT32 = 0x3000, 0x0, DataType.UINT32, 0
+
+
 class TestEntry(unittest.TestCase):
     def test_encode_decode(self) -> None:
         for entry in list(TestDataEntry):
@@ -71,3 +82,22 @@ class TestEntry(unittest.TestCase):
             self.assertEqual(raw, e.value.to_bytes(2, "little"))
             e2 = entry.decode_to_enum(raw)
             self.assertEqual(e, e2)
+
+    def test_key_table(self) -> None:
+        table = EntryKeyTable(list(TestKeyTableEntry))
+        self.assertEqual(
+            table.entries,
+            [
+                TestKeyTableEntry.VAR_UINT16,
+                TestKeyTableEntry.RECORD_INT8,
+                TestKeyTableEntry.RECORD_FLOAT64,
+                TestKeyTableEntry.VAR_INT64,
+            ],
+        )
+        self.assertEqual(table.encode(TestKeyTableEntry.RECORD_INT8, -1), 1)
+        self.assertEqual(table.encode(TestKeyTableEntry.VAR_INT64, 2), 4)
+        self.assertEqual(table.encode(TestKeyTableEntry.VAR_UINT16, 0xFFFF), 1)
+        for entry in table.entries:
+            key = table.key(entry)
+            encoded = table.encode(entry, entry.default)
+            self.assertEqual(table.decode(key, encoded), (entry, entry.default))
@@ -1,14 +1,23 @@
 import os
 import unittest
 
+from oresat_cand.errors import MessageVersionCandError
 from oresat_cand.message import (
+    BUS_STATS_CLASS_NAMES,
     AddFileMessage,
     BusStateMessage,
+    BusStatsMessage,
     EmcyRecvMessage,
     EmcySendMessage,
     ErrorMessage,
     HbRecvMessage,
+    LatencyStatsMessage,
+    LatencySummary,
+    OdCompactTableMessage,
+    OdWriteCompactMessage,
     OdWriteMessage,
+    ScheduleCancelMessage,
+    ScheduleMessage,
     SdoAbortErrorMessage,
     SdoReadMessage,
     SdoReadToFileMessage,
@@ -16,7 +25,9 @@ from oresat_cand.message import (
     SdoWriteMessage,
     SyncSendMessage,
     TpdoSendMessage,
+    TpdoSendMultiMessage,
     UnknownIdErrorMessage,
+    unix_to_scet,
 )
 
 
@@ -36,6 +47,31 @@ class TestTpdoSendMessage(unittest.TestCase):
         self.assertEqual(msg, msg2)
 
 
+class TestTpdoSendMultiMessage(unittest.TestCase):
+    def test_pack_unpack(self) -> None:
+        msg = TpdoSendMultiMessage((1 << 0) | (1 << 3) | (1 << 63))
+        raw = msg.pack()
+        self.assertEqual(len(raw), 2 + 8)
+        msg2 = TpdoSendMultiMessage.unpack(raw)
+        self.assertEqual(msg, msg2)
+
+
+class TestScheduleMessage(unittest.TestCase):
+    def test_pack_unpack(self) -> None:
+        msg = ScheduleMessage(7, unix_to_scet(1700000000.25), 1, b"\x02")
+        raw = msg.pack()
+        self.assertEqual(len(raw), 2 + 4 + 8 + 1 + 1 + 1)
+        msg2 = ScheduleMessage.unpack(raw)
+        self.assertEqual(msg, msg2)
+
+        msg = ScheduleCancelMessage(7)
+        self.assertEqual(ScheduleCancelMessage.unpack(msg.pack()), msg)
+
+    def test_unix_to_scet(self) -> None:
+        self.assertEqual(unix_to_scet(1700000000.25), 1700000000 | (250000 << 32))
+        self.assertEqual(unix_to_scet(1.9999999), 2)  # rounds into the next second
+
+
 class TestOdWriteMessage(unittest.TestCase):
     def test_pack_unpack(self) -> None:
         msg = OdWriteMessage(0x7000, 0x1, b"\x12\x34")
@@ -43,6 +79,30 @@ class TestOdWriteMessage(unittest.TestCase):
         msg2 = OdWriteMessage.unpack(raw)
         self.assertEqual(msg, msg2)
 
+        msg = OdWriteMessage(0x7000, 0x1, b"\x12\x34", 1700000000123456789)
+        raw = msg.pack()
+        self.assertEqual(len(raw), 8 + 8)
+        msg2 = OdWriteMessage.unpack(raw)
+        self.assertEqual(msg, msg2)
+
+
+class TestOdWriteCompactMessage(unittest.TestCase):
+    def test_pack_unpack(self) -> None:
+        msg = OdWriteCompactMessage(0x12345678, [(0, 1), (2, 300), (200, 0xFFFFFFFFFFFFFFFF)])
+        raw = msg.pack()
+        self.assertEqual(raw[6:10], b"\x00\x01\x02\xac")  # key delta, value varints
+        msg2 = OdWriteCompactMessage.unpack(raw)
+        self.assertEqual(msg, msg2)
+
+
+class TestOdCompactTableMessage(unittest.TestCase):
+    def test_pack_unpack(self) -> None:
+        msg = OdCompactTableMessage(0x12345678)
+        raw = msg.pack()
+        self.assertEqual(raw, b"\x01\x13\x78\x56\x34\x12")
+        msg2 = OdCompactTableMessage.unpack(raw)
+        self.assertEqual(msg, msg2)
+
 
 class TestSdoReadMessage(unittest.TestCase):
     def test_pack_unpack(self) -> None:
@@ -87,6 +147,15 @@ class TestEmcyRecvMessage(unittest.TestCase):
         msg2 = EmcyRecvMessage.unpack(raw)
         self.assertEqual(msg, msg2)
 
+        raw = EmcyRecvMessage(0x11, 0x1234, 0xABCD, 1700000000123456789).pack()
+        self.assertEqual(len(raw), 9 + 8)
+        self.assertEqual(EmcyRecvMessage.unpack(raw).rx_time_ns, 1700000000123456789)
+
+    def test_old_version(self) -> None:
+        raw = EmcyRecvMessage(0x11, 0x1234, 0xABCD).pack()
+        with self.assertRaises(MessageVersionCandError):  # a daemon without the rx time
+            EmcyRecvMessage.unpack(b"\x00" + raw[1:9])
+
 
 class TestSyncSendMessage(unittest.TestCase):
     def test_pack_unpack(self) -> None:
@@ -104,6 +173,17 @@ class TestBusStateMessage(unittest.TestCase):
         self.assertEqual(msg, msg2)
 
 
+class TestBusStatsMessage(unittest.TestCase):
+    def test_pack_unpack(self) -> None:
+        frames = dict(zip(BUS_STATS_CLASS_NAMES, [1, 50, 0, 5, 900, 30, 25, 0]))
+        msg = BusStatsMessage(2, 5000, 123, frames, 40, 1, 1, 0, 2, 0, 3, {0x0C: 500, 0x7C: 10})
+        raw = msg.pack()
+        self.assertEqual(len(raw), 40 + 2 * 3)
+        msg2 = BusStatsMessage.unpack(raw)
+        self.assertEqual(msg, msg2)
+        self.assertAlmostEqual(msg2.load_percent, 12.3)
+
+
 class TestSdoReadFileMessage(unittest.TestCase):
     def test_pack_unpack(self) -> None:
         msg = SdoReadToFileMessage(0x1, "remote.txt")
@@ -124,6 +204,25 @@ class TestSdoWriteFileMessage(unittest.TestCase):
         os.remove(test_file)
 
 
+class TestLatencyStatsMessage(unittest.TestCase):
+    def test_pack_unpack(self) -> None:
+        msg = LatencyStatsMessage(False, [])
+        raw = msg.pack()
+        self.assertEqual(len(raw), 4)
+        msg2 = LatencyStatsMessage.unpack(raw)
+        self.assertEqual(msg, msg2)
+
+        stats = [
+            LatencySummary(10, 120, 100, 150, 300, 900, 20000),
+            LatencySummary(0, 0, 0, 0, 0, 0, 0),
+        ]
+        msg = LatencyStatsMessage(True, stats)
+        raw = msg.pack()
+        self.assertEqual(len(raw), 4 + 2 * 28)
+        msg2 = LatencyStatsMessage.unpack(raw)
+        self.assertEqual(msg, msg2)
+
+
 class TestErrorMessage(unittest.TestCase):
     def test_pack_unpack(self) -> None:
         msg = ErrorMessage(0x1234)
@@ -0,0 +1,84 @@
+import os
+import shutil
+import struct
+import subprocess
+import tempfile
+import unittest
+from pathlib import Path
+
+from oresat_cand import od_shm
+from oresat_cand.entry import DataType, Entry
+from oresat_cand.errors import ShmCandError
+
+SHM_NAME = f"/oresat-cand-od-test-{os.getpid()}"
+SHM_PATH = Path("/dev/shm") / SHM_NAME.lstrip("/")
+C_READER = Path(__file__).parents[3] / "src" / "common" / "od_shm.c"
+
+
+class TestShmEntry(Entry):
+    UINT32 = 0x4000, 0x0, DataType.UINT32, 0
+    STR = 0x4001, 0x2, DataType.STR, ""
+    MISSING = 0x4001, 0x3, DataType.UINT8, 0
+
+
+class TestOdShm(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        # the reader lib from the daemon's source, unless one is installed or given
+        cls._lib_dir = None
+        if os.environ.get(od_shm.SHM_LIB_ENV) or not C_READER.exists() or not shutil.which("cc"):
+            return
+        cls._lib_dir = tempfile.TemporaryDirectory()
+        lib = Path(cls._lib_dir.name) / "liboresat-cand-od-shm.so"
+        subprocess.run(["cc", "-shared", "-fPIC", "-o", lib, C_READER, "-lrt"], check=True)
+        os.environ[od_shm.SHM_LIB_ENV] = str(lib)
+
+    @classmethod
+    def tearDownClass(cls):
+        if cls._lib_dir:
+            del os.environ[od_shm.SHM_LIB_ENV]
+            cls._lib_dir.cleanup()
+
+    def setUp(self):
+        header = struct.pack("<IHHIIIIQ", od_shm.SHM_MAGIC, od_shm.SHM_VERSION, 16, 2, 64, 16, 0, 0)
+        entries = struct.pack("<IHBBII", 2, 0x4000, 0, 0, 0, 4)
+        entries += struct.pack("<IHBBII", 0, 0x4001, 2, 0, 8, 8)
+        data = struct.pack("<I", 1234) + bytes(4) + b"abc".ljust(8, b"\0")
+        SHM_PATH.write_bytes(header + entries + data)
+
+    def tearDown(self):
+        SHM_PATH.unlink(missing_ok=True)
+
+    def test_read(self):
+        with od_shm.OdShm(SHM_NAME) as shm:
+            self.assertEqual(shm.read(TestShmEntry.UINT32), 1234)
+            self.assertEqual(shm.read(TestShmEntry.STR), "abc")
+            self.assertEqual(shm.seq(TestShmEntry.UINT32), 2)
+            self.assertIn(TestShmEntry.STR, shm)
+            self.assertNotIn(TestShmEntry.MISSING, shm)
+            with self.assertRaises(ValueError):
+                shm.read(TestShmEntry.MISSING)
+
+    def test_missing(self):
+        with self.assertRaises(FileNotFoundError):
+            od_shm.OdShm(SHM_NAME + "-missing")
+
+    def test_stale(self):
+        shm = od_shm.OdShm(SHM_NAME)
+        with open(SHM_PATH, "r+b") as f:
+            f.write(bytes(4))  # the daemon clears the magic when it stops
+        with self.assertRaises(ShmCandError):
+            shm.read(TestShmEntry.UINT32)
+        shm.close()
+        with self.assertRaises(ShmCandError):
+            od_shm.OdShm(SHM_NAME)
+
+    def test_stale_mid_write(self):
+        shm = od_shm.OdShm(SHM_NAME)
+        with open(SHM_PATH, "r+b") as f:
+            f.write(bytes(4))  # stopped while writing the uint32
+            f.seek(32)
+            f.write(struct.pack("<I", 3))
+        with self.assertRaisesRegex(ShmCandError, "stale"):
+            shm.read(TestShmEntry.UINT32)
+        shm.close()
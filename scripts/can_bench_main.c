@@ -0,0 +1,249 @@
+#include "parse_int.h"
+#include <dirent.h>
+#include <errno.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_FRAMES   200000
+#define SETTLE_MS        200 // after the last frame, so the daemon has handled everything before the cpu is read
+#define LOG_LINE_MAX_LEN 128
+#define SEND_RETRY_US    100
+#define PATH_LEN         64
+
+static void usage(char *name) {
+    printf("%s <interface> <pid> [frames] [rate] [candump-log]\n", name);
+    printf("\n");
+    printf("Replays frames on a (v)can interface and prints the cpu time a running oresat-cand spends per frame,\n");
+    printf("from the schedstat of all its threads. The same time idle is measured after and subtracted. Run it\n");
+    printf("with the daemon started with -b 1 and then with the default -b to compare one frame per wakeup with\n");
+    printf("batched receives.\n");
+    printf("\n");
+    printf("pid:         the oresat-cand process on the interface\n");
+    printf("frames:      number of frames to send (default %d)\n", DEFAULT_FRAMES);
+    printf("rate:        frames/s to send at, 0 for as fast as the tx queue takes them (default 0)\n");
+    printf("candump-log: replay frames from a candump -l log instead of a synthetic PDO/SDO mix\n");
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t time_ns) {
+    struct timespec ts = {
+        .tv_sec = time_ns / 1000000000ULL,
+        .tv_nsec = time_ns % 1000000000ULL,
+    };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+// ns all threads of pid have run for, the first field of each thread's schedstat; 0 if the process is gone
+static uint64_t process_cpu_ns(int pid) {
+    char path[PATH_LEN];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%d/task/%.16s/schedstat", pid, ent->d_name);
+        FILE *fp = fopen(path, "r");
+        if (!fp) {
+            continue; // the thread exited
+        }
+        unsigned long long run_ns = 0;
+        if (fscanf(fp, "%llu", &run_ns) == 1) {
+            total += run_ns;
+        }
+        fclose(fp);
+    }
+    closedir(dir);
+    return total;
+}
+
+static int open_socket(const char *ifname) {
+    int sock = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+    if (sock < 0) {
+        return -errno;
+    }
+
+    struct sockaddr_can addr = {
+        .can_family = AF_CAN,
+        .can_ifindex = if_nametoindex(ifname),
+    };
+    int r = 0;
+    if (addr.can_ifindex == 0) {
+        r = -ENODEV;
+    } else if (setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0) < 0) {
+        r = -errno; // the sender receives nothing
+    } else if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        r = -errno;
+    }
+    if (r < 0) {
+        close(sock);
+        return r;
+    }
+    return sock;
+}
+
+// candump -l lines look like "(1700000000.123456) can0 181#0102030405060708"
+static uint32_t load_candump(const char *path, struct can_frame **frames) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return 0;
+    }
+
+    uint32_t len = 0;
+    uint32_t cap = 0;
+    char line[LOG_LINE_MAX_LEN];
+    while (fgets(line, sizeof(line), fp)) {
+        char *frame_str = strrchr(line, ' ');
+        char *hash = frame_str ? strchr(frame_str, '#') : NULL;
+        if (!hash) {
+            continue;
+        }
+        if (len == cap) {
+            cap = cap ? cap * 2 : 1024;
+            struct can_frame *tmp = realloc(*frames, cap * sizeof(struct can_frame));
+            if (!tmp) {
+                break;
+            }
+            *frames = tmp;
+        }
+
+        struct can_frame *frame = &(*frames)[len];
+        memset(frame, 0, sizeof(struct can_frame));
+        *hash = '\0';
+        frame->can_id = strtoul(frame_str + 1, NULL, 16);
+        if (strlen(frame_str + 1) > 3) {
+            frame->can_id |= CAN_EFF_FLAG;
+        }
+        char *data = hash + 1;
+        if (*data == 'R') {
+            frame->can_id |= CAN_RTR_FLAG;
+        } else {
+            while ((frame->can_dlc < CAN_MAX_DLEN) && (sscanf(data, "%2hhx", &frame->data[frame->can_dlc]) == 1)) {
+                frame->can_dlc++;
+                data += 2;
+            }
+        }
+        len++;
+    }
+    fclose(fp);
+    return len;
+}
+
+// mostly PDOs with some SDO segments and heartbeats, like a busy manager node sees
+static uint32_t make_frames(struct can_frame **frames) {
+    const uint32_t len = 100;
+    *frames = calloc(len, sizeof(struct can_frame));
+    if (!*frames) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        struct can_frame *frame = &(*frames)[i];
+        uint32_t node_id = 1 + (i % 0x7F);
+        if (i % 10 == 0) {
+            frame->can_id = 0x580 + node_id;
+        } else if (i % 25 == 0) {
+            frame->can_id = 0x700 + node_id;
+        } else {
+            frame->can_id = 0x180 + (0x100 * (i % 4)) + node_id;
+        }
+        frame->can_dlc = (frame->can_id >= 0x700) ? 1 : CAN_MAX_DLEN;
+        for (uint32_t j = 0; j < frame->can_dlc; j++) {
+            frame->data[j] = (uint8_t)(i + j);
+        }
+    }
+    return len;
+}
+
+// returns the frames sent
+static uint32_t send_frames(int sock, const struct can_frame *frames, uint32_t frames_len, uint32_t total,
+                            uint32_t rate) {
+    uint64_t start_ns = now_ns();
+    uint32_t sent = 0;
+    while (sent < total) {
+        if (rate > 0) {
+            sleep_until_ns(start_ns + ((uint64_t)sent * 1000000000ULL) / rate);
+        }
+        const struct can_frame *frame = &frames[sent % frames_len];
+        if (write(sock, frame, sizeof(struct can_frame)) == sizeof(struct can_frame)) {
+            sent++;
+        } else if ((errno == ENOBUFS) || (errno == EAGAIN)) {
+            usleep(SEND_RETRY_US); // tx queue full, a real CAN bus drains at bitrate
+        } else {
+            printf("send failed: %s\n", strerror(errno));
+            break;
+        }
+    }
+    return sent;
+}
+
+int main(int argc, char *argv[]) {
+    int pid = 0;
+    int total = DEFAULT_FRAMES;
+    int rate = 0;
+    if ((argc < 3) || (argc > 6) || (parse_int_arg(argv[2], &pid) < 0) ||
+        ((argc > 3) && (parse_int_arg(argv[3], &total) < 0)) || ((argc > 4) && (parse_int_arg(argv[4], &rate) < 0)) ||
+        (pid <= 0) || (total <= 0) || (rate < 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (process_cpu_ns(pid) == 0) {
+        printf("no process %d\n", pid);
+        return EXIT_FAILURE;
+    }
+
+    struct can_frame *frames = NULL;
+    uint32_t frames_len = (argc > 5) ? load_candump(argv[5], &frames) : make_frames(&frames);
+    if (frames_len == 0) {
+        printf("no frames to replay\n");
+        free(frames);
+        return EXIT_FAILURE;
+    }
+
+    int sock = open_socket(argv[1]);
+    if (sock < 0) {
+        printf("failed to open %s: %s\n", argv[1], strerror(-sock));
+        free(frames);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t start_ns = now_ns();
+    uint64_t cpu_start_ns = process_cpu_ns(pid);
+    uint32_t sent = send_frames(sock, frames, frames_len, total, rate);
+    sleep_until_ns(now_ns() + (SETTLE_MS * 1000000ULL));
+    uint64_t cpu_busy_ns = process_cpu_ns(pid) - cpu_start_ns;
+    uint64_t wall_ns = now_ns() - start_ns;
+
+    // the daemon's own timers and threads over the same time, without frames
+    cpu_start_ns = process_cpu_ns(pid);
+    sleep_until_ns(now_ns() + wall_ns);
+    uint64_t cpu_idle_ns = process_cpu_ns(pid) - cpu_start_ns;
+
+    close(sock);
+    free(frames);
+
+    double wall_s = wall_ns / 1e9;
+    double frame_us = (cpu_busy_ns > cpu_idle_ns) ? ((cpu_busy_ns - cpu_idle_ns) / 1e3) / (sent ? sent : 1) : 0;
+    printf("%u frames in %.3f s (%.0f frames/s), daemon cpu %.1f ms busy, %.1f ms idle, %.3f us cpu/frame\n", sent,
+           wall_s, sent / wall_s, cpu_busy_ns / 1e6, cpu_idle_ns / 1e6, frame_us);
+    return (sent == (uint32_t)total) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
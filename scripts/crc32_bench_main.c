@@ -0,0 +1,78 @@
+#include "system.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <zlib.h>
+
+#define DEFAULT_BUF_LEN (16 * 1024 * 1024)
+#define DEFAULT_LOOPS   20
+#define CHUNK_LEN       16384 // same chunk size get_fd_crc32() uses
+
+static double elapsed_s(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    size_t buf_len = DEFAULT_BUF_LEN;
+    int loops = DEFAULT_LOOPS;
+    if (argc > 1) {
+        buf_len = strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        loops = strtol(argv[2], NULL, 0);
+    }
+    if ((buf_len == 0) || (loops <= 0)) {
+        printf("%s [buffer-length] [loops]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *buf = malloc(buf_len);
+    if (!buf) {
+        printf("failed to allocate %zu bytes\n", buf_len);
+        return EXIT_FAILURE;
+    }
+    srand(time(NULL));
+    for (size_t i = 0; i < buf_len; i++) {
+        buf[i] = (uint8_t)rand();
+    }
+
+    struct timespec start;
+    struct timespec end;
+    uint32_t crc_zlib = 0;
+    uint32_t crc_stream = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int l = 0; l < loops; l++) {
+        crc_zlib = crc32(0L, buf, buf_len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double zlib_s = elapsed_s(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int l = 0; l < loops; l++) {
+        crc_stream = 0;
+        for (size_t offset = 0; offset < buf_len; offset += CHUNK_LEN) {
+            size_t len = (buf_len - offset) < CHUNK_LEN ? (buf_len - offset) : CHUNK_LEN;
+            crc_stream = crc32_update(crc_stream, &buf[offset], len);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double stream_s = elapsed_s(&start, &end);
+
+    double mb = (double)buf_len * loops / (1024 * 1024);
+#if defined(__ARM_FEATURE_CRC32)
+    const char *impl = "armv8 crc32";
+#else
+    const char *impl = "zlib";
+#endif
+    printf("zlib crc32:   %8.1f MiB/s (0x%08X)\n", mb / zlib_s, crc_zlib);
+    printf("crc32_update: %8.1f MiB/s (0x%08X) using %s\n", mb / stream_s, crc_stream, impl);
+
+    free(buf);
+    if (crc_zlib != crc_stream) {
+        printf("crc mismatch\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
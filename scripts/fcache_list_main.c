@@ -14,13 +14,20 @@
 extern CO_t *CO;
 
 static void usage(char *name) {
-    printf("%s <interface> <node-id> <cache>\n", name);
+    printf("%s <interface> <node-id> <cache> [prefix] [offset] [count]\n", name);
     printf("\n");
     printf("caches: fread or fwrite\n");
+    printf("prefix: only list files whose name starts with prefix\n");
+    printf("offset: index of first matching file to list (default 0)\n");
+    printf("count: max number of files to list, 0 for no limit (default 0)\n");
+}
+
+static uint32_t get_le_uint32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
+    if ((argc < 4) || (argc > 7)) {
         printf("invalid number of args\n\n");
         usage(argv[0]);
         return EXIT_FAILURE;
@@ -49,28 +56,65 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    char *buf = NULL;
+    char *prefix = (argc > 4) ? argv[4] : "";
+    int offset = 0;
+    int count = 0;
+    if ((argc > 5) && ((parse_int_arg(argv[5], &offset) < 0) || (offset < 0))) {
+        printf("invalid offset: %s\n", argv[5]);
+        return EXIT_FAILURE;
+    }
+    if ((argc > 6) && ((parse_int_arg(argv[6], &count) < 0) || (count < 0) || (count > UINT16_MAX))) {
+        printf("invalid count: %s\n", argv[6]);
+        return EXIT_FAILURE;
+    }
+
+    // always set the filter, a previous client may have left one behind
+    uint32_t list_offset = offset;
+    uint16_t list_count = count;
+    uint32_t list_newer_than = 0;
     CO_SDO_abortCode_t abort_code =
-        sdo_read_str(CO->SDOclient, node_id, index, OD_SUBINDEX_FREAD_CACHE_FILES_JSON, &buf, false);
+        sdo_write_uint32(CO->SDOclient, node_id, index, OD_SUBINDEX_FREAD_CACHE_LIST_OFFSET, &list_offset);
+    if (abort_code == 0) {
+        abort_code = sdo_write_uint16(CO->SDOclient, node_id, index, OD_SUBINDEX_FREAD_CACHE_LIST_COUNT, &list_count);
+    }
+    if (abort_code == 0) {
+        abort_code = sdo_write_str(CO->SDOclient, node_id, index, OD_SUBINDEX_FREAD_CACHE_LIST_PREFIX, prefix);
+    }
+    if (abort_code == 0) {
+        abort_code = sdo_write_uint32(CO->SDOclient, node_id, index, OD_SUBINDEX_FREAD_CACHE_LIST_NEWER_THAN,
+                                      &list_newer_than);
+    }
+    if (abort_code != 0) {
+        goto abort;
+    }
+
+    uint8_t *buf = NULL;
+    size_t buf_size = 0;
+    abort_code = sdo_read_bytes(CO->SDOclient, node_id, index, OD_SUBINDEX_FREAD_CACHE_FILES_BIN, &buf, &buf_size,
+                                true);
     if (abort_code != 0) {
         goto abort;
     } else if (!buf) {
         goto empty_buf;
     }
 
-    if (strncmp(buf, "[]", strlen(buf))) {
-        // could be done with cJSON
-        char *token = strtok(buf, ",");
-        while (token != NULL) {
-            int len = strlen(token);
-            if (token[len - 1] == ']') { // last file
-                token[len - 2] = '\0';
-            } else {
-                token[len - 1] = '\0';
+    // uint32 total matches, uint16 entries, then per entry uint32 size, uint32 mtime, uint8 name len, name
+    if (buf_size >= 6) {
+        uint32_t total = get_le_uint32(buf);
+        uint16_t entries = (uint16_t)buf[4] | ((uint16_t)buf[5] << 8);
+        size_t pos = 6;
+        for (uint16_t i = 0; (i < entries) && ((pos + 9) <= buf_size); i++) {
+            uint32_t size = get_le_uint32(&buf[pos]);
+            uint32_t mtime = get_le_uint32(&buf[pos + 4]);
+            uint8_t name_len = buf[pos + 8];
+            pos += 9;
+            if ((pos + name_len) > buf_size) {
+                break;
             }
-            printf("%s\n", &token[2]);
-            token = strtok(NULL, ",");
+            printf("%-40.*s %10u %10u\n", name_len, (char *)&buf[pos], size, mtime);
+            pos += name_len;
         }
+        printf("listed %u of %u file(s)\n", entries, total);
     }
 
     free(buf);
@@ -0,0 +1,161 @@
+#include "can_batch.h"
+#include "histogram.h"
+#include "ipc_msg.h"
+#include "parse_int.h"
+#include <errno.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <zmq.h>
+
+#define DEFAULT_REQUESTS    1000
+#define REQUEST_INTERVAL_US 10000 // past the usual tpdo inhibit times
+#define RECV_TIMEOUT_MS     100   // a request without a frame by then is counted as lost
+#define SUB_CONNECT_WAIT_US 500000
+
+static void usage(char *name) {
+    printf("%s <interface> <cob-id> [tpdo] [requests]\n", name);
+    printf("\n");
+    printf("Sends tpdo send requests to a running oresat-cand over ipc and prints the latency from each request\n");
+    printf("to the kernel rx timestamp of the tpdo frame on the (v)can interface.\n");
+    printf("\n");
+    printf("cob-id:   the tpdo's cob-id, e.g. 0x180 + node id for tpdo 0\n");
+    printf("tpdo:     tpdo number as the app sees it (default 0)\n");
+    printf("requests: number of requests (default %d)\n", DEFAULT_REQUESTS);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts); // same clock as the kernel rx timestamps
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static int open_socket(const char *ifname, uint32_t cob_id) {
+    int sock = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+    if (sock < 0) {
+        return -errno;
+    }
+
+    struct sockaddr_can addr = {
+        .can_family = AF_CAN,
+        .can_ifindex = if_nametoindex(ifname),
+    };
+    struct can_filter filter = {
+        .can_id = cob_id,
+        .can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG,
+    };
+    struct timeval tv = {
+        .tv_sec = 0,
+        .tv_usec = RECV_TIMEOUT_MS * 1000,
+    };
+    int r = 0;
+    if (addr.can_ifindex == 0) {
+        r = -ENODEV;
+    } else if ((setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter)) < 0) ||
+               (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)) {
+        r = -errno;
+    } else if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        r = -errno;
+    } else {
+        r = can_enable_timestamping(sock);
+    }
+    if (r < 0) {
+        close(sock);
+        return r;
+    }
+    return sock;
+}
+
+// drop tpdos sent before the request, e.g. by an event timer
+static void drain(int sock) {
+    struct can_frame frame;
+    while (recv(sock, &frame, sizeof(frame), MSG_DONTWAIT) > 0) {
+    }
+}
+
+// kernel rx time of the first tpdo frame received at or after sent_ns, 0 on timeout
+static uint64_t wait_for_tpdo(int sock, can_batch_t *batch, uint64_t sent_ns) {
+    while (1) {
+        int n = can_batch_recv(sock, batch, true);
+        if (n <= 0) {
+            return 0;
+        }
+        for (int i = 0; i < n; i++) {
+            uint64_t rx_ns = can_batch_timestamp_ns(batch, i);
+            if (can_batch_is_valid(batch, i) && (rx_ns >= sent_ns)) {
+                return rx_ns;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int cob_id = 0;
+    int tpdo = 0;
+    int requests = DEFAULT_REQUESTS;
+    if ((argc < 3) || (argc > 5) || (parse_int_arg(argv[2], &cob_id) < 0) ||
+        ((argc > 3) && (parse_int_arg(argv[3], &tpdo) < 0)) ||
+        ((argc > 4) && (parse_int_arg(argv[4], &requests) < 0)) || (cob_id <= 0) || (cob_id > (int)CAN_SFF_MASK) ||
+        (tpdo < 0) || (tpdo > UINT8_MAX) || (requests <= 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int sock = open_socket(argv[1], cob_id);
+    if (sock < 0) {
+        printf("failed to open %s: %s\n", argv[1], strerror(-sock));
+        return EXIT_FAILURE;
+    }
+    can_batch_t batch;
+    if (can_batch_init(&batch, CAN_BATCH_DEFAULT_LEN) < 0) {
+        close(sock);
+        return EXIT_FAILURE;
+    }
+
+    void *context = zmq_ctx_new();
+    void *publisher = zmq_socket(context, ZMQ_PUB);
+    zmq_connect(publisher, "tcp://localhost:6002");
+    usleep(SUB_CONNECT_WAIT_US); // msgs sent before the subscription is up are dropped
+
+    ipc_msg_tpdo_send_t msg = {
+        .header.version = IPC_MSG_VERSION,
+        .header.id = IPC_MSG_ID_TPDO_SEND,
+        .number = tpdo,
+    };
+    static histogram_t hist;
+    int lost = 0;
+    for (int i = 0; i < requests; i++) {
+        drain(sock);
+        uint64_t sent_ns = now_ns();
+        zmq_send(publisher, &msg, sizeof(msg), 0);
+        uint64_t rx_ns = wait_for_tpdo(sock, &batch, sent_ns);
+        if (rx_ns == 0) {
+            lost++;
+        } else {
+            histogram_record(&hist, (rx_ns - sent_ns) / 1000);
+        }
+        usleep(REQUEST_INTERVAL_US);
+    }
+
+    histogram_summary_t summary;
+    histogram_summary(&hist, &summary);
+    printf("tpdo %d cob-id 0x%03X: %u received, %d lost\n", tpdo, cob_id, summary.count, lost);
+    printf("request to wire us: mean %u p50 %u p90 %u p99 %u p99.9 %u max %u\n", summary.mean, summary.p50,
+           summary.p90, summary.p99, summary.p999, summary.max);
+
+    int linger = 0;
+    zmq_setsockopt(publisher, ZMQ_LINGER, &linger, sizeof(linger));
+    zmq_close(publisher);
+    zmq_ctx_term(context);
+    can_batch_free(&batch);
+    close(sock);
+    return (lost < requests) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
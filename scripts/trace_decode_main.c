@@ -0,0 +1,128 @@
+#include "trace.h"
+#include <linux/can.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint32_t newest_seq = 0;
+
+static void usage(char *name) {
+    printf("%s <trace-file> [last-n]\n", name);
+    printf("\n");
+    printf("last-n: only print the newest n records (default all)\n");
+}
+
+// seq wraps, so order by distance from the newest record, oldest first
+static int cmp_records(const void *a, const void *b) {
+    uint32_t age_a = newest_seq - ((const trace_record_t *)a)->seq;
+    uint32_t age_b = newest_seq - ((const trace_record_t *)b)->seq;
+    return (age_a < age_b) - (age_a > age_b);
+}
+
+static uint16_t get_le_uint16(const uint8_t *data) {
+    return (uint16_t)data[0] | ((uint16_t)data[1] << 8);
+}
+
+static uint32_t get_le_uint32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void print_record(const trace_record_t *rec) {
+    char time_str[32];
+    time_t sec = rec->time_ns / 1000000000ULL;
+    struct tm tm;
+    gmtime_r(&sec, &tm);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%S", &tm);
+    printf("%s.%06lluZ ", time_str, (unsigned long long)((rec->time_ns % 1000000000ULL) / 1000));
+
+    switch (rec->type) {
+    case TRACE_CAN_RX:
+    case TRACE_CAN_TX:
+        printf("CAN %s %03X%s%s [%u]", (rec->type == TRACE_CAN_RX) ? "RX" : "TX", rec->id,
+               (rec->arg & CAN_ERR_FLAG) ? " ERR" : "", (rec->arg & CAN_RTR_FLAG) ? " RTR" : "", rec->len);
+        for (int i = 0; i < rec->len; i++) {
+            printf(" %02X", rec->data[i]);
+        }
+        break;
+    case TRACE_SDO_SERVER:
+        printf("SDO SERVER state 0x%02X -> 0x%02X", rec->arg, rec->id);
+        break;
+    case TRACE_SDO_CLIENT:
+        printf("SDO CLIENT node 0x%02X 0x%04X.%02X abort 0x%08X %u us", rec->id, get_le_uint16(rec->data),
+               rec->data[2], rec->arg, get_le_uint32(&rec->data[3]));
+        break;
+    case TRACE_IPC_REQ:
+        printf("IPC REQ id 0x%02X reply 0x%02X %u us", rec->id, rec->data[0], rec->arg);
+        break;
+    case TRACE_IPC_MSG:
+        printf("IPC MSG id 0x%02X %u us", rec->id, rec->arg);
+        break;
+    case TRACE_NMT:
+        printf("NMT node 0x%02X state 0x%02X", rec->id, rec->arg);
+        break;
+    case TRACE_EMCY_RX:
+    case TRACE_EMCY_TX:
+        printf("EMCY %s node 0x%02X code 0x%04X info 0x%08X", (rec->type == TRACE_EMCY_RX) ? "RX" : "TX", rec->id,
+               get_le_uint16(rec->data), rec->arg);
+        break;
+    default:
+        printf("UNKNOWN type 0x%02X id 0x%X arg 0x%X", rec->type, rec->id, rec->arg);
+        break;
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    if ((argc < 2) || (argc > 3)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    unsigned long last_n = (argc == 3) ? strtoul(argv[2], NULL, 0) : 0;
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (!fp) {
+        printf("failed to open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    trace_header_t header;
+    if ((fread(&header, sizeof(header), 1, fp) != 1) || (header.magic != TRACE_MAGIC)) {
+        printf("%s is not a trace file\n", argv[1]);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+    if ((header.version != TRACE_VERSION) || (header.record_size != sizeof(trace_record_t))) {
+        printf("unsupported trace version %u (record size %u)\n", header.version, header.record_size);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    trace_record_t *records = malloc((size_t)header.records * sizeof(trace_record_t));
+    if (!records) {
+        printf("failed to allocate %u records\n", header.records);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+    size_t read = fread(records, sizeof(trace_record_t), header.records, fp);
+    fclose(fp);
+
+    // drop unused and torn (seq 0) records
+    size_t valid = 0;
+    for (size_t i = 0; i < read; i++) {
+        if (records[i].seq != 0) {
+            records[valid++] = records[i];
+        }
+    }
+    newest_seq = header.head;
+    qsort(records, valid, sizeof(trace_record_t), cmp_records);
+
+    size_t first = ((last_n > 0) && (last_n < valid)) ? (valid - last_n) : 0;
+    for (size_t i = first; i < valid; i++) {
+        print_record(&records[i]);
+    }
+
+    free(records);
+    return EXIT_SUCCESS;
+}
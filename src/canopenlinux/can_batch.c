@@ -0,0 +1,147 @@
+#define _GNU_SOURCE // for recvmmsg() and sendmmsg()
+#include "can_batch.h"
+#include <errno.h>
+#include <linux/can.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+// SO_TIMESTAMPNS, an SO_TIMESTAMPING stamp if something else enabled it on the socket, and SO_RXQ_OVFL
+#define CMSG_LEN_MAX \
+    (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(3 * sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)))
+
+int can_batch_init(can_batch_t *batch, uint32_t len) {
+    if (!batch || (len == 0) || (len > CAN_BATCH_MAX_LEN)) {
+        return -EINVAL;
+    }
+
+    memset(batch, 0, sizeof(can_batch_t));
+    batch->frames = calloc(len, sizeof(struct can_frame));
+    batch->iovs = calloc(len, sizeof(struct iovec));
+    batch->msgs = calloc(len, sizeof(struct mmsghdr));
+    batch->cmsgs = calloc(len, CMSG_LEN_MAX);
+    if (!batch->frames || !batch->iovs || !batch->msgs || !batch->cmsgs) {
+        can_batch_free(batch);
+        return -ENOMEM;
+    }
+
+    batch->len = len;
+    for (uint32_t i = 0; i < len; i++) {
+        batch->iovs[i].iov_base = &batch->frames[i];
+        batch->iovs[i].iov_len = sizeof(struct can_frame);
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return 0;
+}
+
+void can_batch_free(can_batch_t *batch) {
+    if (!batch) {
+        return;
+    }
+    free(batch->frames);
+    free(batch->iovs);
+    free(batch->msgs);
+    free(batch->cmsgs);
+    memset(batch, 0, sizeof(can_batch_t));
+}
+
+int can_enable_timestamping(int sock) {
+    int enable = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+int can_batch_recv(int sock, can_batch_t *batch, bool wait) {
+    if (!batch || (batch->len == 0)) {
+        return -EINVAL;
+    }
+
+    // recvmmsg overwrites the lengths and flags, reset them for every call
+    for (uint32_t i = 0; i < batch->len; i++) {
+        struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+        hdr->msg_control = &batch->cmsgs[i * CMSG_LEN_MAX];
+        hdr->msg_controllen = CMSG_LEN_MAX;
+        hdr->msg_flags = 0;
+    }
+
+    int n = recvmmsg(sock, batch->msgs, batch->len, wait ? MSG_WAITFORONE : MSG_DONTWAIT, NULL);
+    return (n < 0) ? -errno : n;
+}
+
+int can_batch_send(int sock, can_batch_t *batch, uint32_t len) {
+    if (!batch || (len > batch->len)) {
+        return -EINVAL;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+        hdr->msg_control = NULL;
+        hdr->msg_controllen = 0;
+        hdr->msg_flags = 0;
+    }
+
+    int n = sendmmsg(sock, batch->msgs, len, MSG_DONTWAIT);
+    return (n < 0) ? -errno : n;
+}
+
+uint64_t can_batch_timestamp_ns(const can_batch_t *batch, uint32_t i) {
+    if (!batch || (i >= batch->len)) {
+        return 0;
+    }
+
+    struct msghdr *hdr = (struct msghdr *)&batch->msgs[i].msg_hdr;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+        }
+    }
+    return 0;
+}
+
+bool can_batch_is_valid(const can_batch_t *batch, uint32_t i) {
+    if (!batch || (i >= batch->len)) {
+        return false;
+    }
+    return batch->msgs[i].msg_len == sizeof(struct can_frame);
+}
+
+bool can_batch_is_tx(const can_batch_t *batch, uint32_t i) {
+    if (!batch || (i >= batch->len)) {
+        return false;
+    }
+    return batch->msgs[i].msg_hdr.msg_flags & MSG_DONTROUTE;
+}
+
+bool can_batch_is_own(const can_batch_t *batch, uint32_t i) {
+    if (!batch || (i >= batch->len)) {
+        return false;
+    }
+    return batch->msgs[i].msg_hdr.msg_flags & MSG_CONFIRM;
+}
+
+uint32_t can_batch_drops(const can_batch_t *batch, uint32_t i) {
+    if (!batch || (i >= batch->len)) {
+        return 0;
+    }
+
+    struct msghdr *hdr = (struct msghdr *)&batch->msgs[i].msg_hdr;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_RXQ_OVFL)) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            return drops;
+        }
+    }
+    return 0;
+}
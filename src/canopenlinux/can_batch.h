@@ -0,0 +1,50 @@
+#ifndef _CAN_BATCH_H_
+#define _CAN_BATCH_H_
+
+#include <linux/can.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/*
+ * Batched SocketCAN receive and send: one recvmmsg or sendmmsg call moves up to len frames instead of a syscall per
+ * frame. When kernel timestamps are enabled on the socket, each received frame carries its SO_TIMESTAMPNS time, and
+ * with SO_RXQ_OVFL the socket's drop count.
+ */
+
+#define CAN_BATCH_DEFAULT_LEN 32
+#define CAN_BATCH_MAX_LEN     1024
+
+typedef struct {
+    uint32_t len; // capacity
+    struct can_frame *frames;
+    struct iovec *iovs;
+    struct mmsghdr *msgs;
+    uint8_t *cmsgs;
+} can_batch_t;
+
+int can_batch_init(can_batch_t *batch, uint32_t len);
+void can_batch_free(can_batch_t *batch);
+
+// request CLOCK_REALTIME software rx timestamps on the socket
+int can_enable_timestamping(int sock);
+
+// take up to batch->len frames that are already queued, with wait it blocks for the first one; returns the number
+// received or negative errno
+int can_batch_recv(int sock, can_batch_t *batch, bool wait);
+
+// send the first len frames without blocking; returns the number sent, fewer once the socket is full, or negative errno
+int can_batch_send(int sock, can_batch_t *batch, uint32_t len);
+
+// CLOCK_REALTIME ns of frame i from the last recv, 0 if none
+uint64_t can_batch_timestamp_ns(const can_batch_t *batch, uint32_t i);
+// frame i is a complete classic CAN frame
+bool can_batch_is_valid(const can_batch_t *batch, uint32_t i);
+// frame i was sent by a socket on this host (local loopback)
+bool can_batch_is_tx(const can_batch_t *batch, uint32_t i);
+// frame i was sent by this socket, only received with CAN_RAW_RECV_OWN_MSGS
+bool can_batch_is_own(const can_batch_t *batch, uint32_t i);
+// frames the kernel dropped on the socket so far when frame i was received, 0 without SO_RXQ_OVFL
+uint32_t can_batch_drops(const can_batch_t *batch, uint32_t i);
+
+#endif
@@ -0,0 +1,181 @@
+#include "can_rx.h"
+#include "CANopen.h"
+#include "CO_epoll_interface.h"
+#include "bus_stats.h"
+#include "can_batch.h"
+#include "logger.h"
+#include "trace.h"
+#include <assert.h>
+#include <errno.h>
+#include <linux/can.h>
+#include <linux/can/error.h>
+#include <linux/can/raw.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#if CO_DRIVER_ERROR_REPORTING > 0
+#include "CO_error.h"
+#endif
+
+// CANopenLinux hands the frame read from the socket straight to the rx callbacks
+static_assert(sizeof(CO_CANrxMsg_t) == sizeof(struct can_frame), "CO_CANrxMsg_t is not a struct can_frame");
+
+static can_batch_t batch;
+static int drops_fd = -1;
+static uint32_t last_drops = 0; // the socket's SO_RXQ_OVFL count, it only goes up until the socket is reopened
+static uint64_t rx_time_ns[CAN_SFF_MASK + 1];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+int can_rx_init(uint32_t batch_len) {
+    int r = can_batch_init(&batch, batch_len ? batch_len : CAN_BATCH_DEFAULT_LEN);
+    if (r < 0) {
+        log_error("can rx batch of %u failed: %d", batch_len, -r);
+    }
+    return r;
+}
+
+void can_rx_free(void) {
+    can_batch_free(&batch);
+}
+
+int can_rx_setup(CO_CANmodule_t *CANmodule) {
+    if (!CANmodule || !CANmodule->CANinterfaces) {
+        return -EINVAL;
+    }
+    if (batch.len == 0) {
+        return 0; // CO_CANrxFromEpoll() reads the socket, it would pass on every frame and its own tx frames
+    }
+
+    int r = 0;
+    for (uint32_t i = 0; i < CANmodule->CANinterfaceCount; i++) {
+        int fd = CANmodule->CANinterfaces[i].fd;
+        struct can_filter all = {
+            .can_id = 0,
+            .can_mask = 0,
+        };
+        can_err_mask_t err_mask = CAN_ERR_MASK;
+        int enable = 1;
+        if ((setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, &all, sizeof(all)) < 0) ||
+            (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask)) < 0) ||
+            (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &enable, sizeof(enable)) < 0) ||
+            (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) < 0)) {
+            r = -errno;
+            log_error("can rx socket setup failed: %d", errno);
+            continue;
+        }
+        int t = can_enable_timestamping(fd);
+        if (t < 0) {
+            log_warning("can rx kernel timestamps unavailable: %d", -t);
+        }
+    }
+    return r;
+}
+
+// same matching as CANopenLinux's CO_CANread(), the rx buffers' masks include the EFF and RTR flags
+static void dispatch(CO_CANmodule_t *CANmodule, CO_CANinterface_t *interface, struct can_frame *frame) {
+#if CO_DRIVER_ERROR_REPORTING > 0
+    if (frame->can_id & CAN_ERR_FLAG) {
+        CO_CANerror_rxMsgError(&interface->errorhandler, frame);
+        return;
+    }
+    CO_CANerror_rxMsg(&interface->errorhandler);
+#else
+    (void)interface;
+    if (frame->can_id & CAN_ERR_FLAG) {
+        return;
+    }
+#endif
+
+    for (uint16_t i = 0; i < CANmodule->rxSize; i++) {
+        CO_CANrx_t *buffer = &CANmodule->rxArray[i];
+        if ((buffer->CANrx_callback != NULL) && (((frame->can_id ^ buffer->ident) & buffer->mask) == 0)) {
+            buffer->CANrx_callback(buffer->object, (void *)frame);
+            return;
+        }
+    }
+}
+
+static void receive(CO_CANmodule_t *CANmodule, CO_CANinterface_t *interface) {
+    int n = can_batch_recv(interface->fd, &batch, false);
+    if (n < 0) {
+        if ((n != -EAGAIN) && (n != -EWOULDBLOCK) && (n != -EINTR)) {
+            log_error("can rx recv error: %d", -n);
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct can_frame *frame = &batch.frames[i];
+        if (!can_batch_is_valid(&batch, i)) {
+            continue;
+        }
+
+        // frames sent by any socket on this host are flagged with MSG_DONTROUTE, the ones sent by CANopenNode's own
+        // socket with MSG_CONFIRM too
+        trace_type_t type = can_batch_is_tx(&batch, i) ? TRACE_CAN_TX : TRACE_CAN_RX;
+        uint8_t len = (frame->can_dlc > CAN_MAX_DLEN) ? CAN_MAX_DLEN : frame->can_dlc;
+        uint64_t time_ns = can_batch_timestamp_ns(&batch, i);
+        if (time_ns) {
+            trace_record_at(time_ns, type, frame->can_id & CAN_SFF_MASK, frame->can_id, frame->data, len);
+        } else {
+            trace_record(type, frame->can_id & CAN_SFF_MASK, frame->can_id, frame->data, len);
+        }
+        bus_stats_frame(frame->can_id, frame->data, len, type == TRACE_CAN_TX);
+        if (can_batch_is_own(&batch, i)) {
+            continue;
+        }
+
+        if ((type == TRACE_CAN_RX) && !(frame->can_id & (CAN_EFF_FLAG | CAN_ERR_FLAG))) {
+            __atomic_store_n(&rx_time_ns[frame->can_id & CAN_SFF_MASK], time_ns ? time_ns : now_ns(),
+                             __ATOMIC_RELAXED);
+        }
+        dispatch(CANmodule, interface, frame);
+    }
+
+    if (interface->fd != drops_fd) { // reopened on a CANopen communication reset
+        drops_fd = interface->fd;
+        last_drops = 0;
+    }
+    uint32_t drops = (n > 0) ? can_batch_drops(&batch, n - 1) : 0;
+    if (drops > last_drops) {
+        CANmodule->CANerrorStatus |= CO_CAN_ERRRX_OVERFLOW;
+        last_drops = drops;
+    }
+}
+
+void can_rx_process(CO_epoll_t *ep, CO_CANmodule_t *CANmodule) {
+    if (!ep || !ep->epoll_new || !CANmodule || !CANmodule->CANinterfaces || (batch.len == 0)) {
+        return;
+    }
+
+    // every wakeup of the socket is handled here, CO_CANrxFromEpoll() would read a frame on an error and pass it on
+    // without the filtering the socket lost with can_rx_setup()
+    for (uint32_t i = 0; i < CANmodule->CANinterfaceCount; i++) {
+        CO_CANinterface_t *interface = &CANmodule->CANinterfaces[i];
+        if (ep->ev.data.fd != interface->fd) {
+            continue;
+        }
+        if (ep->ev.events & (EPOLLERR | EPOLLHUP)) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            getsockopt(interface->fd, SOL_SOCKET, SO_ERROR, &error, &len); // clears it
+            log_debug("can rx socket event 0x%X, error %d", ep->ev.events, error);
+        }
+        if (ep->ev.events & EPOLLIN) {
+            receive(CANmodule, interface);
+        }
+        ep->epoll_new = false;
+        return;
+    }
+}
+
+uint64_t can_rx_time_ns(uint16_t cob_id) {
+    return __atomic_load_n(&rx_time_ns[cob_id & CAN_SFF_MASK], __ATOMIC_RELAXED);
+}
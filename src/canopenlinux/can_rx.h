@@ -0,0 +1,32 @@
+#ifndef _CAN_RX_H_
+#define _CAN_RX_H_
+
+#include "CANopen.h"
+#include "CO_epoll_interface.h"
+#include <stdint.h>
+
+/*
+ * Batched receive on CANopenNode's own CAN socket. CO_epoll_processRT() reads one frame per epoll wakeup, so
+ * can_rx_process() runs right before it and takes up to batch_len queued frames with one recvmmsg call, handing each
+ * to the matching CANopenNode rx callback like CO_CANrxFromEpoll() does.
+ *
+ * The socket is opened up to every frame on the bus and its own tx frames, so each frame is traced and counted in the
+ * bus stats here too, with the kernel rx timestamp from the same recvmmsg. Only frames matching CANopenNode's rx
+ * buffers are passed on, its own tx frames never are.
+ */
+int can_rx_init(uint32_t batch_len); // 0 for CAN_BATCH_DEFAULT_LEN
+void can_rx_free(void);
+
+// after CO_CANsetNormalMode(); CANopenLinux narrows the socket's filter again when RPDO cob-ids change, so it's safe
+// to call again at any time. Does nothing when can_rx_init() failed, the socket is then left as CANopenLinux set it.
+int can_rx_setup(CO_CANmodule_t *CANmodule);
+
+// before CO_epoll_processRT() on the same epoll, clears ep->epoll_new when it handled the wakeup
+void can_rx_process(CO_epoll_t *ep, CO_CANmodule_t *CANmodule);
+
+// CLOCK_REALTIME ns the last frame with the 11-bit cob_id was received from the bus (kernel timestamp when
+// available), 0 if none yet. Set right before the frame goes to CANopenNode, so in its rx callbacks it is the time of
+// the frame being handled. Frames sent by this host are not counted.
+uint64_t can_rx_time_ns(uint16_t cob_id);
+
+#endif
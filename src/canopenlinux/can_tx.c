@@ -0,0 +1,86 @@
+#include "can_tx.h"
+#include "CANopen.h"
+#include "can_batch.h"
+#include "logger.h"
+#include <errno.h>
+#include <linux/can.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+ssize_t __real_send(int sockfd, const void *buf, size_t len, int flags);
+
+static can_batch_t batch;
+static uint32_t batch_used = 0;
+static int batch_fd = -1;            // the socket the batched frames are for
+static __thread bool active = false; // only the thread between can_tx_begin() and can_tx_end() batches
+
+int can_tx_init(uint32_t batch_len) {
+    int r = can_batch_init(&batch, batch_len ? batch_len : CAN_BATCH_DEFAULT_LEN);
+    if (r < 0) {
+        log_error("can tx batch of %u failed: %d", batch_len, -r);
+    }
+    return r;
+}
+
+void can_tx_free(void) {
+    can_batch_free(&batch);
+    batch_used = 0;
+    batch_fd = -1;
+}
+
+// send what fits in the socket, the rest moves to the front of the batch; returns negative errno if none was sent
+static int flush(void) {
+    int n = can_batch_send(batch_fd, &batch, batch_used);
+    if (n < 0) {
+        return n;
+    }
+    batch_used -= n;
+    memmove(batch.frames, &batch.frames[n], batch_used * sizeof(struct can_frame));
+    return 0;
+}
+
+void can_tx_begin(CO_CANmodule_t *CANmodule) {
+    if ((batch.len == 0) || !CANmodule || !CANmodule->CANinterfaces || (CANmodule->CANinterfaceCount != 1)) {
+        return;
+    }
+    int fd = CANmodule->CANinterfaces[0].fd;
+    if (fd != batch_fd) { // reopened on a CANopen communication reset, the frames left were for the old socket
+        batch_used = 0;
+        batch_fd = fd;
+    }
+    active = true;
+}
+
+void can_tx_end(CO_CANmodule_t *CANmodule) {
+    if (!active) {
+        return;
+    }
+    active = false;
+
+    int r = flush();
+    if ((r < 0) && (r != -EAGAIN) && (r != -EWOULDBLOCK) && (r != -ENOBUFS) && (r != -EINTR)) {
+        log_error("can tx send error: %d, dropped %u frames", -r, batch_used);
+        batch_used = 0;
+        CANmodule->CANerrorStatus |= CO_CAN_ERRTX_OVERFLOW;
+    }
+}
+
+// CANopenLinux's CO_CANsend() sends each frame with send(), this takes them into the batch instead
+ssize_t __wrap_send(int sockfd, const void *buf, size_t len, int flags) {
+    if (!active || (sockfd != batch_fd) || (len != sizeof(struct can_frame))) {
+        return __real_send(sockfd, buf, len, flags);
+    }
+
+    if (batch_used == batch.len) {
+        int r = flush();
+        if ((r < 0) || (batch_used == batch.len)) {
+            errno = (r < 0) ? -r : EAGAIN; // CANopenLinux keeps the frame and retries it like for a full socket
+            return -1;
+        }
+    }
+    memcpy(&batch.frames[batch_used++], buf, len);
+    return len;
+}
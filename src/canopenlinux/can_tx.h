@@ -0,0 +1,23 @@
+#ifndef _CAN_TX_H_
+#define _CAN_TX_H_
+
+#include "CANopen.h"
+#include <stdint.h>
+
+/*
+ * Batched send on CANopenNode's own CAN socket. CANopenLinux's CO_CANsend() calls send() once per frame, so the
+ * library is linked with --wrap=send: between can_tx_begin() and can_tx_end() on the same thread the frames for the
+ * socket are batched and can_tx_end() sends them with one sendmmsg call. Sends from other threads, to other sockets,
+ * or outside of the two go out right away.
+ *
+ * A full batch is sent early, when the socket has no room left for it the frame is refused with EAGAIN like a full
+ * socket, so CANopenLinux keeps it to retry. Frames can_tx_end() could not send stay batched for the next one.
+ */
+int can_tx_init(uint32_t batch_len); // 0 for CAN_BATCH_DEFAULT_LEN
+void can_tx_free(void);
+
+// around CO_epoll_processRT(), where the PDO and SYNC frames are sent
+void can_tx_begin(CO_CANmodule_t *CANmodule);
+void can_tx_end(CO_CANmodule_t *CANmodule);
+
+#endif
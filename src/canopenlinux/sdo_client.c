@@ -1,9 +1,12 @@
 #include "sdo_client.h"
 #include "CO_SDOserver.h"
+#include "latency.h"
 #include "system.h"
+#include "trace.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #define SDO_TIMEOUT_MS 1000
@@ -51,6 +54,15 @@ char *ABORT_CODES_STR[] = {
     "No buf available",
 };
 
+static void trace_sdo_client(uint8_t node_id, uint16_t index, uint8_t subindex, CO_SDO_abortCode_t abort_code,
+                             uint64_t start_us) {
+    uint32_t duration_us = get_uptime_us() - start_us;
+    uint8_t data[7] = {index & 0xFF, index >> 8, subindex};
+    memcpy(&data[3], &duration_us, sizeof(duration_us));
+    trace_record(TRACE_SDO_CLIENT, node_id, abort_code, data, sizeof(data));
+    latency_record(LATENCY_SDO_CLIENT, duration_us);
+}
+
 char *get_sdo_abort_string(uint32_t code) {
     char *r = NULL;
     for (int i = 0; i < (int)ABORT_CODES_LEN; i++) {
@@ -61,8 +73,8 @@ char *get_sdo_abort_string(uint32_t code) {
     return r;
 }
 
-CO_SDO_abortCode_t sdo_read_dynamic(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex,
-                                    void **buf, size_t *buf_size, bool block_transfer) {
+static CO_SDO_abortCode_t do_sdo_read_dynamic(CO_SDOclient_t *client, uint8_t node_id, uint16_t index,
+                                              uint8_t subindex, void **buf, size_t *buf_size, bool block_transfer) {
     CO_SDO_return_t ret;
 
     ret = CO_SDOclient_setup(client, CO_CAN_ID_SDO_CLI + node_id, CO_CAN_ID_SDO_SRV + node_id, node_id);
@@ -111,8 +123,17 @@ CO_SDO_abortCode_t sdo_read_dynamic(CO_SDOclient_t *client, uint8_t node_id, uin
     return CO_SDO_AB_NONE;
 }
 
-CO_SDO_abortCode_t sdo_read(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex, void *buf,
-                            size_t buf_size, size_t *read_size) {
+CO_SDO_abortCode_t sdo_read_dynamic(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex,
+                                    void **buf, size_t *buf_size, bool block_transfer) {
+    uint64_t start_us = get_uptime_us();
+    CO_SDO_abortCode_t abort_code =
+        do_sdo_read_dynamic(client, node_id, index, subindex, buf, buf_size, block_transfer);
+    trace_sdo_client(node_id, index, subindex, abort_code, start_us);
+    return abort_code;
+}
+
+static CO_SDO_abortCode_t do_sdo_read(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex,
+                                      void *buf, size_t buf_size, size_t *read_size) {
     CO_SDO_return_t ret;
     uint8_t *data = (uint8_t *)buf;
 
@@ -150,8 +171,16 @@ CO_SDO_abortCode_t sdo_read(CO_SDOclient_t *client, uint8_t node_id, uint16_t in
     return CO_SDO_AB_NONE;
 }
 
-CO_SDO_abortCode_t sdo_write(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex, void *buf,
-                             size_t buf_size) {
+CO_SDO_abortCode_t sdo_read(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex, void *buf,
+                            size_t buf_size, size_t *read_size) {
+    uint64_t start_us = get_uptime_us();
+    CO_SDO_abortCode_t abort_code = do_sdo_read(client, node_id, index, subindex, buf, buf_size, read_size);
+    trace_sdo_client(node_id, index, subindex, abort_code, start_us);
+    return abort_code;
+}
+
+static CO_SDO_abortCode_t do_sdo_write(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex,
+                                       void *buf, size_t buf_size) {
     CO_SDO_return_t ret;
     uint8_t *data = (uint8_t *)buf;
 
@@ -187,8 +216,16 @@ CO_SDO_abortCode_t sdo_write(CO_SDOclient_t *client, uint8_t node_id, uint16_t i
     return CO_SDO_AB_NONE;
 }
 
-CO_SDO_abortCode_t sdo_read_to_file(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex,
-                                    char *file_path) {
+CO_SDO_abortCode_t sdo_write(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex, void *buf,
+                             size_t buf_size) {
+    uint64_t start_us = get_uptime_us();
+    CO_SDO_abortCode_t abort_code = do_sdo_write(client, node_id, index, subindex, buf, buf_size);
+    trace_sdo_client(node_id, index, subindex, abort_code, start_us);
+    return abort_code;
+}
+
+static CO_SDO_abortCode_t do_sdo_read_to_file(CO_SDOclient_t *client, uint8_t node_id, uint16_t index,
+                                              uint8_t subindex, char *file_path) {
     CO_SDO_return_t ret;
 
     ret = CO_SDOclient_setup(client, CO_CAN_ID_SDO_CLI + node_id, CO_CAN_ID_SDO_SRV + node_id, node_id);
@@ -231,8 +268,16 @@ CO_SDO_abortCode_t sdo_read_to_file(CO_SDOclient_t *client, uint8_t node_id, uin
     return CO_SDO_AB_NONE;
 }
 
-CO_SDO_abortCode_t sdo_write_from_file(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex,
-                                       char *file_path) {
+CO_SDO_abortCode_t sdo_read_to_file(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex,
+                                    char *file_path) {
+    uint64_t start_us = get_uptime_us();
+    CO_SDO_abortCode_t abort_code = do_sdo_read_to_file(client, node_id, index, subindex, file_path);
+    trace_sdo_client(node_id, index, subindex, abort_code, start_us);
+    return abort_code;
+}
+
+static CO_SDO_abortCode_t do_sdo_write_from_file(CO_SDOclient_t *client, uint8_t node_id, uint16_t index,
+                                                 uint8_t subindex, char *file_path) {
     CO_SDO_return_t ret;
 
     ret = CO_SDOclient_setup(client, CO_CAN_ID_SDO_CLI + node_id, CO_CAN_ID_SDO_SRV + node_id, node_id);
@@ -282,3 +327,11 @@ CO_SDO_abortCode_t sdo_write_from_file(CO_SDOclient_t *client, uint8_t node_id,
     fclose(fp);
     return CO_SDO_AB_NONE;
 }
+
+CO_SDO_abortCode_t sdo_write_from_file(CO_SDOclient_t *client, uint8_t node_id, uint16_t index, uint8_t subindex,
+                                       char *file_path) {
+    uint64_t start_us = get_uptime_us();
+    CO_SDO_abortCode_t abort_code = do_sdo_write_from_file(client, node_id, index, subindex, file_path);
+    trace_sdo_client(node_id, index, subindex, abort_code, start_us);
+    return abort_code;
+}
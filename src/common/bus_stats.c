@@ -0,0 +1,209 @@
+#include "bus_stats.h"
+#include "logger.h"
+#include "system.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/can.h>
+#include <linux/can/error.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SYSFS_PATH_LEN 64
+
+// counters are written by the thread receiving CAN frames (the RT thread) and swapped out by the snapshot
+static uint32_t frames[BUS_STATS_CLASS_LEN];
+static uint32_t node_frames[BUS_STATS_NODES];
+static uint32_t tx_frames = 0;
+static uint32_t err_frames = 0;
+static uint32_t err_passive = 0;
+static uint32_t bus_off = 0;
+static uint32_t tx_overflow = 0;
+static uint32_t rx_overflow = 0;
+static uint64_t bits = 0;
+
+static bool last_tx_overflow = false;
+static bool last_rx_overflow = false;
+
+static char ifname[IFNAMSIZ] = {0};
+static uint32_t bitrate = 0;
+static int carrier_fd = -1;
+static int tx_dropped_fd = -1;
+static uint64_t last_tx_dropped = 0;
+static uint32_t last_snapshot_ms = 0;
+
+static int sysfs_open(const char *name) {
+    char path[SYSFS_PATH_LEN];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/%s", ifname, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// sysfs attributes are regenerated on every read from offset 0, so the fd can stay open
+static int sysfs_read(int *fd, const char *name, char *buf, size_t len) {
+    if (*fd < 0) {
+        *fd = sysfs_open(name);
+        if (*fd < 0) {
+            return -errno;
+        }
+    }
+    ssize_t n = pread(*fd, buf, len - 1, 0);
+    if (n <= 0) {
+        // the interface was removed, reopen on the next read in case it comes back
+        int r = (n < 0) ? -errno : -ENODATA;
+        close(*fd);
+        *fd = -1;
+        return r;
+    }
+    buf[n] = '\0';
+    return 0;
+}
+
+int bus_stats_init(const char *name, uint32_t rate) {
+    if (!name || (rate == 0)) {
+        return -EINVAL;
+    }
+
+    bus_stats_free();
+    snprintf(ifname, sizeof(ifname), "%s", name);
+    bitrate = rate;
+    carrier_fd = sysfs_open("carrier");
+    tx_dropped_fd = sysfs_open("statistics/tx_dropped");
+    if ((carrier_fd < 0) || (tx_dropped_fd < 0)) {
+        log_warning("failed to open sysfs stats for %s: %d", ifname, errno);
+    }
+
+    bus_stats_t stats;
+    bus_stats_snapshot(&stats); // start from zero
+    return 0;
+}
+
+void bus_stats_free(void) {
+    if (carrier_fd >= 0) {
+        close(carrier_fd);
+        carrier_fd = -1;
+    }
+    if (tx_dropped_fd >= 0) {
+        close(tx_dropped_fd);
+        tx_dropped_fd = -1;
+    }
+}
+
+static bus_stats_class_t get_class(uint32_t cob_id) {
+    if (cob_id == 0x000) {
+        return BUS_STATS_NMT;
+    } else if (cob_id == 0x080) {
+        return BUS_STATS_SYNC;
+    } else if (cob_id < 0x100) {
+        return BUS_STATS_EMCY;
+    } else if (cob_id == 0x100) {
+        return BUS_STATS_TIME;
+    } else if ((cob_id >= 0x180) && (cob_id < 0x580)) {
+        return BUS_STATS_PDO;
+    } else if ((cob_id >= 0x580) && (cob_id < 0x680)) {
+        return BUS_STATS_SDO;
+    } else if ((cob_id >= 0x700) && (cob_id < 0x780)) {
+        return BUS_STATS_HB;
+    }
+    return BUS_STATS_OTHER;
+}
+
+// nominal frame bits plus the average stuff bits for random data (1 per 10 stuffable bits)
+static uint32_t frame_bits(uint32_t can_id, uint8_t len) {
+    uint32_t stuffable = ((can_id & CAN_EFF_FLAG) ? 54 : 34) + (8 * len);
+    return stuffable + 13 + (stuffable / 10);
+}
+
+void bus_stats_frame(uint32_t can_id, const uint8_t *data, uint8_t len, bool tx) {
+    if (can_id & CAN_ERR_FLAG) {
+        __atomic_fetch_add(&err_frames, 1, __ATOMIC_RELAXED);
+        if ((can_id & CAN_ERR_CRTL) && data && (len > 1) &&
+            (data[1] & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE))) {
+            __atomic_fetch_add(&err_passive, 1, __ATOMIC_RELAXED);
+        }
+        if (can_id & CAN_ERR_BUSOFF) {
+            __atomic_fetch_add(&bus_off, 1, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+
+    bus_stats_class_t class = BUS_STATS_OTHER;
+    if (!(can_id & CAN_EFF_FLAG)) {
+        uint32_t cob_id = can_id & CAN_SFF_MASK;
+        class = get_class(cob_id);
+        if ((class == BUS_STATS_EMCY) || (class == BUS_STATS_PDO) || (class == BUS_STATS_SDO) ||
+            (class == BUS_STATS_HB)) {
+            __atomic_fetch_add(&node_frames[cob_id & 0x7F], 1, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_fetch_add(&frames[class], 1, __ATOMIC_RELAXED);
+    if (tx) {
+        __atomic_fetch_add(&tx_frames, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&bits, frame_bits(can_id, (can_id & CAN_RTR_FLAG) ? 0 : len), __ATOMIC_RELAXED);
+}
+
+void bus_stats_overflow(bool tx, bool rx) {
+    if (tx && !last_tx_overflow) {
+        __atomic_fetch_add(&tx_overflow, 1, __ATOMIC_RELAXED);
+    }
+    if (rx && !last_rx_overflow) {
+        __atomic_fetch_add(&rx_overflow, 1, __ATOMIC_RELAXED);
+    }
+    last_tx_overflow = tx;
+    last_rx_overflow = rx;
+}
+
+int bus_stats_carrier(void) {
+    char buf[4];
+    int r = sysfs_read(&carrier_fd, "carrier", buf, sizeof(buf));
+    if (r == -EINVAL) {
+        return 0; // reading carrier of an interface that is down fails with EINVAL
+    }
+    return (r < 0) ? r : (buf[0] == '1');
+}
+
+static uint32_t swap_zero(uint32_t *counter) {
+    return __atomic_exchange_n(counter, 0, __ATOMIC_RELAXED);
+}
+
+void bus_stats_snapshot(bus_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    uint32_t now_ms = get_uptime_ms();
+    stats->interval_ms = now_ms - last_snapshot_ms;
+    last_snapshot_ms = now_ms;
+
+    for (uint32_t i = 0; i < BUS_STATS_CLASS_LEN; i++) {
+        stats->frames[i] = swap_zero(&frames[i]);
+    }
+    for (uint32_t i = 0; i < BUS_STATS_NODES; i++) {
+        stats->node_frames[i] = swap_zero(&node_frames[i]);
+    }
+    stats->tx_frames = swap_zero(&tx_frames);
+    stats->err_frames = swap_zero(&err_frames);
+    stats->err_passive = swap_zero(&err_passive);
+    stats->bus_off = swap_zero(&bus_off);
+    stats->tx_overflow = swap_zero(&tx_overflow);
+    stats->rx_overflow = swap_zero(&rx_overflow);
+
+    uint64_t interval_bits = __atomic_exchange_n(&bits, 0, __ATOMIC_RELAXED);
+    uint64_t capacity = ((uint64_t)bitrate * stats->interval_ms) / 1000;
+    uint64_t load = capacity ? ((interval_bits * 1000) / capacity) : 0;
+    stats->load = (load > 1000) ? 1000 : (uint16_t)load;
+
+    char buf[24];
+    stats->tx_dropped = 0;
+    if (sysfs_read(&tx_dropped_fd, "statistics/tx_dropped", buf, sizeof(buf)) == 0) {
+        uint64_t tx_dropped = strtoull(buf, NULL, 10);
+        if (tx_dropped >= last_tx_dropped) {
+            stats->tx_dropped = (uint32_t)(tx_dropped - last_tx_dropped);
+        }
+        last_tx_dropped = tx_dropped; // the counter restarts if the interface is recreated
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef _BUS_STATS_H_
+#define _BUS_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CAN bus statistics. Frames are fed in by the CAN rx path, CANopenNode's queue overflow flags by the main loop,
+ * and bus_stats_snapshot() returns everything counted since the previous snapshot.
+ */
+
+typedef enum {
+    BUS_STATS_NMT = 0,   // 0x000
+    BUS_STATS_SYNC = 1,  // 0x080
+    BUS_STATS_EMCY = 2,  // 0x081 to 0x0FF
+    BUS_STATS_TIME = 3,  // 0x100
+    BUS_STATS_PDO = 4,   // 0x180 to 0x57F
+    BUS_STATS_SDO = 5,   // 0x580 to 0x67F
+    BUS_STATS_HB = 6,    // 0x700 to 0x77F
+    BUS_STATS_OTHER = 7, // LSS, extended ids, and anything else
+} bus_stats_class_t;
+
+#define BUS_STATS_CLASS_LEN 8
+#define BUS_STATS_NODES     128
+
+typedef struct {
+    uint32_t interval_ms; // time covered by the snapshot
+    uint16_t load;        // estimated bus load in 0.1 % units
+    uint32_t frames[BUS_STATS_CLASS_LEN];
+    uint32_t node_frames[BUS_STATS_NODES]; // frames of node id based cob ids (EMCY, PDO, SDO, HB) by node id
+    uint32_t tx_frames;
+    uint32_t err_frames;
+    uint32_t err_passive; // error frames reporting the controller went error passive
+    uint32_t bus_off;
+    uint32_t tx_overflow; // times CANopenNode's tx buffer overflowed
+    uint32_t rx_overflow; // times CANopenNode's rx buffer overflowed
+    uint32_t tx_dropped;  // frames dropped by the kernel's tx queue
+} bus_stats_t;
+
+int bus_stats_init(const char *ifname, uint32_t bitrate);
+void bus_stats_free(void);
+
+// can_id is the raw SocketCAN id with flags
+void bus_stats_frame(uint32_t can_id, const uint8_t *data, uint8_t len, bool tx);
+// feed CANopenNode's overflow flags, only rising edges are counted
+void bus_stats_overflow(bool tx_overflow, bool rx_overflow);
+
+// 1 if the interface has carrier, 0 if not, or negative errno if the interface is missing
+int bus_stats_carrier(void);
+void bus_stats_snapshot(bus_stats_t *stats);
+
+#endif
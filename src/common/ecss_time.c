@@ -61,3 +61,13 @@ int set_ecss_utc(const ecss_utc_t *utc) {
     }
     return r;
 }
+
+uint64_t ecss_scet_to_ns(const ecss_scet_t *scet) {
+    return ((uint64_t)scet->coarse * 1000000000ULL) + ((uint64_t)scet->fine * 1000ULL);
+}
+
+void ecss_scet_from_ns(uint64_t ns, ecss_scet_t *scet) {
+    scet->raw = 0;
+    scet->coarse = ns / 1000000000ULL;
+    scet->fine = (ns % 1000000000ULL) / 1000ULL;
+}
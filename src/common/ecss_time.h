@@ -30,4 +30,8 @@ int set_ecss_scet(const ecss_scet_t *scet);
 void get_ecss_utc(ecss_utc_t *utc);
 int set_ecss_utc(const ecss_utc_t *utc);
 
+// CLOCK_REALTIME ns, fine is in microseconds like get_ecss_scet()
+uint64_t ecss_scet_to_ns(const ecss_scet_t *scet);
+void ecss_scet_from_ns(uint64_t ns, ecss_scet_t *scet);
+
 #endif
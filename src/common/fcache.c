@@ -1,4 +1,5 @@
 #include "fcache.h"
+#include "logger.h"
 #include "system.h"
 #include <dirent.h>
 #include <errno.h>
@@ -11,6 +12,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
+
+#define FILES_ALLOC_STEP 64
+
+static uint32_t find_file(fcache_t *cache, const char *file_name, bool *found);
+static int index_file(fcache_t *cache, const char *file_name, bool scanned);
+static void unindex_file(fcache_t *cache, uint32_t i);
+static void unindex_name(fcache_t *cache, const char *file_name);
+static int make_room(fcache_t *cache, uint64_t new_bytes, uint32_t new_files);
 
 fcache_t *fcache_init(char *dir_path) {
     int r = mkdir_path(dir_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
@@ -18,11 +29,23 @@ fcache_t *fcache_init(char *dir_path) {
         return NULL;
     }
 
-    fcache_t *cache = (fcache_t *)malloc(sizeof(fcache_t));
-    ;
-    if (cache) {
-        pthread_mutex_init(&cache->mutex, NULL);
-        strncpy(cache->dir_path, dir_path, strlen(dir_path) + 1);
+    fcache_t *cache = (fcache_t *)calloc(1, sizeof(fcache_t));
+    if (!cache) {
+        return NULL;
+    }
+    pthread_mutex_init(&cache->mutex, NULL);
+    strncpy(cache->dir_path, dir_path, strlen(dir_path) + 1);
+
+    DIR *d = opendir(cache->dir_path);
+    if (d != NULL) {
+        struct dirent *dir;
+        while ((dir = readdir(d)) != NULL) {
+            if (dir->d_name[0] == '.') {
+                continue; // skip ., .., and hidden temp files
+            }
+            index_file(cache, dir->d_name, true);
+        }
+        closedir(d);
     }
     return cache;
 }
@@ -32,21 +55,74 @@ void fcache_free(fcache_t *cache) {
         return;
     }
     pthread_mutex_destroy(&cache->mutex);
+    free(cache->files);
     free(cache);
 }
 
+int fcache_set_limits(fcache_t *cache, uint64_t max_bytes, uint32_t max_files, uint8_t min_free_percent) {
+    if (!cache || (min_free_percent > 100)) {
+        return -EINVAL;
+    }
+
+    // only enforced on the next add, so a restart on a full card doesn't evict files still waiting to be used
+    pthread_mutex_lock(&cache->mutex);
+    cache->max_bytes = max_bytes;
+    cache->max_files = max_files;
+    cache->min_free_percent = min_free_percent;
+    pthread_mutex_unlock(&cache->mutex);
+    return 0;
+}
+
+int fcache_add_priority(fcache_t *cache, const char *prefix, int8_t priority) {
+    if (!cache || !prefix || (strlen(prefix) >= FCACHE_PRIORITY_PREFIX_LEN)) {
+        return -EINVAL;
+    }
+
+    int r = 0;
+    pthread_mutex_lock(&cache->mutex);
+    if (cache->priorities_len < FCACHE_PRIORITIES_MAX) {
+        fcache_priority_t *p = &cache->priorities[cache->priorities_len++];
+        strncpy(p->prefix, prefix, FCACHE_PRIORITY_PREFIX_LEN);
+        p->priority = priority;
+        for (uint32_t i = 0; i < cache->files_len; i++) {
+            if (!strncmp(cache->files[i].name, prefix, strlen(prefix))) {
+                cache->files[i].priority = priority;
+            }
+        }
+    } else {
+        r = -ENOMEM;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return r;
+}
+
 int fcache_add(fcache_t *cache, char *file_path, bool consume) {
     if (!cache || !is_file(file_path)) {
         return -EINVAL;
     }
 
+    struct stat file_stat;
+    if (stat(file_path, &file_stat) == -1) {
+        return -errno;
+    }
+
+    char path_copy[PATH_MAX];
+    strncpy(path_copy, file_path, PATH_MAX - 1);
+    path_copy[PATH_MAX - 1] = '\0';
+    char *file_name = basename(path_copy);
+
     int r;
     pthread_mutex_lock(&cache->mutex);
-    if (consume) {
-        r = move_file(file_path, cache->dir_path);
-    } else {
-        r = copy_file(file_path, cache->dir_path);
+    unindex_name(cache, file_name); // replaced, its bytes must not count against the new file
+    r = make_room(cache, file_stat.st_size, 1);
+    if (r == 0) {
+        if (consume) {
+            r = move_file(file_path, cache->dir_path);
+        } else {
+            r = copy_file(file_path, cache->dir_path);
+        }
     }
+    index_file(cache, file_name, false); // the new file, or the old one if it was not replaced
     pthread_mutex_unlock(&cache->mutex);
     return r;
 }
@@ -63,11 +139,18 @@ int fcache_add_new(fcache_t *cache, char *file_name, uint8_t *file_data, uint32_
     }
 
     pthread_mutex_lock(&cache->mutex);
-    FILE *fp = fopen(buffer, "wb");
-    if (fp != NULL) {
-        fwrite(file_data, file_data_len, 1, fp);
-        fclose(fp);
+    unindex_name(cache, file_name); // replaced, its bytes must not count against the new file
+    r = make_room(cache, file_data_len, 1);
+    if (r == 0) {
+        FILE *fp = fopen(buffer, "wb");
+        if (fp != NULL) {
+            fwrite(file_data, file_data_len, 1, fp);
+            fclose(fp);
+        } else {
+            r = -errno;
+        }
     }
+    index_file(cache, file_name, false); // the new file, or the old one if it was not replaced
     pthread_mutex_unlock(&cache->mutex);
     return r;
 }
@@ -88,6 +171,9 @@ int fcache_delete(fcache_t *cache, char *file_name) {
     if (r == -1) {
         r = -errno;
     }
+    if ((r == 0) || (r == -ENOENT)) { // a file that could not be removed is still there and still counted
+        unindex_name(cache, file_name);
+    }
     pthread_mutex_unlock(&cache->mutex);
     return r;
 }
@@ -105,6 +191,11 @@ int fcache_copy(fcache_t *cache, char *file_name, char *dest_dir) {
 
     pthread_mutex_lock(&cache->mutex);
     r = copy_file(buffer, dest_dir);
+    bool found;
+    uint32_t i = find_file(cache, file_name, &found);
+    if (found) {
+        cache->files[i].last_used = time(NULL);
+    }
     pthread_mutex_unlock(&cache->mutex);
     return r;
 }
@@ -122,10 +213,31 @@ int fcache_move(fcache_t *cache, char *file_name, char *dest_dir) {
 
     pthread_mutex_lock(&cache->mutex);
     r = move_file(buffer, dest_dir);
+    if (r == 0) {
+        bool found;
+        uint32_t i = find_file(cache, file_name, &found);
+        if (found) {
+            unindex_file(cache, i);
+        }
+    }
     pthread_mutex_unlock(&cache->mutex);
     return r;
 }
 
+void fcache_touch(fcache_t *cache, char *file_name) {
+    if (!cache || !file_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    bool found;
+    uint32_t i = find_file(cache, file_name, &found);
+    if (found) {
+        cache->files[i].last_used = time(NULL);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
+
 uint32_t fcache_size(fcache_t *cache) {
     if (!cache) {
         return 0;
@@ -133,91 +245,331 @@ uint32_t fcache_size(fcache_t *cache) {
 
     uint32_t count = 0;
     pthread_mutex_lock(&cache->mutex);
-    count = files_in_dir(cache->dir_path);
+    count = cache->files_len;
     pthread_mutex_unlock(&cache->mutex);
     return count;
 }
 
+uint64_t fcache_bytes(fcache_t *cache) {
+    if (!cache) {
+        return 0;
+    }
+
+    uint64_t bytes = 0;
+    pthread_mutex_lock(&cache->mutex);
+    bytes = cache->bytes;
+    pthread_mutex_unlock(&cache->mutex);
+    return bytes;
+}
+
 bool fcache_file_exist(fcache_t *cache, char *file_name) {
     if (!cache || !file_name) {
-        return -EINVAL;
+        return false;
     }
 
     bool found;
     pthread_mutex_lock(&cache->mutex);
-    found = is_file_in_dir(cache->dir_path, file_name);
+    find_file(cache, file_name, &found);
     pthread_mutex_unlock(&cache->mutex);
     return found;
 }
 
+static bool filter_match(const fcache_file_t *file, const fcache_filter_t *filter) {
+    if (!filter) {
+        return true;
+    }
+    if ((filter->prefix[0] != '\0') && strncmp(file->name, filter->prefix, strlen(filter->prefix))) {
+        return false;
+    }
+    return file->mtime > filter->newer_than;
+}
+
+// calls cb on each file that matches filter, returns the total number of matching files
+static uint32_t for_each_match(fcache_t *cache, const fcache_filter_t *filter,
+                               void (*cb)(const fcache_file_t *file, uint32_t n, void *arg), void *arg) {
+    uint32_t total = 0;
+    uint32_t listed = 0;
+    for (uint32_t i = 0; i < cache->files_len; i++) {
+        if (!filter_match(&cache->files[i], filter)) {
+            continue;
+        }
+        if ((!filter || (total >= filter->offset)) && (!filter || !filter->count || (listed < filter->count))) {
+            cb(&cache->files[i], listed, arg);
+            listed++;
+        }
+        total++;
+    }
+    return total;
+}
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    uint16_t entries;
+} list_buf_t;
+
+static void json_len_cb(const fcache_file_t *file, uint32_t n, void *arg) {
+    (void)n;
+    *(size_t *)arg += strlen(file->name) + 4; // quotes and ", "
+}
+
+static void json_fill_cb(const fcache_file_t *file, uint32_t n, void *arg) {
+    list_buf_t *list = (list_buf_t *)arg;
+    list->len += sprintf((char *)&list->buf[list->len], "%s\"%s\"", n == 0 ? "" : ", ", file->name);
+}
+
 // this could be done with cJSON, but it is a one-off
-char *fcache_list_files_as_json(fcache_t *cache) {
+char *fcache_list_files_as_json(fcache_t *cache, const fcache_filter_t *filter) {
     if (!cache) {
         return NULL;
     }
 
-    unsigned int size = 256;
-    unsigned int offset = 0;
-    char *buf = (char *)malloc(size);
-    if (!buf) {
+    pthread_mutex_lock(&cache->mutex);
+
+    size_t size = 3; // "[]" and '\0'
+    for_each_match(cache, filter, json_len_cb, &size);
+
+    list_buf_t list = {
+        .buf = (uint8_t *)malloc(size),
+        .len = 1,
+    };
+    if (list.buf != NULL) {
+        list.buf[0] = '[';
+        for_each_match(cache, filter, json_fill_cb, &list);
+        list.buf[list.len++] = ']';
+        list.buf[list.len] = '\0';
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+    return (char *)list.buf;
+}
+
+static void bin_len_cb(const fcache_file_t *file, uint32_t n, void *arg) {
+    (void)n;
+    size_t name_len = strlen(file->name);
+    *(size_t *)arg += 2 * sizeof(uint32_t) + sizeof(uint8_t) + (name_len > UINT8_MAX ? UINT8_MAX : name_len);
+}
+
+static void bin_fill_cb(const fcache_file_t *file, uint32_t n, void *arg) {
+    (void)n;
+    list_buf_t *list = (list_buf_t *)arg;
+    uint32_t size = file->size > UINT32_MAX ? UINT32_MAX : (uint32_t)file->size;
+    uint32_t mtime = (uint32_t)file->mtime;
+    size_t name_len = strlen(file->name);
+    uint8_t len = name_len > UINT8_MAX ? UINT8_MAX : (uint8_t)name_len;
+
+    memcpy(&list->buf[list->len], &size, sizeof(size));
+    list->len += sizeof(size);
+    memcpy(&list->buf[list->len], &mtime, sizeof(mtime));
+    list->len += sizeof(mtime);
+    list->buf[list->len++] = len;
+    memcpy(&list->buf[list->len], file->name, len);
+    list->len += len;
+    list->entries++;
+}
+
+uint8_t *fcache_list_files_as_bin(fcache_t *cache, const fcache_filter_t *filter, size_t *out_len) {
+    if (!cache || !out_len) {
         return NULL;
     }
-    buf[0] = '[';
-    buf[1] = '\0';
-    offset = 1;
+
+    fcache_filter_t bin_filter = {0};
+    if (filter) {
+        bin_filter = *filter;
+    }
+    if (!bin_filter.count || (bin_filter.count > UINT16_MAX)) {
+        bin_filter.count = UINT16_MAX; // number of entries is only a uint16
+    }
 
     pthread_mutex_lock(&cache->mutex);
-    DIR *d = opendir(cache->dir_path);
-    if (d == NULL) {
-        return NULL;
+
+    size_t size = sizeof(uint32_t) + sizeof(uint16_t);
+    for_each_match(cache, &bin_filter, bin_len_cb, &size);
+
+    list_buf_t list = {
+        .buf = (uint8_t *)malloc(size),
+        .len = sizeof(uint32_t) + sizeof(uint16_t),
+        .entries = 0,
+    };
+    if (list.buf != NULL) {
+        uint32_t total = for_each_match(cache, &bin_filter, bin_fill_cb, &list);
+        memcpy(list.buf, &total, sizeof(total));
+        memcpy(&list.buf[sizeof(total)], &list.entries, sizeof(list.entries));
+        *out_len = list.len;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+    return list.buf;
+}
+
+static void first_name_cb(const fcache_file_t *file, uint32_t n, void *arg) {
+    if ((n == 0) && arg) {
+        strcpy((char *)arg, file->name);
+    }
+}
+
+uint32_t fcache_count(fcache_t *cache, const fcache_filter_t *filter, char *first) {
+    if (!cache) {
+        return 0;
     }
 
-    struct dirent *dir;
-    while ((dir = readdir(d)) != NULL) { // directory found
-        if (strncmp(dir->d_name, ".", strlen(dir->d_name)) == 0 ||
-            strncmp(dir->d_name, "..", strlen(dir->d_name)) == 0) {
-            continue; // skip . and ..
+    if (first) {
+        first[0] = '\0';
+    }
+    pthread_mutex_lock(&cache->mutex);
+    uint32_t total = for_each_match(cache, filter, first_name_cb, first);
+    pthread_mutex_unlock(&cache->mutex);
+    return total;
+}
+
+// files are kept sorted by name; returns the index of the file or where it would be inserted
+static uint32_t find_file(fcache_t *cache, const char *file_name, bool *found) {
+    uint32_t low = 0;
+    uint32_t high = cache->files_len;
+    *found = false;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        int cmp = strcmp(cache->files[mid].name, file_name);
+        if (cmp == 0) {
+            *found = true;
+            return mid;
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
+    }
+    return low;
+}
+
+static int8_t get_priority(fcache_t *cache, const char *file_name) {
+    for (uint8_t i = 0; i < cache->priorities_len; i++) {
+        if (!strncmp(file_name, cache->priorities[i].prefix, strlen(cache->priorities[i].prefix))) {
+            return cache->priorities[i].priority;
+        }
+    }
+    return 0;
+}
+
+// scanned is for files already in the dir at init, their mtime is the best guess of when they were last used
+static int index_file(fcache_t *cache, const char *file_name, bool scanned) {
+    if (strlen(file_name) > NAME_MAX) {
+        return -ENAMETOOLONG;
+    }
+
+    char path[PATH_MAX];
+    int r = path_join(cache->dir_path, (char *)file_name, path, PATH_MAX);
+    if (r < 0) {
+        return r;
+    }
 
-        while ((offset + strlen(dir->d_name) + 5) > size) {
-            void *tmp = realloc(buf, size * 2);
+    struct stat file_stat;
+    if (stat(path, &file_stat) == -1) {
+        return -errno;
+    }
+    if (!S_ISREG(file_stat.st_mode)) {
+        return -EINVAL;
+    }
+
+    bool found;
+    uint32_t i = find_file(cache, file_name, &found);
+    if (found) {
+        cache->bytes -= cache->files[i].size;
+    } else {
+        if (cache->files_len == cache->files_max) {
+            void *tmp = realloc(cache->files, (cache->files_max + FILES_ALLOC_STEP) * sizeof(fcache_file_t));
             if (tmp == NULL) {
-                free(buf);
-                buf = NULL;
-                break;
+                return -ENOMEM;
             }
-            buf = tmp;
-            size *= 2;
+            cache->files = tmp;
+            cache->files_max += FILES_ALLOC_STEP;
+        }
+        memmove(&cache->files[i + 1], &cache->files[i], (cache->files_len - i) * sizeof(fcache_file_t));
+        cache->files_len++;
+        strncpy(cache->files[i].name, file_name, NAME_MAX + 1);
+        cache->files[i].priority = get_priority(cache, file_name);
+    }
+
+    fcache_file_t *file = &cache->files[i];
+    file->size = file_stat.st_size;
+    file->mtime = file_stat.st_mtime;
+    file->last_used = scanned ? file_stat.st_mtime : time(NULL);
+    cache->bytes += file->size;
+    return 0;
+}
+
+static void unindex_file(fcache_t *cache, uint32_t i) {
+    cache->bytes -= cache->files[i].size;
+    cache->files_len--;
+    memmove(&cache->files[i], &cache->files[i + 1], (cache->files_len - i) * sizeof(fcache_file_t));
+}
 
-            if (size > 10024) { // hard limit
-                free(buf);
-                buf = NULL;
-                break;
+static void unindex_name(fcache_t *cache, const char *file_name) {
+    bool found;
+    uint32_t i = find_file(cache, file_name, &found);
+    if (found) {
+        unindex_file(cache, i);
+    }
+}
+
+static bool over_quotas(fcache_t *cache, uint64_t new_bytes, uint32_t new_files) {
+    if ((cache->max_files != 0) && ((cache->files_len + new_files) > cache->max_files)) {
+        return true;
+    }
+    return (cache->max_bytes != 0) && ((cache->bytes + new_bytes) > cache->max_bytes);
+}
+
+// bytes to free for the filesystem to stay above min_free_percent with new_bytes more on it, 0 if none
+static uint64_t free_space_deficit(fcache_t *cache, uint64_t new_bytes) {
+    struct statvfs fs;
+    if ((cache->min_free_percent == 0) || (statvfs(cache->dir_path, &fs) < 0) || (fs.f_blocks == 0)) {
+        return 0;
+    }
+    uint64_t total = (uint64_t)fs.f_blocks * fs.f_frsize;
+    uint64_t avail = (uint64_t)fs.f_bavail * fs.f_frsize;
+    uint64_t wanted = (total * cache->min_free_percent / 100) + new_bytes;
+    return (wanted > avail) ? wanted - avail : 0;
+}
+
+/*
+ * Evict the lowest priority, least recently used files until new bytes/files fit within the quotas and the
+ * filesystem keeps min_free_percent free. Only as many bytes as the filesystem is short are evicted for the free
+ * space, and none when even an empty cache would not be enough, as then it's other data that fills it.
+ */
+static int make_room(fcache_t *cache, uint64_t new_bytes, uint32_t new_files) {
+    if ((cache->max_bytes != 0) && (new_bytes > cache->max_bytes)) {
+        return -EFBIG;
+    }
+
+    uint64_t deficit = free_space_deficit(cache, new_bytes);
+    if (deficit > cache->bytes) {
+        log_warning("fcache %s: filesystem is below %d%% free, but the cache only has %llu bytes to evict",
+                    cache->dir_path, cache->min_free_percent, (unsigned long long)cache->bytes);
+        deficit = 0;
+    }
+
+    char path[PATH_MAX];
+    uint64_t freed = 0;
+    while ((cache->files_len > 0) && (over_quotas(cache, new_bytes, new_files) || (freed < deficit))) {
+        uint32_t victim = 0;
+        for (uint32_t i = 1; i < cache->files_len; i++) {
+            fcache_file_t *file = &cache->files[i];
+            fcache_file_t *best = &cache->files[victim];
+            if ((file->priority < best->priority) ||
+                ((file->priority == best->priority) && (file->last_used < best->last_used))) {
+                victim = i;
             }
         }
 
-        if (offset == 1) { // first file name
-            buf[1] = '"';
-            offset++;
-            buf[offset] = '\0';
-        } else {
-            strncat(buf, ", \"", strlen(", \"") + 1);
-            offset += 3;
+        path_join(cache->dir_path, cache->files[victim].name, path, PATH_MAX);
+        if ((remove(path) == -1) && (errno != ENOENT)) {
+            int r = -errno;
+            log_error("fcache failed to evict %s: %d", path, -r);
+            return r;
         }
-        strncat(buf, dir->d_name, strlen(dir->d_name));
-        offset += strlen(dir->d_name);
-        buf[offset] = '"';
-        offset++;
-        buf[offset] = '\0';
-    }
-    closedir(d);
-    pthread_mutex_unlock(&cache->mutex);
-
-    if (buf != NULL) {
-        buf[offset] = ']';
-        offset++;
-        buf[offset] = '\0';
-        offset++;
+        log_info("fcache evicted %s (%llu bytes)", path, (unsigned long long)cache->files[victim].size);
+        freed += cache->files[victim].size;
+        unindex_file(cache, victim);
     }
-    return buf;
+    return 0;
 }
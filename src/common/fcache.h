@@ -5,25 +5,75 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
+
+#define FCACHE_PRIORITIES_MAX      8
+#define FCACHE_PRIORITY_PREFIX_LEN 32
+
+typedef struct {
+    char name[NAME_MAX + 1];
+    uint64_t size;
+    time_t mtime;
+    time_t last_used; // for LRU eviction
+    int8_t priority;  // lower priority files are evicted first
+} fcache_file_t;
+
+typedef struct {
+    char prefix[FCACHE_PRIORITY_PREFIX_LEN];
+    int8_t priority;
+} fcache_priority_t;
+
+typedef struct {
+    uint32_t offset;           // index of first matching file to list, files are sorted by name
+    uint32_t count;            // max files to list, 0 for no limit
+    char prefix[NAME_MAX + 1]; // only list files starting with prefix, empty for all
+    time_t newer_than;         // only list files with a mtime after this, 0 for all
+} fcache_filter_t;
 
 typedef struct {
     char dir_path[PATH_MAX];
     pthread_mutex_t mutex;
+    fcache_file_t *files; // index of the files in dir_path, so nothing has to readdir the cache
+    uint32_t files_len;
+    uint32_t files_max;
+    uint64_t bytes;
+    uint64_t max_bytes;       // 0 for no limit
+    uint32_t max_files;       // 0 for no limit
+    uint8_t min_free_percent; // min free space of the filesystem the cache is on, 0 for no limit
+    fcache_priority_t priorities[FCACHE_PRIORITIES_MAX];
+    uint8_t priorities_len;
 } fcache_t;
 
 fcache_t *fcache_init(char *dir_path);
 void fcache_free(fcache_t *cache);
 
+// limits are enforced when a file is added, files already in the cache are never evicted by setting them
+int fcache_set_limits(fcache_t *cache, uint64_t max_bytes, uint32_t max_files, uint8_t min_free_percent);
+// files starting with prefix get priority (default 0), the first matching prefix added wins
+int fcache_add_priority(fcache_t *cache, const char *prefix, int8_t priority);
+
 int fcache_add(fcache_t *cache, char *file_path, bool consume);
 int fcache_add_new(fcache_t *cache, char *file_name, uint8_t *file_data, uint32_t file_data_len);
 int fcache_delete(fcache_t *cache, char *file_name);
 int fcache_copy(fcache_t *cache, char *file_name, char *dest_dir);
 int fcache_move(fcache_t *cache, char *file_name, char *dest_dir);
+void fcache_touch(fcache_t *cache, char *file_name); // mark a file as used for LRU eviction
 
 uint32_t fcache_size(fcache_t *cache);
+uint64_t fcache_bytes(fcache_t *cache);
 
 bool fcache_file_exist(fcache_t *cache, char *file_name);
 
-char *fcache_list_files_as_json(fcache_t *cache); // non-NULL results must be freed
+// filter can be NULL to list all files, non-NULL results must be freed
+char *fcache_list_files_as_json(fcache_t *cache, const fcache_filter_t *filter);
+
+/*
+ * Compact little-endian listing: uint32 total matching files (before offset/count), uint16 number of entries, then
+ * per entry a uint32 size, uint32 mtime, uint8 name length, and the name without a '\0'.
+ */
+uint8_t *fcache_list_files_as_bin(fcache_t *cache, const fcache_filter_t *filter, size_t *out_len);
+
+// number of files matching filter (before offset/count), first (NAME_MAX + 1 long) gets the first listed name or ""
+uint32_t fcache_count(fcache_t *cache, const fcache_filter_t *filter, char *first);
 
 #endif
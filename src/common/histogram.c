@@ -0,0 +1,100 @@
+#include "histogram.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+static uint32_t bucket_index(uint32_t value) {
+    if (value < HISTOGRAM_SUB_LEN) {
+        return value;
+    }
+    uint32_t msb = 31 - __builtin_clz(value);
+    uint32_t sub = (value >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_LEN - 1);
+    return ((msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_LEN) + sub;
+}
+
+static uint32_t bucket_highest_value(uint32_t index) {
+    if (index < HISTOGRAM_SUB_LEN) {
+        return index;
+    }
+    uint32_t msb = (index / HISTOGRAM_SUB_LEN) + HISTOGRAM_SUB_BITS - 1;
+    uint32_t sub = index % HISTOGRAM_SUB_LEN;
+    uint32_t shift = msb - HISTOGRAM_SUB_BITS;
+    uint64_t lowest = ((uint64_t)(HISTOGRAM_SUB_LEN + sub)) << shift;
+    return (uint32_t)(lowest + (1ULL << shift) - 1);
+}
+
+void histogram_record(histogram_t *hist, uint32_t value) {
+    if (!hist) {
+        return;
+    }
+
+    __atomic_fetch_add(&hist->buckets[bucket_index(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, value, __ATOMIC_RELAXED);
+
+    uint32_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while ((value > max) &&
+           !__atomic_compare_exchange_n(&hist->max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void histogram_reset(histogram_t *hist) {
+    if (!hist) {
+        return;
+    }
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        __atomic_store_n(&hist->buckets[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&hist->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->sum, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->max, 0, __ATOMIC_RELAXED);
+}
+
+uint32_t histogram_percentile(const histogram_t *hist, double percentile) {
+    if (!hist) {
+        return 0;
+    }
+
+    // sum the buckets rather than trusting count, a concurrent record may have only updated one of them
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        total += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    if (percentile > 100.0) {
+        percentile = 100.0;
+    }
+    uint64_t target = (uint64_t)((percentile / 100.0) * total + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= target) {
+            uint32_t value = bucket_highest_value(i);
+            uint32_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+            return ((max != 0) && (value > max)) ? max : value;
+        }
+    }
+    return __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+}
+
+void histogram_summary(const histogram_t *hist, histogram_summary_t *summary) {
+    if (!hist || !summary) {
+        return;
+    }
+
+    uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+    uint64_t sum = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+    summary->count = (count > UINT32_MAX) ? UINT32_MAX : (uint32_t)count;
+    summary->mean = count ? (uint32_t)(sum / count) : 0;
+    summary->p50 = histogram_percentile(hist, 50.0);
+    summary->p90 = histogram_percentile(hist, 90.0);
+    summary->p99 = histogram_percentile(hist, 99.0);
+    summary->p999 = histogram_percentile(hist, 99.9);
+    summary->max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,39 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+
+/*
+ * Log-linear (HDR style) histogram of uint32 values. Values below 2^HISTOGRAM_SUB_BITS get exact buckets, every
+ * power of 2 above that is split into 2^HISTOGRAM_SUB_BITS linear buckets, so percentiles are within 12.5% of the
+ * real value over the full uint32 range in under 1 KiB. Recording is lock-free and safe from any thread.
+ */
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB_LEN  (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS  ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_LEN)
+
+typedef struct {
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint32_t max;
+} histogram_t;
+
+typedef struct {
+    uint32_t count; // saturates at UINT32_MAX
+    uint32_t mean;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t p999;
+    uint32_t max;
+} histogram_summary_t;
+
+void histogram_record(histogram_t *hist, uint32_t value);
+void histogram_reset(histogram_t *hist);
+
+// highest value equivalent to the bucket holding the percentile (0.0 to 100.0), 0 if empty
+uint32_t histogram_percentile(const histogram_t *hist, double percentile);
+void histogram_summary(const histogram_t *hist, histogram_summary_t *summary);
+
+#endif
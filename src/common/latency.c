@@ -0,0 +1,45 @@
+#include "latency.h"
+#include "histogram.h"
+#include <stddef.h>
+#include <stdint.h>
+
+static histogram_t histograms[LATENCY_LEN];
+
+static const char *names[LATENCY_LEN] = {
+    "rt_cycle",
+    "rt_jitter",
+    "sdo_server",
+    "sdo_client",
+    "ipc_sdo_read",
+    "ipc_sdo_write",
+    "ipc_add_file",
+    "ipc_sdo_read_to_file",
+    "ipc_sdo_write_from_file",
+    "ipc_other",
+};
+
+void latency_record(latency_id_t id, uint32_t us) {
+    if ((uint32_t)id < LATENCY_LEN) {
+        histogram_record(&histograms[id], us);
+    }
+}
+
+void latency_reset(latency_id_t id) {
+    if ((uint32_t)id < LATENCY_LEN) {
+        histogram_reset(&histograms[id]);
+    }
+}
+
+void latency_reset_all(void) {
+    for (uint32_t i = 0; i < LATENCY_LEN; i++) {
+        histogram_reset(&histograms[i]);
+    }
+}
+
+const histogram_t *latency_get(latency_id_t id) {
+    return ((uint32_t)id < LATENCY_LEN) ? &histograms[id] : NULL;
+}
+
+const char *latency_name(latency_id_t id) {
+    return ((uint32_t)id < LATENCY_LEN) ? names[id] : NULL;
+}
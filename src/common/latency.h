@@ -0,0 +1,31 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include "histogram.h"
+#include <stdint.h>
+
+// fixed set of latency histograms kept by the daemon, values are in microseconds
+typedef enum {
+    LATENCY_RT_CYCLE = 0,                // time spent processing one RT thread cycle
+    LATENCY_RT_JITTER = 1,               // RT thread wakeup period error vs the configured interval
+    LATENCY_SDO_SERVER = 2,              // SDO server transfer, from leaving idle to idle again
+    LATENCY_SDO_CLIENT = 3,              // SDO client transfer
+    LATENCY_IPC_SDO_READ = 4,            // IPC requests, from receiving the request to sending the reply
+    LATENCY_IPC_SDO_WRITE = 5,
+    LATENCY_IPC_ADD_FILE = 6,
+    LATENCY_IPC_SDO_READ_TO_FILE = 7,
+    LATENCY_IPC_SDO_WRITE_FROM_FILE = 8,
+    LATENCY_IPC_OTHER = 9,               // any other IPC request
+} latency_id_t;
+
+#define LATENCY_LEN 10
+
+void latency_record(latency_id_t id, uint32_t us);
+void latency_reset(latency_id_t id);
+void latency_reset_all(void);
+
+// NULL for an unknown id
+const histogram_t *latency_get(latency_id_t id);
+const char *latency_name(latency_id_t id);
+
+#endif
@@ -1,9 +1,35 @@
 #include "logger.h"
-#include <libgen.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/syslog.h>
+#include <time.h>
+
+#define LOG_MSG_MAX_LEN        256
+#define LOG_RING_SLOTS         128 // must be a power of 2
+#define LOG_WRITER_INTERVAL_MS 20
+
+typedef struct {
+    int level;
+    uint32_t line;
+    const char *file; // always a string literal (__FILE__) or NULL
+    char msg[LOG_MSG_MAX_LEN];
+} log_record_t;
+
+// single producer (the owning thread), single consumer (the writer thread)
+typedef struct log_ring_t {
+    log_record_t slots[LOG_RING_SLOTS];
+    uint32_t head;      // next slot to write, only written by producer
+    uint32_t tail;      // next slot to read, only written by consumer
+    uint32_t dropped;   // messages lost to a full ring
+    bool free;          // owning thread exited, ring can be reused
+    struct log_ring_t *next;
+} log_ring_t;
 
 static char *LOG_LEVEL_STR[] = {
     "DEBUG", "INFO", "NOTICE", "WARNINNG", "ERROR", "CRITIAL", "ALERT", "EMERGENCY", "UNKNOWN",
@@ -11,6 +37,15 @@ static char *LOG_LEVEL_STR[] = {
 
 static int log_level = LOG_INFO;
 
+static bool async_running = false;
+static log_sink_t async_sink = LOG_SINK_STDOUT;
+static pthread_t writer_thread_id;
+static pthread_key_t ring_key;
+static bool ring_key_created = false;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static log_ring_t *rings = NULL;
+static __thread log_ring_t *thread_ring = NULL;
+
 int log_level_get(void) {
     return log_level;
 }
@@ -53,19 +88,185 @@ char *log_level_get_str(int level) {
     return name;
 }
 
-void log_message(int level, char *file, uint32_t line, const char *fmt, ...) {
+static void log_write(log_sink_t sink, int level, const char *file, uint32_t line, const char *msg) {
+    if (sink == LOG_SINK_SYSLOG) {
+        if (file) {
+            syslog(level, "%s:%u - %s", file, line, msg);
+        } else {
+            syslog(level, "%s", msg);
+        }
+    } else if (file) {
+        printf("%s: %s:%u - %s\n", log_level_get_str(level), file, line, msg);
+    } else {
+        printf("%s: %s\n", log_level_get_str(level), msg);
+    }
+}
+
+// basename() may modify its arg, __FILE__ is a literal
+static const char *file_basename(const char *file) {
+    if (!file) {
+        return NULL;
+    }
+    const char *name = strrchr(file, '/');
+    return name ? name + 1 : file;
+}
+
+static void ring_release(void *arg) {
+    log_ring_t *ring = arg;
+    __atomic_store_n(&ring->free, true, __ATOMIC_RELEASE);
+}
+
+static log_ring_t *get_thread_ring(void) {
+    if (thread_ring) {
+        return thread_ring;
+    }
+
+    pthread_mutex_lock(&rings_mutex);
+    log_ring_t *ring = rings;
+    for (; ring != NULL; ring = ring->next) { // reuse the ring of an exited thread
+        if (__atomic_load_n(&ring->free, __ATOMIC_ACQUIRE)) {
+            ring->free = false;
+            break;
+        }
+    }
+    if (!ring) {
+        ring = calloc(1, sizeof(log_ring_t));
+        if (ring) {
+            ring->next = rings;
+            __atomic_store_n(&rings, ring, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&rings_mutex);
+
+    if (ring) {
+        pthread_setspecific(ring_key, ring);
+        thread_ring = ring;
+    }
+    return ring;
+}
+
+static bool ring_push(int level, const char *file, uint32_t line, const char *fmt, va_list args) {
+    log_ring_t *ring = get_thread_ring();
+    if (!ring) {
+        return false;
+    }
+
+    uint32_t head = ring->head;
+    if ((head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= LOG_RING_SLOTS) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    log_record_t *record = &ring->slots[head & (LOG_RING_SLOTS - 1)];
+    record->level = level;
+    record->file = file;
+    record->line = line;
+    vsnprintf(record->msg, sizeof(record->msg), fmt, args);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void rings_drain(void) {
+    log_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    bool wrote = false;
+
+    for (; ring != NULL; ring = ring->next) {
+        uint32_t tail = ring->tail;
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for (; tail != head; tail++) {
+            log_record_t *record = &ring->slots[tail & (LOG_RING_SLOTS - 1)];
+            log_write(async_sink, record->level, file_basename(record->file), record->line, record->msg);
+            wrote = true;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        uint32_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped > 0) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "dropped %u log message(s)", dropped);
+            log_write(async_sink, LOG_WARNING, NULL, 0, msg);
+            wrote = true;
+        }
+    }
+
+    if (wrote && (async_sink == LOG_SINK_STDOUT)) {
+        fflush(stdout); // one write per batch
+    }
+}
+
+static void *log_writer_thread(void *arg) {
+    (void)arg;
+    struct timespec ts = {
+        .tv_sec = 0,
+        .tv_nsec = LOG_WRITER_INTERVAL_MS * 1000000L,
+    };
+    while (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+        rings_drain();
+        nanosleep(&ts, NULL);
+    }
+    rings_drain();
+    return NULL;
+}
+
+int log_async_start(log_sink_t sink) {
+    if (async_running) {
+        return -EALREADY;
+    }
+
+    int r;
+    if (!ring_key_created) { // kept on stop, threads may still own rings
+        r = pthread_key_create(&ring_key, ring_release);
+        if (r != 0) {
+            return -r;
+        }
+        ring_key_created = true;
+    }
+
+    async_sink = sink;
+    if (sink == LOG_SINK_SYSLOG) {
+        openlog(NULL, LOG_NDELAY, LOG_DAEMON);
+    }
+
+    __atomic_store_n(&async_running, true, __ATOMIC_RELEASE);
+    r = pthread_create(&writer_thread_id, NULL, log_writer_thread, NULL);
+    if (r != 0) {
+        __atomic_store_n(&async_running, false, __ATOMIC_RELEASE);
+        return -r;
+    }
+    return 0;
+}
+
+void log_async_stop(void) {
+    if (!async_running) {
+        return;
+    }
+
+    __atomic_store_n(&async_running, false, __ATOMIC_RELEASE);
+    pthread_join(writer_thread_id, NULL);
+    if (async_sink == LOG_SINK_SYSLOG) {
+        closelog();
+    }
+    async_sink = LOG_SINK_STDOUT;
+    // rings are left allocated, other threads may still hold them
+}
+
+void log_vmessage(int level, const char *file, uint32_t line, const char *fmt, va_list args) {
     if (level > log_level) {
         return;
     }
 
-    va_list args1;
-    va_start(args1, fmt);
-    va_list args2;
-    va_copy(args2, args1);
-    char buf[1 + vsnprintf(NULL, 0, fmt, args1)];
-    va_end(args1);
-    vsnprintf(buf, sizeof buf, fmt, args2);
-    va_end(args2);
+    if (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE) && ring_push(level, file, line, fmt, args)) {
+        return;
+    }
 
-    printf("%s: %s:%d - %s\n", log_level_get_str(level), basename(file), line, buf);
+    char buf[LOG_MSG_MAX_LEN];
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    log_write(LOG_SINK_STDOUT, level, file_basename(file), line, buf);
+}
+
+void log_message(int level, char *file, uint32_t line, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    log_vmessage(level, file, line, fmt, args);
+    va_end(args);
 }
@@ -1,21 +1,51 @@
 #ifndef _LOGGER_H_
 #define _LOGGER_H_
 
+#include <stdarg.h>
 #include <stdint.h>
 #include <sys/syslog.h>
 
+/*
+ * Calls above this level are removed at compile time, e.g. -DLOG_COMPILE_LEVEL=LOG_INFO drops all log_debug calls
+ * (the args are still type checked).
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+typedef enum {
+    LOG_SINK_STDOUT,
+    LOG_SINK_SYSLOG, // syslog is the journal under systemd, keeps the level as the priority
+} log_sink_t;
+
 int log_level_get(void);
 void log_level_set(int level);
 char *log_level_get_str(int level);
 void log_message(int level, char *file, uint32_t line, const char *fmt, ...);
+void log_vmessage(int level, const char *file, uint32_t line, const char *fmt, va_list args); // file can be NULL
+
+/*
+ * Move output to a writer thread. After this log calls only format into a per-thread lock-free ring buffer and
+ * never block; messages are dropped (and counted) if a ring is full. Until started, or after stopped, messages are
+ * written synchronously.
+ */
+int log_async_start(log_sink_t sink);
+void log_async_stop(void); // flushes all pending messages
+
+#define log_at_level(level, fmt, ...)                                                                                 \
+    do {                                                                                                               \
+        if ((level) <= LOG_COMPILE_LEVEL) {                                                                            \
+            log_message(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__);                                                \
+        }                                                                                                              \
+    } while (0)
 
-#define log_debug(fmt, ...)     log_message(LOG_DEBUG, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define log_info(fmt, ...)      log_message(LOG_INFO, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define log_notice(fmt, ...)    log_message(LOG_NOTICE, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define log_warning(fmt, ...)   log_message(LOG_WARNING, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define log_error(fmt, ...)     log_message(LOG_ERR, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define log_critical(fmt, ...)  log_message(LOG_CRIT, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define log_alert(fmt, ...)     log_message(LOG_ALERT, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define log_emergency(fmt, ...) log_message(LOG_EMERG, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#define log_debug(fmt, ...)     log_at_level(LOG_DEBUG, fmt, ##__VA_ARGS__)
+#define log_info(fmt, ...)      log_at_level(LOG_INFO, fmt, ##__VA_ARGS__)
+#define log_notice(fmt, ...)    log_at_level(LOG_NOTICE, fmt, ##__VA_ARGS__)
+#define log_warning(fmt, ...)   log_at_level(LOG_WARNING, fmt, ##__VA_ARGS__)
+#define log_error(fmt, ...)     log_at_level(LOG_ERR, fmt, ##__VA_ARGS__)
+#define log_critical(fmt, ...)  log_at_level(LOG_CRIT, fmt, ##__VA_ARGS__)
+#define log_alert(fmt, ...)     log_at_level(LOG_ALERT, fmt, ##__VA_ARGS__)
+#define log_emergency(fmt, ...) log_at_level(LOG_EMERG, fmt, ##__VA_ARGS__)
 
 #endif
@@ -0,0 +1,239 @@
+#include "metrics.h"
+#include "fcache.h"
+#include "logger.h"
+#include "system.h"
+#include <errno.h>
+#include <glob.h>
+#include <inttypes.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <sys/sysinfo.h>
+
+#define PROC_STAT     "/proc/stat"
+#define THERMAL_GLOB  "/sys/class/thermal/thermal_zone*/temp"
+#define LINE_LEN      256
+#define STOP_CHECK_MS 250
+#define CACHES_LEN    2
+
+static metrics_t metrics = {0};
+static fcache_t *caches[CACHES_LEN] = {NULL};
+static uint32_t caches_len[CACHES_LEN] = {0};
+static char zone_paths[METRICS_ZONES_MAX][PATH_MAX];
+static uint8_t zones = 0;
+static cpu_times_t cpu_prev = {0};
+static cpu_times_t core_prev[METRICS_CORES_MAX] = {0};
+static uint32_t fast_period_ms = METRICS_DEFAULT_FAST_MS;
+static uint32_t slow_period_ms = METRICS_DEFAULT_SLOW_MS;
+static bool running = false;
+static pthread_t thread_id;
+
+#define STORE(dst, value) __atomic_store_n(&(dst), (value), __ATOMIC_RELAXED)
+#define LOAD(src)         __atomic_load_n(&(src), __ATOMIC_RELAXED)
+
+int parse_cpu_times(const char *line, int *core, cpu_times_t *times) {
+    if (strncmp(line, "cpu", 3) != 0) {
+        return -EINVAL;
+    }
+    const char *fields = &line[3];
+    *core = -1;
+    if (*fields != ' ') {
+        char *end = NULL;
+        *core = (int)strtol(fields, &end, 10);
+        if ((end == fields) || (*end != ' ')) {
+            return -EINVAL;
+        }
+        fields = end;
+    }
+
+    // user nice system idle iowait irq softirq steal, guest time is already counted in user
+    uint64_t v[8] = {0};
+    int n = sscanf(fields, " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                           " %" SCNu64,
+                   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+    if (n < 4) {
+        return -EINVAL;
+    }
+    times->total = 0;
+    for (int i = 0; i < n; i++) {
+        times->total += v[i];
+    }
+    times->busy = times->total - v[3] - v[4]; // idle and iowait
+    return 0;
+}
+
+uint8_t cpu_busy_percent(const cpu_times_t *prev, const cpu_times_t *now) {
+    if ((now->total <= prev->total) || (now->busy < prev->busy)) {
+        return 0;
+    }
+    uint64_t busy = now->busy - prev->busy;
+    uint64_t total = now->total - prev->total;
+    return (uint8_t)(busy >= total ? 100 : (busy * 100) / total);
+}
+
+static void sample_cpu(void) {
+    FILE *fp = fopen(PROC_STAT, "r");
+    if (fp == NULL) {
+        return;
+    }
+    char line[LINE_LEN];
+    uint8_t cores = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        int core;
+        cpu_times_t now;
+        if (parse_cpu_times(line, &core, &now) < 0) {
+            break; // the cpu lines are first
+        } else if (core < 0) {
+            STORE(metrics.cpu_percent, cpu_busy_percent(&cpu_prev, &now));
+            cpu_prev = now;
+        } else if (core < METRICS_CORES_MAX) {
+            STORE(metrics.core_percent[core], cpu_busy_percent(&core_prev[core], &now));
+            core_prev[core] = now;
+            cores = (core + 1 > cores) ? core + 1 : cores;
+        }
+    }
+    fclose(fp);
+    STORE(metrics.cores, cores);
+}
+
+static void sample_ram(void) {
+    struct sysinfo info;
+    if ((sysinfo(&info) >= 0) && (info.totalram > 0)) {
+        STORE(metrics.ram_percent, (uint8_t)(((info.totalram - info.freeram) * 100) / info.totalram));
+    }
+}
+
+static void sample_storage(void) {
+    struct statvfs fiData;
+    if ((statvfs("/", &fiData) >= 0) && (fiData.f_blocks > 0)) {
+        STORE(metrics.storage_percent, (uint8_t)(((fiData.f_blocks - fiData.f_bavail) * 100) / fiData.f_blocks));
+    }
+}
+
+static void sample_caches(void) {
+    for (int i = 0; i < CACHES_LEN; i++) {
+        if (caches[i] != NULL) {
+            STORE(caches_len[i], fcache_size(caches[i]));
+        }
+    }
+}
+
+static void find_zones(void) {
+    glob_t g;
+    zones = 0;
+    if (glob(THERMAL_GLOB, 0, NULL, &g) != 0) {
+        return; // no thermal zones, e.g. in a vm
+    }
+    for (size_t i = 0; (i < g.gl_pathc) && (zones < METRICS_ZONES_MAX); i++) {
+        snprintf(zone_paths[zones++], PATH_MAX, "%s", g.gl_pathv[i]);
+    }
+    globfree(&g);
+}
+
+static void sample_temperatures(void) {
+    int8_t hottest = INT8_MIN;
+    for (uint8_t i = 0; i < zones; i++) {
+        FILE *fp = fopen(zone_paths[i], "r");
+        long milli_c = 0;
+        if (fp != NULL) {
+            if (fscanf(fp, "%ld", &milli_c) != 1) {
+                milli_c = 0;
+            }
+            fclose(fp);
+        }
+        long c = milli_c / 1000;
+        int8_t temp = (int8_t)((c > INT8_MAX) ? INT8_MAX : (c < INT8_MIN) ? INT8_MIN : c);
+        STORE(metrics.zone_temperature[i], temp);
+        hottest = (temp > hottest) ? temp : hottest;
+    }
+    STORE(metrics.zones, zones);
+    STORE(metrics.temperature, (zones > 0) ? hottest : 0);
+}
+
+static void *metrics_thread(void *arg) {
+    (void)arg;
+    uint32_t fast_elapsed_ms = 0;
+    uint32_t slow_elapsed_ms = 0;
+    while (running) {
+        sleep_ms(STOP_CHECK_MS);
+        fast_elapsed_ms += STOP_CHECK_MS;
+        slow_elapsed_ms += STOP_CHECK_MS;
+        if (fast_elapsed_ms >= fast_period_ms) {
+            fast_elapsed_ms = 0;
+            sample_cpu();
+            sample_ram();
+            sample_caches();
+        }
+        if (slow_elapsed_ms >= slow_period_ms) {
+            slow_elapsed_ms = 0;
+            sample_storage();
+            sample_temperatures();
+        }
+    }
+    return NULL;
+}
+
+int metrics_init(fcache_t *fread_cache, fcache_t *fwrite_cache, uint32_t fast_ms, uint32_t slow_ms) {
+    if (running || (fast_ms == 0) || (slow_ms == 0)) {
+        return -EINVAL;
+    }
+    caches[0] = fread_cache;
+    caches[1] = fwrite_cache;
+    fast_period_ms = fast_ms;
+    slow_period_ms = slow_ms;
+    find_zones();
+
+    // cpu usage is relative to the previous sample, this first one is the usage since boot
+    sample_cpu();
+    sample_ram();
+    sample_caches();
+    sample_storage();
+    sample_temperatures();
+
+    running = true;
+    int r = pthread_create(&thread_id, NULL, metrics_thread, NULL);
+    if (r != 0) {
+        running = false;
+        return -r;
+    }
+    return 0;
+}
+
+void metrics_free(void) {
+    if (!running) {
+        return;
+    }
+    running = false;
+    pthread_join(thread_id, NULL);
+    caches[0] = NULL;
+    caches[1] = NULL;
+}
+
+void metrics_get(metrics_t *out) {
+    out->storage_percent = LOAD(metrics.storage_percent);
+    out->ram_percent = LOAD(metrics.ram_percent);
+    out->cpu_percent = LOAD(metrics.cpu_percent);
+    out->cores = LOAD(metrics.cores);
+    for (int i = 0; i < METRICS_CORES_MAX; i++) {
+        out->core_percent[i] = LOAD(metrics.core_percent[i]);
+    }
+    out->temperature = LOAD(metrics.temperature);
+    out->zones = LOAD(metrics.zones);
+    for (int i = 0; i < METRICS_ZONES_MAX; i++) {
+        out->zone_temperature[i] = LOAD(metrics.zone_temperature[i]);
+    }
+}
+
+uint32_t metrics_fcache_len(fcache_t *cache) {
+    for (int i = 0; (cache != NULL) && (i < CACHES_LEN); i++) {
+        if (caches[i] == cache) {
+            return LOAD(caches_len[i]);
+        }
+    }
+    return fcache_size(cache);
+}
@@ -0,0 +1,46 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include "fcache.h"
+#include <stdint.h>
+
+/*
+ * System metrics sampled from a thread, so OD reads and PDOs only load the last sample and never make syscalls or
+ * take the fcache mutex. CPU and RAM usage and the cache lengths are sampled every fast_ms, storage usage and
+ * temperatures every slow_ms. Every field is stored and loaded atomically.
+ */
+
+#define METRICS_DEFAULT_FAST_MS 1000
+#define METRICS_DEFAULT_SLOW_MS 10000
+#define METRICS_CORES_MAX       8
+#define METRICS_ZONES_MAX       8
+
+typedef struct {
+    uint8_t storage_percent;
+    uint8_t ram_percent;
+    uint8_t cpu_percent; // all cores, over the last fast period
+    uint8_t cores;
+    uint8_t core_percent[METRICS_CORES_MAX];
+    int8_t temperature; // hottest thermal zone in C, 0 with no zones
+    uint8_t zones;
+    int8_t zone_temperature[METRICS_ZONES_MAX]; // C, in thermal_zone order
+} metrics_t;
+
+typedef struct {
+    uint64_t busy;
+    uint64_t total;
+} cpu_times_t;
+
+// either cache can be NULL, the first sample is taken before this returns
+int metrics_init(fcache_t *fread_cache, fcache_t *fwrite_cache, uint32_t fast_ms, uint32_t slow_ms);
+void metrics_free(void);
+
+void metrics_get(metrics_t *metrics);
+// the sampled file count of the cache, or a direct fcache_size() for caches not given to metrics_init()
+uint32_t metrics_fcache_len(fcache_t *cache);
+
+// parses a /proc/stat cpu line, core is -1 for the "cpu" all cores line, returns 0 or a negative errno
+int parse_cpu_times(const char *line, int *core, cpu_times_t *times);
+uint8_t cpu_busy_percent(const cpu_times_t *prev, const cpu_times_t *now);
+
+#endif
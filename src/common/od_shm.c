@@ -0,0 +1,126 @@
+#include "od_shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SPINS_BEFORE_SLEEP 100
+#define WAIT_SLEEP_NS      1000
+#define WAIT_MAX_SPINS     (SPINS_BEFORE_SLEEP + 10000) // a daemon that died mid write leaves the count odd
+
+static bool header_valid(const od_shm_header_t *header, size_t len) {
+    if ((len < sizeof(od_shm_header_t)) || (header->magic != OD_SHM_MAGIC) || (header->version != OD_SHM_VERSION) ||
+        (header->entry_size != sizeof(od_shm_entry_t))) {
+        return false;
+    }
+    uint64_t table_end = sizeof(od_shm_header_t) + ((uint64_t)header->entries_len * sizeof(od_shm_entry_t));
+    return (table_end <= header->data_offset) && (((uint64_t)header->data_offset + header->data_len) <= len);
+}
+
+int od_shm_open(od_shm_t *shm, const char *name) {
+    if (!shm) {
+        return -EINVAL;
+    }
+    memset(shm, 0, sizeof(od_shm_t));
+    int fd = shm_open(name ? name : OD_SHM_NAME, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int r = -errno;
+        close(fd);
+        return r;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -errno;
+    }
+    if (!header_valid(base, st.st_size)) {
+        munmap(base, st.st_size);
+        return -EPROTO;
+    }
+    shm->base = base;
+    shm->len = st.st_size;
+    shm->header = base;
+    shm->entries = (const od_shm_entry_t *)&shm->header[1];
+    shm->data = (const uint8_t *)base + shm->header->data_offset;
+    return 0;
+}
+
+void od_shm_close(od_shm_t *shm) {
+    if (shm && shm->base) {
+        munmap(shm->base, shm->len);
+        memset(shm, 0, sizeof(od_shm_t));
+    }
+}
+
+int od_shm_find(const od_shm_t *shm, uint16_t index, uint8_t subindex) {
+    if (!shm || !shm->base) {
+        return -EINVAL;
+    }
+    uint32_t key = ((uint32_t)index << 8) | subindex;
+    int low = 0;
+    int high = (int)shm->header->entries_len - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        uint32_t mid_key = ((uint32_t)shm->entries[mid].index << 8) | shm->entries[mid].subindex;
+        if (mid_key == key) {
+            return mid;
+        } else if (mid_key < key) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -ENOENT;
+}
+
+int od_shm_read_pos(const od_shm_t *shm, uint32_t pos, void *buf, size_t buf_len, uint32_t *seq) {
+    if (!shm || !shm->base || !buf || (pos >= shm->header->entries_len)) {
+        return -EINVAL;
+    }
+    const od_shm_entry_t *entry = &shm->entries[pos];
+    size_t len = (entry->len < buf_len) ? entry->len : buf_len;
+    if (((uint64_t)entry->offset + len) > shm->header->data_len) {
+        return -EINVAL;
+    }
+    uint32_t spins = 0;
+    uint32_t start;
+    while (true) {
+        start = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if (start & 1) { // the daemon is writing it
+            if (__atomic_load_n(&shm->header->magic, __ATOMIC_RELAXED) != OD_SHM_MAGIC) {
+                return -ESTALE;
+            } else if (spins >= WAIT_MAX_SPINS) {
+                return -EAGAIN;
+            } else if (spins++ >= SPINS_BEFORE_SLEEP) {
+                nanosleep(&(struct timespec){.tv_nsec = WAIT_SLEEP_NS}, NULL);
+            }
+            continue;
+        }
+        memcpy(buf, &shm->data[entry->offset], len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == start) {
+            break;
+        }
+    }
+    if (__atomic_load_n(&shm->header->magic, __ATOMIC_ACQUIRE) != OD_SHM_MAGIC) {
+        return -ESTALE; // the daemon stopped, a new one makes a new segment
+    }
+    if (seq) {
+        *seq = start;
+    }
+    return (int)len;
+}
+
+int od_shm_read(const od_shm_t *shm, uint16_t index, uint8_t subindex, void *buf, size_t buf_len) {
+    int pos = od_shm_find(shm, index, subindex);
+    return (pos < 0) ? pos : od_shm_read_pos(shm, pos, buf, buf_len, NULL);
+}
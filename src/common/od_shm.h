@@ -0,0 +1,65 @@
+#ifndef _OD_SHM_H_
+#define _OD_SHM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Snapshot of the app OD entries (index 0x4000 and up, the ones in the ipc od write broadcasts) that oresat-cand
+ * keeps in a POSIX shared memory segment, so local processes can read any current value without an ipc message.
+ * Writes still go through the ipc consumer.
+ *
+ * The segment is a header, a table of entries sorted by index and subindex, then the data area. Each entry has a
+ * sequence count that is odd while the daemon writes the value and is bumped by 2 for each write, a reader copies the
+ * value and retries if the count was odd or changed. All fields are little endian. When the daemon stops it clears
+ * the magic, reads then fail with -ESTALE and the segment has to be opened again.
+ *
+ * Only libc is needed for the reader, so apps can use it without the rest of oresat-cand.
+ */
+
+#define OD_SHM_NAME    "/oresat-cand-od"
+#define OD_SHM_MAGIC   0x4D53444FU // "ODSM"
+#define OD_SHM_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size; // sizeof(od_shm_entry_t)
+    uint32_t entries_len;
+    uint32_t data_offset; // from the start of the segment, 8 byte aligned
+    uint32_t data_len;
+    uint32_t table_crc; // crc32 of the uint16 index, uint8 subindex, and uint32 len of each entry
+    uint64_t start_ns;  // CLOCK_REALTIME when the daemon made the segment
+} od_shm_header_t;
+
+typedef struct {
+    uint32_t seq;
+    uint16_t index;
+    uint8_t subindex;
+    uint8_t reserved;
+    uint32_t offset; // in the data area, 8 byte aligned
+    uint32_t len;    // strings are null padded to it
+} od_shm_entry_t;
+
+typedef struct {
+    void *base;
+    size_t len;
+    const od_shm_header_t *header;
+    const od_shm_entry_t *entries;
+    const uint8_t *data;
+} od_shm_t;
+
+// name NULL is OD_SHM_NAME, returns 0 or a negative errno (-EPROTO for an unknown layout)
+int od_shm_open(od_shm_t *shm, const char *name);
+void od_shm_close(od_shm_t *shm);
+
+// position of the entry in the table to read it by, or -ENOENT; positions stay valid until the segment is reopened
+int od_shm_find(const od_shm_t *shm, uint16_t index, uint8_t subindex);
+/*
+ * Copies up to buf_len bytes of the value at pos, returns the length copied, -EINVAL, -ESTALE, or -EAGAIN if a write
+ * never finished. seq (can be NULL) is set to the entry's count, which changes with every write.
+ */
+int od_shm_read_pos(const od_shm_t *shm, uint32_t pos, void *buf, size_t buf_len, uint32_t *seq);
+int od_shm_read(const od_shm_t *shm, uint16_t index, uint8_t subindex, void *buf, size_t buf_len);
+
+#endif
@@ -0,0 +1,306 @@
+#include "scheduler.h"
+#include "ecss_time.h"
+#include "logger.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TIMER_SLACK_NS 1 // the default 50 us slack of non rt threads is more than the firing error
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static sched_action_t heap[SCHEDULER_MAX_ACTIONS];
+static uint16_t heap_len = 0;
+static uint64_t next_seq = 0;
+static sched_fire_cb_t fire = NULL;
+static int priority = 0;
+static int timer_fd = -1;
+static int event_fd = -1;
+static bool running = false;
+static pthread_t thread_id;
+static scheduler_stats_t stats;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static bool before(const sched_action_t *a, const sched_action_t *b) {
+    return (a->time_ns < b->time_ns) || ((a->time_ns == b->time_ns) && (a->seq < b->seq));
+}
+
+static void sift_up(uint16_t i) {
+    while (i > 0) {
+        uint16_t parent = (i - 1) / 2;
+        if (!before(&heap[i], &heap[parent])) {
+            break;
+        }
+        sched_action_t tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+static void sift_down(uint16_t i) {
+    while (true) {
+        uint16_t first = i;
+        uint16_t left = (2 * i) + 1;
+        uint16_t right = left + 1;
+        if ((left < heap_len) && before(&heap[left], &heap[first])) {
+            first = left;
+        }
+        if ((right < heap_len) && before(&heap[right], &heap[first])) {
+            first = right;
+        }
+        if (first == i) {
+            break;
+        }
+        sched_action_t tmp = heap[i];
+        heap[i] = heap[first];
+        heap[first] = tmp;
+        i = first;
+    }
+}
+
+// must hold the mutex
+static void heap_pop(void) {
+    heap[0] = heap[--heap_len];
+    sift_down(0);
+}
+
+// must hold the mutex
+static void update_stats(void) {
+    ecss_scet_t scet = {.raw = 0};
+    if (heap_len > 0) {
+        ecss_scet_from_ns(heap[0].time_ns, &scet);
+    }
+    __atomic_store_n(&stats.pending, heap_len, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats.next_scet, scet.raw, __ATOMIC_RELAXED);
+}
+
+static void wake(void) {
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) < 0) {
+        log_error("scheduler wake write failed: %d", errno);
+    }
+}
+
+// a zero it_value disarms the timer when there is nothing pending
+static void arm_timer(uint64_t time_ns) {
+    struct itimerspec its = {0};
+    if (time_ns != 0) {
+        its.it_value.tv_sec = time_ns / 1000000000ULL;
+        its.it_value.tv_nsec = time_ns % 1000000000ULL;
+    }
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL) < 0) {
+        log_error("scheduler timerfd_settime failed: %d", errno);
+    }
+}
+
+static void record_late(int64_t late_ns) {
+    uint32_t late_us = (late_ns <= 0) ? 0 : (late_ns / 1000 > UINT32_MAX) ? UINT32_MAX : (uint32_t)(late_ns / 1000);
+    __atomic_store_n(&stats.late_last_us, late_us, __ATOMIC_RELAXED);
+    if (late_us > __atomic_load_n(&stats.late_max_us, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&stats.late_max_us, late_us, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&stats.fired, 1, __ATOMIC_RELAXED);
+}
+
+static void fire_due(void) {
+    while (true) {
+        pthread_mutex_lock(&mutex);
+        uint64_t now = now_ns();
+        if ((heap_len == 0) || (heap[0].time_ns > now)) {
+            pthread_mutex_unlock(&mutex);
+            return;
+        }
+        sched_action_t action = heap[0];
+        heap_pop();
+        update_stats();
+        pthread_mutex_unlock(&mutex);
+
+        int64_t late_ns = (int64_t)(now - action.time_ns);
+        record_late(late_ns);
+        if (fire) {
+            fire(&action, late_ns);
+        }
+        free(action.data);
+    }
+}
+
+static void *scheduler_thread(void *arg) {
+    (void)arg;
+    prctl(PR_SET_TIMERSLACK, TIMER_SLACK_NS);
+    if (priority > 0) {
+        struct sched_param param = {.sched_priority = priority};
+        int r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (r != 0) {
+            log_error("failed to set scheduler thread priority: %d", r);
+        }
+    }
+
+    struct pollfd fds[2] = {
+        {.fd = timer_fd, .events = POLLIN},
+        {.fd = event_fd, .events = POLLIN},
+    };
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        fire_due();
+
+        pthread_mutex_lock(&mutex);
+        arm_timer((heap_len > 0) ? heap[0].time_ns : 0);
+        pthread_mutex_unlock(&mutex);
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno != EINTR) {
+                log_error("scheduler poll failed: %d", errno);
+            }
+            continue;
+        }
+        uint64_t value;
+        if ((fds[0].revents & POLLIN) && (read(timer_fd, &value, sizeof(value)) < 0) && (errno == ECANCELED)) {
+            log_debug("clock was set, rearming the scheduler timer");
+        }
+        if (fds[1].revents & POLLIN) {
+            (void)!read(event_fd, &value, sizeof(value)); // an action was added or canceled
+        }
+    }
+    return NULL;
+}
+
+int scheduler_init(sched_fire_cb_t fire_cb, int rt_priority) {
+    if (running) {
+        return -EALREADY;
+    }
+    timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((timer_fd < 0) || (event_fd < 0)) {
+        int r = -errno;
+        scheduler_free();
+        return r;
+    }
+    fire = fire_cb;
+    priority = rt_priority;
+    stats = (scheduler_stats_t){0};
+
+    running = true;
+    int r = pthread_create(&thread_id, NULL, scheduler_thread, NULL);
+    if (r != 0) {
+        running = false;
+        scheduler_free();
+        return -r;
+    }
+    return 0;
+}
+
+void scheduler_free(void) {
+    if (running) {
+        __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+        wake();
+        pthread_join(thread_id, NULL);
+    }
+    scheduler_cancel(0);
+    if (timer_fd >= 0) {
+        close(timer_fd);
+        timer_fd = -1;
+    }
+    if (event_fd >= 0) {
+        close(event_fd);
+        event_fd = -1;
+    }
+    fire = NULL;
+}
+
+int scheduler_add(uint32_t id, const ecss_scet_t *scet, uint8_t type, const void *data, size_t len) {
+    if (!scet || (len > SCHEDULER_DATA_MAX_LEN) || (!data && (len > 0))) {
+        return -EINVAL;
+    }
+    if (!running) {
+        return -ENODEV;
+    }
+    uint8_t *copy = NULL;
+    if (len > 0) {
+        copy = malloc(len);
+        if (!copy) {
+            return -ENOMEM;
+        }
+        memcpy(copy, data, len);
+    }
+
+    pthread_mutex_lock(&mutex);
+    if (heap_len >= SCHEDULER_MAX_ACTIONS) {
+        pthread_mutex_unlock(&mutex);
+        free(copy);
+        __atomic_add_fetch(&stats.dropped, 1, __ATOMIC_RELAXED);
+        return -ENOSPC;
+    }
+    heap[heap_len] = (sched_action_t){
+        .time_ns = ecss_scet_to_ns(scet),
+        .seq = next_seq++,
+        .id = id,
+        .type = type,
+        .len = len,
+        .data = copy,
+    };
+    heap_len++;
+    sift_up(heap_len - 1);
+    bool earliest = heap[0].seq == (next_seq - 1);
+    update_stats();
+    pthread_mutex_unlock(&mutex);
+
+    if (earliest) {
+        wake(); // the timer is armed for a later action
+    }
+    return 0;
+}
+
+int scheduler_add_packed(const uint8_t *buf, size_t len) {
+    if (!buf || (len < SCHED_PACKED_HEADER_LEN)) {
+        return -EINVAL;
+    }
+    uint32_t id;
+    ecss_scet_t scet;
+    memcpy(&id, buf, sizeof(id));
+    memcpy(&scet.raw, &buf[sizeof(id)], sizeof(scet.raw));
+    uint8_t type = buf[sizeof(id) + sizeof(scet.raw)];
+    return scheduler_add(id, &scet, type, &buf[SCHED_PACKED_HEADER_LEN], len - SCHED_PACKED_HEADER_LEN);
+}
+
+uint32_t scheduler_cancel(uint32_t id) {
+    pthread_mutex_lock(&mutex);
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < heap_len; i++) {
+        if ((id == 0) || (heap[i].id == id)) {
+            free(heap[i].data);
+        } else {
+            heap[kept++] = heap[i];
+        }
+    }
+    uint32_t canceled = heap_len - kept;
+    heap_len = kept;
+    for (int i = (heap_len / 2) - 1; i >= 0; i--) {
+        sift_down(i);
+    }
+    update_stats();
+    pthread_mutex_unlock(&mutex);
+    return canceled; // the timer may fire early for a canceled action, it just rearms
+}
+
+void scheduler_stats(scheduler_stats_t *out) {
+    out->pending = __atomic_load_n(&stats.pending, __ATOMIC_RELAXED);
+    out->next_scet = __atomic_load_n(&stats.next_scet, __ATOMIC_RELAXED);
+    out->fired = __atomic_load_n(&stats.fired, __ATOMIC_RELAXED);
+    out->late_max_us = __atomic_load_n(&stats.late_max_us, __ATOMIC_RELAXED);
+    out->late_last_us = __atomic_load_n(&stats.late_last_us, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,62 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include "ecss_time.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Time-tagged actions fired at a SCET. Pending actions are kept in a min-heap on their time and a thread sleeps on an
+ * absolute CLOCK_REALTIME timerfd armed for the earliest one, so it wakes at the deadline without a polling tick. Time
+ * sync slews the clock under the timer, a step cancels it and it is rearmed for the new clock. The scheduler does not
+ * know what the actions do, the fire callback runs them from the scheduler thread.
+ */
+
+#define SCHEDULER_MAX_ACTIONS  256
+#define SCHEDULER_DATA_MAX_LEN 255
+
+typedef enum {
+    SCHED_OD_WRITE = 0,   // data is a uint16 index, uint8 subindex, then the value
+    SCHED_TPDO = 1,       // data is a uint8 tpdo number
+    SCHED_OS_COMMAND = 2, // data is the command, no null terminator
+} sched_type_t;
+
+/*
+ * Packed layout of an action in ipc msgs and the scheduler OD record: uint32 id, uint64 ecss_scet_t raw, uint8 type,
+ * then the data. The id is picked by the sender to cancel the action later, 0 for none.
+ */
+#define SCHED_PACKED_HEADER_LEN (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t))
+
+typedef struct {
+    uint64_t time_ns; // CLOCK_REALTIME
+    uint64_t seq;     // actions at the same time fire in the order they were added
+    uint32_t id;
+    uint8_t type;
+    uint8_t len;
+    uint8_t *data;
+} sched_action_t;
+
+typedef struct {
+    uint16_t pending;
+    uint64_t next_scet; // ecss_scet_t raw of the earliest pending action, 0 for none
+    uint32_t fired;
+    uint32_t late_max_us; // most an action fired past its time
+    uint32_t late_last_us;
+    uint32_t dropped; // actions rejected as the heap was full
+} scheduler_stats_t;
+
+// late_ns is how far past its time the action fired, actions added in the past fire right away
+typedef void (*sched_fire_cb_t)(const sched_action_t *action, int64_t late_ns);
+
+// rt_priority > 0 runs the scheduler thread as SCHED_FIFO
+int scheduler_init(sched_fire_cb_t fire_cb, int rt_priority);
+void scheduler_free(void);
+
+// returns 0 or a negative errno, -ENOSPC when full
+int scheduler_add(uint32_t id, const ecss_scet_t *scet, uint8_t type, const void *data, size_t len);
+int scheduler_add_packed(const uint8_t *buf, size_t len);
+// cancels every pending action with the id, or all with id 0, returns the number canceled
+uint32_t scheduler_cancel(uint32_t id);
+void scheduler_stats(scheduler_stats_t *stats);
+
+#endif
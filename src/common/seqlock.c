@@ -0,0 +1,60 @@
+#include "seqlock.h"
+#include "system.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SPINS_BEFORE_SLEEP 100 // writes only hold the lock for a memcpy, so one still running is almost done
+#define WAIT_SLEEP_US      1
+
+static void wait_spin(uint32_t *spins) {
+    if (*spins < SPINS_BEFORE_SLEEP) {
+        (*spins)++;
+        __asm__ volatile("" ::: "memory");
+    } else {
+        sleep_us(WAIT_SLEEP_US); // lets a preempted writer finish
+    }
+}
+
+uint32_t seqlock_read_begin(const seqlock_t *lock) {
+    uint32_t spins = 0;
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE)) & 1) {
+        wait_spin(&spins);
+    }
+    return seq;
+}
+
+bool seqlock_read_retry(const seqlock_t *lock, uint32_t start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // the data reads can't move after the second load of the count
+    return __atomic_load_n(&lock->seq, __ATOMIC_RELAXED) != start;
+}
+
+void seqlock_write_begin(seqlock_t *lock) {
+    uint32_t spins = 0;
+    uint32_t seq = __atomic_load_n(&lock->seq, __ATOMIC_RELAXED);
+    while ((seq & 1) ||
+           !__atomic_compare_exchange_n(&lock->seq, &seq, seq + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        wait_spin(&spins); // another writer
+        seq = __atomic_load_n(&lock->seq, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE); // the odd count is visible before any of the data writes
+}
+
+void seqlock_write_end(seqlock_t *lock) {
+    __atomic_fetch_add(&lock->seq, 1, __ATOMIC_RELEASE);
+}
+
+void seqlock_read(const seqlock_t *lock, void *dst, const void *src, size_t len) {
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(lock);
+        memcpy(dst, src, len);
+    } while (seqlock_read_retry(lock, seq));
+}
+
+void seqlock_write(seqlock_t *lock, void *dst, const void *src, size_t len) {
+    seqlock_write_begin(lock);
+    memcpy(dst, src, len);
+    seqlock_write_end(lock);
+}
@@ -0,0 +1,35 @@
+#ifndef _SEQLOCK_H_
+#define _SEQLOCK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Sequence lock for small data shared between threads without a mutex. A writer makes the count odd while it changes
+ * the data and even again when it is done, readers copy the data and retry if the count was odd or changed meanwhile.
+ * Readers never block a writer. Writers also exclude each other through the count, so any thread can write.
+ *
+ * Waiting on a write in progress spins briefly and then sleeps, so a SCHED_FIFO thread can't starve a preempted
+ * lower priority writer on the same cpu.
+ */
+
+#define SEQLOCK_INIT {0}
+
+typedef struct {
+    uint32_t seq;
+} seqlock_t;
+
+// returns the count to pass to seqlock_read_retry(), waits while a write is in progress
+uint32_t seqlock_read_begin(const seqlock_t *lock);
+// true if the data read since seqlock_read_begin() may be torn and has to be read again
+bool seqlock_read_retry(const seqlock_t *lock, uint32_t start);
+
+void seqlock_write_begin(seqlock_t *lock);
+void seqlock_write_end(seqlock_t *lock);
+
+// consistent copies of len bytes
+void seqlock_read(const seqlock_t *lock, void *dst, const void *src, size_t len);
+void seqlock_write(seqlock_t *lock, void *dst, const void *src, size_t len);
+
+#endif
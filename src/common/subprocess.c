@@ -0,0 +1,250 @@
+#define _GNU_SOURCE // for pipe2()
+#include "subprocess.h"
+#include "system.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHELL          "/bin/sh"
+#define EXIT_POLL_MS   10 // without a pidfd
+#define SHELL_CHARS    "|&;<>()$`*?[]{}~#!\n"
+#define DQUOTE_ESCAPES "\"\\$`"
+
+extern char **environ;
+
+int subprocess_split(char *cmd, char **argv, int argv_max) {
+    if (!cmd || !argv || (argv_max < 2)) {
+        return -EINVAL;
+    }
+    int argc = 0;
+    char *in = cmd;
+    char *out = cmd; // unquoting only ever shortens the line, so it is done in place
+    while (true) {
+        while ((*in == ' ') || (*in == '\t')) {
+            in++;
+        }
+        if (*in == '\0') {
+            break;
+        }
+        if (argc >= (argv_max - 1)) {
+            return -E2BIG;
+        }
+        argv[argc++] = out;
+        char quote = '\0';
+        bool first_word = argc == 1;
+        while ((*in != '\0') && (quote || ((*in != ' ') && (*in != '\t')))) {
+            char c = *in++;
+            if (quote == '\'') {
+                if (c == '\'') {
+                    quote = '\0';
+                } else {
+                    *out++ = c;
+                }
+            } else if (quote == '"') {
+                if (c == '"') {
+                    quote = '\0';
+                } else if ((c == '$') || (c == '`')) {
+                    return -ENOEXEC; // expansions
+                } else if ((c == '\\') && (*in != '\0') && strchr(DQUOTE_ESCAPES, *in)) {
+                    *out++ = *in++;
+                } else {
+                    *out++ = c;
+                }
+            } else if ((c == '\'') || (c == '"')) {
+                quote = c;
+            } else if (c == '\\') {
+                if (*in == '\0') {
+                    return -EINVAL;
+                }
+                *out++ = *in++;
+            } else if (strchr(SHELL_CHARS, c) || (first_word && (c == '='))) {
+                return -ENOEXEC; // also a leading VAR=value
+            } else {
+                *out++ = c;
+            }
+        }
+        if (quote) {
+            return -EINVAL;
+        }
+        if (*in != '\0') {
+            in++; // past the separator, before ending the word as it may be where out is
+        }
+        *out++ = '\0';
+    }
+    argv[argc] = NULL;
+    return (argc > 0) ? argc : -EINVAL;
+}
+
+int subprocess_spawn(subprocess_t *proc, const char *cmd) {
+    if (!proc || !cmd) {
+        return -EINVAL;
+    }
+    char *line = strdup(cmd);
+    if (!line) {
+        return -ENOMEM;
+    }
+    char *argv[SUBPROCESS_ARGS_MAX];
+    int argc = subprocess_split(line, argv, SUBPROCESS_ARGS_MAX);
+    proc->shell = (argc == -ENOEXEC) || (argc == -E2BIG); // sh has no limit on the words
+    if (proc->shell) {
+        argv[0] = SHELL;
+        argv[1] = "-c";
+        argv[2] = (char *)cmd;
+        argv[3] = NULL;
+    } else if (argc < 0) {
+        free(line);
+        return argc;
+    }
+
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+        int r = -errno;
+        free(line);
+        return r;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDERR_FILENO);
+
+    // its own process group to kill, and none of the daemon's blocked or ignored signals
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    sigaddset(&mask, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+
+    int r = posix_spawnp(&proc->pid, argv[0], &actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    free(line);
+    if (r != 0) {
+        close(pipe_fds[0]);
+        return -r;
+    }
+
+    proc->out_fd = pipe_fds[0];
+    fcntl(proc->out_fd, F_SETFL, fcntl(proc->out_fd, F_GETFL) | O_NONBLOCK);
+    proc->pid_fd = -1;
+#ifdef SYS_pidfd_open
+    proc->pid_fd = (int)syscall(SYS_pidfd_open, proc->pid, 0);
+#endif
+    return 0;
+}
+
+// returns the bytes read, 0 at the end of the output, or a negative errno
+static ssize_t read_output(subprocess_t *proc, char *buf, subprocess_output_cb_t output_cb, void *arg) {
+    ssize_t n = read(proc->out_fd, buf, SUBPROCESS_READ_LEN);
+    if (n < 0) {
+        return -errno;
+    }
+    if ((n > 0) && output_cb) {
+        output_cb(arg, buf, n);
+    }
+    return n;
+}
+
+static int exit_status(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : SUBPROCESS_EXIT_NOEXEC;
+}
+
+static void kill_group(subprocess_t *proc) {
+    kill(-proc->pid, SIGTERM);
+    for (uint32_t waited_ms = 0; waited_ms < SUBPROCESS_KILL_MS; waited_ms += EXIT_POLL_MS) {
+        if (waitpid(proc->pid, NULL, WNOHANG) == proc->pid) {
+            kill(-proc->pid, SIGKILL); // anything it started and left behind
+            return;
+        }
+        sleep_ms(EXIT_POLL_MS);
+    }
+    kill(-proc->pid, SIGKILL);
+    waitpid(proc->pid, NULL, 0);
+}
+
+int subprocess_wait(subprocess_t *proc, subprocess_output_cb_t output_cb, void *arg, uint32_t timeout_ms,
+                    int cancel_fd) {
+    if (!proc || (proc->out_fd < 0)) {
+        return -EINVAL;
+    }
+    char *buf = malloc(SUBPROCESS_READ_LEN);
+    if (!buf) {
+        kill_group(proc);
+        close(proc->out_fd);
+        return -ENOMEM;
+    }
+
+    uint64_t deadline_ms = timeout_ms ? get_uptime_ms() + (uint64_t)timeout_ms : 0;
+    bool out_open = true;
+    int status = 0;
+    int r = 1; // > 0 while running
+    while (r > 0) {
+        struct pollfd fds[3] = {
+            {.fd = out_open ? proc->out_fd : -1, .events = POLLIN},
+            {.fd = proc->pid_fd, .events = POLLIN},
+            {.fd = cancel_fd, .events = POLLIN},
+        };
+        int wait_ms = -1;
+        if (deadline_ms) {
+            uint64_t now_ms = get_uptime_ms();
+            wait_ms = (now_ms >= deadline_ms) ? 0 : (int)(deadline_ms - now_ms);
+        }
+        if ((proc->pid_fd < 0) && ((wait_ms < 0) || (wait_ms > EXIT_POLL_MS))) {
+            wait_ms = EXIT_POLL_MS;
+        }
+        if ((poll(fds, 3, wait_ms) < 0) && (errno != EINTR)) {
+            r = -errno;
+        } else if (fds[2].revents & POLLIN) {
+            r = -ECANCELED;
+        } else if (deadline_ms && (get_uptime_ms() >= deadline_ms)) {
+            r = -ETIMEDOUT;
+        } else {
+            if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t n = read_output(proc, buf, output_cb, arg);
+                out_open = (n > 0) || (n == -EAGAIN) || (n == -EINTR);
+            }
+            // the output can stay open after the exit, e.g. a background process holding it
+            bool exited = (proc->pid_fd < 0) || (fds[1].revents & POLLIN);
+            if (exited && (waitpid(proc->pid, &status, WNOHANG) == proc->pid)) {
+                r = 0;
+            }
+        }
+    }
+
+    if (r == 0) {
+        while (out_open && (read_output(proc, buf, output_cb, arg) > 0)) {
+            ; // what was left in the pipe
+        }
+        r = exit_status(status);
+    } else {
+        kill_group(proc);
+    }
+    free(buf);
+    close(proc->out_fd);
+    proc->out_fd = -1;
+    if (proc->pid_fd >= 0) {
+        close(proc->pid_fd);
+        proc->pid_fd = -1;
+    }
+    return r;
+}
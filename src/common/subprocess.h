@@ -0,0 +1,47 @@
+#ifndef _SUBPROCESS_H_
+#define _SUBPROCESS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Runs a command line without popen(). Plain commands are split into argv here and started directly with
+ * posix_spawnp(), only lines with shell syntax (pipes, redirects, variables, globs, ...) or too many words for argv go
+ * through /bin/sh -c. Stdout and stderr share one pipe that is read in large blocks, polled together with the
+ * process's pidfd and a cancel fd. The process gets its own process group, so a timeout or cancel also kills anything
+ * it started.
+ */
+
+#define SUBPROCESS_ARGS_MAX    64
+#define SUBPROCESS_READ_LEN    16384
+#define SUBPROCESS_KILL_MS     1000 // from SIGTERM to SIGKILL
+#define SUBPROCESS_EXIT_NOEXEC 127  // exit status when the command could not be started, same as sh
+
+typedef struct {
+    pid_t pid;
+    int out_fd; // read end of the stdout and stderr pipe
+    int pid_fd; // -1 on kernels without pidfd_open(), the exit is then polled for
+    bool shell;
+} subprocess_t;
+
+// output as it is read, data is not null terminated
+typedef void (*subprocess_output_cb_t)(void *arg, const char *data, size_t len);
+
+/*
+ * Splits cmd in place into argv (null terminated), with '' and "" quotes and \ escapes. Returns argc, -ENOEXEC if
+ * the line needs a shell, or -EINVAL / -E2BIG.
+ */
+int subprocess_split(char *cmd, char **argv, int argv_max);
+
+int subprocess_spawn(subprocess_t *proc, const char *cmd);
+/*
+ * Reads the output until the process exits and reaps it. timeout_ms 0 is no timeout and cancel_fd -1 is no cancel,
+ * otherwise the process group is killed when it runs out or cancel_fd is readable. Returns the exit status (128 +
+ * signal when killed by a signal), -ETIMEDOUT, -ECANCELED, or a negative errno.
+ */
+int subprocess_wait(subprocess_t *proc, subprocess_output_cb_t output_cb, void *arg, uint32_t timeout_ms,
+                    int cancel_fd);
+
+#endif
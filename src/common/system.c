@@ -1,4 +1,7 @@
+#define _GNU_SOURCE // for copy_file_range() and sched_setaffinity()
 #include "system.h"
+#include <alloca.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -6,12 +9,15 @@
 #include <limits.h>
 #include <linux/fs.h>
 #include <linux/limits.h>
+#include <malloc.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -19,6 +25,17 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#define CRC32_CHUNK_LEN 16384
+#define CPUS_MAX        64
+
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT 4 // linux >= 4.4
+#endif
+
 void sleep_ms(uint32_t ms) {
     struct timespec ts;
     ts.tv_sec = ms / 1000;
@@ -57,25 +74,6 @@ uint32_t get_unix_time_s(void) {
     return (uint32_t)rawtime;
 }
 
-int run_bash_command(char *in, char *out, int out_max_len) {
-    int out_len = 0;
-    FILE *pipe = popen(in, "r");
-    if (pipe == NULL) {
-        return -errno;
-    }
-    int c;
-    for (out_len = 0; (c = fgetc(pipe)) != EOF; out_len++) {
-        if (out_len > (out_max_len - 1)) {
-            break; // max len reached
-        }
-        out[out_len] = (char)c;
-    }
-    pclose(pipe);
-    out_len++;
-    out[out_len - 1] = '\0';
-    return out_len;
-}
-
 bool is_file(char *path) {
     bool r = false;
     FILE *fptr = fopen(path, "r");
@@ -108,48 +106,123 @@ bool is_file_in_dir(char *dir_path, char *file_name) {
     return found;
 }
 
+// if dest is a directory, the file keeps its name inside of it
+static void get_dest_path(char *src, char *dest, char *out, uint32_t out_len) {
+    if (is_dir(dest)) {
+        char src_copy[PATH_MAX];
+        strncpy(src_copy, src, PATH_MAX - 1);
+        src_copy[PATH_MAX - 1] = '\0';
+        path_join(dest, basename(src_copy), out, out_len);
+    } else {
+        strncpy(out, dest, out_len - 1);
+        out[out_len - 1] = '\0';
+    }
+}
+
+static int copy_fd_data(int src_fd, int dest_fd, off_t size) {
+#ifdef FICLONE
+    if (ioctl(dest_fd, FICLONE, src_fd) == 0) {
+        return 0; // reflink, no data copied at all
+    }
+#endif
+
+    bool use_copy_file_range = true;
+    off_t copied = 0;
+    ssize_t written;
+    while (copied < size) {
+        if (use_copy_file_range) {
+            written = copy_file_range(src_fd, NULL, dest_fd, NULL, size - copied, 0);
+            if ((written == -1) && (copied == 0) &&
+                ((errno == EXDEV) || (errno == ENOSYS) || (errno == EINVAL) || (errno == EOPNOTSUPP))) {
+                use_copy_file_range = false; // not supported between these filesystems, fallback to sendfile
+                continue;
+            }
+        } else {
+            written = sendfile(dest_fd, src_fd, NULL, size - copied);
+        }
+
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        } else if (written == 0) {
+            break; // src file was truncated
+        }
+        copied += written;
+    }
+    return 0;
+}
+
 int copy_file(char *src, char *dest) {
-    int r = 0;
+    if (!src || !dest) {
+        return -EINVAL;
+    }
+
+    char dest_path[PATH_MAX];
+    get_dest_path(src, dest, dest_path, PATH_MAX);
 
     int src_fd = open(src, O_RDONLY);
     if (src_fd == -1) {
         return -errno;
     }
 
-    char *tmp = dest;
-    if (is_dir(dest)) {
-        char dest_tmp[PATH_MAX];
-        path_join(dest, basename(src), dest_tmp, PATH_MAX);
-        tmp = dest_tmp;
+    struct stat file_stat;
+    if (fstat(src_fd, &file_stat) == -1) {
+        int r = -errno;
+        close(src_fd);
+        return r;
     }
 
-    int dest_fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (dest_fd == -1) {
+    // write to a hidden temp file next to dest and rename it, so dest is never seen partially written
+    char dir_buf[PATH_MAX];
+    char name_buf[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    strncpy(dir_buf, dest_path, PATH_MAX);
+    strncpy(name_buf, dest_path, PATH_MAX);
+    if (snprintf(tmp_path, PATH_MAX, "%s/.%s.XXXXXX", dirname(dir_buf), basename(name_buf)) >= PATH_MAX) {
         close(src_fd);
-        return -errno;
+        return -ENAMETOOLONG;
     }
 
-    struct stat file_stat = {0};
-    int result = fstat(src_fd, &file_stat);
-    off_t offset = 0;
-    ssize_t written;
-    while ((result == 0) && (offset < file_stat.st_size)) {
-        written = sendfile(dest_fd, src_fd, &offset, file_stat.st_size);
-        if (written == -1) {
-            r = -errno;
-            break;
-        } else {
-            offset += written;
-        }
+    int dest_fd = mkstemp(tmp_path);
+    if (dest_fd == -1) {
+        int r = -errno;
+        close(src_fd);
+        return r;
     }
+    fchmod(dest_fd, 0644);
 
+    int r = copy_fd_data(src_fd, dest_fd, file_stat.st_size);
     close(src_fd);
-    close(dest_fd);
+    if (close(dest_fd) == -1 && r == 0) {
+        r = -errno;
+    }
+
+    if ((r == 0) && (rename(tmp_path, dest_path) == -1)) {
+        r = -errno;
+    }
+    if (r < 0) {
+        unlink(tmp_path);
+    }
     return r;
 }
 
 int move_file(char *src, char *dest) {
-    int r = copy_file(src, dest);
+    if (!src || !dest) {
+        return -EINVAL;
+    }
+
+    char dest_path[PATH_MAX];
+    get_dest_path(src, dest, dest_path, PATH_MAX);
+
+    if (rename(src, dest_path) == 0) {
+        return 0; // same filesystem, only metadata changed
+    } else if (errno != EXDEV) {
+        return -errno;
+    }
+
+    int r = copy_file(src, dest_path);
     if (r >= 0) {
         r = remove(src);
         if (r == -1) {
@@ -159,55 +232,98 @@ int move_file(char *src, char *dest) {
     return r;
 }
 
-int get_file_crc32(char *file_path, uint32_t *crc) {
-    if (!file_path || !crc) {
-        return -EINVAL;
+#if defined(__ARM_FEATURE_CRC32)
+// ARMv8 CRC32 instructions use the same (IEEE 802.3) polynomial as zlib
+static uint32_t crc32_hw(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    while (len && ((uintptr_t)data & 3)) {
+        crc = __crc32b(crc, *data++);
+        len--;
     }
-
-    FILE *fp = fopen(file_path, "r");
-    if (!fp) {
-        return -errno;
+    while (len >= 4) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32w(crc, word);
+        data += 4;
+        len -= 4;
     }
-
-    int r = 0;
-    void *file_data = NULL;
-
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    if (file_size <= 0) {
-        r = -errno;
-        goto crc_end;
+    while (len--) {
+        crc = __crc32b(crc, *data++);
     }
-    fseek(fp, 0, SEEK_SET);
+    return ~crc;
+}
+#endif
 
-    file_data = malloc(file_size);
-    if (!file_data) {
-        r = -ENOMEM;
-        goto crc_end;
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len) {
+    if (!data || !len) {
+        return crc;
+    }
+#if defined(__ARM_FEATURE_CRC32)
+    return crc32_hw(crc, (const uint8_t *)data, len);
+#else
+    /*
+     * SSE4.2's crc32 instruction is CRC-32C (Castagnoli), which does not match zlib's output, so everything that is
+     * not ARMv8 uses zlib. Feed it in chunks, as zlib's length arg is only a uInt.
+     */
+    const uint8_t *ptr = (const uint8_t *)data;
+    while (len > 0) {
+        uInt chunk = len > UINT_MAX ? UINT_MAX : (uInt)len;
+        crc = (uint32_t)crc32(crc, ptr, chunk);
+        ptr += chunk;
+        len -= chunk;
     }
+    return crc;
+#endif
+}
 
-    if (fread(file_data, 1, file_size, fp) != (size_t)file_size) {
-        r = -1;
-        goto crc_end;
+int get_fd_crc32(int fd, uint32_t *crc) {
+    if ((fd < 0) || !crc) {
+        return -EINVAL;
     }
 
-    if (r == 0) {
-        uint32_t tmp = crc32(0L, Z_NULL, 0);
-        tmp = crc32(tmp, file_data, file_size);
-        *crc = tmp;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    uint8_t buf[CRC32_CHUNK_LEN];
+    uint32_t tmp = 0;
+    ssize_t nbytes;
+    while ((nbytes = read(fd, buf, sizeof(buf))) != 0) {
+        if (nbytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        tmp = crc32_update(tmp, buf, nbytes);
     }
+    *crc = tmp;
+    return 0;
+}
 
-crc_end:
-    if (file_data) {
-        free(file_data);
+int get_file_crc32(char *file_path, uint32_t *crc) {
+    if (!file_path || !crc) {
+        return -EINVAL;
     }
-    if (fp) {
-        fclose(fp);
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
     }
+
+    int r = get_fd_crc32(fd, crc);
+    close(fd);
     return r;
 }
 
 bool check_file_crc32_match(char *file_path_1, char *file_path_2) {
+    struct stat stat_1;
+    struct stat stat_2;
+    if (stat(file_path_1, &stat_1) || stat(file_path_2, &stat_2)) {
+        return false;
+    }
+    if (stat_1.st_size != stat_2.st_size) {
+        return false; // no need to read either file
+    }
+
     uint32_t crc1;
     uint32_t crc2;
     if (get_file_crc32(file_path_1, &crc1) || get_file_crc32(file_path_2, &crc2)) {
@@ -339,3 +455,83 @@ int path_join(char *head, char *tail, char *out, uint32_t out_len) {
 
     return r;
 }
+
+int parse_cpu_list(const char *str, uint64_t *cpus) {
+    if (!str || !cpus) {
+        return -EINVAL;
+    }
+
+    uint64_t mask = 0;
+    const char *p = str;
+    while (*p != '\0') {
+        char *end;
+        if (!isdigit((unsigned char)*p)) {
+            return -EINVAL;
+        }
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+        if (*end == '-') {
+            if (!isdigit((unsigned char)end[1])) {
+                return -EINVAL;
+            }
+            last = strtoul(end + 1, &end, 10);
+        }
+        if ((first > last) || (last >= CPUS_MAX)) {
+            return -EINVAL;
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            mask |= 1ULL << cpu;
+        }
+        if (*end == ',') {
+            end++;
+            if (*end == '\0') {
+                return -EINVAL;
+            }
+        } else if (*end != '\0') {
+            return -EINVAL;
+        }
+        p = end;
+    }
+    if (mask == 0) {
+        return -EINVAL;
+    }
+
+    *cpus = mask;
+    return 0;
+}
+
+int set_thread_cpus(uint64_t cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPUS_MAX; cpu++) {
+        if (cpus & (1ULL << cpu)) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    // pid 0 is the calling thread, not the whole process
+    return (sched_setaffinity(0, sizeof(set), &set) < 0) ? -errno : 0;
+}
+
+int lock_memory(void) {
+    // lock on fault so the 8 MiB default stacks of every thread (including zmq's) are not pulled in up front, the
+    // stacks that matter are prefaulted by their threads
+    int r = mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT);
+    if ((r < 0) && (errno == EINVAL)) {
+        r = mlockall(MCL_CURRENT | MCL_FUTURE); // kernel without MCL_ONFAULT
+    }
+    if (r < 0) {
+        return -errno;
+    }
+    // freed heap stays mapped and locked, and large allocs come from the locked heap rather than new mmaps
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    return 0;
+}
+
+void prefault_stack(size_t len) {
+    volatile uint8_t *buf = alloca(len);
+    long page_len = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < len; i += (page_len > 0) ? (size_t)page_len : 4096) {
+        buf[i] = 0;
+    }
+}
@@ -2,6 +2,7 @@
 #define _SYSTEM_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -14,12 +15,13 @@ uint64_t get_uptime_us(void);
 
 uint32_t get_unix_time_s(void);
 
-int run_bash_command(char *in, char *out, int out_max_len);
-
 bool is_file(char *file_path);
 bool is_file_in_dir(char *dir_path, char *file_name);
 int copy_file(char *src, char *dest);
 int move_file(char *src, char *dest);
+// crc32 (same as zlib's crc32()), start with crc = 0 and feed chunks in order
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+int get_fd_crc32(int fd, uint32_t *crc); // reads from current offset to EOF in fixed-size chunks
 int get_file_crc32(char *file_path, uint32_t *crc);
 bool check_file_crc32_match(char *file_path_1, char *file_path_2);
 
@@ -30,4 +32,11 @@ int files_in_dir(char *dir_path);
 
 int path_join(char *head, char *tail, char *out, uint32_t out_len);
 
+// cpu list like "1" or "0,2-3" to a bitmask of cpus 0 .. 63
+int parse_cpu_list(const char *str, uint64_t *cpus);
+int set_thread_cpus(uint64_t cpus); // pins the calling thread
+// locks current and future pages in ram as they are faulted in and stops malloc from giving memory back
+int lock_memory(void);
+void prefault_stack(size_t len); // faults in len bytes of the calling thread's stack
+
 #endif
@@ -0,0 +1,251 @@
+#define _GNU_SOURCE // for clock_adjtime()
+#include "time_sync.h"
+#include "logger.h"
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/timex.h>
+#include <time.h>
+
+#define KP              0.7   // per second between samples, same as ptp4l's pi servo
+#define KI              0.3
+#define RMS_ALPHA       0.125 // weight of a new offset in the rms
+#define RX_MAX_AGE_NS   100000000ULL
+#define RX_MAX_AHEAD_NS 1000000ULL
+#define STOP_CHECK_MS   250
+#define PPB_TO_FREQ     65.536 // timex freq is ppm with a 16 bit fraction
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond;
+static bool pending = false;
+static uint64_t pending_master_ns;
+static uint64_t pending_rx_ns;
+static uint64_t pending_local_ns;
+static bool running = false;
+static pthread_t thread_id;
+static uint32_t latency = 0;
+static time_sync_servo_t servo;
+static time_sync_stats_t stats;
+static uint64_t last_rx_ns = 0;
+static bool adjust_failed = false;
+
+static double clamp_ppb(double ppb) {
+    return (ppb > TIME_SYNC_MAX_PPB) ? TIME_SYNC_MAX_PPB : (ppb < -TIME_SYNC_MAX_PPB) ? -TIME_SYNC_MAX_PPB : ppb;
+}
+
+time_sync_action_t time_sync_servo_sample(time_sync_servo_t *servo, int64_t offset_ns, uint64_t rx_ns,
+                                          int64_t *step_ns, double *freq_ppb) {
+    servo->samples++;
+    double abs_offset = fabs((double)offset_ns);
+
+    if (servo->state == TIME_SYNC_LOCKED) {
+        double limit = fmax(TIME_SYNC_SPIKE_MIN_NS, TIME_SYNC_SPIKE_FACTOR * sqrt(servo->rms_sq));
+        if ((abs_offset > limit) && (servo->spikes_in_row < TIME_SYNC_SPIKE_MAX)) {
+            servo->spikes_in_row++;
+            servo->spikes++;
+            return TIME_SYNC_NONE;
+        }
+    }
+    servo->spikes_in_row = 0;
+
+    if (abs_offset > TIME_SYNC_STEP_NS) {
+        *step_ns = offset_ns;
+        *freq_ppb = servo->drift_ppb;
+        servo->state = TIME_SYNC_ACQUIRING;
+        servo->last_offset_ns = 0;
+        servo->last_rx_ns = rx_ns + offset_ns; // where the step puts it
+        servo->rms_sq = 0;
+        servo->steps++;
+        return TIME_SYNC_STEP;
+    }
+
+    double dt_s = (rx_ns > servo->last_rx_ns) ? (double)(rx_ns - servo->last_rx_ns) / 1e9 : 0;
+    int64_t last_offset_ns = servo->last_offset_ns;
+    servo->last_offset_ns = offset_ns;
+    servo->last_rx_ns = rx_ns;
+    if ((servo->state == TIME_SYNC_UNSYNCED) || (dt_s <= 0)) {
+        servo->state = (servo->state == TIME_SYNC_LOCKED) ? TIME_SYNC_LOCKED : TIME_SYNC_ACQUIRING;
+        return TIME_SYNC_NONE; // need a previous sample for the interval
+    }
+
+    if (servo->state == TIME_SYNC_ACQUIRING) {
+        // how far the offset moved with the current frequency is what it is still off by
+        servo->drift_ppb = clamp_ppb(servo->drift_ppb + ((double)(offset_ns - last_offset_ns) / dt_s));
+        servo->state = TIME_SYNC_LOCKED;
+    }
+
+    double ki_term = (KI / dt_s) * (double)offset_ns;
+    *freq_ppb = clamp_ppb(((KP / dt_s) * (double)offset_ns) + servo->drift_ppb + ki_term);
+    servo->drift_ppb = clamp_ppb(servo->drift_ppb + ki_term);
+    double sq = (double)offset_ns * (double)offset_ns;
+    servo->rms_sq = (servo->rms_sq == 0) ? sq : servo->rms_sq + (RMS_ALPHA * (sq - servo->rms_sq));
+    return TIME_SYNC_SLEW;
+}
+
+static int set_freq(double ppb) {
+    struct timex tx = {
+        .modes = ADJ_FREQUENCY,
+        .freq = (long)(ppb * PPB_TO_FREQ),
+    };
+    return (clock_adjtime(CLOCK_REALTIME, &tx) < 0) ? -errno : 0;
+}
+
+static int step_clock(int64_t step_ns) {
+    struct timex tx = {
+        .modes = ADJ_SETOFFSET | ADJ_NANO,
+    };
+    tx.time.tv_sec = step_ns / 1000000000LL;
+    tx.time.tv_usec = step_ns % 1000000000LL; // ns with ADJ_NANO
+    if (tx.time.tv_usec < 0) {                // must be positive
+        tx.time.tv_sec--;
+        tx.time.tv_usec += 1000000000LL;
+    }
+    return (clock_adjtime(CLOCK_REALTIME, &tx) < 0) ? -errno : 0;
+}
+
+static void adjust_clock(time_sync_action_t action, int64_t step_ns, double freq_ppb) {
+    int r = 0;
+    if (action == TIME_SYNC_STEP) {
+        r = step_clock(step_ns);
+        log_info("time sync stepped the clock by %lld us", (long long)(step_ns / 1000));
+    }
+    if ((r == 0) && (action != TIME_SYNC_NONE)) {
+        r = set_freq(freq_ppb);
+    }
+    if ((r < 0) && !adjust_failed) { // e.g. no CAP_SYS_TIME, it will fail the same way every sample
+        log_error("time sync cannot adjust the clock: %d", r);
+    }
+    adjust_failed = r < 0;
+}
+
+static void process_sample(uint64_t master_ns, uint64_t rx_ns, uint64_t local_ns) {
+    // the rx timestamp is taken before local_ns
+    if ((rx_ns == 0) || (rx_ns > (local_ns + RX_MAX_AHEAD_NS)) || ((rx_ns + RX_MAX_AGE_NS) < local_ns)) {
+        rx_ns = local_ns;
+        __atomic_add_fetch(&stats.untimestamped, 1, __ATOMIC_RELAXED);
+    }
+    if (last_rx_ns > (local_ns + RX_MAX_AHEAD_NS)) {
+        last_rx_ns = 0; // the clock was set back by something else
+    }
+    if (rx_ns <= last_rx_ns) {
+        return; // a frame already used or one from before the last step
+    }
+    last_rx_ns = rx_ns;
+
+    int64_t offset_ns = (int64_t)(master_ns + latency - rx_ns);
+    int64_t step_ns = 0;
+    double freq_ppb = 0;
+    time_sync_action_t action = time_sync_servo_sample(&servo, offset_ns, rx_ns, &step_ns, &freq_ppb);
+    adjust_clock(action, step_ns, freq_ppb);
+    if (action == TIME_SYNC_STEP) {
+        last_rx_ns = rx_ns + step_ns; // where the step puts it
+    }
+
+    if (action != TIME_SYNC_NONE) {
+        int64_t clamped = (offset_ns > INT32_MAX) ? INT32_MAX : (offset_ns < INT32_MIN) ? INT32_MIN : offset_ns;
+        __atomic_store_n(&stats.offset_ns, (int32_t)clamped, __ATOMIC_RELAXED);
+        __atomic_store_n(&stats.freq_ppb, (int32_t)freq_ppb, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&stats.state, (uint8_t)servo.state, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats.rms_offset_ns, (uint32_t)fmin(sqrt(servo.rms_sq), UINT32_MAX), __ATOMIC_RELAXED);
+    __atomic_store_n(&stats.samples, servo.samples, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats.steps, servo.steps, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats.spikes, servo.spikes, __ATOMIC_RELAXED);
+}
+
+static void *time_sync_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&mutex);
+    while (running) {
+        if (!pending) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += STOP_CHECK_MS * 1000000L;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&cond, &mutex, &ts);
+            continue;
+        }
+        uint64_t master_ns = pending_master_ns;
+        uint64_t rx_ns = pending_rx_ns;
+        uint64_t local_ns = pending_local_ns;
+        pending = false;
+        pthread_mutex_unlock(&mutex);
+
+        process_sample(master_ns, rx_ns, local_ns);
+
+        pthread_mutex_lock(&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+int time_sync_init(uint32_t latency_ns) {
+    if (running) {
+        return -EALREADY;
+    }
+    latency = latency_ns;
+    last_rx_ns = 0;
+
+    // start from the frequency the clock already runs at, e.g. from the last run
+    struct timex tx = {.modes = 0};
+    servo = (time_sync_servo_t){0};
+    if (clock_adjtime(CLOCK_REALTIME, &tx) >= 0) {
+        servo.drift_ppb = clamp_ppb((double)tx.freq / PPB_TO_FREQ);
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    running = true;
+    int r = pthread_create(&thread_id, NULL, time_sync_thread, NULL);
+    if (r != 0) {
+        running = false;
+        pthread_cond_destroy(&cond);
+        return -r;
+    }
+    return 0;
+}
+
+void time_sync_free(void) {
+    if (!running) {
+        return;
+    }
+    pthread_mutex_lock(&mutex);
+    running = false;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread_id, NULL);
+    pthread_cond_destroy(&cond);
+}
+
+bool time_sync_running(void) {
+    return running;
+}
+
+void time_sync_sample(uint64_t master_ns, uint64_t rx_ns, uint64_t local_ns) {
+    pthread_mutex_lock(&mutex);
+    pending_master_ns = master_ns; // a newer sample replaces one not processed yet
+    pending_rx_ns = rx_ns;
+    pending_local_ns = local_ns;
+    pending = true;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+void time_sync_stats(time_sync_stats_t *out) {
+    out->state = __atomic_load_n(&stats.state, __ATOMIC_RELAXED);
+    out->offset_ns = __atomic_load_n(&stats.offset_ns, __ATOMIC_RELAXED);
+    out->freq_ppb = __atomic_load_n(&stats.freq_ppb, __ATOMIC_RELAXED);
+    out->rms_offset_ns = __atomic_load_n(&stats.rms_offset_ns, __ATOMIC_RELAXED);
+    out->samples = __atomic_load_n(&stats.samples, __ATOMIC_RELAXED);
+    out->steps = __atomic_load_n(&stats.steps, __ATOMIC_RELAXED);
+    out->spikes = __atomic_load_n(&stats.spikes, __ATOMIC_RELAXED);
+    out->untimestamped = __atomic_load_n(&stats.untimestamped, __ATOMIC_RELAXED);
+}
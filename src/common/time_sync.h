@@ -0,0 +1,72 @@
+#ifndef _TIME_SYNC_H_
+#define _TIME_SYNC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Disciplines CLOCK_REALTIME to a time master from its time broadcasts. Each sample pairs the master's time with the
+ * kernel rx timestamp of the frame that carried it. The offset goes through a spike filter that drops frames delayed
+ * on the bus or in the master, then a PI servo turns it into a frequency adjustment, so the clock is slewed with
+ * clock_adjtime(). The clock is only stepped when the offset is past TIME_SYNC_STEP_NS, e.g. on the first sample.
+ */
+
+#define TIME_SYNC_STEP_NS       128000000LL // same as ntpd
+#define TIME_SYNC_MAX_PPB       500000      // the kernel's limit
+#define TIME_SYNC_SPIKE_MIN_NS  50000       // never reject offsets within this
+#define TIME_SYNC_SPIKE_FACTOR  4           // reject offsets past this many rms offsets
+#define TIME_SYNC_SPIKE_MAX     3           // accept the offset after this many rejects in a row, it is a real change
+
+typedef enum {
+    TIME_SYNC_UNSYNCED = 0,
+    TIME_SYNC_ACQUIRING = 1, // stepped, estimating the drift
+    TIME_SYNC_LOCKED = 2,
+} time_sync_state_t;
+
+typedef enum {
+    TIME_SYNC_NONE = 0,
+    TIME_SYNC_SLEW = 1,
+    TIME_SYNC_STEP = 2,
+} time_sync_action_t;
+
+typedef struct {
+    time_sync_state_t state;
+    double drift_ppb; // integral term
+    double rms_sq;    // ewma of the squared offsets while locked
+    int64_t last_offset_ns;
+    uint64_t last_rx_ns;
+    uint8_t spikes_in_row;
+    uint32_t samples;
+    uint32_t steps;
+    uint32_t spikes;
+} time_sync_servo_t;
+
+typedef struct {
+    uint8_t state;
+    int32_t offset_ns;     // of the last accepted sample, master - local, clamped
+    int32_t freq_ppb;      // current frequency adjustment
+    uint32_t rms_offset_ns;
+    uint32_t samples;
+    uint32_t steps;
+    uint32_t spikes;         // samples dropped by the spike filter
+    uint32_t untimestamped;  // samples with no kernel rx timestamp, the local time was used
+} time_sync_stats_t;
+
+// returns what to do with the clock, a step of step_ns or a slew at freq_ppb (also set after a step)
+time_sync_action_t time_sync_servo_sample(time_sync_servo_t *servo, int64_t offset_ns, uint64_t rx_ns,
+                                          int64_t *step_ns, double *freq_ppb);
+
+// latency_ns is the fixed delay from the master's timestamp to the rx timestamp, e.g. the frame's time on the wire
+int time_sync_init(uint32_t latency_ns);
+void time_sync_free(void);
+bool time_sync_running(void);
+
+/*
+ * Hands over a master time from any thread without blocking on the clock. rx_ns is the CLOCK_REALTIME kernel rx
+ * timestamp of the frame that carried it, 0 if unknown, then local_ns (when it was handled) is used. Samples stamped no
+ * later than the previous one are dropped, e.g. the same frame handed over again.
+ */
+void time_sync_sample(uint64_t master_ns, uint64_t rx_ns, uint64_t local_ns);
+void time_sync_stats(time_sync_stats_t *stats);
+
+#endif
@@ -0,0 +1,126 @@
+#include "trace.h"
+#include "logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(trace_record_t) == 32, "trace records must stay 32 bytes");
+_Static_assert(sizeof(trace_header_t) == 64, "trace header must stay 64 bytes");
+
+static trace_header_t *header = NULL;
+static trace_record_t *ring = NULL;
+static size_t map_len = 0;
+
+int trace_init(const char *path, uint32_t records) {
+    if (!path || (records == 0)) {
+        return -EINVAL;
+    }
+    if (header) {
+        return -EALREADY;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        int r = -errno;
+        log_error("failed to open trace file %s: %d", path, errno);
+        return r;
+    }
+
+    size_t len = sizeof(trace_header_t) + ((size_t)records * sizeof(trace_record_t));
+    trace_header_t old = {0};
+    bool reuse = (pread(fd, &old, sizeof(old), 0) == sizeof(old)) && (old.magic == TRACE_MAGIC) &&
+                 (old.version == TRACE_VERSION) && (old.record_size == sizeof(trace_record_t)) &&
+                 (old.records == records);
+    if (!reuse) {
+        // recreate, posix_fallocate so a full disk fails here and not as a SIGBUS in trace_record
+        int r = (ftruncate(fd, 0) < 0) ? errno : posix_fallocate(fd, 0, len);
+        if (r != 0) {
+            log_error("failed to size trace file %s: %d", path, r);
+            close(fd);
+            return -r;
+        }
+    }
+
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (map == MAP_FAILED) {
+        int r = -errno;
+        log_error("failed to map trace file %s: %d", path, errno);
+        return r;
+    }
+
+    trace_header_t *hdr = map;
+    if (!reuse) {
+        hdr->magic = TRACE_MAGIC;
+        hdr->version = TRACE_VERSION;
+        hdr->record_size = sizeof(trace_record_t);
+        hdr->records = records;
+        hdr->head = 0;
+    }
+    log_info("trace file %s with %u records (%s)", path, records, reuse ? "appending" : "new");
+
+    ring = (trace_record_t *)((uint8_t *)map + sizeof(trace_header_t));
+    map_len = len;
+    __atomic_store_n(&header, hdr, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void trace_free(void) {
+    trace_header_t *hdr = __atomic_exchange_n(&header, NULL, __ATOMIC_ACQ_REL);
+    if (hdr) {
+        msync(hdr, map_len, MS_SYNC);
+        munmap(hdr, map_len);
+        ring = NULL;
+    }
+}
+
+void trace_sync(void) {
+    trace_header_t *hdr = __atomic_load_n(&header, __ATOMIC_ACQUIRE);
+    if (hdr) {
+        msync(hdr, map_len, MS_ASYNC);
+    }
+}
+
+void trace_record(trace_type_t type, uint16_t id, uint32_t arg, const void *data, uint8_t len) {
+    if (!__atomic_load_n(&header, __ATOMIC_RELAXED)) {
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    trace_record_at(((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec, type, id, arg, data, len);
+}
+
+void trace_record_at(uint64_t time_ns, trace_type_t type, uint16_t id, uint32_t arg, const void *data, uint8_t len) {
+    trace_header_t *hdr = __atomic_load_n(&header, __ATOMIC_ACQUIRE);
+    if (!hdr) {
+        return;
+    }
+
+    uint32_t seq = __atomic_add_fetch(&hdr->head, 1, __ATOMIC_RELAXED);
+    if (seq == 0) { // 0 marks an incomplete record, skip it on wrap
+        seq = __atomic_add_fetch(&hdr->head, 1, __ATOMIC_RELAXED);
+    }
+    trace_record_t *rec = &ring[(seq - 1) % hdr->records];
+
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    rec->time_ns = time_ns;
+    rec->type = type;
+    rec->id = id;
+    rec->arg = arg;
+    rec->len = (len > TRACE_DATA_LEN) ? TRACE_DATA_LEN : len;
+    if (data && rec->len) {
+        memcpy(rec->data, data, rec->len);
+    }
+    if (rec->len < TRACE_DATA_LEN) {
+        memset(&rec->data[rec->len], 0, TRACE_DATA_LEN - rec->len);
+    }
+    __atomic_store_n(&rec->seq, seq, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,56 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+#define TRACE_MAGIC   0x454341525453524FULL // "ORSTRACE" little-endian
+#define TRACE_VERSION 1
+
+typedef enum {
+    TRACE_CAN_RX = 0x1,     // id: 11-bit cob id, arg: raw can_id with EFF/RTR/ERR flags, data: frame
+    TRACE_CAN_TX = 0x2,     // same as TRACE_CAN_RX
+    TRACE_SDO_SERVER = 0x3, // id: new state, arg: previous state
+    TRACE_SDO_CLIENT = 0x4, // id: node id, arg: abort code, data: uint16 index, uint8 subindex, uint32 duration us
+    TRACE_IPC_REQ = 0x5,    // id: ipc msg id, arg: latency us, data: uint8 reply msg id
+    TRACE_IPC_MSG = 0x6,    // id: ipc msg id, arg: processing time us
+    TRACE_NMT = 0x7,        // id: node id (0 for this node), arg: new nmt state
+    TRACE_EMCY_RX = 0x8,    // id: node id (0 for this node), arg: info code, data: uint16 error code
+    TRACE_EMCY_TX = 0x9,    // id: 0, arg: info code, data: uint16 error code
+} trace_type_t;
+
+#define TRACE_DATA_LEN 12
+
+// fixed 32 byte records (no padding), so the file is a plain array and a torn record can only hurt itself
+typedef struct {
+    uint64_t time_ns; // CLOCK_REALTIME
+    uint32_t seq;     // 1 based record number, 0 while the record is being written
+    uint8_t type;     // trace_type_t
+    uint8_t len;      // bytes used in data
+    uint16_t id;
+    uint32_t arg;
+    uint8_t data[TRACE_DATA_LEN];
+} trace_record_t;
+
+typedef struct {
+    uint64_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t records; // capacity of the ring
+    uint32_t head;    // next record number to claim, (head - 1) % records is the newest
+    uint8_t reserved[44];
+} trace_header_t; // 64 bytes, records follow
+
+/*
+ * Open (or create) a ring file of records at path and map it. A file with a different capacity or version is
+ * recreated. Until this is called, and after trace_free, the trace_* calls are no-ops.
+ */
+int trace_init(const char *path, uint32_t records);
+void trace_free(void);
+void trace_sync(void); // schedule write back of dirty pages, call periodically
+
+// lock-free and safe from any thread; data is truncated to TRACE_DATA_LEN
+void trace_record(trace_type_t type, uint16_t id, uint32_t arg, const void *data, uint8_t len);
+// same as trace_record with the time (CLOCK_REALTIME ns) taken elsewhere, e.g. a kernel rx timestamp
+void trace_record_at(uint64_t time_ns, trace_type_t type, uint16_t id, uint32_t arg, const void *data, uint8_t len);
+
+#endif
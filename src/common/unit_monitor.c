@@ -0,0 +1,366 @@
+#include "unit_monitor.h"
+#include "logger.h"
+#include "system.h"
+#include <errno.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_LIBSYSTEMD
+#include <systemd/sd-bus.h>
+#endif
+
+#define POLL_INTERVAL_MS 5000
+#define STOP_CHECK_MS    250
+#define LINE_LEN         512
+
+#define SYSTEMD_DEST       "org.freedesktop.systemd1"
+#define SYSTEMD_PATH       "/org/freedesktop/systemd1"
+#define SYSTEMD_UNIT_PATH  SYSTEMD_PATH "/unit"
+#define SYSTEMD_MANAGER    SYSTEMD_DEST ".Manager"
+#define SYSTEMD_UNIT       SYSTEMD_DEST ".Unit"
+#define DBUS_PROPERTIES    "org.freedesktop.DBus.Properties"
+#define BUS_WAIT_US        (STOP_CHECK_MS * 1000)
+
+static uint8_t *count_of(unit_counts_t *counts, unit_state_t state) {
+    return (state == UNIT_ACTIVE) ? &counts->active : (state == UNIT_FAILED) ? &counts->failed : NULL;
+}
+
+static void count_add(unit_counts_t *counts, unit_state_t state, int delta) {
+    uint8_t *count = count_of(counts, state);
+    if (count != NULL) {
+        __atomic_add_fetch(count, delta, __ATOMIC_RELAXED);
+    }
+}
+
+// caller must hold the mutex
+static unit_entry_t *find_unit(unit_monitor_t *mon, const char *unit) {
+    for (uint8_t i = 0; i < mon->len; i++) {
+        if (strcmp(mon->units[i].name, unit) == 0) {
+            return &mon->units[i];
+        }
+    }
+    return NULL;
+}
+
+unit_monitor_t *unit_monitor_init(const char *pattern, unit_monitor_cb_t cb) {
+    if ((pattern == NULL) || (strlen(pattern) >= UNIT_NAME_MAX_LEN)) {
+        return NULL;
+    }
+    unit_monitor_t *mon = calloc(1, sizeof(unit_monitor_t));
+    if (mon == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&mon->mutex, NULL);
+    strcpy(mon->pattern, pattern);
+    mon->cb = cb;
+    return mon;
+}
+
+void unit_monitor_free(unit_monitor_t *mon) {
+    if (mon == NULL) {
+        return;
+    }
+    if (mon->running) {
+        mon->running = false;
+        pthread_join(mon->thread, NULL);
+    }
+    pthread_mutex_destroy(&mon->mutex);
+    free(mon);
+}
+
+int unit_monitor_set_state(unit_monitor_t *mon, const char *unit, unit_state_t state) {
+    if ((mon == NULL) || (unit == NULL)) {
+        return -EINVAL;
+    }
+    if ((strlen(unit) >= UNIT_NAME_MAX_LEN) || (fnmatch(mon->pattern, unit, 0) != 0)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&mon->mutex);
+    unit_entry_t *entry = find_unit(mon, unit);
+    bool changed = true;
+    if (entry != NULL) {
+        entry->seen = true;
+        changed = entry->state != state;
+        if (changed) {
+            count_add(&mon->counts, entry->state, -1);
+            count_add(&mon->counts, state, 1);
+            entry->state = state;
+        }
+    } else if (mon->len < UNIT_MONITOR_MAX_UNITS) {
+        entry = &mon->units[mon->len++];
+        strcpy(entry->name, unit);
+        entry->state = state;
+        entry->seen = true;
+        __atomic_add_fetch(&mon->counts.total, 1, __ATOMIC_RELAXED);
+        count_add(&mon->counts, state, 1);
+    } else {
+        pthread_mutex_unlock(&mon->mutex);
+        return -ENOSPC;
+    }
+    unit_counts_t counts = unit_monitor_counts(mon);
+    pthread_mutex_unlock(&mon->mutex);
+
+    if (changed && mon->cb) {
+        mon->cb(unit, state, counts);
+    }
+    return changed;
+}
+
+int unit_monitor_remove(unit_monitor_t *mon, const char *unit) {
+    if ((mon == NULL) || (unit == NULL)) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&mon->mutex);
+    unit_entry_t *entry = find_unit(mon, unit);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&mon->mutex);
+        return 0;
+    }
+    __atomic_sub_fetch(&mon->counts.total, 1, __ATOMIC_RELAXED);
+    count_add(&mon->counts, entry->state, -1);
+    *entry = mon->units[--mon->len]; // order doesn't matter, move the last one into the gap
+    unit_counts_t counts = unit_monitor_counts(mon);
+    pthread_mutex_unlock(&mon->mutex);
+
+    if (mon->cb) {
+        mon->cb(unit, UNIT_INACTIVE, counts);
+    }
+    return 1;
+}
+
+unit_counts_t unit_monitor_counts(unit_monitor_t *mon) {
+    unit_counts_t counts = {0};
+    if (mon != NULL) {
+        counts.total = __atomic_load_n(&mon->counts.total, __ATOMIC_RELAXED);
+        counts.active = __atomic_load_n(&mon->counts.active, __ATOMIC_RELAXED);
+        counts.failed = __atomic_load_n(&mon->counts.failed, __ATOMIC_RELAXED);
+    }
+    return counts;
+}
+
+unit_state_t unit_state_from_str(const char *active_state) {
+    if ((strcmp(active_state, "active") == 0) || (strcmp(active_state, "reloading") == 0)) {
+        return UNIT_ACTIVE;
+    } else if (strcmp(active_state, "failed") == 0) {
+        return UNIT_FAILED;
+    }
+    return UNIT_INACTIVE;
+}
+
+const char *unit_state_str(unit_state_t state) {
+    return (state == UNIT_ACTIVE) ? "active" : (state == UNIT_FAILED) ? "failed" : "inactive";
+}
+
+/*
+ * Fallback backend, lists the units every POLL_INTERVAL_MS. Only differences from the last poll reach the counts and
+ * callback, same as with the bus.
+ */
+static int poll_units(unit_monitor_t *mon) {
+    char cmd[LINE_LEN];
+    snprintf(cmd, sizeof(cmd), "systemctl list-units --all --no-legend --plain '%s' 2>/dev/null", mon->pattern);
+    FILE *pipe = popen(cmd, "r");
+    if (pipe == NULL) {
+        return -errno;
+    }
+
+    pthread_mutex_lock(&mon->mutex);
+    for (uint8_t i = 0; i < mon->len; i++) {
+        mon->units[i].seen = false;
+    }
+    pthread_mutex_unlock(&mon->mutex);
+
+    char line[LINE_LEN];
+    char name[UNIT_NAME_MAX_LEN];
+    char active_state[32];
+    while (fgets(line, sizeof(line), pipe) != NULL) {
+        // unit load active sub description
+        if (sscanf(line, "%127s %*s %31s", name, active_state) == 2) {
+            unit_monitor_set_state(mon, name, unit_state_from_str(active_state));
+        }
+    }
+    if (pclose(pipe) != 0) {
+        return -EIO; // keep the last known units rather than dropping them all
+    }
+
+    while (1) {
+        pthread_mutex_lock(&mon->mutex);
+        name[0] = '\0';
+        for (uint8_t i = 0; i < mon->len; i++) {
+            if (!mon->units[i].seen) {
+                strcpy(name, mon->units[i].name);
+                break;
+            }
+        }
+        pthread_mutex_unlock(&mon->mutex);
+        if (name[0] == '\0') {
+            break;
+        }
+        unit_monitor_remove(mon, name);
+    }
+    return 0;
+}
+
+static void poll_loop(unit_monitor_t *mon) {
+    uint32_t elapsed_ms = POLL_INTERVAL_MS;
+    while (mon->running) {
+        if (elapsed_ms >= POLL_INTERVAL_MS) {
+            elapsed_ms = 0;
+            int r = poll_units(mon);
+            if (r < 0) {
+                log_error("failed to list systemd units: %d", r);
+            }
+        }
+        sleep_ms(STOP_CHECK_MS);
+        elapsed_ms += STOP_CHECK_MS;
+    }
+}
+
+#ifdef HAVE_LIBSYSTEMD
+static int on_properties_changed(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error) {
+    (void)ret_error;
+    unit_monitor_t *mon = (unit_monitor_t *)userdata;
+    const char *interface = NULL;
+    char *unit = NULL;
+    if ((sd_bus_message_read(msg, "s", &interface) < 0) || (strcmp(interface, SYSTEMD_UNIT) != 0) ||
+        (sd_bus_path_decode(sd_bus_message_get_path(msg), SYSTEMD_UNIT_PATH, &unit) <= 0)) {
+        return 0;
+    }
+
+    int r = sd_bus_message_enter_container(msg, 'a', "{sv}");
+    while ((r > 0) && ((r = sd_bus_message_enter_container(msg, 'e', "sv")) > 0)) {
+        const char *key = NULL;
+        const char *value = NULL;
+        r = sd_bus_message_read(msg, "s", &key);
+        if (r < 0) {
+            break;
+        } else if (strcmp(key, "ActiveState") == 0) {
+            r = sd_bus_message_read(msg, "v", "s", &value);
+            if (r >= 0) {
+                unit_monitor_set_state(mon, unit, unit_state_from_str(value));
+            }
+        } else {
+            r = sd_bus_message_skip(msg, "v");
+        }
+        if (r >= 0) {
+            r = sd_bus_message_exit_container(msg);
+        }
+    }
+    free(unit);
+    return 0;
+}
+
+static int on_unit_removed(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error) {
+    (void)ret_error;
+    const char *unit = NULL;
+    const char *path = NULL;
+    if (sd_bus_message_read(msg, "so", &unit, &path) >= 0) {
+        unit_monitor_remove((unit_monitor_t *)userdata, unit);
+    }
+    return 0;
+}
+
+static int load_units(sd_bus *bus, unit_monitor_t *mon) {
+    sd_bus_message *msg = NULL;
+    sd_bus_message *reply = NULL;
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    char *patterns[] = {mon->pattern, NULL};
+    char *states[] = {NULL};
+
+    int r = sd_bus_message_new_method_call(bus, &msg, SYSTEMD_DEST, SYSTEMD_PATH, SYSTEMD_MANAGER,
+                                           "ListUnitsByPatterns");
+    if (r >= 0) {
+        r = sd_bus_message_append_strv(msg, states);
+    }
+    if (r >= 0) {
+        r = sd_bus_message_append_strv(msg, patterns);
+    }
+    if (r >= 0) {
+        r = sd_bus_call(bus, msg, 0, &error, &reply);
+    }
+    if (r >= 0) {
+        r = sd_bus_message_enter_container(reply, 'a', "(ssssssouso)");
+    }
+    while (r > 0) {
+        const char *name, *description, *load_state, *active_state, *sub_state, *following, *path, *job_type,
+            *job_path;
+        uint32_t job_id;
+        r = sd_bus_message_read(reply, "(ssssssouso)", &name, &description, &load_state, &active_state, &sub_state,
+                                &following, &path, &job_id, &job_type, &job_path);
+        if (r > 0) {
+            unit_monitor_set_state(mon, name, unit_state_from_str(active_state));
+        }
+    }
+
+    sd_bus_error_free(&error);
+    sd_bus_message_unref(reply);
+    sd_bus_message_unref(msg);
+    return r;
+}
+
+// returns once stopped, or a negative errno if the bus could not be set up
+static int bus_loop(unit_monitor_t *mon) {
+    sd_bus *bus = NULL;
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+
+    // the signals must be matched before listing the units, or a change between the two would be missed
+    int r = sd_bus_open_system(&bus);
+    if (r >= 0) {
+        r = sd_bus_match_signal(bus, NULL, SYSTEMD_DEST, NULL, DBUS_PROPERTIES, "PropertiesChanged",
+                                on_properties_changed, mon);
+    }
+    if (r >= 0) {
+        r = sd_bus_match_signal(bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH, SYSTEMD_MANAGER, "UnitRemoved",
+                                on_unit_removed, mon);
+    }
+    if (r >= 0) { // systemd only emits unit signals with a subscriber
+        r = sd_bus_call_method(bus, SYSTEMD_DEST, SYSTEMD_PATH, SYSTEMD_MANAGER, "Subscribe", &error, NULL, "");
+    }
+    if (r >= 0) {
+        r = load_units(bus, mon);
+    }
+    sd_bus_error_free(&error);
+
+    while ((r >= 0) && mon->running) {
+        r = sd_bus_process(bus, NULL);
+        if (r == 0) {
+            r = sd_bus_wait(bus, BUS_WAIT_US);
+        }
+    }
+    sd_bus_flush_close_unref(bus);
+    if (mon->running) {
+        log_error("systemd bus error: %d", r);
+    }
+    return mon->running ? r : 0;
+}
+#endif
+
+static void *monitor_thread(void *arg) {
+    unit_monitor_t *mon = (unit_monitor_t *)arg;
+#ifdef HAVE_LIBSYSTEMD
+    if (bus_loop(mon) == 0) {
+        return NULL;
+    }
+    log_info("polling systemctl for %s", mon->pattern);
+#endif
+    poll_loop(mon);
+    return NULL;
+}
+
+int unit_monitor_start(unit_monitor_t *mon) {
+    if ((mon == NULL) || mon->running) {
+        return -EINVAL;
+    }
+    mon->running = true;
+    int r = pthread_create(&mon->thread, NULL, monitor_thread, mon);
+    if (r != 0) {
+        mon->running = false;
+        return -r;
+    }
+    return 0;
+}
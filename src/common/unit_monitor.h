@@ -0,0 +1,67 @@
+#ifndef _UNIT_MONITOR_H_
+#define _UNIT_MONITOR_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Tracks the state of the systemd units matching a glob and keeps their total/active/failed counts, updated one unit
+ * at a time as changes come in, so reading the counts never touches systemd. With libsystemd the monitor follows the
+ * unit PropertiesChanged signals on the system bus, without it (or with no bus) systemctl is polled and only the
+ * differences are applied. unit_monitor_set_state() and unit_monitor_remove() are the same path the backends use, so
+ * they also stand in for systemd when nothing is started.
+ */
+
+#define UNIT_MONITOR_MAX_UNITS 64
+#define UNIT_NAME_MAX_LEN      128
+
+typedef enum {
+    UNIT_INACTIVE = 0, // also activating and deactivating
+    UNIT_ACTIVE = 1,   // also reloading
+    UNIT_FAILED = 2,
+} unit_state_t;
+
+typedef struct {
+    uint8_t total;
+    uint8_t active;
+    uint8_t failed;
+} unit_counts_t;
+
+// called on every unit state change, after the counts are updated, from whichever thread made the change
+typedef void (*unit_monitor_cb_t)(const char *unit, unit_state_t state, unit_counts_t counts);
+
+typedef struct {
+    char name[UNIT_NAME_MAX_LEN];
+    unit_state_t state;
+    bool seen; // listed by the latest systemctl poll
+} unit_entry_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    char pattern[UNIT_NAME_MAX_LEN];
+    unit_entry_t units[UNIT_MONITOR_MAX_UNITS];
+    uint8_t len;
+    unit_counts_t counts; // each count is read and written atomically, reads don't take the mutex
+    unit_monitor_cb_t cb;
+    pthread_t thread;
+    bool running;
+} unit_monitor_t;
+
+// pattern is a glob on unit names, e.g. "oresat*.service", cb can be NULL
+unit_monitor_t *unit_monitor_init(const char *pattern, unit_monitor_cb_t cb);
+void unit_monitor_free(unit_monitor_t *mon);
+
+// loads the current units and follows their changes from a thread
+int unit_monitor_start(unit_monitor_t *mon);
+
+// returns 1 if it changed the counts, 0 if not (incl. units not matching the pattern), or a negative errno
+int unit_monitor_set_state(unit_monitor_t *mon, const char *unit, unit_state_t state);
+int unit_monitor_remove(unit_monitor_t *mon, const char *unit);
+
+unit_counts_t unit_monitor_counts(unit_monitor_t *mon);
+// maps a systemd ActiveState
+unit_state_t unit_state_from_str(const char *active_state);
+const char *unit_state_str(unit_state_t state);
+
+#endif
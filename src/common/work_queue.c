@@ -0,0 +1,151 @@
+#include "work_queue.h"
+#include "logger.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct work_item {
+    work_fn_t fn;
+    void *arg;
+    work_item_t *next;
+};
+
+// caller must hold the mutex
+static work_item_t *take_item(work_queue_t *wq, work_class_t *class) {
+    for (int c = 0; c < WORK_CLASS_LEN; c++) {
+        if (!wq->head[c] || ((c == WORK_BULK) && (wq->bulk_running >= wq->bulk_max))) {
+            continue;
+        }
+        work_item_t *item = wq->head[c];
+        wq->head[c] = item->next;
+        if (!wq->head[c]) {
+            wq->tail[c] = NULL;
+        }
+        *class = c;
+        return item;
+    }
+    return NULL;
+}
+
+static void *worker_thread(void *arg) {
+    work_queue_t *wq = (work_queue_t *)arg;
+
+    pthread_mutex_lock(&wq->mutex);
+    while (!wq->stop) {
+        work_class_t class;
+        work_item_t *item = take_item(wq, &class);
+        if (!item) {
+            pthread_cond_wait(&wq->cond, &wq->mutex);
+            continue;
+        }
+        if (class == WORK_BULK) {
+            wq->bulk_running++;
+        }
+        pthread_mutex_unlock(&wq->mutex);
+
+        item->fn(item->arg);
+        free(item);
+
+        pthread_mutex_lock(&wq->mutex);
+        if (class == WORK_BULK) {
+            wq->bulk_running--;
+            pthread_cond_broadcast(&wq->cond); // a bulk job may have been waiting for a free slot
+        }
+    }
+    pthread_mutex_unlock(&wq->mutex);
+    return NULL;
+}
+
+work_queue_t *work_queue_init(uint8_t workers) {
+    work_queue_t *wq = calloc(1, sizeof(work_queue_t));
+    if (!wq) {
+        return NULL;
+    }
+    pthread_mutex_init(&wq->mutex, NULL);
+    pthread_cond_init(&wq->cond, NULL);
+    wq->bulk_max = (workers > 1) ? (workers - 1) : 1;
+    if (workers == 0) {
+        return wq;
+    }
+
+    wq->threads = calloc(workers, sizeof(pthread_t));
+    if (!wq->threads) {
+        work_queue_free(wq);
+        return NULL;
+    }
+    for (; wq->workers < workers; wq->workers++) {
+        if (pthread_create(&wq->threads[wq->workers], NULL, worker_thread, wq) != 0) {
+            log_error("work queue thread %u failed to start", wq->workers);
+            work_queue_free(wq);
+            return NULL;
+        }
+    }
+    return wq;
+}
+
+void work_queue_free(work_queue_t *wq) {
+    if (!wq) {
+        return;
+    }
+
+    pthread_mutex_lock(&wq->mutex);
+    wq->stop = true;
+    pthread_cond_broadcast(&wq->cond);
+    pthread_mutex_unlock(&wq->mutex);
+    for (uint8_t i = 0; i < wq->workers; i++) {
+        pthread_join(wq->threads[i], NULL);
+    }
+
+    for (int c = 0; c < WORK_CLASS_LEN; c++) {
+        while (wq->head[c]) {
+            work_item_t *item = wq->head[c];
+            wq->head[c] = item->next;
+            free(item->arg);
+            free(item);
+        }
+    }
+    pthread_cond_destroy(&wq->cond);
+    pthread_mutex_destroy(&wq->mutex);
+    free(wq->threads);
+    free(wq);
+}
+
+int work_queue_submit(work_queue_t *wq, work_class_t class, work_fn_t fn, void *arg) {
+    if (!wq || !fn || (class >= WORK_CLASS_LEN)) {
+        return -EINVAL;
+    }
+    if (wq->workers == 0) {
+        fn(arg);
+        return 0;
+    }
+
+    work_item_t *item = malloc(sizeof(work_item_t));
+    if (!item) {
+        return -ENOMEM;
+    }
+    item->fn = fn;
+    item->arg = arg;
+    item->next = NULL;
+
+    pthread_mutex_lock(&wq->mutex);
+    if (wq->stop) {
+        pthread_mutex_unlock(&wq->mutex);
+        free(item);
+        return -ECANCELED;
+    }
+    if (wq->tail[class]) {
+        wq->tail[class]->next = item;
+    } else {
+        wq->head[class] = item;
+    }
+    wq->tail[class] = item;
+    pthread_cond_signal(&wq->cond);
+    pthread_mutex_unlock(&wq->mutex);
+    return 0;
+}
+
+uint8_t work_queue_workers(work_queue_t *wq) {
+    return wq ? wq->workers : 0;
+}
@@ -0,0 +1,46 @@
+#ifndef _WORK_QUEUE_H_
+#define _WORK_QUEUE_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Worker pool with priority classes. Workers always take the oldest job of the highest class queued, and bulk jobs
+ * only run on all but one worker, so an interactive job never waits for more than the job in front of it. A queue
+ * with no workers runs each job inline in work_queue_submit().
+ */
+
+typedef enum {
+    WORK_IMMEDIATE = 0,   // OD writes, TPDO, SYNC, EMCY
+    WORK_INTERACTIVE = 1, // short SDO transfers
+    WORK_BULK = 2,        // file transfers and copies
+} work_class_t;
+
+#define WORK_CLASS_LEN 3
+
+typedef void (*work_fn_t)(void *arg);
+
+typedef struct work_item work_item_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    work_item_t *head[WORK_CLASS_LEN];
+    work_item_t *tail[WORK_CLASS_LEN];
+    pthread_t *threads;
+    uint8_t workers;
+    uint8_t bulk_max;
+    uint8_t bulk_running;
+    bool stop;
+} work_queue_t;
+
+work_queue_t *work_queue_init(uint8_t workers);
+// waits for running jobs, queued jobs are dropped and their arg is passed to free()
+void work_queue_free(work_queue_t *wq);
+
+// arg is owned by fn once submitted (not on error), it must be heap allocated so it can be freed if dropped
+int work_queue_submit(work_queue_t *wq, work_class_t class, work_fn_t fn, void *arg);
+uint8_t work_queue_workers(work_queue_t *wq);
+
+#endif
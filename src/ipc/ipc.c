@@ -3,24 +3,54 @@
 #include "ipc_broadcast.h"
 #include "ipc_consume.h"
 #include "ipc_respond.h"
+#include "work_queue.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
 #include <zmq.h>
 
 static void *context = NULL;
+static work_queue_t *work_queue = NULL;
 
-void ipc_init(OD_t *od) {
+void ipc_init(OD_t *od, bool compact_od_writes, uint8_t workers) {
     context = zmq_ctx_new();
     if (context) {
-        ipc_broadcast_init(context, od);
-        ipc_consume_init(context);
-        ipc_respond_init(context);
+        work_queue = work_queue_init(workers);
+        ipc_broadcast_init(context, od, compact_od_writes);
+        ipc_consume_init(context, work_queue);
+        ipc_respond_init(context, work_queue);
     }
 }
 
 void ipc_free(void) {
     if (context) {
+        work_queue_free(work_queue); // workers still reply through the respond sockets
+        work_queue = NULL;
         ipc_broadcast_free();
         ipc_consume_free();
         ipc_respond_free();
         zmq_ctx_term(context);
     }
 }
+
+int ipc_epoll_add(int epoll_fd) {
+    int fds[] = {ipc_respond_fd(), ipc_consume_fd(), ipc_broadcast_fd(), ipc_broadcast_queue_fd()};
+    for (unsigned int i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        struct epoll_event ev = {
+            .events = EPOLLIN,
+            .data.fd = fds[i],
+        };
+        if (fds[i] < 0) {
+            return -ENOTCONN;
+        }
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &ev) < 0) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+bool ipc_is_fd(int fd) {
+    return (fd >= 0) && ((fd == ipc_respond_fd()) || (fd == ipc_consume_fd()) || (fd == ipc_broadcast_fd()) ||
+                         (fd == ipc_broadcast_queue_fd()));
+}
@@ -2,8 +2,22 @@
 #define _IPC_H_
 
 #include "CANopen.h"
+#include <stdbool.h>
+#include <stdint.h>
 
-void ipc_init(OD_t *od);
+/*
+ * workers is the size of the pool that runs sdo and file requests off the ipc threads, so they can't hold up od
+ * writes, tpdo, sync and emcy msgs. With 0 workers every msg is handled inline by the thread that received it.
+ */
+void ipc_init(OD_t *od, bool compact_od_writes, uint8_t workers);
 void ipc_free(void);
 
+/*
+ * Single thread mode: adds the sockets' ZMQ_FD to the caller's epoll. They only signal that zmq's internal state
+ * changed (edge triggered), so after any wakeup every ipc_*_process() must be called with wait false until they all
+ * return false.
+ */
+int ipc_epoll_add(int epoll_fd);
+bool ipc_is_fd(int fd);
+
 #endif
@@ -1,29 +1,386 @@
 #include "ipc_broadcast.h"
 #include "CANopen.h"
 #include "CO_ODinterface.h"
+#include "bus_stats.h"
+#include "can_rx.h"
 #include "ipc_msg.h"
 #include "logger.h"
+#include "od_seqlock.h"
+#include "system.h"
+#include <assert.h>
+#include <errno.h>
+#include <linux/can.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <zmq.h>
 
 #define CAN_BUS_NOT_FOUND 0
 #define CAN_BUS_DOWN      1
 #define CAN_BUS_UP        2
 
+#define COMPACT_FLUSH_MS      10
+#define VARINT_MAX_LEN        10 // for a uint64
+#define COMPACT_ENTRY_MAX_LEN (2 * VARINT_MAX_LEN)
+#define RPDO_MAX              512
+#define PDO_COB_ID_INVALID    0x80000000
+#define COMPACT_CLIENTS_MAX   32
+#define CLIENT_ID_MAX_LEN     8
+
+static_assert(IPC_BUS_STATS_CLASS_LEN == BUS_STATS_CLASS_LEN, "bus stats classes do not match the ipc msg");
+static_assert(IPC_BUS_STATS_NODES_MAX >= (BUS_STATS_NODES - 1), "bus stats nodes do not fit in the ipc msg");
+
+typedef struct {
+    uint32_t key; // index << 8 | subindex
+    const void *data;
+    uint8_t len;
+    seqlock_t *lock;
+} compact_entry_t;
+
 static void *broadcaster = NULL;
 static void *monitor = NULL;
-static uint8_t clients = 0;
+static uint8_t clients = 0; // only changed by the owner thread
+
+/*
+ * zmq sockets are not thread safe, but msgs come from the RT, main, ipc, scheduler, updater and unit monitor threads.
+ * They go through queue_push (under queue_mutex) and the thread running ipc_broadcast_process() forwards them to the
+ * PUB socket, so it is the only one sending on it.
+ */
+static void *queue_push = NULL;
+static void *queue_pull = NULL;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t queue_dropped = 0;
+
+static compact_entry_t *compact_table = NULL;
+static uint32_t compact_table_len = 0;
+static uint32_t compact_table_crc = 0;
+static uint32_t *compact_dirty = NULL; // bitmap of table entries written since the last flush
+
+typedef struct {
+    uint32_t key; // index << 8 | subindex
+    uint16_t cob_id;
+} rpdo_entry_t;
+
+typedef struct {
+    uint8_t id[CLIENT_ID_MAX_LEN]; // ROUTER routing id
+    uint8_t id_len;
+    bool match;
+} compact_client_t;
+
+/*
+ * Clients that sent their compact table crc since the last client connected or disconnected, compact writes are only
+ * sent while all connected clients did and every crc matched.
+ */
+static compact_client_t compact_clients[COMPACT_CLIENTS_MAX];
+static uint32_t compact_clients_len = 0;
+static bool compact_clients_full = false; // a client did not fit, so it is not known to match
+static pthread_mutex_t compact_clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool compact_on = false;
+
+static rpdo_entry_t *rpdo_table = NULL; // od entries mapped to a valid RPDO, sorted by key
+static uint32_t rpdo_table_len = 0;
 
 static ODR_t ipc_broadcast_data(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
 
 static OD_extension_t ext = {
     .object = NULL,
-    .read = OD_readOriginal,
+    .read = od_seqlock_read_original, // tpdos and sdo uploads, while ipc threads may be writing
     .write = ipc_broadcast_data,
 };
 
-int ipc_broadcast_init(void *context, OD_t *od) {
+/*
+ * Numeric data types only, the same rule as EntryKeyTable in the python lib. The od config loader marks exactly those
+ * ODA_TRPDO, octet strings of 1, 2, 4 or 8 bytes are not in the table.
+ */
+static bool is_compact_sub(const OD_entry_t *entry, uint8_t subindex, OD_IO_t *io) {
+    if (OD_getSub(entry, subindex, io, true) != ODR_OK) {
+        return false;
+    }
+    OD_size_t len = io->stream.dataLength;
+    return (io->stream.dataOrig != NULL) && (io->stream.attribute & ODA_TRPDO) && !(io->stream.attribute & ODA_STR) &&
+           ((len == 1) || (len == 2) || (len == 4) || (len == 8));
+}
+
+// first call with table NULL to count entries
+static uint32_t compact_table_fill(OD_t *od, compact_entry_t *table) {
+    uint32_t n = 0;
+    OD_IO_t io;
+    for (int i = 0; i < od->size; i++) {
+        OD_entry_t *entry = &od->list[i];
+        if (entry->index < OD_SEQLOCK_INDEX_MIN) {
+            continue;
+        }
+        // list is sorted by index, so keys are sorted too
+        int first = (entry->subEntriesCount > 1) ? 1 : 0; // skip highest subindex of records/arrays
+        for (int sub = first; sub <= UINT8_MAX; sub++) {
+            if (!is_compact_sub(entry, sub, &io)) {
+                continue;
+            }
+            if (table) {
+                table[n].key = (entry->index << 8) | sub;
+                table[n].data = io.stream.dataOrig;
+                table[n].len = io.stream.dataLength;
+                table[n].lock = od_seqlock_get(entry);
+                uint8_t raw[4] = {entry->index & 0xFF, entry->index >> 8, sub, io.stream.dataLength};
+                compact_table_crc = crc32_update(compact_table_crc, raw, sizeof(raw));
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+static int compact_table_init(OD_t *od) {
+    uint32_t len = compact_table_fill(od, NULL);
+    if (len == 0) {
+        return 0;
+    }
+
+    compact_table = malloc(len * sizeof(compact_entry_t));
+    compact_dirty = calloc((len + 31) / 32, sizeof(uint32_t));
+    if (!compact_table || !compact_dirty) {
+        free(compact_table);
+        free(compact_dirty);
+        compact_table = NULL;
+        compact_dirty = NULL;
+        return -ENOMEM;
+    }
+
+    compact_table_crc = 0;
+    compact_table_len = compact_table_fill(od, compact_table);
+    log_info("compact od write broadcasts for %u entries (table crc 0x%08X)", compact_table_len, compact_table_crc);
+    return 0;
+}
+
+static int compact_table_find(uint16_t index, uint8_t subindex) {
+    uint32_t key = (index << 8) | subindex;
+    int low = 0;
+    int high = (int)compact_table_len - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        if (compact_table[mid].key == key) {
+            return mid;
+        } else if (compact_table[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+// under compact_clients_mutex
+static void compact_clients_update(void) {
+    bool on = !compact_clients_full && (compact_clients_len >= ipc_clients_count());
+    for (uint32_t i = 0; on && (i < compact_clients_len); i++) {
+        on = compact_clients[i].match;
+    }
+    __atomic_store_n(&compact_on, on, __ATOMIC_RELEASE);
+}
+
+// owner thread only, the clients still connected are asked for their crc again
+static void compact_clients_reset(void) {
+    pthread_mutex_lock(&compact_clients_mutex);
+    compact_clients_len = 0;
+    compact_clients_full = false;
+    compact_clients_update();
+    pthread_mutex_unlock(&compact_clients_mutex);
+
+    if (compact_table && broadcaster) {
+        ipc_msg_od_compact_table_t msg = {
+            .header =
+                {
+                    .version = IPC_MSG_VERSION,
+                    .id = IPC_MSG_ID_OD_COMPACT_TABLE,
+                },
+            .table_crc = compact_table_crc,
+        };
+        zmq_send(broadcaster, &msg, sizeof(msg), 0);
+    }
+}
+
+uint32_t ipc_broadcast_compact_client(const uint8_t *id, size_t id_len, uint32_t table_crc) {
+    if (!compact_table || !id) {
+        return 0;
+    }
+
+    bool match = table_crc == compact_table_crc;
+    if (!match) {
+        log_warning("client compact table crc 0x%08X does not match 0x%08X, od writes are sent per entry", table_crc,
+                    compact_table_crc);
+    }
+
+    pthread_mutex_lock(&compact_clients_mutex);
+    uint32_t i = 0;
+    while ((i < compact_clients_len) &&
+           ((compact_clients[i].id_len != id_len) || (memcmp(compact_clients[i].id, id, id_len) != 0))) {
+        i++;
+    }
+    if ((i == compact_clients_len) && (compact_clients_len < COMPACT_CLIENTS_MAX) && (id_len <= CLIENT_ID_MAX_LEN)) {
+        memcpy(compact_clients[i].id, id, id_len);
+        compact_clients[i].id_len = id_len;
+        compact_clients_len++;
+    }
+    if (i < compact_clients_len) {
+        compact_clients[i].match = match;
+    } else {
+        compact_clients_full = true;
+    }
+    compact_clients_update();
+    pthread_mutex_unlock(&compact_clients_mutex);
+    return compact_table_crc;
+}
+
+static int cmp_rpdo_entry(const void *a, const void *b) {
+    uint32_t key_a = ((const rpdo_entry_t *)a)->key;
+    uint32_t key_b = ((const rpdo_entry_t *)b)->key;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+// first call with table NULL to count entries
+static uint32_t rpdo_table_fill(OD_t *od, rpdo_entry_t *table) {
+    uint32_t n = 0;
+    for (int i = 0; i < RPDO_MAX; i++) {
+        OD_entry_t *comm = OD_find(od, 0x1400 + i);
+        OD_entry_t *map = OD_find(od, 0x1600 + i);
+        uint32_t cob_id;
+        uint8_t map_len;
+        if (!comm || !map || (OD_get_u32(comm, 1, &cob_id, true) != ODR_OK) || (cob_id & PDO_COB_ID_INVALID) ||
+            (OD_get_u8(map, 0, &map_len, true) != ODR_OK)) {
+            continue;
+        }
+        for (uint8_t sub = 1; sub <= map_len; sub++) {
+            uint32_t param; // index << 16 | subindex << 8 | bit length
+            if ((OD_get_u32(map, sub, &param, true) != ODR_OK) || ((param >> 16) < 0x4000)) {
+                continue; // only entries with the ipc broadcast extension
+            }
+            if (table) {
+                table[n].key = param >> 8;
+                table[n].cob_id = cob_id & CAN_SFF_MASK;
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+// the mapping is read once, RPDOs remapped at runtime keep the old timestamps
+static int rpdo_table_init(OD_t *od) {
+    uint32_t len = rpdo_table_fill(od, NULL);
+    if (len == 0) {
+        return 0;
+    }
+    rpdo_table = malloc(len * sizeof(rpdo_entry_t));
+    if (!rpdo_table) {
+        return -ENOMEM;
+    }
+    rpdo_table_len = rpdo_table_fill(od, rpdo_table);
+    qsort(rpdo_table, rpdo_table_len, sizeof(rpdo_entry_t), cmp_rpdo_entry);
+    return 0;
+}
+
+static bool rpdo_find(uint16_t index, uint8_t subindex, uint16_t *cob_id) {
+    rpdo_entry_t key = {.key = (index << 8) | subindex};
+    const rpdo_entry_t *entry =
+        rpdo_table ? bsearch(&key, rpdo_table, rpdo_table_len, sizeof(rpdo_entry_t), cmp_rpdo_entry) : NULL;
+    if (entry) {
+        *cob_id = entry->cob_id;
+    }
+    return entry != NULL;
+}
+
+static size_t varint_encode(uint64_t value, uint8_t *buf) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        buf[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buf[len++] = value;
+    return len;
+}
+
+// zigzag at the entry's bit width, so small negative signed values stay small without knowing the data type
+static uint64_t zigzag_encode(uint64_t raw, uint8_t len) {
+    uint8_t bits = len * 8;
+    uint64_t mask = (bits == 64) ? UINT64_MAX : ((1ULL << bits) - 1);
+    uint64_t sign = (raw >> (bits - 1)) & 1;
+    return ((raw << 1) ^ (sign ? mask : 0)) & mask;
+}
+
+// rx_time_ns is only appended for rpdo mapped entries, NULL for the rest
+static size_t make_od_write(ipc_msg_od_t *msg, uint16_t index, uint8_t subindex, const void *data, uint8_t len,
+                            const uint64_t *rx_time_ns) {
+    msg->header.version = IPC_MSG_VERSION;
+    msg->header.id = IPC_MSG_ID_OD_WRITE;
+    msg->index = index;
+    msg->subindex = subindex;
+    msg->buffer.len = len;
+    memcpy(msg->buffer.data, data, len);
+    size_t msg_len = IPC_MSG_OD_MIN_LEN + len;
+    if (rx_time_ns && ((len + sizeof(uint64_t)) <= sizeof(msg->buffer.data))) {
+        memcpy(&msg->buffer.data[len], rx_time_ns, sizeof(uint64_t));
+        msg_len += sizeof(uint64_t);
+    }
+    return msg_len;
+}
+
+// owner thread only, with a client on another table the entries written since the last flush go out one by one
+static void compact_flush(void) {
+    ipc_msg_od_compact_t msg = {
+        .header =
+            {
+                .version = IPC_MSG_VERSION,
+                .id = IPC_MSG_ID_OD_WRITE_COMPACT,
+            },
+        .table_crc = compact_table_crc,
+    };
+    size_t len = 0;
+    uint32_t last_key = 0;
+    uint32_t words = (compact_table_len + 31) / 32;
+    bool compact = __atomic_load_n(&compact_on, __ATOMIC_ACQUIRE);
+
+    for (uint32_t w = 0; w < words; w++) {
+        uint32_t bits = __atomic_exchange_n(&compact_dirty[w], 0, __ATOMIC_ACQ_REL);
+        if ((bits == 0) || (clients == 0) || !broadcaster) {
+            continue;
+        }
+        while (bits) {
+            uint32_t key = (w * 32) + __builtin_ctz(bits);
+            bits &= bits - 1;
+
+            uint64_t raw = 0;
+            if (compact_table[key].lock) {
+                seqlock_read(compact_table[key].lock, &raw, compact_table[key].data, compact_table[key].len);
+            } else {
+                memcpy(&raw, compact_table[key].data, compact_table[key].len);
+            }
+            if (!compact) {
+                ipc_msg_od_t msg_od;
+                size_t msg_od_len = make_od_write(&msg_od, compact_table[key].key >> 8, compact_table[key].key & 0xFF,
+                                                  &raw, compact_table[key].len, NULL);
+                zmq_send(broadcaster, &msg_od, msg_od_len, 0);
+                continue;
+            }
+
+            if ((len + COMPACT_ENTRY_MAX_LEN) > sizeof(msg.data)) {
+                zmq_send(broadcaster, &msg, IPC_MSG_OD_COMPACT_MIN_LEN + len, 0);
+                len = 0;
+                last_key = 0;
+            }
+            len += varint_encode(key - last_key, &msg.data[len]);
+            len += varint_encode(zigzag_encode(raw, compact_table[key].len), &msg.data[len]);
+            last_key = key;
+        }
+    }
+
+    if (len > 0) {
+        zmq_send(broadcaster, &msg, IPC_MSG_OD_COMPACT_MIN_LEN + len, 0);
+    }
+}
+
+int ipc_broadcast_init(void *context, OD_t *od, bool compact_od_writes) {
     if (!context || !od) {
         return -EINVAL;
     }
@@ -35,8 +392,26 @@ int ipc_broadcast_init(void *context, OD_t *od) {
     monitor = zmq_socket(context, ZMQ_PAIR);
     zmq_connect(monitor, "inproc://monitor");
 
+    if (compact_od_writes && (compact_table_init(od) < 0)) {
+        log_error("compact od write table alloc failed, using per entry broadcasts");
+    }
+    pthread_mutex_lock(&compact_clients_mutex);
+    compact_clients_update();
+    pthread_mutex_unlock(&compact_clients_mutex);
+    if (rpdo_table_init(od) < 0) {
+        log_error("rpdo mapping table alloc failed, od writes will not have rx timestamps");
+    }
+
+    queue_pull = zmq_socket(context, ZMQ_PULL);
+    zmq_bind(queue_pull, "inproc://broadcasts");
+    void *push = zmq_socket(context, ZMQ_PUSH);
+    zmq_connect(push, "inproc://broadcasts");
+    pthread_mutex_lock(&queue_mutex);
+    queue_push = push; // other threads may already be calling broadcast()
+    pthread_mutex_unlock(&queue_mutex);
+
     for (int i = 0; i < od->size; i++) {
-        if (od->list[i].index >= 0x4000) {
+        if (od->list[i].index >= OD_SEQLOCK_INDEX_MIN) {
             OD_extension_init(&od->list[i], &ext);
         }
     }
@@ -44,38 +419,122 @@ int ipc_broadcast_init(void *context, OD_t *od) {
     return 0;
 }
 
-void ipc_broadcast_process(void) {
+int ipc_broadcast_fd(void) {
+    int fd = -1;
+    size_t len = sizeof(fd);
+    return (monitor && (zmq_getsockopt(monitor, ZMQ_FD, &fd, &len) == 0)) ? fd : -1;
+}
+
+int ipc_broadcast_queue_fd(void) {
+    int fd = -1;
+    size_t len = sizeof(fd);
+    return (queue_pull && (zmq_getsockopt(queue_pull, ZMQ_FD, &fd, &len) == 0)) ? fd : -1;
+}
+
+// from any thread, never blocks, the msg is dropped if the owner thread is a whole pipe behind
+static void broadcast(const void *msg, size_t len) {
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_push && (zmq_send(queue_push, msg, len, ZMQ_DONTWAIT) < 0)) {
+        queue_dropped++;
+    }
+    pthread_mutex_unlock(&queue_mutex); // before ipc_broadcast_init() or after ipc_broadcast_free() it's dropped
+}
+
+// owner thread only
+static void forward_queued(void) {
     zmq_msg_t msg;
+    zmq_msg_init(&msg);
+    while (zmq_msg_recv(&msg, queue_pull, ZMQ_DONTWAIT) >= 0) {
+        zmq_msg_send(&msg, broadcaster, 0);
+    }
+    zmq_msg_close(&msg);
+
+    pthread_mutex_lock(&queue_mutex);
+    uint32_t dropped = queue_dropped;
+    queue_dropped = 0;
+    pthread_mutex_unlock(&queue_mutex);
+    if (dropped > 0) {
+        log_error("broadcast queue full, dropped %u msgs", dropped);
+    }
+}
+
+bool ipc_broadcast_process(bool wait) {
+    static uint32_t last_flush_ms = 0;
+    zmq_pollitem_t items[] = {
+        {monitor, 0, ZMQ_POLLIN, 0},
+        {queue_pull, 0, ZMQ_POLLIN, 0},
+    };
+
+    long timeout = wait ? -1 : 0;
+    if (compact_table && wait) {
+        // wake up at least every flush interval to batch up numeric od writes
+        uint32_t elapsed_ms = get_uptime_ms() - last_flush_ms;
+        timeout = (elapsed_ms >= COMPACT_FLUSH_MS) ? 0 : (COMPACT_FLUSH_MS - elapsed_ms);
+    }
+    int r = zmq_poll(items, 2, timeout);
+    if (r < 0) {
+        return false;
+    }
+
+    if (items[1].revents & ZMQ_POLLIN) {
+        forward_queued();
+    }
+    if (compact_table) {
+        // without wait the caller's loop sets the pace, either way flush once the interval has passed
+        uint32_t now_ms = get_uptime_ms();
+        if ((now_ms - last_flush_ms) >= COMPACT_FLUSH_MS) {
+            compact_flush();
+            last_flush_ms = now_ms;
+        }
+    }
+    if (!(items[0].revents & ZMQ_POLLIN)) {
+        return false;
+    }
 
     // event number and value
+    zmq_msg_t msg;
     zmq_msg_init(&msg);
-    int r = zmq_msg_recv(&msg, monitor, 0);
+    r = zmq_msg_recv(&msg, monitor, ZMQ_DONTWAIT);
     if (r == -1) {
         zmq_msg_close(&msg);
-        return;
+        return false;
     }
     uint8_t *data = zmq_msg_data(&msg);
     uint16_t event = *(uint16_t *)data;
     if (event & ZMQ_EVENT_ACCEPTED) {
-        clients++;
+        __atomic_store_n(&clients, clients + 1, __ATOMIC_RELAXED);
         log_info("new client connected (total %d)", clients);
     } else if (event & ZMQ_EVENT_DISCONNECTED) {
-        clients--;
+        __atomic_store_n(&clients, clients - 1, __ATOMIC_RELAXED);
         log_info("client disconnected (total %d)", clients);
     }
+    if (event & (ZMQ_EVENT_ACCEPTED | ZMQ_EVENT_DISCONNECTED)) {
+        compact_clients_reset();
+    }
 
     // event address
     zmq_msg_init(&msg);
     r = zmq_msg_recv(&msg, monitor, 0);
     if (r == -1) {
         zmq_msg_close(&msg);
-        return;
+        return true;
     }
 
     zmq_msg_close(&msg);
+    return true;
 }
 
 void ipc_broadcast_free(void) {
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_push) {
+        zmq_close(queue_push);
+        queue_push = NULL;
+    }
+    pthread_mutex_unlock(&queue_mutex);
+    if (queue_pull) {
+        zmq_close(queue_pull);
+        queue_pull = NULL;
+    }
     if (broadcaster) {
         zmq_close(broadcaster);
         broadcaster = NULL;
@@ -84,37 +543,59 @@ void ipc_broadcast_free(void) {
         zmq_close(monitor);
         monitor = NULL;
     }
+    free(compact_table);
+    free(compact_dirty);
+    compact_table = NULL;
+    compact_dirty = NULL;
+    compact_table_len = 0;
+    pthread_mutex_lock(&compact_clients_mutex);
+    compact_clients_len = 0;
+    compact_clients_full = false;
+    pthread_mutex_unlock(&compact_clients_mutex);
+    free(rpdo_table);
+    rpdo_table = NULL;
+    rpdo_table_len = 0;
 }
 
 uint8_t ipc_clients_count(void) {
-    return clients;
+    return __atomic_load_n(&clients, __ATOMIC_RELAXED);
+}
+
+static void send_od_write(uint16_t index, uint8_t subindex, const void *data, uint8_t len, const uint64_t *rx_time_ns) {
+    ipc_msg_od_t msg_od;
+    size_t msg_len = make_od_write(&msg_od, index, subindex, data, len, rx_time_ns);
+    broadcast(&msg_od, msg_len);
+    log_debug("od write index 0x%X subindex 0x%X", msg_od.index, msg_od.subindex);
 }
 
 static ODR_t ipc_broadcast_data(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
-    ODR_t ac = OD_writeOriginal(stream, buf, count, countWritten);
+    ODR_t ac = od_seqlock_write_original(stream, buf, count, countWritten);
+    uint16_t cob_id = 0;
+    bool rpdo_mapped = rpdo_find(stream->index, stream->subIndex, &cob_id);
+    // rpdo data goes out on its own to keep the rx time, and all of it while a client has another table
+    if ((ac == ODR_OK) && compact_table && !rpdo_mapped && __atomic_load_n(&compact_on, __ATOMIC_ACQUIRE)) {
+        int key = compact_table_find(stream->index, stream->subIndex);
+        if (key >= 0) { // sent on next flush
+            __atomic_fetch_or(&compact_dirty[key / 32], 1U << (key % 32), __ATOMIC_RELEASE);
+            return ac;
+        }
+    }
     if ((ac == ODR_OK) && (stream->dataLength > 0) && (stream->dataLength <= IPC_STR_MAX_LEN)) {
-        ipc_msg_od_t msg_od = {
-            .header =
-                {
-                    .version = IPC_MSG_VERSION,
-                    .id = IPC_MSG_ID_OD_WRITE,
-                },
-            .index = stream->index,
-            .subindex = stream->subIndex,
-            .buffer =
-                {
-                    .len = stream->dataLength,
-                },
-        };
-        memcpy(&msg_od.buffer.data, buf, stream->dataLength);
-        zmq_send(broadcaster, &msg_od, IPC_MSG_OD_MIN_LEN + stream->dataLength, 0);
-        log_debug("od write index 0x%X subindex 0x%X", msg_od.index, msg_od.subindex);
+        uint64_t rx_time_ns = rpdo_mapped ? can_rx_time_ns(cob_id) : 0;
+        send_od_write(stream->index, stream->subIndex, buf, stream->dataLength, rpdo_mapped ? &rx_time_ns : NULL);
     }
     return ac;
 }
 
-void ipc_broadcast_hb(uint8_t node_id, uint8_t state) {
-    if ((clients == 0) || !broadcaster) {
+void ipc_broadcast_od_write(uint16_t index, uint8_t subindex, const void *data, uint8_t len) {
+    if (!data || (len == 0)) {
+        return;
+    }
+    send_od_write(index, subindex, data, len, NULL);
+}
+
+void ipc_broadcast_hb(uint8_t node_id, uint8_t state, uint64_t rx_time_ns) {
+    if (ipc_clients_count() == 0) {
         return;
     }
     ipc_msg_hb_recv_t msg_hb_recv = {
@@ -125,12 +606,13 @@ void ipc_broadcast_hb(uint8_t node_id, uint8_t state) {
             },
         .node_id = node_id,
         .state = state,
+        .rx_time_ns = rx_time_ns,
     };
-    zmq_send(broadcaster, &msg_hb_recv, sizeof(ipc_msg_hb_recv_t), 0);
+    broadcast(&msg_hb_recv, sizeof(ipc_msg_hb_recv_t));
 }
 
-void ipc_broadcast_emcy(uint8_t node_id, uint16_t code, uint32_t info) {
-    if ((clients == 0) || !broadcaster) {
+void ipc_broadcast_emcy(uint8_t node_id, uint16_t code, uint32_t info, uint64_t rx_time_ns) {
+    if (ipc_clients_count() == 0) {
         return;
     }
     ipc_msg_emcy_recv_t msg_emcy_recv = {
@@ -142,8 +624,9 @@ void ipc_broadcast_emcy(uint8_t node_id, uint16_t code, uint32_t info) {
         .node_id = node_id,
         .code = code,
         .info = info,
+        .rx_time_ns = rx_time_ns,
     };
-    zmq_send(broadcaster, &msg_emcy_recv, sizeof(ipc_msg_emcy_recv_t), 0);
+    broadcast(&msg_emcy_recv, sizeof(ipc_msg_emcy_recv_t));
 }
 
 static void ipc_broadcast_status(uint8_t state) {
@@ -155,31 +638,60 @@ static void ipc_broadcast_status(uint8_t state) {
             },
         .state = state,
     };
-    zmq_send(broadcaster, &msg_bus_status, sizeof(ipc_msg_bus_status_t), 0);
+    broadcast(&msg_bus_status, sizeof(ipc_msg_bus_status_t));
 }
 
-void ipc_broadcast_bus_status(CO_t *co) {
-    if ((clients == 0) || !broadcaster) {
-        return;
+static uint16_t saturate_u16(uint32_t value) {
+    return (value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+}
+
+static void ipc_broadcast_bus_stats(uint8_t state) {
+    bus_stats_t stats;
+    bus_stats_snapshot(&stats);
+
+    ipc_msg_bus_stats_t msg = {
+        .header =
+            {
+                .version = IPC_MSG_VERSION,
+                .id = IPC_MSG_ID_BUS_STATS,
+            },
+        .state = state,
+        .interval_ms = stats.interval_ms,
+        .load = stats.load,
+        .tx_frames = saturate_u16(stats.tx_frames),
+        .err_frames = saturate_u16(stats.err_frames),
+        .err_passive = saturate_u16(stats.err_passive),
+        .bus_off = saturate_u16(stats.bus_off),
+        .tx_overflow = saturate_u16(stats.tx_overflow),
+        .rx_overflow = saturate_u16(stats.rx_overflow),
+        .tx_dropped = saturate_u16(stats.tx_dropped),
+        .nodes_len = 0,
+    };
+    for (uint32_t i = 0; i < IPC_BUS_STATS_CLASS_LEN; i++) {
+        msg.frames[i] = saturate_u16(stats.frames[i]);
     }
-    if (!co || !co->CANmodule || !co->CANmodule->CANinterfaces) {
-        ipc_broadcast_status(CAN_BUS_NOT_FOUND);
-        return;
+    for (uint32_t i = 1; (i < BUS_STATS_NODES) && (msg.nodes_len < IPC_BUS_STATS_NODES_MAX); i++) {
+        if (stats.node_frames[i] != 0) {
+            msg.nodes[msg.nodes_len].node_id = i;
+            msg.nodes[msg.nodes_len].frames = saturate_u16(stats.node_frames[i]);
+            msg.nodes_len++;
+        }
     }
+    broadcast(&msg, IPC_MSG_BUS_STATS_MIN_LEN + (msg.nodes_len * sizeof(ipc_bus_stats_node_t)));
+}
 
-    static char file_path[64];
-    sprintf(file_path, "/sys/class/net/%s/carrier", co->CANmodule->CANinterfaces[0].ifName);
-    FILE *fp = fopen(file_path, "r");
-    if (fp) {
-        char up;
-        fread(&up, 1, 1, fp);
-        fclose(fp);
-        if (up == '1') {
-            ipc_broadcast_status(CAN_BUS_UP);
-        } else {
-            ipc_broadcast_status(CAN_BUS_DOWN);
+void ipc_broadcast_bus_status(CO_t *co) {
+    if (ipc_clients_count() == 0) {
+        return; // counting continues, the next snapshot covers the whole gap
+    }
+
+    uint8_t state = CAN_BUS_NOT_FOUND;
+    if (co && co->CANmodule && co->CANmodule->CANinterfaces) {
+        int r = bus_stats_carrier();
+        if (r >= 0) {
+            state = r ? CAN_BUS_UP : CAN_BUS_DOWN;
         }
-    } else {
-        ipc_broadcast_status(CAN_BUS_NOT_FOUND);
     }
+    ipc_broadcast_status(state);
+    ipc_broadcast_bus_stats(state);
 }
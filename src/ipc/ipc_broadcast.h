@@ -3,16 +3,31 @@
 
 #include "CANopen.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-int ipc_broadcast_init(void *context, OD_t *od);
-void ipc_broadcast_process(void);
+/*
+ * The thread calling ipc_broadcast_process() owns the PUB socket and is the only one sending on it. The
+ * ipc_broadcast_*() msgs below can come from any thread, they are queued for the owner and dropped before init or
+ * after free.
+ */
+int ipc_broadcast_init(void *context, OD_t *od, bool compact_od_writes);
+// returns true if a client event was handled, with wait false it returns right away when none is queued
+bool ipc_broadcast_process(bool wait);
+int ipc_broadcast_fd(void);       // ZMQ_FD of the client monitor, edge triggered
+int ipc_broadcast_queue_fd(void); // ZMQ_FD of the msgs queued for the owner, edge triggered
 void ipc_broadcast_free(void);
 
-void ipc_broadcast_hb(uint8_t node_id, uint8_t state);
-void ipc_broadcast_emcy(uint8_t node_id, uint16_t code, uint32_t info);
+// rx_time_ns is the CLOCK_REALTIME kernel rx timestamp of the frame, 0 if unknown
+void ipc_broadcast_hb(uint8_t node_id, uint8_t state, uint64_t rx_time_ns);
+void ipc_broadcast_emcy(uint8_t node_id, uint16_t code, uint32_t info, uint64_t rx_time_ns);
 void ipc_broadcast_bus_status(CO_t *co);
+// for daemon owned entries (below 0x4000), app entries are broadcast on every write
+void ipc_broadcast_od_write(uint16_t index, uint8_t subindex, const void *data, uint8_t len);
 
 uint8_t ipc_clients_count(void);
 
+// a client's compact table crc, id is its ROUTER routing id; returns the daemon's crc, 0 if it sends no compact writes
+uint32_t ipc_broadcast_compact_client(const uint8_t *id, size_t id_len, uint32_t table_crc);
+
 #endif
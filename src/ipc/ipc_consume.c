@@ -3,28 +3,54 @@
 #include "ipc_broadcast.h"
 #include "ipc_msg.h"
 #include "logger.h"
+#include "od_seqlock.h"
+#include "os_command_ext.h"
+#include "scheduler.h"
 #include "system.h"
+#include "trace.h"
+#include "work_queue.h"
+#include <errno.h>
 #include <libgen.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <zmq.h>
 
+#define CONFIG_JOB_POLL_MS 100 // how often a blocking process call checks on a queued config job
+
 static void *consumer = NULL;
+static work_queue_t *work_queue = NULL;
+static uint32_t config_jobs = 0;   // queued or running config jobs
+static bool config_reset = false; // set by a config job, handed to the caller of ipc_consume_process()
+static int tpdo_wake_fd = -1;
+
+typedef struct {
+    uint8_t buffer_in[IPC_MSG_MAX_LEN];
+    uint32_t buffer_in_recv;
+    char *od_config_path;
+    uint64_t start_us;
+} config_job_t;
 
 static void ipc_consume_emcy_send(uint8_t *buffer_in, uint32_t buffer_in_recv, CO_t *co);
 static void ipc_consume_tpdo_send(uint8_t *buffer_in, uint32_t buffer_in_recv, CO_t *co, CO_config_t *base_config,
                                   CO_config_t *config);
+static void ipc_consume_tpdo_send_multi(uint8_t *buffer_in, uint32_t buffer_in_recv, CO_t *co,
+                                        CO_config_t *base_config, CO_config_t *config);
 static void ipc_consume_sync_send(CO_t *co, CO_config_t *config);
-static void ipc_consume_od_write(uint8_t *buffer_in, uint32_t buffer_in_recv, OD_t *od);
+static void ipc_consume_od_write(uint8_t *buffer_in, uint32_t buffer_in_recv, CO_t *co, OD_t *od);
+static void ipc_consume_schedule(uint8_t *buffer_in, uint32_t buffer_in_recv);
+static void ipc_consume_schedule_cancel(uint8_t *buffer_in, uint32_t buffer_in_recv);
 static void ipc_consume_config(uint8_t *buffer_in, uint32_t buffer_in_recv, char *od_config_path, bool *reset);
+static bool queue_config(uint8_t *buffer_in, uint32_t buffer_in_recv, char *od_config_path, uint64_t start_us);
 
-int ipc_consume_init(void *context) {
+int ipc_consume_init(void *context, work_queue_t *wq) {
     if (!context) {
         return -EINVAL;
     }
+    work_queue = wq;
 
     consumer = zmq_socket(context, ZMQ_SUB);
     zmq_setsockopt(consumer, ZMQ_SUBSCRIBE, NULL, 0);
@@ -33,24 +59,52 @@ int ipc_consume_init(void *context) {
     return 0;
 }
 
-void ipc_consume_process(CO_t *co, OD_t *od, CO_config_t *base_config, CO_config_t *config, char *od_config_path,
-                         bool *reset) {
+void ipc_consume_set_tpdo_wake_fd(int event_fd) {
+    tpdo_wake_fd = event_fd;
+}
+
+int ipc_consume_fd(void) {
+    int fd = -1;
+    size_t len = sizeof(fd);
+    return (consumer && (zmq_getsockopt(consumer, ZMQ_FD, &fd, &len) == 0)) ? fd : -1;
+}
+
+bool ipc_consume_process(CO_t *co, OD_t *od, CO_config_t *base_config, CO_config_t *config, char *od_config_path,
+                         bool *reset, bool wait) {
     if (!co || !od || !base_config || !config || !od_config_path) {
         log_error("null args");
-        return;
+        return false;
+    }
+
+    // a config job runs on a worker, so don't block forever while one could still ask for a reset
+    int timeout_ms = wait ? -1 : 0;
+    if (wait && __atomic_load_n(&config_jobs, __ATOMIC_ACQUIRE)) {
+        timeout_ms = CONFIG_JOB_POLL_MS;
+    }
+    zmq_pollitem_t item = {consumer, 0, ZMQ_POLLIN, 0};
+    int r = zmq_poll(&item, 1, timeout_ms);
+    if (__atomic_exchange_n(&config_reset, false, __ATOMIC_ACQ_REL)) {
+        *reset = true;
+    }
+    if (r <= 0) {
+        return false;
     }
 
     static uint8_t buffer_in[IPC_MSG_MAX_LEN];
-    int nbytes = zmq_recv(consumer, buffer_in, IPC_MSG_MAX_LEN, 0);
+    int nbytes = zmq_recv(consumer, buffer_in, IPC_MSG_MAX_LEN, ZMQ_DONTWAIT);
+    if (nbytes < 0) {
+        return false;
+    }
     if (nbytes <= (int)sizeof(ipc_header_t)) {
-        return;
+        return true;
     }
 
     if (buffer_in[0] != IPC_MSG_VERSION) {
         log_error("expected ipc protocal version %d not %d", IPC_MSG_VERSION, buffer_in[0]);
-        return;
+        return true;
     }
 
+    uint64_t start_us = get_uptime_us();
     uint32_t buffer_in_recv = nbytes;
     switch (buffer_in[1]) {
     case IPC_MSG_ID_EMCY_SEND:
@@ -59,18 +113,33 @@ void ipc_consume_process(CO_t *co, OD_t *od, CO_config_t *base_config, CO_config
     case IPC_MSG_ID_TPDO_SEND:
         ipc_consume_tpdo_send(buffer_in, buffer_in_recv, co, base_config, config);
         break;
+    case IPC_MSG_ID_TPDO_SEND_MULTI:
+        ipc_consume_tpdo_send_multi(buffer_in, buffer_in_recv, co, base_config, config);
+        break;
     case IPC_MSG_ID_OD_WRITE:
-        ipc_consume_od_write(buffer_in, buffer_in_recv, od);
+        ipc_consume_od_write(buffer_in, buffer_in_recv, co, od);
         break;
     case IPC_MSG_ID_SYNC_SEND:
         ipc_consume_sync_send(co, config);
         break;
+    case IPC_MSG_ID_SCHEDULE:
+        ipc_consume_schedule(buffer_in, buffer_in_recv);
+        break;
+    case IPC_MSG_ID_SCHEDULE_CANCEL:
+        ipc_consume_schedule_cancel(buffer_in, buffer_in_recv);
+        break;
     case IPC_MSG_ID_CONFIG:
+        if (queue_config(buffer_in, buffer_in_recv, od_config_path, start_us)) {
+            return true; // traced by the job
+        }
         ipc_consume_config(buffer_in, buffer_in_recv, od_config_path, reset);
         break;
     default:
         break;
     }
+
+    trace_record(TRACE_IPC_MSG, buffer_in[1], get_uptime_us() - start_us, NULL, 0);
+    return true;
 }
 
 void ipc_consume_free(void) {
@@ -78,6 +147,41 @@ void ipc_consume_free(void) {
         zmq_close(consumer);
         consumer = NULL;
     }
+    work_queue = NULL;
+}
+
+static void config_job_run(void *arg) {
+    config_job_t *job = (config_job_t *)arg;
+    bool reset = false;
+    ipc_consume_config(job->buffer_in, job->buffer_in_recv, job->od_config_path, &reset);
+    if (reset) {
+        __atomic_store_n(&config_reset, true, __ATOMIC_RELEASE);
+    }
+    __atomic_fetch_sub(&config_jobs, 1, __ATOMIC_ACQ_REL);
+    trace_record(TRACE_IPC_MSG, IPC_MSG_ID_CONFIG, get_uptime_us() - job->start_us, NULL, 0);
+    free(job);
+}
+
+// the crc check and copy of the config file is bulk work, returns false if it must be done inline
+static bool queue_config(uint8_t *buffer_in, uint32_t buffer_in_recv, char *od_config_path, uint64_t start_us) {
+    if (work_queue_workers(work_queue) == 0) {
+        return false;
+    }
+    config_job_t *job = malloc(sizeof(config_job_t));
+    if (!job) {
+        return false;
+    }
+    memcpy(job->buffer_in, buffer_in, buffer_in_recv);
+    job->buffer_in_recv = buffer_in_recv;
+    job->od_config_path = od_config_path;
+    job->start_us = start_us;
+    __atomic_fetch_add(&config_jobs, 1, __ATOMIC_ACQ_REL);
+    if (work_queue_submit(work_queue, WORK_BULK, config_job_run, job) < 0) {
+        __atomic_fetch_sub(&config_jobs, 1, __ATOMIC_ACQ_REL);
+        free(job);
+        return false;
+    }
+    return true;
 }
 
 static void ipc_consume_emcy_send(uint8_t *buffer_in, uint32_t buffer_in_recv, CO_t *co) {
@@ -88,6 +192,29 @@ static void ipc_consume_emcy_send(uint8_t *buffer_in, uint32_t buffer_in_recv, C
     ipc_msg_emcy_send_t *msg_emcy_send = (ipc_msg_emcy_send_t *)buffer_in;
     log_info("emcy send with code 0x%X info 0x%X", msg_emcy_send->code, msg_emcy_send->info);
     CO_errorReport(co->em, CO_EM_GENERIC_ERROR, msg_emcy_send->code, msg_emcy_send->info);
+    trace_record(TRACE_EMCY_TX, 0, msg_emcy_send->info, &msg_emcy_send->code, sizeof(msg_emcy_send->code));
+}
+
+static bool tpdo_request(uint8_t number, CO_t *co, CO_config_t *base_config, CO_config_t *config) {
+    if (number >= config->CNT_TPDO) {
+        log_error("invalid tpdo number %d", number);
+        return false;
+    }
+    log_debug("tpdo send %d", number);
+    uint8_t tpdos_offset = 0;
+    if (base_config->CNT_TPDO != config->CNT_TPDO) {
+        tpdos_offset = base_config->CNT_TPDO; // add the common base tpdos to num
+    }
+    co->TPDO[number + tpdos_offset].sendRequest = true;
+    return true;
+}
+
+// the rt thread only processes tpdos on its tick, wake it so they go out now
+static void tpdo_wake(void) {
+    uint64_t one = 1;
+    if ((tpdo_wake_fd >= 0) && (write(tpdo_wake_fd, &one, sizeof(one)) < 0)) {
+        log_error("tpdo wake write failed: %d", errno);
+    }
 }
 
 static void ipc_consume_tpdo_send(uint8_t *buffer_in, uint32_t buffer_in_recv, CO_t *co, CO_config_t *base_config,
@@ -97,19 +224,52 @@ static void ipc_consume_tpdo_send(uint8_t *buffer_in, uint32_t buffer_in_recv, C
         return;
     }
     ipc_msg_tpdo_send_t *msg_tpdo_send = (ipc_msg_tpdo_send_t *)buffer_in;
-    if (msg_tpdo_send->number < config->CNT_TPDO) {
-        log_debug("tpdo send %d", msg_tpdo_send->number);
-        uint8_t tpdos_offset = 0;
-        if (base_config->CNT_TPDO != config->CNT_TPDO) {
-            tpdos_offset = base_config->CNT_TPDO; // add the common base tpdos to num
-        }
-        co->TPDO[msg_tpdo_send->number + tpdos_offset].sendRequest = true;
-    } else {
-        log_error("invalid tpdo number %d", msg_tpdo_send->number);
+    if (tpdo_request(msg_tpdo_send->number, co, base_config, config)) {
+        tpdo_wake();
     }
 }
 
-static void ipc_consume_od_write(uint8_t *buffer_in, uint32_t buffer_in_recv, OD_t *od) {
+static void ipc_consume_tpdo_send_multi(uint8_t *buffer_in, uint32_t buffer_in_recv, CO_t *co,
+                                        CO_config_t *base_config, CO_config_t *config) {
+    if (buffer_in_recv != sizeof(ipc_msg_tpdo_send_multi_t)) {
+        log_error("tpdo send multi msg len mismatch; got %d expect %d", buffer_in_recv,
+                  sizeof(ipc_msg_tpdo_send_multi_t));
+        return;
+    }
+    ipc_msg_tpdo_send_multi_t *msg_tpdo_send = (ipc_msg_tpdo_send_multi_t *)buffer_in;
+    uint64_t tpdos = msg_tpdo_send->tpdos;
+    bool requested = false;
+    while (tpdos) {
+        uint8_t number = __builtin_ctzll(tpdos);
+        tpdos &= tpdos - 1;
+        requested |= tpdo_request(number, co, base_config, config);
+    }
+    if (requested) {
+        tpdo_wake();
+    }
+}
+
+/*
+ * Not on the CANopen threads, which also access the od; app entries have a seqlock, the rest need the global lock.
+ * Also called from the scheduler thread. Without od_orig the write goes through ipc_broadcast_data(), which only
+ * queues the msg (or marks the compact entry) for the broadcaster's owner thread, so no thread but that one sends on
+ * the PUB socket.
+ */
+static ODR_t od_write(CO_t *co, const OD_entry_t *entry, uint8_t subindex, const void *value, OD_size_t len,
+                      bool od_orig) {
+    if (entry == NULL) {
+        return ODR_IDX_NOT_EXIST;
+    }
+    if (od_seqlock_get(entry) != NULL) {
+        return od_seqlock_set_value(entry, subindex, value, len, od_orig);
+    }
+    CO_LOCK_OD(co->CANmodule);
+    ODR_t r = OD_set_value(entry, subindex, (void *)value, len, od_orig);
+    CO_UNLOCK_OD(co->CANmodule);
+    return r;
+}
+
+static void ipc_consume_od_write(uint8_t *buffer_in, uint32_t buffer_in_recv, CO_t *co, OD_t *od) {
     if ((buffer_in_recv < IPC_MSG_OD_MIN_LEN) || (buffer_in_recv > sizeof(ipc_msg_od_t))) {
         log_error("od write msg len mismatch; got %d, expect between %d to %d", buffer_in_recv, IPC_MSG_OD_MIN_LEN,
                   sizeof(ipc_msg_od_t));
@@ -118,7 +278,85 @@ static void ipc_consume_od_write(uint8_t *buffer_in, uint32_t buffer_in_recv, OD
     ipc_msg_od_t *msg_od = (ipc_msg_od_t *)buffer_in;
     log_debug("od write index 0x%X subindex 0x%X", msg_od->index, msg_od->subindex);
     OD_entry_t *entry = OD_find(od, msg_od->index);
-    OD_set_value(entry, msg_od->subindex, msg_od->buffer.data, msg_od->buffer.len, ipc_clients_count() <= 1);
+    // a lone client sent the value itself, it only needs broadcasting to the others
+    bool od_orig = ipc_clients_count() <= 1;
+    ODR_t r = od_write(co, entry, msg_od->subindex, msg_od->buffer.data, msg_od->buffer.len, od_orig);
+    if (r != ODR_OK) {
+        log_debug("od write to 0x%X 0x%X failed: %d", msg_od->index, msg_od->subindex, r);
+    }
+}
+
+static void ipc_consume_schedule(uint8_t *buffer_in, uint32_t buffer_in_recv) {
+    if ((buffer_in_recv < IPC_MSG_SCHEDULE_MIN_LEN) || (buffer_in_recv > sizeof(ipc_msg_schedule_t))) {
+        log_error("schedule msg len mismatch; got %d, expect between %d to %d", buffer_in_recv,
+                  IPC_MSG_SCHEDULE_MIN_LEN, sizeof(ipc_msg_schedule_t));
+        return;
+    }
+    ipc_msg_schedule_t *msg = (ipc_msg_schedule_t *)buffer_in;
+    if (buffer_in_recv < (IPC_MSG_SCHEDULE_MIN_LEN + msg->data.len)) {
+        log_error("schedule msg data len %d past the end of the msg", msg->data.len);
+        return;
+    }
+    ecss_scet_t scet = {.raw = msg->scet};
+    int r = scheduler_add(msg->action_id, &scet, msg->type, msg->data.data, msg->data.len);
+    if (r < 0) {
+        log_error("failed to schedule action %u: %d", msg->action_id, -r);
+    }
+}
+
+static void ipc_consume_schedule_cancel(uint8_t *buffer_in, uint32_t buffer_in_recv) {
+    if (buffer_in_recv != sizeof(ipc_msg_schedule_cancel_t)) {
+        log_error("schedule cancel msg len mismatch; got %d expect %d", buffer_in_recv,
+                  sizeof(ipc_msg_schedule_cancel_t));
+        return;
+    }
+    ipc_msg_schedule_cancel_t *msg = (ipc_msg_schedule_cancel_t *)buffer_in;
+    log_debug("canceled %u scheduled actions with id %u", scheduler_cancel(msg->action_id), msg->action_id);
+}
+
+void ipc_consume_scheduled(const sched_action_t *action, CO_t *co, OD_t *od, CO_config_t *base_config,
+                           CO_config_t *config) {
+    switch (action->type) {
+    case SCHED_OD_WRITE: {
+        const size_t value_offset = sizeof(uint16_t) + sizeof(uint8_t);
+        if (action->len <= value_offset) {
+            log_error("scheduled od write %u too short", action->id);
+            break;
+        }
+        uint16_t index;
+        memcpy(&index, action->data, sizeof(index));
+        uint8_t subindex = action->data[sizeof(index)];
+        OD_entry_t *entry = OD_find(od, index);
+        if (entry == NULL) {
+            log_error("scheduled od write %u to missing index 0x%X", action->id, index);
+            break;
+        }
+        // every client learns of it, no app sent it
+        ODR_t r = od_write(co, entry, subindex, &action->data[value_offset], action->len - value_offset, false);
+        if (r != ODR_OK) {
+            log_error("scheduled od write %u to 0x%X 0x%X failed: %d", action->id, index, subindex, r);
+        }
+        break;
+    }
+    case SCHED_TPDO:
+        if ((action->len == 1) && tpdo_request(action->data[0], co, base_config, config)) {
+            tpdo_wake();
+        }
+        break;
+    case SCHED_OS_COMMAND: {
+        char command[SCHEDULER_DATA_MAX_LEN + 1];
+        memcpy(command, action->data, action->len);
+        command[action->len] = '\0';
+        int r = os_command_run(command);
+        if (r < 0) {
+            log_error("scheduled os command %u not run: %d", action->id, -r);
+        }
+        break;
+    }
+    default:
+        log_error("unknown scheduled action type %d", action->type);
+        break;
+    }
 }
 
 static void ipc_consume_sync_send(CO_t *co, CO_config_t *config) {
@@ -2,12 +2,21 @@
 #define _IPC_CONSUMER_H_
 
 #include "CANopen.h"
+#include "scheduler.h"
+#include "work_queue.h"
 #include <stdbool.h>
 #include <stdint.h>
 
-int ipc_consume_init(void *context);
-void ipc_consume_process(CO_t *co, OD_t *od, CO_config_t *base_config, CO_config_t *config, char *od_config_path,
-                         bool *reset);
+int ipc_consume_init(void *context, work_queue_t *wq); // config msgs are queued on wq as bulk work
+// returns true if a msg was handled, with wait false it returns right away when none is queued
+bool ipc_consume_process(CO_t *co, OD_t *od, CO_config_t *base_config, CO_config_t *config, char *od_config_path,
+                         bool *reset, bool wait);
+// eventfd written after tpdo send requests, to wake the epoll loop that runs CO_epoll_processRT()
+void ipc_consume_set_tpdo_wake_fd(int event_fd);
+int ipc_consume_fd(void); // ZMQ_FD, edge triggered
+// runs an action from the scheduler thread, the same way as the ipc msg for it
+void ipc_consume_scheduled(const sched_action_t *action, CO_t *co, OD_t *od, CO_config_t *base_config,
+                           CO_config_t *config);
 void ipc_consume_free(void);
 
 #endif
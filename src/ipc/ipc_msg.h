@@ -5,7 +5,7 @@
 
 #define IPC_MSG_ID_LEN sizeof(uint8_t)
 
-#define IPC_MSG_VERSION     0 // only increase on breaking changes
+#define IPC_MSG_VERSION     1 // only increase on breaking changes
 #define IPC_MSG_VERSION_LEN sizeof(uint8_t)
 
 #define IPC_MSG_MAX_LEN 1000
@@ -27,6 +27,13 @@ typedef enum {
     IPC_MSG_ID_SDO_READ_TO_FILE = 0xA,
     IPC_MSG_ID_SDO_WRITE_FROM_FILE = 0xB,
     IPC_MSG_ID_CONFIG = 0xC,
+    IPC_MSG_ID_OD_WRITE_COMPACT = 0xD,
+    IPC_MSG_ID_LATENCY_STATS = 0xE,
+    IPC_MSG_ID_BUS_STATS = 0xF,
+    IPC_MSG_ID_TPDO_SEND_MULTI = 0x10,
+    IPC_MSG_ID_SCHEDULE = 0x11,
+    IPC_MSG_ID_SCHEDULE_CANCEL = 0x12,
+    IPC_MSG_ID_OD_COMPACT_TABLE = 0x13,
 } ipc_msg_id_t;
 
 typedef enum {
@@ -61,6 +68,38 @@ typedef struct __attribute__((packed)) {
     uint8_t number;
 } ipc_msg_tpdo_send_t;
 
+#define IPC_TPDO_SEND_MULTI_MAX 64
+
+// bit n requests tpdo n, same numbering as ipc_msg_tpdo_send_t
+typedef struct __attribute__((packed)) {
+    ipc_header_t header;
+    uint64_t tpdos;
+} ipc_msg_tpdo_send_multi_t;
+
+/*
+ * Action for the daemon to run at a SCET (ecss_scet_t raw). Type 0 writes an OD entry, data is a uint16 index, uint8
+ * subindex, then the value. Type 1 sends a TPDO, data is a uint8 tpdo number. Type 2 runs an os command, data is the
+ * command without a null terminator. The action id is picked by the sender to cancel it later, 0 for none.
+ */
+typedef struct __attribute__((packed)) {
+    ipc_header_t header;
+    uint32_t action_id;
+    uint64_t scet;
+    uint8_t type;
+    ipc_bytes_t data;
+} ipc_msg_schedule_t;
+#define IPC_MSG_SCHEDULE_MIN_LEN (offsetof(ipc_msg_schedule_t, data) + sizeof(ipc_str_len_t))
+
+// cancels every pending action with the action id, or all of them with 0
+typedef struct __attribute__((packed)) {
+    ipc_header_t header;
+    uint32_t action_id;
+} ipc_msg_schedule_cancel_t;
+
+/*
+ * OD write broadcasts of entries mapped to an RPDO are followed by a uint64 CLOCK_REALTIME kernel rx timestamp in ns
+ * of the last frame received with that RPDO's cob-id (0 if unknown), just past buffer.data[buffer.len].
+ */
 typedef struct __attribute__((packed)) {
     ipc_header_t header;
     uint16_t index;
@@ -69,6 +108,30 @@ typedef struct __attribute__((packed)) {
 } ipc_msg_od_t;
 #define IPC_MSG_OD_MIN_LEN (offsetof(ipc_msg_od_t, buffer) + sizeof(ipc_str_len_t))
 
+/*
+ * Batch of numeric OD writes. Keys are positions in the table of numeric entries with index >= 0x4000 sorted by
+ * index/subindex (subindex 0 of records/arrays skipped) and table_crc is the crc32 of that table as uint16 index,
+ * uint8 subindex, uint8 length per entry. Data is pairs of unsigned LEB128 varints: the key delta from the previous
+ * key in the msg (the first is the key itself) and the value zigzag encoded at the entry's bit width.
+ */
+typedef struct __attribute__((packed)) {
+    ipc_header_t header;
+    uint32_t table_crc;
+    uint8_t data[IPC_MSG_MAX_LEN - sizeof(ipc_header_t) - sizeof(uint32_t)];
+} ipc_msg_od_compact_t;
+#define IPC_MSG_OD_COMPACT_MIN_LEN offsetof(ipc_msg_od_compact_t, data)
+
+/*
+ * A client sends the crc of its compact table as a request and the reply has the daemon's, 0 when it sends no compact
+ * writes. The daemon also broadcasts it with its own crc when a client connects or disconnects, every client then
+ * sends its crc again. Compact writes only go out while every connected client's crc matches, else each write is its
+ * own ipc_msg_od_t.
+ */
+typedef struct __attribute__((packed)) {
+    ipc_header_t header;
+    uint32_t table_crc;
+} ipc_msg_od_compact_table_t;
+
 typedef struct __attribute__((packed)) {
     ipc_header_t header;
     uint8_t node_id;
@@ -89,6 +152,36 @@ typedef struct __attribute__((packed)) {
     uint8_t state;
 } ipc_msg_bus_status_t;
 
+#define IPC_BUS_STATS_CLASS_LEN 8 // NMT, SYNC, EMCY, TIME, PDO, SDO, HB, and other frames
+#define IPC_BUS_STATS_NODES_MAX 127
+
+typedef struct __attribute__((packed)) {
+    uint8_t node_id;
+    uint16_t frames;
+} ipc_bus_stats_node_t;
+
+/*
+ * Periodic bus statistics snapshot, all counts are for the interval and saturate. Only nodes with frames in the
+ * interval are listed.
+ */
+typedef struct __attribute__((packed)) {
+    ipc_header_t header;
+    uint8_t state; // same as ipc_msg_bus_status_t
+    uint32_t interval_ms;
+    uint16_t load; // estimated bus load in 0.1 % units
+    uint16_t frames[IPC_BUS_STATS_CLASS_LEN];
+    uint16_t tx_frames;
+    uint16_t err_frames;
+    uint16_t err_passive;
+    uint16_t bus_off;
+    uint16_t tx_overflow; // CANopenNode tx buffer overflows
+    uint16_t rx_overflow; // CANopenNode rx buffer overflows
+    uint16_t tx_dropped;  // kernel tx queue drops
+    uint8_t nodes_len;
+    ipc_bus_stats_node_t nodes[IPC_BUS_STATS_NODES_MAX];
+} ipc_msg_bus_stats_t;
+#define IPC_MSG_BUS_STATS_MIN_LEN offsetof(ipc_msg_bus_stats_t, nodes)
+
 typedef struct __attribute__((packed)) {
     ipc_header_t header;
     uint8_t node_id;
@@ -103,14 +196,40 @@ typedef struct __attribute__((packed)) {
     uint8_t node_id;
     uint16_t code;
     uint32_t info;
+    uint64_t rx_time_ns; // CLOCK_REALTIME kernel rx timestamp, 0 if unknown or sent by this node
 } ipc_msg_emcy_recv_t;
 
 typedef struct __attribute__((packed)) {
     ipc_header_t header;
     uint8_t node_id;
     uint8_t state;
+    uint64_t rx_time_ns; // CLOCK_REALTIME kernel rx timestamp, 0 if unknown
 } ipc_msg_hb_recv_t;
 
+#define IPC_LATENCY_STATS_MAX_LEN 32
+
+typedef struct __attribute__((packed)) {
+    uint32_t count;
+    uint32_t mean; // all values other than count are in microseconds
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t p999;
+    uint32_t max;
+} ipc_latency_summary_t;
+
+/*
+ * Latency histogram summaries of the daemon. The request is only the header and the reset flag, the reply echoes
+ * both and adds one summary per histogram in latency_id_t order.
+ */
+typedef struct __attribute__((packed)) {
+    ipc_header_t header;
+    uint8_t reset; // clear the histograms after reading them
+    uint8_t len;
+    ipc_latency_summary_t summaries[IPC_LATENCY_STATS_MAX_LEN];
+} ipc_msg_latency_stats_t;
+#define IPC_MSG_LATENCY_STATS_MIN_LEN offsetof(ipc_msg_latency_stats_t, len)
+
 typedef struct __attribute__((packed)) {
     ipc_header_t header;
     int32_t error;
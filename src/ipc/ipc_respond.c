@@ -1,8 +1,15 @@
 #include "ipc_respond.h"
 #include "CANopen.h"
+#include "ipc_broadcast.h"
 #include "ipc_msg.h"
+#include "latency.h"
 #include "logger.h"
 #include "sdo_client.h"
+#include "system.h"
+#include "trace.h"
+#include "work_queue.h"
+#include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -10,7 +17,25 @@
 
 #define ZMQ_HEADER_LEN 5
 
+static_assert(LATENCY_LEN <= IPC_LATENCY_STATS_MAX_LEN, "latency histograms do not fit in the ipc msg");
+
 static void *responder = NULL;
+static void *replies_push = NULL; // workers send replies here, the responder thread forwards them to the router
+static void *replies_pull = NULL;
+static pthread_mutex_t replies_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sdo_client_mutex = PTHREAD_MUTEX_INITIALIZER; // there is only one sdo client
+static work_queue_t *work_queue = NULL;
+
+typedef struct {
+    uint8_t header[ZMQ_HEADER_LEN];
+    uint8_t buffer_in[IPC_MSG_MAX_LEN];
+    uint32_t buffer_in_recv;
+    uint64_t start_us;
+    CO_t *co;
+    fcache_t *fread_cache;
+    bool sdo_allowed;
+    bool reply_direct; // runs on the responder thread, so it can use the router socket
+} respond_job_t;
 
 static uint32_t ipc_respond_sdo_read(uint8_t *buffer_in, uint32_t buffer_in_recv, uint8_t *buffer_out, CO_t *co);
 static uint32_t ipc_respond_sdo_write(uint8_t *buffer_in, uint32_t buffer_in_recv, uint8_t *buffer_out, CO_t *co);
@@ -20,23 +45,174 @@ static uint32_t ipc_respond_sdo_read_to_file(uint8_t *buffer_in, uint32_t buffer
                                              CO_t *co);
 static uint32_t ipc_respond_sdo_write_from_file(uint8_t *buffer_in, uint32_t buffer_in_recv, uint8_t *buffer_out,
                                                 CO_t *co);
+static uint32_t ipc_respond_latency_stats(uint8_t *buffer_in, uint32_t buffer_in_recv, uint8_t *buffer_out);
+static uint32_t ipc_respond_od_compact_table(const uint8_t *header, uint8_t *buffer_in, uint32_t buffer_in_recv,
+                                             uint8_t *buffer_out);
+
+static latency_id_t ipc_latency_id(uint8_t msg_id) {
+    switch (msg_id) {
+    case IPC_MSG_ID_SDO_READ:
+        return LATENCY_IPC_SDO_READ;
+    case IPC_MSG_ID_SDO_WRITE:
+        return LATENCY_IPC_SDO_WRITE;
+    case IPC_MSG_ID_ADD_FILE:
+        return LATENCY_IPC_ADD_FILE;
+    case IPC_MSG_ID_SDO_READ_TO_FILE:
+        return LATENCY_IPC_SDO_READ_TO_FILE;
+    case IPC_MSG_ID_SDO_WRITE_FROM_FILE:
+        return LATENCY_IPC_SDO_WRITE_FROM_FILE;
+    default:
+        return LATENCY_IPC_OTHER;
+    }
+}
+
+static work_class_t ipc_work_class(uint8_t msg_id) {
+    switch (msg_id) {
+    case IPC_MSG_ID_SDO_READ:
+    case IPC_MSG_ID_SDO_WRITE:
+        return WORK_INTERACTIVE;
+    case IPC_MSG_ID_ADD_FILE:
+    case IPC_MSG_ID_SDO_READ_TO_FILE:
+    case IPC_MSG_ID_SDO_WRITE_FROM_FILE:
+        return WORK_BULK;
+    default:
+        return WORK_IMMEDIATE; // latency stats, the compact table crc and unknown ids are answered right away
+    }
+}
 
-int ipc_respond_init(void *context) {
+int ipc_respond_init(void *context, work_queue_t *wq) {
     if (!context) {
         return -EINVAL;
     }
     responder = zmq_socket(context, ZMQ_ROUTER);
     zmq_bind(responder, "tcp://*:6000");
 
+    replies_pull = zmq_socket(context, ZMQ_PULL);
+    zmq_bind(replies_pull, "inproc://replies");
+    replies_push = zmq_socket(context, ZMQ_PUSH);
+    zmq_connect(replies_push, "inproc://replies");
+
+    work_queue = wq;
     return 0;
 }
 
-void ipc_respond_process(CO_t *co, OD_t *od, CO_config_t *config, fcache_t *fread_cache) {
-    if (!co || !od || !config) {
-        log_error("null arg");
+static uint32_t make_error_msg(uint8_t *buffer_out, int error) {
+    ipc_msg_error_t *msg_error = (ipc_msg_error_t *)buffer_out;
+    msg_error->header.version = IPC_MSG_VERSION;
+    msg_error->header.id = IPC_MSG_ID_ERROR;
+    msg_error->error = error;
+    return sizeof(ipc_msg_error_t);
+}
+
+static bool is_sdo_client_msg(uint8_t msg_id) {
+    return (msg_id == IPC_MSG_ID_SDO_READ) || (msg_id == IPC_MSG_ID_SDO_WRITE) ||
+           (msg_id == IPC_MSG_ID_SDO_READ_TO_FILE) || (msg_id == IPC_MSG_ID_SDO_WRITE_FROM_FILE);
+}
+
+int ipc_respond_fd(void) {
+    int fd = -1;
+    size_t len = sizeof(fd);
+    return (responder && (zmq_getsockopt(responder, ZMQ_FD, &fd, &len) == 0)) ? fd : -1;
+}
+
+static uint32_t respond_dispatch(respond_job_t *job, uint8_t *buffer_out) {
+    uint8_t *buffer_in = job->buffer_in;
+    uint32_t buffer_in_recv = job->buffer_in_recv;
+    uint32_t buffer_out_send = 0;
+
+    switch (buffer_in[1]) {
+    case IPC_MSG_ID_SDO_READ:
+        buffer_out_send = ipc_respond_sdo_read(buffer_in, buffer_in_recv, buffer_out, job->co);
+        break;
+    case IPC_MSG_ID_SDO_WRITE:
+        buffer_out_send = ipc_respond_sdo_write(buffer_in, buffer_in_recv, buffer_out, job->co);
+        break;
+    case IPC_MSG_ID_ADD_FILE:
+        buffer_out_send = ipc_respond_add_file(buffer_in, buffer_in_recv, buffer_out, job->fread_cache);
+        break;
+    case IPC_MSG_ID_SDO_READ_TO_FILE:
+        buffer_out_send = ipc_respond_sdo_read_to_file(buffer_in, buffer_in_recv, buffer_out, job->co);
+        break;
+    case IPC_MSG_ID_SDO_WRITE_FROM_FILE:
+        buffer_out_send = ipc_respond_sdo_write_from_file(buffer_in, buffer_in_recv, buffer_out, job->co);
+        break;
+    case IPC_MSG_ID_LATENCY_STATS:
+        buffer_out_send = ipc_respond_latency_stats(buffer_in, buffer_in_recv, buffer_out);
+        break;
+    case IPC_MSG_ID_OD_COMPACT_TABLE:
+        buffer_out_send = ipc_respond_od_compact_table(job->header, buffer_in, buffer_in_recv, buffer_out);
+        break;
+    default:
+        log_debug("unknown msg id %d", buffer_in[0]);
+        ipc_msg_error_id_t *msg_error_id = (ipc_msg_error_id_t *)buffer_out;
+        msg_error_id->header.version = IPC_MSG_VERSION;
+        msg_error_id->header.id = IPC_MSG_ID_ERROR_UNKNOWN_ID;
+        msg_error_id->id = buffer_in[1];
+        buffer_out_send = sizeof(ipc_msg_error_t);
+        break;
+    }
+    return buffer_out_send;
+}
+
+static void respond_job_run(void *arg) {
+    respond_job_t *job = (respond_job_t *)arg;
+    uint8_t msg_id = job->buffer_in[1];
+    uint8_t buffer_out[IPC_MSG_MAX_LEN];
+    uint32_t buffer_out_send = 0;
+
+    if (is_sdo_client_msg(msg_id) && !job->sdo_allowed) {
+        log_error("sdo client requests are not supported in single thread mode");
+        buffer_out_send = make_error_msg(buffer_out, ENOTSUP);
+    } else if (is_sdo_client_msg(msg_id)) {
+        pthread_mutex_lock(&sdo_client_mutex);
+        buffer_out_send = respond_dispatch(job, buffer_out);
+        pthread_mutex_unlock(&sdo_client_mutex);
+    } else {
+        buffer_out_send = respond_dispatch(job, buffer_out);
+    }
+
+    // always send a response
+    if (buffer_out_send == 0) {
+        buffer_out_send = make_error_msg(buffer_out, EINVAL);
+    }
+
+    if (job->reply_direct) {
+        zmq_send(responder, job->header, ZMQ_HEADER_LEN, ZMQ_SNDMORE);
+        zmq_send(responder, job->header, 0, ZMQ_SNDMORE);
+        zmq_send(responder, buffer_out, buffer_out_send, 0);
+    } else {
+        pthread_mutex_lock(&replies_mutex);
+        zmq_send(replies_push, job->header, ZMQ_HEADER_LEN, ZMQ_SNDMORE);
+        zmq_send(replies_push, buffer_out, buffer_out_send, 0);
+        pthread_mutex_unlock(&replies_mutex);
+    }
+
+    uint32_t latency_us = get_uptime_us() - job->start_us;
+    trace_record(TRACE_IPC_REQ, msg_id, latency_us, &buffer_out[1], 1);
+    latency_record(ipc_latency_id(msg_id), latency_us);
+    free(job);
+}
+
+static void forward_reply(void) {
+    uint8_t header[ZMQ_HEADER_LEN];
+    static uint8_t buffer_out[IPC_MSG_MAX_LEN];
+
+    int header_len = zmq_recv(replies_pull, header, sizeof(header), ZMQ_DONTWAIT);
+    if (header_len < 0) {
+        return;
+    }
+    int len = zmq_recv(replies_pull, buffer_out, sizeof(buffer_out), 0);
+    if ((header_len != ZMQ_HEADER_LEN) || (len < 0)) {
+        log_error("bad worker reply");
         return;
     }
 
+    zmq_send(responder, header, ZMQ_HEADER_LEN, ZMQ_SNDMORE);
+    zmq_send(responder, header, 0, ZMQ_SNDMORE);
+    zmq_send(responder, buffer_out, len, 0);
+}
+
+static void recv_request(CO_t *co, fcache_t *fread_cache, bool wait) {
     zmq_msg_t msg;
     int r = zmq_msg_init(&msg);
     if (r != 0) {
@@ -44,7 +220,7 @@ void ipc_respond_process(CO_t *co, OD_t *od, CO_config_t *config, fcache_t *frea
     }
 
     int nbytes = 0;
-    nbytes = zmq_msg_recv(&msg, responder, 0);
+    nbytes = zmq_msg_recv(&msg, responder, ZMQ_DONTWAIT);
     if (nbytes < 0) {
         zmq_msg_close(&msg);
         return;
@@ -58,13 +234,18 @@ void ipc_respond_process(CO_t *co, OD_t *od, CO_config_t *config, fcache_t *frea
         zmq_msg_close(&msg);
         return;
     }
-    uint8_t header[ZMQ_HEADER_LEN];
-    memcpy(header, zmq_msg_data(&msg), nbytes);
+    respond_job_t *job = malloc(sizeof(respond_job_t));
+    if (!job) {
+        zmq_msg_close(&msg);
+        return;
+    }
+    memcpy(job->header, zmq_msg_data(&msg), nbytes);
 
     nbytes = zmq_msg_recv(&msg, responder, 0);
     if (nbytes != 0) {
         log_error("zmq msg recv header error");
         zmq_msg_close(&msg);
+        free(job);
         return;
     }
 
@@ -72,67 +253,63 @@ void ipc_respond_process(CO_t *co, OD_t *od, CO_config_t *config, fcache_t *frea
     if (nbytes == -1) {
         log_error("zmq msg recv error %d", errno);
         zmq_msg_close(&msg);
+        free(job);
         return;
     }
 
-    if (nbytes <= 2) {
-        log_error("ipc msg is to small at %d bytes", nbytes);
+    if ((nbytes <= 2) || (nbytes > IPC_MSG_MAX_LEN)) {
+        log_error("ipc msg is an invalid size at %d bytes", nbytes);
         zmq_msg_close(&msg);
+        free(job);
         return;
     }
 
-    uint32_t buffer_in_recv = nbytes;
-    static uint8_t buffer_in[IPC_MSG_MAX_LEN];
-    memcpy(&buffer_in, zmq_msg_data(&msg), nbytes);
+    job->start_us = get_uptime_us();
+    job->buffer_in_recv = nbytes;
+    memcpy(job->buffer_in, zmq_msg_data(&msg), nbytes);
 
     zmq_msg_close(&msg);
 
-    if (buffer_in[0] != IPC_MSG_VERSION) {
-        log_error("expected ipc protocal version %d not %d", IPC_MSG_VERSION, buffer_in[0]);
+    if (job->buffer_in[0] != IPC_MSG_VERSION) {
+        log_error("expected ipc protocal version %d not %d", IPC_MSG_VERSION, job->buffer_in[0]);
+        free(job);
         return;
     }
 
-    uint32_t buffer_out_send = 0;
-    static uint8_t buffer_out[IPC_MSG_MAX_LEN];
-
-    switch (buffer_in[1]) {
-    case IPC_MSG_ID_SDO_READ:
-        buffer_out_send = ipc_respond_sdo_read(buffer_in, buffer_in_recv, buffer_out, co);
-        break;
-    case IPC_MSG_ID_SDO_WRITE:
-        buffer_out_send = ipc_respond_sdo_write(buffer_in, buffer_in_recv, buffer_out, co);
-        break;
-    case IPC_MSG_ID_ADD_FILE:
-        buffer_out_send = ipc_respond_add_file(buffer_in, buffer_in_recv, buffer_out, fread_cache);
-        break;
-    case IPC_MSG_ID_SDO_READ_TO_FILE:
-        buffer_out_send = ipc_respond_sdo_read_to_file(buffer_in, buffer_in_recv, buffer_out, co);
-        break;
-    case IPC_MSG_ID_SDO_WRITE_FROM_FILE:
-        buffer_out_send = ipc_respond_sdo_write_from_file(buffer_in, buffer_in_recv, buffer_out, co);
-        break;
-    default:
-        log_debug("unknown msg id %d", buffer_in[0]);
-        ipc_msg_error_id_t *msg_error_id = (ipc_msg_error_id_t *)buffer_out;
-        msg_error_id->header.version = IPC_MSG_VERSION;
-        msg_error_id->header.id = IPC_MSG_ID_ERROR_UNKNOWN_ID;
-        msg_error_id->id = buffer_in[1];
-        buffer_out_send = sizeof(ipc_msg_error_t);
-        break;
+    job->co = co;
+    job->fread_cache = fread_cache;
+    job->sdo_allowed = wait;
+    work_class_t class = ipc_work_class(job->buffer_in[1]);
+    job->reply_direct = (class == WORK_IMMEDIATE) || (work_queue_workers(work_queue) == 0);
+    if (job->reply_direct) {
+        respond_job_run(job);
+    } else if (work_queue_submit(work_queue, class, respond_job_run, job) < 0) {
+        log_error("failed to queue ipc msg id 0x%X, handling it now", job->buffer_in[1]);
+        job->reply_direct = true;
+        respond_job_run(job);
     }
+}
 
-    // always send a response
-    if (buffer_out_send == 0) {
-        ipc_msg_error_t *msg_error = (ipc_msg_error_t *)buffer_out;
-        msg_error->header.version = IPC_MSG_VERSION;
-        msg_error->header.id = IPC_MSG_ID_ERROR;
-        msg_error->error = EINVAL;
-        buffer_out_send = sizeof(ipc_msg_error_t);
+bool ipc_respond_process(CO_t *co, OD_t *od, CO_config_t *config, fcache_t *fread_cache, bool wait) {
+    if (!co || !od || !config) {
+        log_error("null arg");
+        return false;
     }
 
-    zmq_send(responder, header, ZMQ_HEADER_LEN, ZMQ_SNDMORE);
-    zmq_send(responder, header, 0, ZMQ_SNDMORE);
-    zmq_send(responder, buffer_out, buffer_out_send, 0);
+    zmq_pollitem_t items[] = {
+        {responder, 0, ZMQ_POLLIN, 0},
+        {replies_pull, 0, ZMQ_POLLIN, 0},
+    };
+    if (zmq_poll(items, 2, wait ? -1 : 0) <= 0) {
+        return false;
+    }
+    if (items[1].revents & ZMQ_POLLIN) {
+        forward_reply();
+    }
+    if (items[0].revents & ZMQ_POLLIN) {
+        recv_request(co, fread_cache, wait);
+    }
+    return true;
 }
 
 void ipc_respond_free(void) {
@@ -140,6 +317,15 @@ void ipc_respond_free(void) {
         zmq_close(responder);
         responder = NULL;
     }
+    if (replies_push) {
+        zmq_close(replies_push);
+        replies_push = NULL;
+    }
+    if (replies_pull) {
+        zmq_close(replies_pull);
+        replies_pull = NULL;
+    }
+    work_queue = NULL;
 }
 
 static uint32_t make_sdo_abort_msg(uint8_t *buffer_out, uint32_t abort_code) {
@@ -231,13 +417,12 @@ static uint32_t ipc_respond_add_file(uint8_t *buffer_in, uint32_t buffer_in_recv
     msg_sdo_file->path.data[msg_sdo_file->path.len] = '\0';
 
     int error = fcache_add(fread_cache, msg_sdo_file->path.data, false);
-    if (error) {
+    if (error == 0) {
         buffer_out_send = buffer_in_recv;
         memcpy(buffer_out, buffer_in, buffer_out_send);
     } else {
-        buffer_out[0] = IPC_MSG_ID_ERROR_ABORT;
-        buffer_out[1] = (uint8_t)error;
-        buffer_out_send = 2;
+        log_error("failed to add %s to the fread cache: %d", msg_sdo_file->path.data, -error);
+        buffer_out_send = make_error_msg(buffer_out, -error);
     }
     return buffer_out_send;
 }
@@ -299,3 +484,52 @@ static uint32_t ipc_respond_sdo_write_from_file(uint8_t *buffer_in, uint32_t buf
     }
     return buffer_out_send;
 }
+
+static uint32_t ipc_respond_latency_stats(uint8_t *buffer_in, uint32_t buffer_in_recv, uint8_t *buffer_out) {
+    if (buffer_in_recv < IPC_MSG_LATENCY_STATS_MIN_LEN) {
+        log_error("latency stats msg len mismatch; got %d, expect at least %d", buffer_in_recv,
+                  IPC_MSG_LATENCY_STATS_MIN_LEN);
+        return 0;
+    }
+
+    ipc_msg_latency_stats_t *msg_in = (ipc_msg_latency_stats_t *)buffer_in;
+    ipc_msg_latency_stats_t *msg_out = (ipc_msg_latency_stats_t *)buffer_out;
+    msg_out->header.version = IPC_MSG_VERSION;
+    msg_out->header.id = IPC_MSG_ID_LATENCY_STATS;
+    msg_out->reset = msg_in->reset;
+    msg_out->len = LATENCY_LEN;
+
+    for (uint32_t i = 0; i < LATENCY_LEN; i++) {
+        histogram_summary_t summary;
+        histogram_summary(latency_get(i), &summary);
+        if (msg_in->reset) {
+            latency_reset(i);
+        }
+
+        ipc_latency_summary_t *out = &msg_out->summaries[i];
+        out->count = summary.count;
+        out->mean = summary.mean;
+        out->p50 = summary.p50;
+        out->p90 = summary.p90;
+        out->p99 = summary.p99;
+        out->p999 = summary.p999;
+        out->max = summary.max;
+    }
+    return offsetof(ipc_msg_latency_stats_t, summaries) + (LATENCY_LEN * sizeof(ipc_latency_summary_t));
+}
+
+static uint32_t ipc_respond_od_compact_table(const uint8_t *header, uint8_t *buffer_in, uint32_t buffer_in_recv,
+                                             uint8_t *buffer_out) {
+    if (buffer_in_recv != sizeof(ipc_msg_od_compact_table_t)) {
+        log_error("od compact table msg len mismatch; got %d, expect %d", buffer_in_recv,
+                  sizeof(ipc_msg_od_compact_table_t));
+        return 0;
+    }
+
+    ipc_msg_od_compact_table_t *msg_in = (ipc_msg_od_compact_table_t *)buffer_in;
+    ipc_msg_od_compact_table_t *msg_out = (ipc_msg_od_compact_table_t *)buffer_out;
+    msg_out->header.version = IPC_MSG_VERSION;
+    msg_out->header.id = IPC_MSG_ID_OD_COMPACT_TABLE;
+    msg_out->table_crc = ipc_broadcast_compact_client(header, ZMQ_HEADER_LEN, msg_in->table_crc);
+    return sizeof(ipc_msg_od_compact_table_t);
+}
@@ -3,11 +3,19 @@
 
 #include "CANopen.h"
 #include "fcache.h"
+#include "work_queue.h"
 #include <stdbool.h>
 #include <stdint.h>
 
-int ipc_respond_init(void *context);
-void ipc_respond_process(CO_t *co, OD_t *od, CO_config_t *config, fcache_t *fread_cache);
+// sdo requests go to wq's interactive class and file requests to its bulk class, the rest is answered inline
+int ipc_respond_init(void *context, work_queue_t *wq);
+/*
+ * Handles one request, returns true if one was handled. With wait false it returns right away when none is queued,
+ * for callers that run the CANopen processing themselves; blocking SDO client requests are then rejected, as the
+ * frames they wait on would never be processed.
+ */
+bool ipc_respond_process(CO_t *co, OD_t *od, CO_config_t *config, fcache_t *fread_cache, bool wait);
+int ipc_respond_fd(void); // ZMQ_FD, edge triggered
 void ipc_respond_free(void);
 
 #endif
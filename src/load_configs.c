@@ -591,6 +591,7 @@ static void reset_tmp_data(struct tmp_data_t *data) {
 static int fill_var(struct tmp_data_t *data, void **value, OD_size_t *value_length, uint8_t *attribute) {
     OD_size_t length = 0;
 
+    // only the numeric types are ODA_TRPDO, the compact od write broadcasts pick their entries by it
     switch (data->data_type) {
     case BOOLEAN:
         *value = (void *)str2buf_bool(data->default_value);
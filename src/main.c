@@ -1,7 +1,12 @@
 #include "CANopen.h"
 #include "CO_epoll_interface.h"
 #include "OD.h"
+#include "bus_stats.h"
+#include "can_batch.h"
+#include "can_rx.h"
+#include "can_tx.h"
 #include "config.h"
+#include "daemons_ext.h"
 #include "ecss_time_ext.h"
 #include "fcache.h"
 #include "file_transfer_ext.h"
@@ -9,11 +14,22 @@
 #include "ipc_broadcast.h"
 #include "ipc_consume.h"
 #include "ipc_respond.h"
+#include "latency.h"
 #include "load_configs.h"
 #include "logger.h"
+#include "logs_ext.h"
+#include "metrics.h"
+#include "od_seqlock.h"
+#include "od_snapshot.h"
 #include "os_command_ext.h"
+#include "scheduler.h"
+#include "scheduler_ext.h"
+#include "stats_ext.h"
 #include "system.h"
 #include "system_ext.h"
+#include "trace.h"
+#include "updater_ext.h"
+#include <linux/limits.h>
 #include <linux/reboot.h>
 #include <net/if.h>
 #include <sched.h>
@@ -36,19 +52,34 @@
 #define CACHE_BASE_HOME_PATH "~/.cache/oresat"
 
 #define FREAD_CACHE_DIR       "fread"
-#define FREAD_CACHE_ROOT_PATH CACHE_BASE_ROOT_PATH "/" FREAD_CACHE_DIR
-#define FREAD_CACHE_ROOT_HOME CACHE_BASE_HOME_PATH "/" FREAD_CACHE_DIR
-
-#define FWRITE_CACHE_DIR       "fwrite"
-#define FWRITE_CACHE_ROOT_PATH CACHE_BASE_ROOT_PATH "/" FWRITE_CACHE_DIR
-#define FWRITE_CACHE_ROOT_HOME CACHE_BASE_HOME_PATH "/" FWRITE_CACHE_DIR
+#define FWRITE_CACHE_DIR      "fwrite"
+#define TRACE_FILE_NAME       "trace.bin"
+#define LOGS_CURSOR_FILE_NAME "logs_cursor"
+
+// cache quotas, the oldest and lowest priority files are evicted first
+#define FREAD_CACHE_MAX_BYTES  (1024ULL * 1024 * 1024)
+#define FREAD_CACHE_MAX_FILES  20000
+#define FWRITE_CACHE_MAX_BYTES (256ULL * 1024 * 1024)
+#define FWRITE_CACHE_MAX_FILES 1000
+#define CACHE_MIN_FREE_PERCENT 10 // evict files when the filesystem has less free space than this
+#define CACHE_PRIORITY_REMAKE  -1
+#define CACHE_PRIORITY_KEEP    1
 
 #define DEFAULT_NODE_ID       0x7C
 #define DEFAULT_CAN_INTERFACE "can0"
+#define CAN_BITRATE           1000000 // only used for the bus load estimate and time sync
+#define SCET_FRAME_BITS       111     // 8 byte data frame without stuff bits
 
 #define MAIN_THREAD_INTERVAL_US 100000
 #define TMR_THREAD_INTERVAL_US  1000
+#define TMR_THREAD_MAX_TICK_US  1000000
+#define THREAD_STACK_PREFAULT   (256 * 1024) // with -l, stack faulted in by each thread before its loop
+#define IPC_MSGS_PER_LOOP       16 // single thread mode, so a burst of ipc msgs can't starve CANopen processing
+#define IPC_WORKERS             3  // sdo and file requests, one is kept free of bulk work
 #define BUS_CHECK_INTERVAL_S    5
+#define TRACE_SYNC_INTERVAL_S   10
+
+#define TRACE_RECORDS 65536 // 2 MiB ring file
 
 #define NMT_CONTROL \
     (CO_NMT_STARTUP_TO_OPERATIONAL | CO_NMT_ERR_ON_ERR_REG | CO_ERR_REG_GENERIC_ERR | CO_ERR_REG_COMMUNICATION)
@@ -68,11 +99,31 @@ static CO_epoll_t ep_rt;
 static volatile sig_atomic_t CO_endProgram = 0;
 static char od_path[256] = {0};
 static char node_path[256] = {0};
+static uint64_t rt_cpus = 0;  // 0 for no affinity
+static uint64_t ipc_cpus = 0; // 0 for no affinity
+static bool lock_mem = false;
+static bool single_thread = false;
 
 static void *rt_thread(void *arg);
 static void *ipc_responder_thread(void *arg);
 static void *ipc_consumer_thread(void *arg);
 static void *ipc_broadcaster_thread(void *arg);
+static void thread_setup(const char *name, uint64_t cpus);
+static void ipc_process_ready(CO_epoll_t *ep, bool *ipc_reset);
+static void updater_status_changed(uint8_t status);
+static void daemons_changed(uint8_t subindex, uint8_t value);
+static void scheduled_action_fired(const sched_action_t *action, int64_t late_ns);
+
+static void get_cache_base_path(char *path, size_t len) {
+    if (getuid() == 0) {
+        snprintf(path, len, "%s", CACHE_BASE_ROOT_PATH);
+    } else {
+        wordexp_t exp_result;
+        wordexp(CACHE_BASE_HOME_PATH, &exp_result, 0);
+        snprintf(path, len, "%s", exp_result.we_wordv[0]);
+        wordfree(&exp_result);
+    }
+}
 
 static void sigHandler(int sig) {
     (void)sig;
@@ -84,7 +135,9 @@ static void EmergencyRxCallback(const uint16_t ident, const uint16_t errorCode,
     int16_t nodeIdRx = ident ? (ident & 0x7F) : node_id;
 
     log_printf(LOG_NOTICE, DBG_EMERGENCY_RX, nodeIdRx, errorCode, errorRegister, errorBit, infoCode);
-    ipc_broadcast_emcy(nodeIdRx, errorCode, infoCode);
+    trace_record(TRACE_EMCY_RX, ident ? nodeIdRx : 0, infoCode, &errorCode, sizeof(errorCode));
+    // called from CANopenNode's rx callback in can_rx_process(), so the stamp is this frame's
+    ipc_broadcast_emcy(nodeIdRx, errorCode, infoCode, ident ? can_rx_time_ns(ident) : 0);
 }
 
 static char *NmtState2Str(CO_NMT_internalState_t state) {
@@ -104,24 +157,62 @@ static char *NmtState2Str(CO_NMT_internalState_t state) {
 
 static void NmtChangedCallback(CO_NMT_internalState_t state) {
     log_printf(LOG_NOTICE, DBG_NMT_CHANGE, NmtState2Str(state), state);
+    trace_record(TRACE_NMT, 0, state, NULL, 0);
 }
 
 static void HeartbeatNmtChangedCallback(uint8_t nodeId, uint8_t idx, CO_NMT_internalState_t state, void *object) {
     (void)object;
     log_printf(LOG_NOTICE, DBG_HB_CONS_NMT_CHANGE, nodeId, idx, NmtState2Str(state), state);
-    ipc_broadcast_hb(nodeId, state);
+    trace_record(TRACE_NMT, nodeId, state, NULL, 0);
+    // the main thread sees the change after the rx, the node's last heartbeat is the one with the new state
+    ipc_broadcast_hb(nodeId, state, can_rx_time_ns(CO_CAN_ID_HEARTBEAT + nodeId));
+}
+
+// the sdo server runs in the main thread, so its state can be sampled after each main loop
+static void trace_sdo_server_state(CO_t *co) {
+    static CO_SDO_state_t last_state = CO_SDO_ST_IDLE;
+    static uint64_t start_us = 0;
+    if (!co->SDOserver) {
+        return;
+    }
+    CO_SDO_state_t state = co->SDOserver[0].state;
+    if (state != last_state) {
+        trace_record(TRACE_SDO_SERVER, state, last_state, NULL, 0);
+        if (last_state == CO_SDO_ST_IDLE) {
+            start_us = get_uptime_us();
+        } else if (state == CO_SDO_ST_IDLE) {
+            latency_record(LATENCY_SDO_SERVER, get_uptime_us() - start_us);
+        }
+        last_state = state;
+    }
 }
 
 static void printUsage(char *progName) {
     printf("Usage: %s [options]\n", progName);
     printf("\n");
     printf("Options:\n");
+    printf("  -a <cpus>           Pin the RT thread to a CPU list, e.g. 1 or 2-3\n");
+    printf("  -A <cpus>           Pin the IPC threads to a CPU list\n");
+    printf("  -b <frames>         CAN frames read or sent per RT wakeup (default: %d)\n", CAN_BATCH_DEFAULT_LEN);
+    printf("  -c                  Broadcast numeric OD writes as compact batched messages\n");
     printf("  -i <interface>      CAN interface (default: " DEFAULT_CAN_INTERFACE ")\n");
+    printf("  -l                  Lock memory in RAM and prefault the thread stacks\n");
     printf("  -m                  Node is the network manager node\n");
+    printf("  -M <fast-ms>,<slow-ms>\n");
+    printf("                      Metrics sample periods, CPU, RAM and cache lengths every fast-ms,\n");
+    printf("                      storage and temperatures every slow-ms (default: %d,%d)\n", METRICS_DEFAULT_FAST_MS,
+           METRICS_DEFAULT_SLOW_MS);
     printf("  -n <node-id>        CANopen node id (default: 0x%X)\n", DEFAULT_NODE_ID);
     printf("  -p <priority>       Real-time priority of RT thread (1 .. 99). If not set or\n");
     printf("                      set to -1, then normal scheduler is used for RT thread\n");
     printf("                      (default: -1).\n");
+    printf("  -s                  Single thread mode, CANopen and IPC run in one epoll loop.\n");
+    printf("                      IPC SDO client requests are rejected\n");
+    printf("  -t <max-us>         Adaptive tick, the RT thread sleeps until the next CANopen\n");
+    printf("                      timer deadline, but no longer than max-us (%d .. %d).\n", TMR_THREAD_INTERVAL_US,
+           TMR_THREAD_MAX_TICK_US);
+    printf("                      IPC TPDO requests can wait up to max-us (default: fixed %d us tick)\n",
+           TMR_THREAD_INTERVAL_US);
     printf("  -v                  Verbose logging\n");
 }
 
@@ -167,6 +258,11 @@ int main(int argc, char *argv[]) {
     char can_interface[20] = DEFAULT_CAN_INTERFACE;
     bool loaded_od_conf = false;
     bool network_manager_node = false;
+    bool compact_od_writes = false;
+    uint32_t can_batch_len = CAN_BATCH_DEFAULT_LEN;
+    uint32_t rt_tick_us = TMR_THREAD_INTERVAL_US;
+    uint32_t metrics_fast_ms = METRICS_DEFAULT_FAST_MS;
+    uint32_t metrics_slow_ms = METRICS_DEFAULT_SLOW_MS;
 
     get_default_node_config_path(node_path, 256);
     get_default_od_config_path(od_path, 256);
@@ -178,23 +274,61 @@ int main(int argc, char *argv[]) {
         make_node_config(node_path);
     }
 
-    while ((opt = getopt(argc, argv, "hi:mn:p:v")) != -1) {
+    while ((opt = getopt(argc, argv, "a:A:b:chi:lmM:n:p:st:v")) != -1) {
         switch (opt) {
+        case 'a':
+            if (parse_cpu_list(optarg, &rt_cpus) < 0) {
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'A':
+            if (parse_cpu_list(optarg, &ipc_cpus) < 0) {
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            can_batch_len = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            compact_od_writes = true;
+            break;
         case 'h':
             printUsage(argv[0]);
             exit(EXIT_SUCCESS);
         case 'i':
             strncpy(can_interface, optarg, strlen(optarg));
             break;
+        case 'l':
+            lock_mem = true;
+            break;
         case 'm':
             network_manager_node = true;
             break;
+        case 'M':
+            if ((sscanf(optarg, "%u,%u", &metrics_fast_ms, &metrics_slow_ms) != 2) || (metrics_fast_ms == 0) ||
+                (metrics_slow_ms == 0)) {
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'n':
             node_id = strtol(optarg, NULL, 16);
             break;
         case 'p':
             rtPriority = strtol(optarg, NULL, 0);
             break;
+        case 's':
+            single_thread = true;
+            break;
+        case 't':
+            rt_tick_us = strtoul(optarg, NULL, 0);
+            if ((rt_tick_us < TMR_THREAD_INTERVAL_US) || (rt_tick_us > TMR_THREAD_MAX_TICK_US)) {
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'v':
             log_level_set(LOG_DEBUG);
             break;
@@ -204,6 +338,11 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // systemd sets JOURNAL_STREAM when stdout goes to the journal, log through syslog there to keep the levels
+    if (log_async_start(getenv("JOURNAL_STREAM") ? LOG_SINK_SYSLOG : LOG_SINK_STDOUT) == 0) {
+        atexit(log_async_stop); // flush on every exit path
+    }
+
     if (getuid() != 0) {
         log_warning("not running as root");
     }
@@ -220,6 +359,13 @@ int main(int argc, char *argv[]) {
 
     log_info("starting %s %s", PROJECT_NAME, PROJECT_VERSION);
 
+    if (lock_mem) {
+        r = lock_memory();
+        if (r < 0) {
+            log_error("failed to lock memory: %d", -r);
+        }
+    }
+
     bool first_interface_check = true;
     do {
         CANptr.can_ifindex = if_nametoindex(can_interface);
@@ -266,42 +412,84 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    err = CO_epoll_create(&epMain, MAIN_THREAD_INTERVAL_US);
+    // CO_epoll_processLast() shortens the timer to the next CANopen deadline, so a long interval makes it adaptive
+    err = CO_epoll_create(&epMain, single_thread ? rt_tick_us : MAIN_THREAD_INTERVAL_US);
     if (err != CO_ERROR_NO) {
         log_printf(LOG_CRIT, DBG_GENERAL, "CO_epoll_create(main), err=", err);
         exit(EXIT_FAILURE);
     }
-    err = CO_epoll_create(&ep_rt, TMR_THREAD_INTERVAL_US);
-    if (err != CO_ERROR_NO) {
-        log_printf(LOG_CRIT, DBG_GENERAL, "CO_epoll_create(RT), err=", err);
-        exit(EXIT_FAILURE);
+    if (single_thread) {
+        CANptr.epoll_fd = epMain.epoll_fd;
+    } else {
+        err = CO_epoll_create(&ep_rt, rt_tick_us);
+        if (err != CO_ERROR_NO) {
+            log_printf(LOG_CRIT, DBG_GENERAL, "CO_epoll_create(RT), err=", err);
+            exit(EXIT_FAILURE);
+        }
+        CANptr.epoll_fd = ep_rt.epoll_fd;
     }
-    CANptr.epoll_fd = ep_rt.epoll_fd;
+
+    char cache_path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    get_cache_base_path(cache_path, sizeof(cache_path));
+
+    mkdir_path(cache_path, 0755);
+    path_join(cache_path, TRACE_FILE_NAME, tmp_path, sizeof(tmp_path));
+    trace_init(tmp_path, TRACE_RECORDS);
+    bus_stats_init(can_interface, CAN_BITRATE);
+    can_rx_init(can_batch_len);
+    can_tx_init(can_batch_len);
 
     if (network_manager_node == false) {
-        if (getuid() == 0) {
-            fread_cache = fcache_init(FREAD_CACHE_ROOT_PATH);
-            fwrite_cache = fcache_init(FWRITE_CACHE_ROOT_PATH);
-        } else {
-            wordexp_t exp_result;
-            char tmp_path[256];
-            wordexp(CACHE_BASE_HOME_PATH, &exp_result, 0);
-            sprintf(tmp_path, "%s/%s", exp_result.we_wordv[0], FREAD_CACHE_DIR);
-            fread_cache = fcache_init(tmp_path);
-            sprintf(tmp_path, "%s/%s", exp_result.we_wordv[0], FWRITE_CACHE_DIR);
-            fwrite_cache = fcache_init(tmp_path);
-            wordfree(&exp_result);
-        }
+        path_join(cache_path, FREAD_CACHE_DIR, tmp_path, sizeof(tmp_path));
+        fread_cache = fcache_init(tmp_path);
+        path_join(cache_path, FWRITE_CACHE_DIR, tmp_path, sizeof(tmp_path));
+        fwrite_cache = fcache_init(tmp_path);
         log_info("fread cache path: %s", fread_cache->dir_path);
         log_info("fwrite cache path: %s", fwrite_cache->dir_path);
+        fcache_set_limits(fread_cache, FREAD_CACHE_MAX_BYTES, FREAD_CACHE_MAX_FILES, CACHE_MIN_FREE_PERCENT);
+        fcache_set_limits(fwrite_cache, FWRITE_CACHE_MAX_BYTES, FWRITE_CACHE_MAX_FILES, CACHE_MIN_FREE_PERCENT);
+        // exports the daemon can make again go before app files, updates waiting to run go after other uploads
+        fcache_add_priority(fread_cache, "os_command_", CACHE_PRIORITY_REMAKE);
+        fcache_add_priority(fread_cache, "logs_", CACHE_PRIORITY_REMAKE);
+        fcache_add_priority(fread_cache, "updater_status_", CACHE_PRIORITY_REMAKE);
+        fcache_add_priority(fwrite_cache, "update_", CACHE_PRIORITY_KEEP);
+        if (metrics_init(fread_cache, fwrite_cache, metrics_fast_ms, metrics_slow_ms) < 0) {
+            log_error("failed to start the metrics sampler");
+        }
 
-        os_command_extension_init(od);
-        ecss_time_extension_init(od);
+        os_command_extension_init(od, fread_cache);
+        ecss_time_extension_init(od, (SCET_FRAME_BITS * 1000000000ULL) / CAN_BITRATE);
         file_transfer_extension_init(od, fread_cache, fwrite_cache);
         system_extension_init(od);
+        updater_extension_init(od, fread_cache, fwrite_cache, updater_status_changed);
+        path_join(cache_path, LOGS_CURSOR_FILE_NAME, tmp_path, sizeof(tmp_path));
+        logs_extension_init(od, fread_cache, tmp_path);
+        daemons_extension_init(od, daemons_changed);
     }
-
-    ipc_init(od);
+    stats_extension_init(od);
+    scheduler_extension_init(od);
+
+    // the od is shared even with -s, the scheduler, updater, unit monitor and sdo extensions' threads still use it
+    if (od_seqlock_init(od) < 0) { // before ipc, its extension reads and writes app entries under the seqlocks
+        log_error("od seqlock alloc failed, ipc od writes can race tpdo and sdo reads");
+    } else if ((r = od_snapshot_init(od, NULL)) < 0) { // kept up to date by the seqlock writes
+        log_error("failed to make the od snapshot for local apps: %d", -r);
+    }
+    ipc_init(od, compact_od_writes, single_thread ? 0 : IPC_WORKERS);
+    ipc_consume_set_tpdo_wake_fd(single_thread ? epMain.event_fd : ep_rt.event_fd);
+    r = scheduler_init(scheduled_action_fired, rtPriority); // fires through the ipc consumer's handlers
+    if (r < 0) {
+        log_error("failed to start the scheduler: %d", -r);
+    }
+    if (single_thread) {
+        r = ipc_epoll_add(epMain.epoll_fd);
+        if (r < 0) {
+            log_critical("failed to add ipc sockets to epoll: %d", -r);
+            exit(EXIT_FAILURE);
+        }
+    }
+    bool ipc_reset = false;
 
     while ((reset != CO_RESET_APP) && (reset != CO_RESET_QUIT) && (CO_endProgram == 0)) {
         uint32_t errInfo;
@@ -355,7 +543,22 @@ int main(int argc, char *argv[]) {
             log_printf(LOG_INFO, DBG_CAN_OPEN_INFO, node_id, "node-id not initialized");
         }
 
-        if (firstRun) {
+        if (firstRun && single_thread) {
+            firstRun = false;
+
+            thread_setup("main", rt_cpus); // this loop is the rt loop
+            if (rtPriority > 0) {
+                struct sched_param param;
+
+                param.sched_priority = rtPriority;
+                if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+                    log_printf(LOG_CRIT, DBG_ERRNO, "pthread_setschedparam()");
+                    programExit = EXIT_FAILURE;
+                    CO_endProgram = 1;
+                    continue;
+                }
+            }
+        } else if (firstRun) {
             firstRun = false;
 
             if (pthread_create(&rt_thread_id, NULL, rt_thread, NULL) != 0) {
@@ -409,54 +612,97 @@ int main(int argc, char *argv[]) {
         }
 
         CO_CANsetNormalMode(co->CANmodule);
+        can_rx_setup(co->CANmodule);
 
         log_printf(LOG_INFO, DBG_CAN_OPEN_INFO, node_id, "running ...");
 
         reset = CO_RESET_NOT;
         while (reset == CO_RESET_NOT && CO_endProgram == 0) {
             CO_epoll_wait(&epMain);
+            if (single_thread) {
+                if (epMain.ev.data.fd == epMain.event_fd) {
+                    epMain.timerEvent = true; // tpdo send request or queued ipc msgs, process pdos now too
+                }
+                can_rx_process(&epMain, co->CANmodule);
+                // realtime so the pdos' next deadline shortens the timer, like the rt thread's; with -t the tick alone
+                // would delay event driven tpdos and rpdo timeouts by up to the whole interval
+                can_tx_begin(co->CANmodule);
+                CO_epoll_processRT(&epMain, co, true);
+                can_tx_end(co->CANmodule);
+            }
             CO_epoll_processMain(&epMain, co, false, &reset);
+            if (single_thread) {
+                ipc_process_ready(&epMain, &ipc_reset);
+                if (ipc_reset) {
+                    CO_endProgram = 1;
+                }
+            }
             CO_epoll_processLast(&epMain);
+            trace_sdo_server_state(co);
+            bus_stats_overflow(co->CANmodule->CANerrorStatus & CO_CAN_ERRTX_OVERFLOW,
+                               co->CANmodule->CANerrorStatus & CO_CAN_ERRRX_OVERFLOW);
 
             static uint32_t last_check = 0;
+            static uint32_t last_trace_sync = 0;
             uint32_t uptime_s = get_uptime_s();
             if (uptime_s > (last_check + BUS_CHECK_INTERVAL_S)) {
+                can_rx_setup(co->CANmodule); // in case an RPDO cob-id change narrowed the socket's filter
                 ipc_broadcast_bus_status(co);
                 last_check = uptime_s;
             }
+            if (uptime_s > (last_trace_sync + TRACE_SYNC_INTERVAL_S)) {
+                trace_sync();
+                last_trace_sync = uptime_s;
+            }
         }
     }
 
     CO_endProgram = 1;
 
+    scheduler_free();
     ipc_free();
 
-    if (pthread_join(rt_thread_id, NULL) != 0) {
-        log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
-        exit(EXIT_FAILURE);
-    }
-    if (pthread_join(ipc_responder_thread_id, NULL) != 0) {
-        log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
-        exit(EXIT_FAILURE);
-    }
-    if (pthread_join(ipc_consumer_thread_id, NULL) != 0) {
-        log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
-        exit(EXIT_FAILURE);
-    }
-    if (pthread_join(ipc_broadcaster_thread_id, NULL) != 0) {
-        log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
-        exit(EXIT_FAILURE);
+    if (!single_thread) {
+        if (pthread_join(rt_thread_id, NULL) != 0) {
+            log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_join(ipc_responder_thread_id, NULL) != 0) {
+            log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_join(ipc_consumer_thread_id, NULL) != 0) {
+            log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_join(ipc_broadcaster_thread_id, NULL) != 0) {
+            log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
+            exit(EXIT_FAILURE);
+        }
     }
+    can_rx_free(); // the rt thread has stopped
+    can_tx_free();
+    bus_stats_free();
 
     if (network_manager_node == false) {
         os_command_extension_free();
+        ecss_time_extension_free();
+        updater_extension_free();
+        logs_extension_free();
+        daemons_extension_free();
         file_transfer_extension_free();
+        metrics_free(); // samples the caches
 
         fcache_free(fread_cache);
         fcache_free(fwrite_cache);
     }
 
-    CO_epoll_close(&ep_rt);
+    trace_free();
+    od_snapshot_free();
+    od_seqlock_free(); // every thread using it has stopped
+    if (!single_thread) {
+        CO_epoll_close(&ep_rt);
+    }
     CO_epoll_close(&epMain);
     CO_CANsetConfigurationMode((void *)&CANptr);
     CO_delete(co);
@@ -469,29 +715,99 @@ int main(int argc, char *argv[]) {
     exit(programExit);
 }
 
+static void thread_setup(const char *name, uint64_t cpus) {
+    if (cpus) {
+        int r = set_thread_cpus(cpus);
+        if (r < 0) {
+            log_error("failed to pin %s thread to cpus 0x%llX: %d", name, (unsigned long long)cpus, -r);
+        }
+    }
+    if (lock_mem) {
+        prefault_stack(THREAD_STACK_PREFAULT);
+    }
+}
+
 static void *rt_thread(void *arg) {
     (void)arg;
+    thread_setup("rt", rt_cpus);
+    uint64_t deadline_us = 0; // when the timer should fire next, 0 if unknown
     while (CO_endProgram == 0) {
         CO_epoll_wait(&ep_rt);
+        uint64_t start_us = get_uptime_us();
+        if (ep_rt.timerEvent) {
+            if (deadline_us != 0) {
+                int64_t error_us = (int64_t)(start_us - deadline_us);
+                latency_record(LATENCY_RT_JITTER, (error_us < 0) ? -error_us : error_us);
+            }
+            deadline_us = start_us + ep_rt.timerInterval_us; // the periodic timer rearms itself on expiry
+        } else if (ep_rt.ev.data.fd == ep_rt.event_fd) {
+            ep_rt.timerEvent = true; // woken by a tpdo send request, process it now instead of on the next tick
+        }
+        can_rx_process(&ep_rt, co->CANmodule);
+        can_tx_begin(co->CANmodule);
         CO_epoll_processRT(&ep_rt, co, true);
+        can_tx_end(co->CANmodule);
         CO_epoll_processLast(&ep_rt);
+        uint64_t end_us = get_uptime_us();
+        if (ep_rt.timerNext_us < ep_rt.timerInterval_us) { // timer was rearmed for an earlier CANopen deadline
+            deadline_us = end_us + ep_rt.timerNext_us;
+        }
+        latency_record(LATENCY_RT_CYCLE, end_us - start_us);
     }
     return NULL;
 }
 
+// zmq fds only signal a change in zmq's state, so drain every socket on each loop, not just the one that woke it
+static void ipc_process_ready(CO_epoll_t *ep, bool *ipc_reset) {
+    bool pending = true;
+    for (int i = 0; pending && (i < IPC_MSGS_PER_LOOP); i++) {
+        pending = ipc_respond_process(co, od, &config, fread_cache, false);
+        pending |= ipc_consume_process(co, od, &base_config, &config, od_path, ipc_reset, false);
+        pending |= ipc_broadcast_process(false);
+    }
+    if (pending) {
+        uint64_t one = 1; // more may be queued, come straight back after the next CANopen processing
+        if (write(ep->event_fd, &one, sizeof(one)) < 0) {
+            log_error("ipc event_fd write failed: %d", errno);
+        }
+    }
+    if (ep->epoll_new && ipc_is_fd(ep->ev.data.fd)) {
+        ep->epoll_new = false;
+    }
+}
+
+// on the updater thread, the msg is queued for the broadcaster's owner thread. The updater starts before ipc_init() and
+// stops after ipc_free(), changes outside that are dropped, clients can still read the status from the od
+static void updater_status_changed(uint8_t status) {
+    ipc_broadcast_od_write(OD_INDEX_UPDATER, OD_SUBINDEX_UPDATER_STATUS, &status, sizeof(status));
+}
+
+// on the unit monitor thread, queued for the broadcaster's owner thread like the updater status. The monitor also
+// starts before ipc_init() and stops after ipc_free(), counts changing outside that are dropped, they're in the od
+static void daemons_changed(uint8_t subindex, uint8_t value) {
+    ipc_broadcast_od_write(OD_INDEX_DAEMONS, subindex, &value, sizeof(value));
+}
+
+static void scheduled_action_fired(const sched_action_t *action, int64_t late_ns) {
+    log_debug("scheduled action %u fired %lld us late", action->id, (long long)(late_ns / 1000));
+    ipc_consume_scheduled(action, co, od, &base_config, &config);
+}
+
 static void *ipc_responder_thread(void *arg) {
     (void)arg;
+    thread_setup("ipc responder", ipc_cpus);
     while (CO_endProgram == 0) {
-        ipc_respond_process(co, od, &config, fread_cache);
+        ipc_respond_process(co, od, &config, fread_cache, true);
     }
     return NULL;
 }
 
 static void *ipc_consumer_thread(void *arg) {
     (void)arg;
+    thread_setup("ipc consumer", ipc_cpus);
     bool ipc_reset = false;
     while (CO_endProgram == 0) {
-        ipc_consume_process(co, od, &base_config, &config, od_path, &ipc_reset);
+        ipc_consume_process(co, od, &base_config, &config, od_path, &ipc_reset, true);
         if (ipc_reset) {
             CO_endProgram = 1;
         }
@@ -501,8 +817,9 @@ static void *ipc_consumer_thread(void *arg) {
 
 static void *ipc_broadcaster_thread(void *arg) {
     (void)arg;
+    thread_setup("ipc broadcaster", ipc_cpus);
     while (CO_endProgram == 0) {
-        ipc_broadcast_process();
+        ipc_broadcast_process(true);
     }
     return NULL;
 }
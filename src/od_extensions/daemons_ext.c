@@ -0,0 +1,107 @@
+#include "daemons_ext.h"
+#include "301/CO_ODinterface.h"
+#include "OD.h"
+#include "logger.h"
+#include "unit_monitor.h"
+#include <stdint.h>
+#include <string.h>
+
+#define DAEMONS_PATTERN "oresat*.service"
+
+static unit_monitor_t *monitor = NULL;
+static daemons_changed_cb_t counts_changed = NULL;
+static unit_counts_t last_counts = {0}; // only used from the monitor thread
+
+static ODR_t daemons_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
+static ODR_t daemons_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
+
+static OD_extension_t ext = {
+    .object = NULL,
+    .read = daemons_read,
+    .write = daemons_write,
+};
+
+static void unit_changed(const char *unit, unit_state_t state, unit_counts_t counts) {
+    log_info("%s is %s", unit, unit_state_str(state));
+    if (counts_changed != NULL) {
+        if (counts.total != last_counts.total) {
+            counts_changed(OD_SUBINDEX_DAEMONS_TOTAL, counts.total);
+        }
+        if (counts.active != last_counts.active) {
+            counts_changed(OD_SUBINDEX_DAEMONS_ACTIVE, counts.active);
+        }
+        if (counts.failed != last_counts.failed) {
+            counts_changed(OD_SUBINDEX_DAEMONS_FAILED, counts.failed);
+        }
+    }
+    last_counts = counts;
+}
+
+void daemons_extension_init(OD_t *od, daemons_changed_cb_t changed_cb) {
+    OD_entry_t *entry = OD_find(od, OD_INDEX_DAEMONS);
+    if (entry == NULL) {
+        log_critical("could not find daemons enty 0x(%X)", OD_INDEX_DAEMONS);
+        return;
+    }
+    counts_changed = changed_cb;
+    monitor = unit_monitor_init(DAEMONS_PATTERN, unit_changed);
+    if (monitor == NULL) {
+        log_critical("failed to create the daemons unit monitor");
+        return;
+    }
+    OD_extension_init(entry, &ext);
+    int r = unit_monitor_start(monitor);
+    if (r < 0) {
+        log_error("failed to start the daemons unit monitor: %d", r);
+    }
+}
+
+void daemons_extension_free(void) {
+    unit_monitor_free(monitor);
+    monitor = NULL;
+}
+
+static ODR_t daemons_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
+    ODR_t r = ODR_OK;
+    unit_counts_t counts = unit_monitor_counts(monitor);
+    switch (stream->subIndex) {
+    case 0:
+        r = OD_readOriginal(stream, buf, count, countRead);
+        break;
+    case OD_SUBINDEX_DAEMONS_TOTAL:
+        memcpy(buf, &counts.total, sizeof(counts.total));
+        *countRead = sizeof(counts.total);
+        break;
+    case OD_SUBINDEX_DAEMONS_ACTIVE:
+        memcpy(buf, &counts.active, sizeof(counts.active));
+        *countRead = sizeof(counts.active);
+        break;
+    case OD_SUBINDEX_DAEMONS_FAILED:
+        memcpy(buf, &counts.failed, sizeof(counts.failed));
+        *countRead = sizeof(counts.failed);
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
+
+static ODR_t daemons_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
+    (void)buf;
+    (void)count;
+    (void)countWritten;
+    ODR_t r = ODR_OK;
+    switch (stream->subIndex) {
+    case 0:
+    case OD_SUBINDEX_DAEMONS_TOTAL:
+    case OD_SUBINDEX_DAEMONS_ACTIVE:
+    case OD_SUBINDEX_DAEMONS_FAILED:
+        r = ODR_READONLY;
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
@@ -0,0 +1,14 @@
+#ifndef _DAEMONS_EXT_H_
+#define _DAEMONS_EXT_H_
+
+#include "301/CO_ODinterface.h"
+#include <stdint.h>
+
+// counts the oresat*.service units, reads (incl. TPDOs) return the counts cached by the unit monitor
+typedef void (*daemons_changed_cb_t)(uint8_t subindex, uint8_t value);
+
+// changed_cb is called from the monitor thread for each count that changes, it must be thread safe, can be NULL
+void daemons_extension_init(OD_t *od, daemons_changed_cb_t changed_cb);
+void daemons_extension_free(void);
+
+#endif
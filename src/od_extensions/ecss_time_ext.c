@@ -1,8 +1,18 @@
 #include "ecss_time_ext.h"
 #include "301/CO_ODinterface.h"
 #include "OD.h"
+#include "can_rx.h"
 #include "ecss_time.h"
 #include "logger.h"
+#include "time_sync.h"
+#include <linux/can.h>
+#include <string.h>
+#include <time.h>
+
+#define RPDO_MAX           512
+#define PDO_COB_ID_INVALID 0x80000000
+
+static uint16_t scet_cob_id = 0; // of the RPDO mapping scet, 0 for none
 
 static ODR_t ecss_scet_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
     (void)count;
@@ -14,9 +24,18 @@ static ODR_t ecss_scet_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_
 
 static ODR_t ecss_scet_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
     (void)count;
-    int r = set_ecss_scet((ecss_scet_t *)buf);
-    if (r < 0) {
-        log_error("cannot set system time to ecss scet: %d", -r);
+    if (time_sync_running()) { // slewed to from the time sync thread, this can be the CANopen thread
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        uint64_t master_ns = ecss_scet_to_ns((const ecss_scet_t *)buf);
+        // the RPDO writes scet on the same thread that received the frame, so this is the stamp of the one carrying it;
+        // writes from sdo or ipc get the previous frame's stamp and are dropped as stale
+        time_sync_sample(master_ns, can_rx_time_ns(scet_cob_id), ((uint64_t)now.tv_sec * 1000000000ULL) + now.tv_nsec);
+    } else {
+        int r = set_ecss_scet((ecss_scet_t *)buf);
+        if (r < 0) {
+            log_error("cannot set system time to ecss scet: %d", -r);
+        }
     }
     *countWritten = stream->dataLength;
     return ODR_OK;
@@ -40,6 +59,60 @@ static ODR_t ecss_utc_write(OD_stream_t *stream, const void *buf, OD_size_t coun
     return ODR_OK;
 }
 
+static ODR_t time_sync_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
+    ODR_t r = ODR_OK;
+    time_sync_stats_t stats;
+    time_sync_stats(&stats);
+    switch (stream->subIndex) {
+    case 0:
+        r = OD_readOriginal(stream, buf, count, countRead);
+        break;
+    case OD_SUBINDEX_TIME_SYNC_STATE:
+        memcpy(buf, &stats.state, sizeof(stats.state));
+        *countRead = sizeof(stats.state);
+        break;
+    case OD_SUBINDEX_TIME_SYNC_OFFSET:
+        memcpy(buf, &stats.offset_ns, sizeof(stats.offset_ns));
+        *countRead = sizeof(stats.offset_ns);
+        break;
+    case OD_SUBINDEX_TIME_SYNC_FREQUENCY:
+        memcpy(buf, &stats.freq_ppb, sizeof(stats.freq_ppb));
+        *countRead = sizeof(stats.freq_ppb);
+        break;
+    case OD_SUBINDEX_TIME_SYNC_RMS_OFFSET:
+        memcpy(buf, &stats.rms_offset_ns, sizeof(stats.rms_offset_ns));
+        *countRead = sizeof(stats.rms_offset_ns);
+        break;
+    case OD_SUBINDEX_TIME_SYNC_SAMPLES:
+        memcpy(buf, &stats.samples, sizeof(stats.samples));
+        *countRead = sizeof(stats.samples);
+        break;
+    case OD_SUBINDEX_TIME_SYNC_STEPS:
+        memcpy(buf, &stats.steps, sizeof(stats.steps));
+        *countRead = sizeof(stats.steps);
+        break;
+    case OD_SUBINDEX_TIME_SYNC_SPIKES:
+        memcpy(buf, &stats.spikes, sizeof(stats.spikes));
+        *countRead = sizeof(stats.spikes);
+        break;
+    case OD_SUBINDEX_TIME_SYNC_UNTIMESTAMPED:
+        memcpy(buf, &stats.untimestamped, sizeof(stats.untimestamped));
+        *countRead = sizeof(stats.untimestamped);
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
+
+static ODR_t time_sync_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
+    (void)buf;
+    (void)count;
+    (void)countWritten;
+    return (stream->subIndex <= OD_SUBINDEX_TIME_SYNC_UNTIMESTAMPED) ? ODR_READONLY : ODR_SUB_NOT_EXIST;
+}
+
 static OD_extension_t scet_ext = {
     .object = NULL,
     .read = ecss_scet_read,
@@ -52,7 +125,34 @@ static OD_extension_t utc_ext = {
     .write = ecss_utc_write,
 };
 
-void ecss_time_extension_init(OD_t *od) {
+static OD_extension_t time_sync_ext = {
+    .object = NULL,
+    .read = time_sync_read,
+    .write = time_sync_write,
+};
+
+// the cob id of the first valid RPDO that maps scet
+static uint16_t find_scet_cob_id(OD_t *od) {
+    for (int i = 0; i < RPDO_MAX; i++) {
+        OD_entry_t *comm = OD_find(od, 0x1400 + i);
+        OD_entry_t *map = OD_find(od, 0x1600 + i);
+        uint32_t cob_id;
+        uint8_t map_len;
+        if (!comm || !map || (OD_get_u32(comm, 1, &cob_id, true) != ODR_OK) || (cob_id & PDO_COB_ID_INVALID) ||
+            (OD_get_u8(map, 0, &map_len, true) != ODR_OK)) {
+            continue;
+        }
+        for (uint8_t sub = 1; sub <= map_len; sub++) {
+            uint32_t param; // index << 16 | subindex << 8 | bit length
+            if ((OD_get_u32(map, sub, &param, true) == ODR_OK) && ((param >> 16) == OD_INDEX_SCET)) {
+                return cob_id & CAN_SFF_MASK;
+            }
+        }
+    }
+    return 0;
+}
+
+void ecss_time_extension_init(OD_t *od, uint32_t frame_ns) {
     OD_entry_t *entry;
 
     entry = OD_find(od, OD_INDEX_SCET);
@@ -60,4 +160,23 @@ void ecss_time_extension_init(OD_t *od) {
 
     entry = OD_find(od, OD_INDEX_UTC);
     OD_extension_init(entry, &utc_ext);
+
+    entry = OD_find(od, OD_INDEX_TIME_SYNC);
+    if (entry != NULL) {
+        OD_extension_init(entry, &time_sync_ext);
+    }
+
+    scet_cob_id = find_scet_cob_id(od);
+    if (scet_cob_id == 0) {
+        log_info("scet is not mapped to a RPDO, scet writes set the clock directly");
+        return;
+    }
+    int r = time_sync_init(frame_ns);
+    if (r < 0) {
+        log_error("failed to start time sync: %d", r);
+    }
+}
+
+void ecss_time_extension_free(void) {
+    time_sync_free();
 }
@@ -2,7 +2,14 @@
 #define _ECSS_TIME_EXT_H_
 
 #include "301/CO_ODinterface.h"
+#include <stdint.h>
 
-void ecss_time_extension_init(OD_t *od);
+/*
+ * When scet is mapped to a RPDO, i.e. the time master's time broadcast, scet writes are samples for the time sync
+ * service and the clock is slewed to them instead of set. frame_ns is the broadcast frame's time on the wire, which
+ * is the least it takes from the master's timestamp to the local rx timestamp.
+ */
+void ecss_time_extension_init(OD_t *od, uint32_t frame_ns);
+void ecss_time_extension_free(void);
 
 #endif
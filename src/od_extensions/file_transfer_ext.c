@@ -3,6 +3,7 @@
 #include "OD.h"
 #include "fcache.h"
 #include "logger.h"
+#include "metrics.h"
 #include "od_ext.h"
 #include "system.h"
 #include <libgen.h>
@@ -25,6 +26,9 @@ typedef struct {
     fcache_t *cache;  // file cache to use if no path is given
     bool file_cached; // convience flag for if file src/dest is the cache
     char *files;
+    uint8_t *files_bin;
+    size_t files_bin_len;
+    fcache_filter_t filter; // filter/paging for files and files_bin
 } file_transfer_data_t;
 
 static ODR_t file_transfer_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
@@ -58,6 +62,9 @@ void file_transfer_extension_init(OD_t *od, fcache_t *fread_cache, fcache_t *fwr
             fread_data->tmp_file_path[0] = '\0';
             fread_data->cache = fread_cache;
             fread_data->files = NULL;
+            fread_data->files_bin = NULL;
+            fread_data->files_bin_len = 0;
+            memset(&fread_data->filter, 0, sizeof(fcache_filter_t));
         }
         fread_ext.object = fread_data;
         OD_extension_init(entry, &fread_ext);
@@ -78,6 +85,9 @@ void file_transfer_extension_init(OD_t *od, fcache_t *fread_cache, fcache_t *fwr
             fwrite_data->tmp_file_path[0] = '\0';
             fwrite_data->cache = fwrite_cache;
             fwrite_data->files = NULL;
+            fwrite_data->files_bin = NULL;
+            fwrite_data->files_bin_len = 0;
+            memset(&fwrite_data->filter, 0, sizeof(fcache_filter_t));
         }
         fwrite_ext.object = fwrite_data;
         OD_extension_init(entry, &fwrite_ext);
@@ -97,6 +107,9 @@ void file_transfer_extension_free(void) {
         if (fdata->files) {
             free(fdata->files);
         }
+        if (fdata->files_bin) {
+            free(fdata->files_bin);
+        }
         free(fread_ext.object);
         fread_ext.object = NULL;
     }
@@ -109,6 +122,9 @@ void file_transfer_extension_free(void) {
         if (fdata->files) {
             free(fdata->files);
         }
+        if (fdata->files_bin) {
+            free(fdata->files_bin);
+        }
         free(fwrite_ext.object);
         fwrite_ext.object = NULL;
     }
@@ -128,21 +144,60 @@ static ODR_t file_transfer_read(OD_stream_t *stream, void *buf, OD_size_t count,
         r = OD_readOriginal(stream, buf, count, countRead);
         break;
     case OD_SUBINDEX_FREAD_CACHE_LENGTH: {
-        uint8_t size = MIN(fcache_size(fdata->cache), 0xFF);
+        uint8_t size = MIN(metrics_fcache_len(fdata->cache), 0xFF); // mapped to a TPDO, no mutex
         *countRead = sizeof(size);
         memcpy(buf, &size, *countRead);
         break;
     }
     case OD_SUBINDEX_FREAD_CACHE_FILES_JSON: {
-        if ((stream->dataOffset == 0) && (fdata->files != NULL)) {
-            free(fdata->files);
+        if (stream->dataOffset == 0) { // only list once per transfer, not per segment
+            if (fdata->files != NULL) {
+                free(fdata->files);
+            }
+            fdata->files = fcache_list_files_as_json(fdata->cache, &fdata->filter);
         }
-        fdata->files = fcache_list_files_as_json(fdata->cache);
         if (fdata->files != NULL) {
             r = od_ext_read_data(stream, buf, count, countRead, fdata->files, strlen(fdata->files) + 1);
+        } else {
+            r = ODR_OUT_OF_MEM;
         }
         break;
     }
+    case OD_SUBINDEX_FREAD_CACHE_FILES_BIN: {
+        if (stream->dataOffset == 0) {
+            if (fdata->files_bin != NULL) {
+                free(fdata->files_bin);
+            }
+            fdata->files_bin = fcache_list_files_as_bin(fdata->cache, &fdata->filter, &fdata->files_bin_len);
+        }
+        if (fdata->files_bin != NULL) {
+            r = od_ext_read_data(stream, buf, count, countRead, fdata->files_bin, fdata->files_bin_len);
+        } else {
+            r = ODR_OUT_OF_MEM;
+        }
+        break;
+    }
+    case OD_SUBINDEX_FREAD_CACHE_LIST_OFFSET: {
+        uint32_t offset = fdata->filter.offset;
+        *countRead = sizeof(offset);
+        memcpy(buf, &offset, *countRead);
+        break;
+    }
+    case OD_SUBINDEX_FREAD_CACHE_LIST_COUNT: {
+        uint16_t list_count = MIN(fdata->filter.count, UINT16_MAX);
+        *countRead = sizeof(list_count);
+        memcpy(buf, &list_count, *countRead);
+        break;
+    }
+    case OD_SUBINDEX_FREAD_CACHE_LIST_PREFIX:
+        r = od_ext_read_data(stream, buf, count, countRead, fdata->filter.prefix, strlen(fdata->filter.prefix) + 1);
+        break;
+    case OD_SUBINDEX_FREAD_CACHE_LIST_NEWER_THAN: {
+        uint32_t newer_than = (uint32_t)fdata->filter.newer_than;
+        *countRead = sizeof(newer_than);
+        memcpy(buf, &newer_than, *countRead);
+        break;
+    }
     case OD_SUBINDEX_FREAD_CACHE_FILE_NAME:
         r = od_ext_read_data(stream, buf, count, countRead, fdata->raw, strlen(fdata->raw) + 1);
         break;
@@ -168,6 +223,9 @@ static ODR_t file_transfer_read(OD_stream_t *stream, void *buf, OD_size_t count,
 
             if (r == ODR_OK) {
                 r = od_ext_read_file(stream, buf, count, countRead, fdata->tmp_file_path, &fdata->fp);
+                if ((r == ODR_OK) && fdata->file_cached) {
+                    fcache_touch(fdata->cache, fdata->file_name); // whole file was read
+                }
             }
         }
         break;
@@ -214,20 +272,48 @@ static ODR_t file_transfer_write(OD_stream_t *stream, const void *buf, OD_size_t
         r = od_ext_write_file(stream, buf, count, countWritten, fdata->tmp_file_path, &fdata->fp);
         if (r == ODR_OK) {
             if (fdata->raw[0] == '/') {
-                if (!strncmp(fdata->raw, fdata->tmp_file_path, strlen(fdata->raw) + 1)) {
+                if (strncmp(fdata->raw, fdata->tmp_file_path, strlen(fdata->raw) + 1)) {
                     e = move_file(fdata->tmp_file_path, fdata->raw);
                     if (e < 0) {
-                        log_error("failed to move %s to %s: %d", fdata->tmp_file_path, fdata->file_name, r);
+                        log_error("failed to move %s to %s: %d", fdata->tmp_file_path, fdata->raw, e);
                     }
                 }
             } else {
                 e = fcache_add(fdata->cache, fdata->tmp_file_path, true);
                 if (e < 0) {
-                    log_error("failed to move %s to %s cache: %d", fdata->tmp_file_path, fdata->name, r);
+                    log_error("failed to move %s to %s cache: %d", fdata->tmp_file_path, fdata->name, e);
                 }
             }
         }
         break;
+    case OD_SUBINDEX_FREAD_CACHE_LIST_OFFSET:
+        r = od_ext_write_data(stream, buf, count, countWritten, &fdata->filter.offset, sizeof(fdata->filter.offset),
+                              NULL);
+        break;
+    case OD_SUBINDEX_FREAD_CACHE_LIST_COUNT: {
+        uint16_t list_count = 0;
+        r = od_ext_write_data(stream, buf, count, countWritten, &list_count, sizeof(list_count), NULL);
+        if (r == ODR_OK) {
+            fdata->filter.count = list_count;
+        }
+        break;
+    }
+    case OD_SUBINDEX_FREAD_CACHE_LIST_PREFIX: {
+        size_t dataWritten = 0;
+        r = od_ext_write_data(stream, buf, count, countWritten, fdata->filter.prefix, NAME_MAX, &dataWritten);
+        if (r == ODR_OK) {
+            fdata->filter.prefix[dataWritten] = '\0';
+        }
+        break;
+    }
+    case OD_SUBINDEX_FREAD_CACHE_LIST_NEWER_THAN: {
+        uint32_t newer_than = 0;
+        r = od_ext_write_data(stream, buf, count, countWritten, &newer_than, sizeof(newer_than), NULL);
+        if (r == ODR_OK) {
+            fdata->filter.newer_than = newer_than;
+        }
+        break;
+    }
     case OD_SUBINDEX_FREAD_CACHE_REMOVE:
         if ((bool *)buf && (fdata->file_name[0] != '\0')) {
             fcache_delete(fdata->cache, fdata->file_name);
@@ -0,0 +1,327 @@
+#include "logs_ext.h"
+#include "301/CO_ODinterface.h"
+#include "OD.h"
+#include "fcache.h"
+#include "logger.h"
+#include "od_ext.h"
+#include "system.h"
+#include <errno.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define JOURNAL_CMD           "journalctl -o short-iso --no-pager"
+#define CURSOR_PREFIX         "-- cursor: "
+#define CURSOR_MAX_LEN        256
+#define LINE_LEN              1024
+#define CMD_LEN               (128 + CURSOR_MAX_LEN)
+#define SINCE_BOOT_CMD        JOURNAL_CMD " --boot --lines=200"
+#define SINCE_BOOT_MAX_LEN    (16 * 1024) // whatever the lines come to, only the newest bytes are kept
+#define SINCE_BOOT_MAX_AGE_MS 5000        // older than this, a read also asks the logs thread for new ones
+#define GZIP_LEVEL            "wb6"
+#define FILE_NAME_LEN         32
+
+static bool running;
+static pthread_t thread_id;
+static fcache_t *cache = NULL;
+static char cursor_path[PATH_MAX];
+static char cursor[CURSOR_MAX_LEN] = {0}; // of the last exported entry, empty for none
+static bool make_file_requested = false;
+static bool since_boot_requested = false;
+static pthread_mutex_t since_boot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char since_boot[SINCE_BOOT_MAX_LEN + 1]; // the last lines loaded by the logs thread, under since_boot_mutex
+static size_t since_boot_len = 0;
+static bool since_boot_loaded = false;
+static uint32_t since_boot_ms = 0; // uptime they were loaded
+static char since_boot_xfer[SINCE_BOOT_MAX_LEN + 1]; // copy read by a transfer, so a reload can't change it midway
+static size_t since_boot_xfer_len = 0;
+
+static ODR_t logs_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
+static ODR_t logs_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
+static void *logs_thread(void *arg);
+
+static OD_extension_t ext = {
+    .object = NULL,
+    .read = logs_read,
+    .write = logs_write,
+};
+
+static void load_cursor(void) {
+    FILE *fp = fopen(cursor_path, "r");
+    if (fp == NULL) {
+        return; // nothing exported yet
+    }
+    if (fgets(cursor, sizeof(cursor), fp) == NULL) {
+        cursor[0] = '\0';
+    }
+    cursor[strcspn(cursor, "\n")] = '\0';
+    fclose(fp);
+}
+
+static void save_cursor(void) {
+    char tmp_path[PATH_MAX + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cursor_path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (fp == NULL) {
+        log_error("failed to save journal cursor: %d", errno);
+        return;
+    }
+    fprintf(fp, "%s\n", cursor);
+    fclose(fp);
+    if (rename(tmp_path, cursor_path) < 0) {
+        log_error("failed to save journal cursor: %d", errno);
+    }
+}
+
+void logs_extension_init(OD_t *od, fcache_t *fread_cache, const char *cursor_file_path) {
+    OD_entry_t *entry = OD_find(od, OD_INDEX_LOGS);
+    if (entry != NULL) {
+        cache = fread_cache;
+        snprintf(cursor_path, sizeof(cursor_path), "%s", cursor_file_path);
+        load_cursor();
+        OD_extension_init(entry, &ext);
+        since_boot_requested = true; // so the first read has them
+        running = true;
+        pthread_create(&thread_id, NULL, logs_thread, NULL);
+    } else {
+        log_critical("could not find logs enty 0x(%X)", OD_INDEX_LOGS);
+    }
+}
+
+void logs_extension_free(void) {
+    if (!running) {
+        return;
+    }
+    running = false;
+    pthread_join(thread_id, NULL);
+}
+
+bool logs_is_valid_cursor(const char *str) {
+    for (; *str; str++) {
+        if (!(((*str >= '0') && (*str <= '9')) || ((*str >= 'a') && (*str <= 'z')) || (*str == '=') ||
+              (*str == ';'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Lines from journalctl go straight into gzip in the cache dir, so no more than a line of the logs is ever in memory.
+ * The file is written hidden and renamed when complete, the cache never lists a partial export.
+ */
+static void make_file(void) {
+    char cmd[CMD_LEN];
+    if ((cursor[0] != '\0') && logs_is_valid_cursor(cursor)) {
+        snprintf(cmd, sizeof(cmd), JOURNAL_CMD " --show-cursor --after-cursor='%s'", cursor);
+    } else {
+        snprintf(cmd, sizeof(cmd), JOURNAL_CMD " --show-cursor --boot");
+    }
+
+    char tmp_name[FILE_NAME_LEN];
+    char tmp_path[PATH_MAX];
+    char path[PATH_MAX];
+    snprintf(tmp_name, sizeof(tmp_name), ".logs_%u.txt.gz", get_unix_time_s());
+    char *file_name = &tmp_name[1];
+    if ((path_join(cache->dir_path, tmp_name, tmp_path, sizeof(tmp_path)) < 0) ||
+        (path_join(cache->dir_path, file_name, path, sizeof(path)) < 0)) {
+        log_error("logs export path too long");
+        return;
+    }
+
+    FILE *pipe = popen(cmd, "r");
+    if (pipe == NULL) {
+        log_error("failed to run journalctl: %d", errno);
+        return;
+    }
+    gzFile gz = gzopen(tmp_path, GZIP_LEVEL);
+    if (gz == NULL) {
+        log_error("failed to open %s", tmp_path);
+        pclose(pipe);
+        return;
+    }
+
+    char line[LINE_LEN];
+    char new_cursor[CURSOR_MAX_LEN] = {0};
+    uint32_t lines = 0;
+    bool write_error = false;
+    bool line_start = true; // fgets splits lines longer than LINE_LEN
+    while (fgets(line, sizeof(line), pipe) != NULL) {
+        size_t len = strlen(line);
+        if (line_start && (strncmp(line, CURSOR_PREFIX, strlen(CURSOR_PREFIX)) == 0)) {
+            const char *value = &line[strlen(CURSOR_PREFIX)];
+            size_t value_len = strcspn(value, "\n");
+            if (value_len < sizeof(new_cursor)) { // a truncated cursor would be worse than none
+                memcpy(new_cursor, value, value_len);
+                new_cursor[value_len] = '\0';
+            }
+        } else if (!line_start || (line[0] != '-')) { // skip "-- No entries --" and other markers
+            if (gzwrite(gz, line, len) != (int)len) {
+                write_error = true;
+            }
+            lines += line_start;
+        }
+        line_start = (len > 0) && (line[len - 1] == '\n');
+    }
+    int r = pclose(pipe);
+    if (gzclose(gz) != Z_OK) {
+        write_error = true;
+    }
+
+    if ((r != 0) || write_error) {
+        log_error("failed to export logs");
+        remove(tmp_path);
+    } else if (lines == 0) {
+        log_info("no new log entries to export");
+        remove(tmp_path);
+    } else if ((rename(tmp_path, path) < 0) || (fcache_add(cache, path, true) < 0)) {
+        log_error("failed to add %s to the fread cache", file_name);
+        remove(tmp_path);
+        remove(path);
+    } else {
+        log_info("exported %u log entries to %s", lines, file_name);
+        if (new_cursor[0] != '\0') {
+            memcpy(cursor, new_cursor, sizeof(cursor));
+            save_cursor();
+        }
+    }
+}
+
+size_t logs_tail_append(char *buf, size_t len, size_t max_len, const char *data, size_t n, bool *dropped) {
+    if (n >= max_len) {
+        *dropped |= (len > 0) || (n > max_len);
+        memcpy(buf, &data[n - max_len], max_len);
+        return max_len;
+    }
+    if ((len + n) > max_len) {
+        size_t drop = len + n - max_len;
+        memmove(buf, &buf[drop], len - drop);
+        len -= drop;
+        *dropped = true;
+    }
+    memcpy(&buf[len], data, n);
+    return len + n;
+}
+
+size_t logs_tail_trim(char *buf, size_t len, bool dropped) {
+    size_t start = 0;
+    if (dropped) {
+        char *newline = memchr(buf, '\n', len);
+        start = newline ? (size_t)(newline - buf) + 1 : 0;
+    }
+    memmove(buf, &buf[start], len - start);
+    return len - start;
+}
+
+// runs on the logs thread, journalctl can take seconds and must not hold up the sdo server
+static void load_since_boot(void) {
+    static char lines[SINCE_BOOT_MAX_LEN + 1];
+    FILE *pipe = popen(SINCE_BOOT_CMD, "r");
+    if (pipe == NULL) {
+        log_error("failed to run journalctl: %d", errno);
+        return;
+    }
+
+    size_t len = 0;
+    bool dropped = false;
+    char chunk[LINE_LEN];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), pipe)) > 0) {
+        len = logs_tail_append(lines, len, SINCE_BOOT_MAX_LEN, chunk, n, &dropped);
+    }
+    pclose(pipe);
+    len = logs_tail_trim(lines, len, dropped);
+
+    pthread_mutex_lock(&since_boot_mutex);
+    since_boot_len = len;
+    memcpy(since_boot, lines, since_boot_len);
+    since_boot[since_boot_len] = '\0';
+    since_boot_loaded = true;
+    since_boot_ms = get_uptime_ms();
+    pthread_mutex_unlock(&since_boot_mutex);
+}
+
+static void *logs_thread(void *arg) {
+    (void)arg;
+    while (running) {
+        sleep_ms(250);
+        if (__atomic_exchange_n(&since_boot_requested, false, __ATOMIC_ACQ_REL)) {
+            load_since_boot();
+        }
+        if (__atomic_exchange_n(&make_file_requested, false, __ATOMIC_ACQ_REL)) {
+            make_file();
+        }
+    }
+    return NULL;
+}
+
+/*
+ * At the start of a transfer. The last lines loaded are read even when old, so a slow link always gets something, and
+ * the logs thread loads newer ones for the next read. ODR_NO_DATA only until the first load is done.
+ */
+static ODR_t start_since_boot_read(void) {
+    ODR_t r = ODR_OK;
+    pthread_mutex_lock(&since_boot_mutex);
+    if (!since_boot_loaded || ((get_uptime_ms() - since_boot_ms) > SINCE_BOOT_MAX_AGE_MS)) {
+        __atomic_store_n(&since_boot_requested, true, __ATOMIC_RELEASE);
+    }
+    if (!since_boot_loaded) {
+        r = ODR_NO_DATA;
+    } else {
+        since_boot_xfer_len = since_boot_len;
+        memcpy(since_boot_xfer, since_boot, since_boot_len + 1);
+    }
+    pthread_mutex_unlock(&since_boot_mutex);
+    return r;
+}
+
+static ODR_t logs_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
+    ODR_t r = ODR_OK;
+    switch (stream->subIndex) {
+    case 0:
+        r = OD_readOriginal(stream, buf, count, countRead);
+        break;
+    case OD_SUBINDEX_LOGS_MAKE_FILE:
+        r = ODR_WRITEONLY;
+        break;
+    case OD_SUBINDEX_LOGS_SINCE_BOOT:
+        if (stream->dataOffset == 0) { // only take the lines once per transfer, not per segment
+            r = start_since_boot_read();
+        }
+        if (r == ODR_OK) {
+            r = od_ext_read_data(stream, buf, count, countRead, since_boot_xfer, since_boot_xfer_len + 1);
+        }
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
+
+static ODR_t logs_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
+    ODR_t r = ODR_OK;
+    bool value = false;
+    switch (stream->subIndex) {
+    case OD_SUBINDEX_LOGS_MAKE_FILE:
+        r = OD_writeOriginal(stream, buf, count, countWritten);
+        memcpy(&value, buf, sizeof(value));
+        if ((r == ODR_OK) && value) {
+            __atomic_store_n(&make_file_requested, true, __ATOMIC_RELEASE);
+        }
+        break;
+    case 0:
+    case OD_SUBINDEX_LOGS_SINCE_BOOT:
+        r = ODR_READONLY;
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
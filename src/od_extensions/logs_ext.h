@@ -0,0 +1,23 @@
+#ifndef _LOGS_EXT_H_
+#define _LOGS_EXT_H_
+
+#include "301/CO_ODinterface.h"
+#include "fcache.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * make_file exports the journal entries added since the last export as a gzip file in the fread cache. The journal
+ * cursor of the last exported entry is kept in cursor_path, so exports continue where they left off across restarts.
+ */
+void logs_extension_init(OD_t *od, fcache_t *fread_cache, const char *cursor_path);
+void logs_extension_free(void);
+
+// the cursor goes into a shell command, journald cursors are only "key=hex" pairs split by ';'
+bool logs_is_valid_cursor(const char *cursor);
+// appends n bytes of data to the len in buf, keeping only the last max_len bytes; dropped is set if any were dropped
+size_t logs_tail_append(char *buf, size_t len, size_t max_len, const char *data, size_t n, bool *dropped);
+// drops the partial first line left by logs_tail_append(), returns the new len
+size_t logs_tail_trim(char *buf, size_t len, bool dropped);
+
+#endif
@@ -0,0 +1,87 @@
+#include "od_seqlock.h"
+#include "301/CO_ODinterface.h"
+#include "logger.h"
+#include "od_snapshot.h"
+#include "seqlock.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static OD_t *locks_od = NULL;
+static seqlock_t *locks = NULL; // one per entry of locks_od->list, only the ones from OD_SEQLOCK_INDEX_MIN are used
+
+int od_seqlock_init(OD_t *od) {
+    if (!od) {
+        return -EINVAL;
+    }
+    locks = calloc(od->size, sizeof(seqlock_t));
+    if (!locks) {
+        return -ENOMEM;
+    }
+    locks_od = od;
+    return 0;
+}
+
+void od_seqlock_free(void) {
+    seqlock_t *old = locks;
+    locks = NULL; // extension reads and writes fall back to the originals
+    locks_od = NULL;
+    free(old);
+}
+
+seqlock_t *od_seqlock_get(const OD_entry_t *entry) {
+    if (!locks || !entry || (entry->index < OD_SEQLOCK_INDEX_MIN) || (entry < locks_od->list) ||
+        (entry >= &locks_od->list[locks_od->size])) {
+        return NULL;
+    }
+    return &locks[entry - locks_od->list];
+}
+
+static seqlock_t *stream_lock(const OD_stream_t *stream) {
+    return locks ? od_seqlock_get(OD_find(locks_od, stream->index)) : NULL;
+}
+
+ODR_t od_seqlock_read_original(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
+    seqlock_t *lock = stream ? stream_lock(stream) : NULL;
+    if (!lock) {
+        return OD_readOriginal(stream, buf, count, countRead);
+    }
+    OD_size_t offset = stream->dataOffset;
+    ODR_t r;
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(lock);
+        stream->dataOffset = offset; // a retried segment starts over
+        r = OD_readOriginal(stream, buf, count, countRead);
+    } while (seqlock_read_retry(lock, seq));
+    return r;
+}
+
+ODR_t od_seqlock_write_original(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
+    seqlock_t *lock = stream ? stream_lock(stream) : NULL;
+    if (!lock) {
+        return OD_writeOriginal(stream, buf, count, countWritten);
+    }
+    seqlock_write_begin(lock);
+    ODR_t r = OD_writeOriginal(stream, buf, count, countWritten);
+    if (r == ODR_OK) { // the last segment, between segments the od holds part old and part new data
+        od_snapshot_update(stream->index, stream->subIndex);
+    }
+    seqlock_write_end(lock);
+    return r;
+}
+
+ODR_t od_seqlock_set_value(const OD_entry_t *entry, uint8_t subindex, const void *value, OD_size_t len, bool odOrig) {
+    seqlock_t *lock = od_seqlock_get(entry);
+    if (!lock || !odOrig) { // through the extension, which takes the seqlock itself
+        return OD_set_value(entry, subindex, (void *)value, len, odOrig);
+    }
+    seqlock_write_begin(lock);
+    ODR_t r = OD_set_value(entry, subindex, (void *)value, len, true);
+    if (r == ODR_OK) {
+        od_snapshot_update(entry->index, subindex);
+    }
+    seqlock_write_end(lock);
+    return r;
+}
@@ -0,0 +1,31 @@
+#ifndef _OD_SEQLOCK_H_
+#define _OD_SEQLOCK_H_
+
+#include "301/CO_ODinterface.h"
+#include "seqlock.h"
+#include <stdbool.h>
+
+/*
+ * A seqlock per OD entry (one for all subindexes of a record or array) for the app entries, which ipc threads write
+ * while the CANopen threads read them for TPDOs and SDO uploads. The entries' extension reads and writes go through
+ * od_seqlock_read_original() and od_seqlock_write_original(), so those don't need the global CO_LOCK_OD against ipc
+ * writers and ipc writers don't wait on the RT thread. Each read segment is consistent, a value read in more than one
+ * segment can still change between them. Writes under a seqlock also copy the value into the od snapshot.
+ */
+
+#define OD_SEQLOCK_INDEX_MIN 0x4000 // the app entries, all with the ipc broadcast extension
+
+int od_seqlock_init(OD_t *od);
+void od_seqlock_free(void);
+
+// NULL for entries below OD_SEQLOCK_INDEX_MIN, they still need CO_LOCK_OD
+seqlock_t *od_seqlock_get(const OD_entry_t *entry);
+
+// OD_readOriginal() and OD_writeOriginal() under the entry's seqlock, for extensions
+ODR_t od_seqlock_read_original(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
+ODR_t od_seqlock_write_original(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
+
+// OD_set_value() for an entry with a seqlock, from any thread
+ODR_t od_seqlock_set_value(const OD_entry_t *entry, uint8_t subindex, const void *value, OD_size_t len, bool odOrig);
+
+#endif
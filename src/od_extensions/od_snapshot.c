@@ -0,0 +1,175 @@
+#include "od_snapshot.h"
+#include "301/CO_ODinterface.h"
+#include "logger.h"
+#include "od_seqlock.h"
+#include "od_shm.h"
+#include "system.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ALIGN_8(x) (((x) + 7U) & ~7U)
+
+typedef struct {
+    uint32_t key; // index << 8 | subindex, same order as the segment's table
+    const void *data;
+    uint32_t len;
+} slot_t;
+
+static slot_t *slots = NULL;
+static uint32_t slots_len = 0;
+static od_shm_header_t *header = NULL;
+static od_shm_entry_t *entries = NULL;
+static uint8_t *data_area = NULL;
+static size_t shm_len = 0;
+static char shm_name[64];
+
+// first call with table NULL to count entries and data bytes
+static uint32_t slots_fill(OD_t *od, slot_t *table, uint32_t *data_len) {
+    uint32_t n = 0;
+    uint32_t offset = 0;
+    OD_IO_t io;
+    for (int i = 0; i < od->size; i++) {
+        OD_entry_t *entry = &od->list[i];
+        if (entry->index < OD_SEQLOCK_INDEX_MIN) {
+            continue;
+        }
+        for (int sub = 0; sub <= UINT8_MAX; sub++) { // list is sorted by index, so keys are sorted too
+            if ((OD_getSub(entry, sub, &io, true) != ODR_OK) || (io.stream.dataOrig == NULL) ||
+                (io.stream.dataLength == 0)) {
+                continue;
+            }
+            if (table) {
+                table[n].key = (entry->index << 8) | sub;
+                table[n].data = io.stream.dataOrig;
+                table[n].len = io.stream.dataLength;
+            }
+            offset += ALIGN_8(io.stream.dataLength);
+            n++;
+        }
+    }
+    *data_len = offset;
+    return n;
+}
+
+static int slot_find(uint16_t index, uint8_t subindex) {
+    uint32_t key = (index << 8) | subindex;
+    int low = 0;
+    int high = (int)slots_len - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        if (slots[mid].key == key) {
+            return mid;
+        } else if (slots[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+int od_snapshot_init(OD_t *od, const char *name) {
+    if (!od) {
+        return -EINVAL;
+    }
+    snprintf(shm_name, sizeof(shm_name), "%s", name ? name : OD_SHM_NAME);
+
+    uint32_t data_len;
+    uint32_t len = slots_fill(od, NULL, &data_len);
+    slots = malloc(((len > 0) ? len : 1) * sizeof(slot_t));
+    if (!slots) {
+        return -ENOMEM;
+    }
+    slots_len = slots_fill(od, slots, &data_len);
+
+    uint32_t data_offset = ALIGN_8(sizeof(od_shm_header_t) + (slots_len * sizeof(od_shm_entry_t)));
+    shm_len = data_offset + data_len;
+    shm_unlink(shm_name); // from a run that didn't stop cleanly, its readers see it go stale
+    int fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644); // apps read it without being root
+    if (fd < 0) {
+        int r = -errno;
+        od_snapshot_free();
+        return r;
+    }
+    void *base = MAP_FAILED;
+    if (ftruncate(fd, shm_len) == 0) {
+        base = mmap(NULL, shm_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int r = (base == MAP_FAILED) ? -errno : 0;
+    close(fd);
+    if (r < 0) {
+        shm_unlink(shm_name);
+        od_snapshot_free();
+        return r;
+    }
+
+    header = base;
+    entries = (od_shm_entry_t *)&header[1];
+    data_area = (uint8_t *)base + data_offset;
+    uint32_t crc = 0;
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < slots_len; i++) {
+        entries[i] = (od_shm_entry_t){
+            .index = slots[i].key >> 8,
+            .subindex = slots[i].key & 0xFF,
+            .offset = offset,
+            .len = slots[i].len,
+        };
+        memcpy(&data_area[offset], slots[i].data, slots[i].len); // ipc isn't up yet, nothing else writes them
+        offset += ALIGN_8(slots[i].len);
+        uint8_t raw[7] = {entries[i].index & 0xFF, entries[i].index >> 8, entries[i].subindex};
+        memcpy(&raw[3], &entries[i].len, sizeof(uint32_t));
+        crc = crc32_update(crc, raw, sizeof(raw));
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header->version = OD_SHM_VERSION;
+    header->entry_size = sizeof(od_shm_entry_t);
+    header->entries_len = slots_len;
+    header->data_offset = data_offset;
+    header->data_len = data_len;
+    header->table_crc = crc;
+    header->start_ns = ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+    __atomic_store_n(&header->magic, OD_SHM_MAGIC, __ATOMIC_RELEASE); // last, readers check it before anything else
+    log_info("od snapshot %s has %u entries in %zu bytes", shm_name, slots_len, shm_len);
+    return 0;
+}
+
+void od_snapshot_free(void) {
+    if (header) {
+        __atomic_store_n(&header->magic, 0, __ATOMIC_RELEASE);
+        munmap(header, shm_len);
+        shm_unlink(shm_name);
+        header = NULL;
+        entries = NULL;
+        data_area = NULL;
+        shm_len = 0;
+    }
+    free(slots);
+    slots = NULL;
+    slots_len = 0;
+}
+
+void od_snapshot_update(uint16_t index, uint8_t subindex) {
+    if (!header) {
+        return;
+    }
+    int i = slot_find(index, subindex);
+    if (i < 0) {
+        return;
+    }
+    od_shm_entry_t *entry = &entries[i];
+    uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED); // the only writer of it
+    __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&data_area[entry->offset], slots[i].data, slots[i].len);
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,20 @@
+#ifndef _OD_SNAPSHOT_H_
+#define _OD_SNAPSHOT_H_
+
+#include "301/CO_ODinterface.h"
+#include <stdint.h>
+
+/*
+ * Publishes the app entries in the od shm segment (see od_shm.h) for local processes to read. Values are copied in by
+ * od_seqlock as they are written, while it holds the entry's seqlock, so there is only ever one writer per value.
+ */
+
+// name NULL is OD_SHM_NAME, a segment left by an earlier run is replaced
+int od_snapshot_init(OD_t *od, const char *name);
+// marks the segment stale for readers that still have it mapped and removes it
+void od_snapshot_free(void);
+
+// copies the current value in, only with the entry's seqlock held
+void od_snapshot_update(uint16_t index, uint8_t subindex);
+
+#endif
@@ -1,28 +1,70 @@
 #include "os_command_ext.h"
 #include "301/CO_ODinterface.h"
 #include "OD.h"
+#include "fcache.h"
 #include "logger.h"
 #include "od_ext.h"
+#include "subprocess.h"
 #include "system.h"
+#include <dirent.h>
+#include <errno.h>
+#include <linux/limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/param.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #define COMMAND_BUFFER_LEN 4096
 #define REPLY_BUFFER_LEN   10024
+#define LOG_COMMAND_LEN    46
+#define QUEUE_LEN          8
+#define COMMAND_TIMEOUT_MS (10 * 60 * 1000) // so a hung command can't block the queue forever
+#define FILE_NAME_LEN      48
+#define FILE_MAX_BYTES     (64U * 1024 * 1024) // of output, e.g. for a command that never stops printing
+#define GZIP_LEVEL         "wb6"
+#define TMP_FILE_PREFIX    ".os_command_"
 
-static bool running;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static bool running = false;
 static pthread_t thread_id;
+static int cancel_fd = -1;
+static fcache_t *cache = NULL;
+static uint8_t mode = OS_COMMAND_OUTPUT_MODE_REPLY;
 static uint8_t status = OS_COMMAND_STATUS_ERROR_NO_REPLY;
-static char command[COMMAND_BUFFER_LEN] = {0};
-static char reply[REPLY_BUFFER_LEN] = {0};
+static char command[COMMAND_BUFFER_LEN] = {0}; // last written to the OD, only used by the CANopen thread
+static char reply[REPLY_BUFFER_LEN] = {0};     // of the last finished command
+static size_t reply_len = 0;
+static char file_name[FILE_NAME_LEN] = {0}; // in the fread cache, of the last command with its output there
+static uint32_t output_size = 0;            // of the last finished command, all of it wherever it went
+static char *queue[QUEUE_LEN];
+static uint8_t queue_head = 0;
+static uint8_t queue_len = 0;
+
+// output of the running command, only used by the thread
+typedef struct {
+    uint8_t mode;
+    char buffer[REPLY_BUFFER_LEN];
+    size_t len;
+    uint64_t size;
+    bool truncated;
+    gzFile gz;
+    bool write_error;
+    uint32_t start_s;
+    char tmp_path[PATH_MAX];
+} output_t;
+
+static output_t output;
 
 static ODR_t os_command_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
 static ODR_t os_command_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
+static ODR_t output_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
+static ODR_t output_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
 static void *os_command_thread(void *arg);
 
 static OD_extension_t ext = {
@@ -31,55 +73,253 @@ static OD_extension_t ext = {
     .write = os_command_write,
 };
 
-void os_command_extension_init(OD_t *od) {
+static OD_extension_t output_ext = {
+    .object = NULL,
+    .read = output_read,
+    .write = output_write,
+};
+
+// a command still running when the daemon stopped leaves its hidden output file behind
+static void remove_tmp_files(void) {
+    DIR *d = (cache != NULL) ? opendir(cache->dir_path) : NULL;
+    if (d == NULL) {
+        return;
+    }
+    char path[PATH_MAX];
+    struct dirent *dir;
+    while ((dir = readdir(d)) != NULL) {
+        if ((strncmp(dir->d_name, TMP_FILE_PREFIX, strlen(TMP_FILE_PREFIX)) == 0) &&
+            (path_join(cache->dir_path, dir->d_name, path, sizeof(path)) == 0) && (remove(path) == 0)) {
+            log_info("removed unfinished os command output %s", dir->d_name);
+        }
+    }
+    closedir(d);
+}
+
+void os_command_extension_init(OD_t *od, fcache_t *fread_cache) {
     OD_entry_t *entry = OD_find(od, OD_INDEX_OS_COMMAND);
+    if (entry == NULL) {
+        log_critical("could not find os command enty 0x(%X)", OD_INDEX_OS_COMMAND);
+        return;
+    }
+    cancel_fd = eventfd(0, EFD_CLOEXEC);
+    if (cancel_fd < 0) {
+        log_critical("failed to create os command cancel fd: %d", errno);
+        return;
+    }
+    cache = fread_cache;
+    remove_tmp_files();
+    OD_extension_init(entry, &ext);
+    entry = OD_find(od, OD_INDEX_OS_COMMAND_OUTPUT);
     if (entry != NULL) {
-        OD_extension_init(entry, &ext);
-        pthread_create(&thread_id, NULL, os_command_thread, NULL);
+        OD_extension_init(entry, &output_ext);
     } else {
-        log_critical("could not find os command enty 0x(%X)", OD_INDEX_OS_COMMAND);
+        log_error("could not find os command output enty 0x(%X)", OD_INDEX_OS_COMMAND_OUTPUT);
+    }
+    running = true;
+    int r = pthread_create(&thread_id, NULL, os_command_thread, NULL);
+    if (r != 0) {
+        running = false;
+        log_critical("failed to start os command thread: %d", r);
     }
 }
 
 void os_command_extension_free(void) {
+    if (!running) {
+        return;
+    }
+    pthread_mutex_lock(&mutex);
     running = false;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    uint64_t one = 1;
+    if (write(cancel_fd, &one, sizeof(one)) < 0) { // kills a running command
+        log_error("os command cancel write failed: %d", errno);
+    }
     pthread_join(thread_id, NULL);
+    for (; queue_len > 0; queue_len--) {
+        free(queue[queue_head]);
+        queue_head = (queue_head + 1) % QUEUE_LEN;
+    }
+    close(cancel_fd);
+    cancel_fd = -1;
+    cache = NULL;
+}
+
+// must hold the mutex
+static int enqueue(const char *cmd, size_t len) {
+    if (!running) {
+        return -ENODEV;
+    } else if (queue_len >= QUEUE_LEN) {
+        return -EBUSY;
+    }
+    char *copy = strndup(cmd, len);
+    if (!copy) {
+        return -ENOMEM;
+    }
+    queue[(queue_head + queue_len) % QUEUE_LEN] = copy;
+    queue_len++;
+    status = OS_COMMAND_STATUS_EXECUTING;
+    pthread_cond_signal(&cond);
+    return 0;
+}
+
+int os_command_run(const char *cmd) {
+    size_t len = strlen(cmd);
+    if ((len == 0) || (len >= COMMAND_BUFFER_LEN)) {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&mutex);
+    int r = enqueue(cmd, len);
+    pthread_mutex_unlock(&mutex);
+    return r;
+}
+
+// the file is written hidden in the cache dir and renamed when the command is done, the cache never lists it partial
+static void open_file(void) {
+    char tmp_name[FILE_NAME_LEN];
+    snprintf(tmp_name, sizeof(tmp_name), TMP_FILE_PREFIX "%u.txt.gz", output.start_s);
+    if ((cache == NULL) || (path_join(cache->dir_path, tmp_name, output.tmp_path, sizeof(output.tmp_path)) < 0)) {
+        output.write_error = true;
+        return;
+    }
+    output.gz = gzopen(output.tmp_path, GZIP_LEVEL);
+    if (output.gz == NULL) {
+        log_error("failed to open %s", output.tmp_path);
+        output.write_error = true;
+        return;
+    }
+    if ((output.len > 0) && (gzwrite(output.gz, output.buffer, output.len) != (int)output.len)) {
+        output.write_error = true;
+    }
+}
+
+static void append_output(void *arg, const char *data, size_t len) {
+    (void)arg;
+    if (output.size + len > FILE_MAX_BYTES) {
+        len = (output.size < FILE_MAX_BYTES) ? FILE_MAX_BYTES - output.size : 0;
+        output.truncated = true;
+    }
+    output.size += len;
+
+    if (output.mode == OS_COMMAND_OUTPUT_MODE_REPLY) {
+        size_t space = sizeof(output.buffer) - 1 - output.len;
+        if (len > space) {
+            len = space;
+            output.truncated = true;
+        }
+    } else if ((output.gz == NULL) && !output.write_error &&
+               ((output.mode == OS_COMMAND_OUTPUT_MODE_FILE) || (output.len + len >= sizeof(output.buffer)))) {
+        open_file(); // auto mode switches to a file once the output outgrows the reply
+    }
+
+    if (output.gz != NULL) {
+        if ((len > 0) && (gzwrite(output.gz, data, len) != (int)len)) {
+            output.write_error = true;
+        }
+    } else if (output.len + len < sizeof(output.buffer)) {
+        memcpy(&output.buffer[output.len], data, len);
+        output.len += len;
+    }
 }
 
+// returns true if the output was added to the cache, the reply is then where it went
+static bool close_file(void) {
+    if (output.gz == NULL) {
+        return false;
+    }
+    if (gzclose(output.gz) != Z_OK) {
+        output.write_error = true;
+    }
+    output.gz = NULL;
+
+    char name[FILE_NAME_LEN];
+    char path[PATH_MAX] = "";
+    snprintf(name, sizeof(name), "os_command_%u.txt.gz", output.start_s);
+    for (uint8_t n = 1; fcache_file_exist(cache, name) && (n < UINT8_MAX); n++) {
+        snprintf(name, sizeof(name), "os_command_%u_%u.txt.gz", output.start_s, n); // more than one in a second
+    }
+    bool renamed = !output.write_error && (path_join(cache->dir_path, name, path, sizeof(path)) == 0) &&
+                   (rename(output.tmp_path, path) == 0);
+    if (!renamed || (fcache_add(cache, path, true) < 0)) {
+        log_error("failed to add os command output to the fread cache");
+        remove(renamed ? path : output.tmp_path);
+        output.len = snprintf(output.buffer, sizeof(output.buffer), "failed to write output file");
+        return false;
+    }
+    pthread_mutex_lock(&mutex);
+    strcpy(file_name, name);
+    pthread_mutex_unlock(&mutex);
+    output.len = snprintf(output.buffer, sizeof(output.buffer), "%s %llu bytes%s", name,
+                          (unsigned long long)output.size, output.truncated ? " truncated" : "");
+    return true;
+}
+
+static uint8_t run_command(const char *cmd) {
+    char message[LOG_COMMAND_LEN + 4];
+    snprintf(message, sizeof(message), "%.*s%s", LOG_COMMAND_LEN, cmd, (strlen(cmd) > LOG_COMMAND_LEN) ? "..." : "");
+    log_info("running os command: %s", message);
+
+    output.mode = __atomic_load_n(&mode, __ATOMIC_RELAXED);
+    output.len = 0;
+    output.size = 0;
+    output.truncated = false;
+    output.write_error = false;
+    output.start_s = get_unix_time_s();
+    subprocess_t proc;
+    int r = subprocess_spawn(&proc, cmd);
+    if (r >= 0) {
+        r = subprocess_wait(&proc, append_output, NULL, COMMAND_TIMEOUT_MS, cancel_fd);
+    }
+    if (output.mode == OS_COMMAND_OUTPUT_MODE_FILE) {
+        if ((output.gz == NULL) && !output.write_error) {
+            open_file(); // an empty file so it is always there to fetch
+        }
+        close_file();
+    } else if (!close_file() && (r < 0) && (output.len == 0)) {
+        const char *error = (r == -ETIMEDOUT) ? "timed out" : (r == -ECANCELED) ? "canceled" : strerror(-r);
+        output.len = snprintf(output.buffer, sizeof(output.buffer), "%s: %s", message, error);
+    }
+    if (output.truncated) {
+        log_warning("os command output truncated after %llu bytes", (unsigned long long)output.size);
+    }
+    output.buffer[output.len] = '\0';
+
+    if (r == 0) {
+        return (output.len > 0) ? OS_COMMAND_STATUS_NO_ERROR_REPLY : OS_COMMAND_STATUS_NO_ERROR_NO_REPLY;
+    }
+    log_info("os command failed: %d", r);
+    return (output.len > 0) ? OS_COMMAND_STATUS_ERROR_REPLY : OS_COMMAND_STATUS_ERROR_NO_REPLY;
+}
+
+// woken right away by a queued command, commands run one at a time in the order they were written
 static void *os_command_thread(void *arg) {
     (void)arg;
-    running = true;
-    unsigned int log_size = 50;
-    char message[log_size];
-    message[log_size - 4] = '.';
-    message[log_size - 3] = '.';
-    message[log_size - 2] = '.';
-    message[log_size - 1] = '\0';
-
-    while (running) {
-        sleep_ms(250);
-        if (status != OS_COMMAND_STATUS_EXECUTING) {
-            continue; // nothing to-do
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        while (running && (queue_len == 0)) {
+            pthread_cond_wait(&cond, &mutex);
+        }
+        if (!running) {
+            break;
         }
+        char *cmd = queue[queue_head];
+        queue_head = (queue_head + 1) % QUEUE_LEN;
+        queue_len--;
+        pthread_mutex_unlock(&mutex);
 
-        if (strlen(command) == 0) {
-            status = OS_COMMAND_STATUS_ERROR_NO_REPLY;
-        } else {
-            strncpy(message, command, MIN(strlen(command) + 1, log_size - 4));
-            log_info("running os command: %s", message);
-            int reply_len = run_bash_command(command, reply, REPLY_BUFFER_LEN);
-            if (reply_len < 0) {
-                reply[0] = '\0';
-                status = OS_COMMAND_STATUS_ERROR_NO_REPLY;
-            } else if (reply_len == 0) {
-                reply[0] = '\0';
-                status = OS_COMMAND_STATUS_NO_ERROR_NO_REPLY;
-            } else {
-                status = OS_COMMAND_STATUS_NO_ERROR_REPLY;
-                reply[reply_len - 1] = '\0';
-            }
+        uint8_t result = run_command(cmd);
+        free(cmd);
+
+        pthread_mutex_lock(&mutex);
+        memcpy(reply, output.buffer, output.len + 1);
+        reply_len = output.len;
+        output_size = (output.size > UINT32_MAX) ? UINT32_MAX : (uint32_t)output.size;
+        if (queue_len == 0) {
+            status = result;
         }
     }
+    pthread_mutex_unlock(&mutex);
     return NULL;
 }
 
@@ -90,31 +330,100 @@ static ODR_t os_command_read(OD_stream_t *stream, void *buf, OD_size_t count, OD
     } else if (stream->subIndex == OD_SUBINDEX_OS_COMMAND_COMMAND) {
         r = od_ext_read_data(stream, buf, count, countRead, command, strlen(command) + 1);
     } else if (stream->subIndex == OD_SUBINDEX_OS_COMMAND_STATUS) {
+        pthread_mutex_lock(&mutex);
         memcpy(buf, &status, 1);
+        pthread_mutex_unlock(&mutex);
         *countRead = 1;
     } else if (stream->subIndex == OD_SUBINDEX_OS_COMMAND_REPLY) {
-        if (reply[0] == '\0') {
+        pthread_mutex_lock(&mutex);
+        if (reply_len == 0) {
             r = ODR_NO_DATA;
         } else {
-            r = od_ext_read_data(stream, buf, count, countRead, reply, strlen(reply) + 1);
+            r = od_ext_read_data(stream, buf, count, countRead, reply, reply_len + 1);
         }
+        pthread_mutex_unlock(&mutex);
     }
     return r;
 }
 
 static ODR_t os_command_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
+    if (stream->subIndex != OD_SUBINDEX_OS_COMMAND_COMMAND) {
+        return ODR_READONLY;
+    }
+    pthread_mutex_lock(&mutex);
+    bool full = queue_len >= QUEUE_LEN;
+    pthread_mutex_unlock(&mutex);
+    if ((stream->dataOffset == 0) && full) {
+        return ODR_DATA_LOC_CTRL; // queued behind the running command otherwise
+    }
+
+    size_t command_len = 0;
+    ODR_t r = od_ext_write_data(stream, buf, count, countWritten, command, COMMAND_BUFFER_LEN - 1, &command_len);
+    if ((r == ODR_OK) && (stream->dataOffset == 0)) {
+        command[command_len] = '\0';
+        command_len = strlen(command);
+        pthread_mutex_lock(&mutex);
+        if (command_len == 0) {
+            if (queue_len == 0) {
+                status = OS_COMMAND_STATUS_ERROR_NO_REPLY;
+            }
+        } else if (enqueue(command, command_len) < 0) {
+            r = ODR_DATA_LOC_CTRL;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+    return r;
+}
+
+static ODR_t output_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
+    ODR_t r = ODR_OK;
+    switch (stream->subIndex) {
+    case 0:
+        r = OD_readOriginal(stream, buf, count, countRead);
+        break;
+    case OD_SUBINDEX_OS_COMMAND_OUTPUT_MODE: {
+        uint8_t value = __atomic_load_n(&mode, __ATOMIC_RELAXED);
+        memcpy(buf, &value, sizeof(value));
+        *countRead = sizeof(value);
+        break;
+    }
+    case OD_SUBINDEX_OS_COMMAND_OUTPUT_FILE_NAME: {
+        char name[FILE_NAME_LEN];
+        pthread_mutex_lock(&mutex);
+        memcpy(name, file_name, sizeof(name));
+        pthread_mutex_unlock(&mutex);
+        r = (name[0] == '\0') ? ODR_NO_DATA : od_ext_read_data(stream, buf, count, countRead, name, strlen(name) + 1);
+        break;
+    }
+    case OD_SUBINDEX_OS_COMMAND_OUTPUT_SIZE:
+        pthread_mutex_lock(&mutex);
+        memcpy(buf, &output_size, sizeof(output_size));
+        pthread_mutex_unlock(&mutex);
+        *countRead = sizeof(output_size);
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
+
+static ODR_t output_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
     ODR_t r = ODR_READONLY;
-    if (stream->subIndex == OD_SUBINDEX_OS_COMMAND_COMMAND) {
-        if (status == OS_COMMAND_STATUS_EXECUTING) {
-            return ODR_DATA_LOC_CTRL;
+    if (stream->subIndex == OD_SUBINDEX_OS_COMMAND_OUTPUT_MODE) {
+        uint8_t value;
+        if (count != sizeof(value)) {
+            return ODR_TYPE_MISMATCH;
         }
-        size_t command_len = 0;
-        r = od_ext_write_data(stream, buf, count, countWritten, command, COMMAND_BUFFER_LEN - 1, &command_len);
-        if (r == ODR_OK) {
-            command[command_len] = '\0';
-            command_len++;
-            status = OS_COMMAND_STATUS_EXECUTING;
+        memcpy(&value, buf, sizeof(value));
+        if (value > OS_COMMAND_OUTPUT_MODE_AUTO) {
+            return ODR_INVALID_VALUE;
         }
+        __atomic_store_n(&mode, value, __ATOMIC_RELAXED); // from the next command run
+        *countWritten = sizeof(value);
+        r = ODR_OK;
+    } else if (stream->subIndex > OD_SUBINDEX_OS_COMMAND_OUTPUT_SIZE) {
+        r = ODR_SUB_NOT_EXIST;
     }
     return r;
 }
@@ -2,8 +2,16 @@
 #define _OS_COMMAND_EXT_H_
 
 #include "301/CO_ODinterface.h"
+#include "fcache.h"
 
-void os_command_extension_init(OD_t *od);
+/*
+ * Commands are queued and run one at a time as they are written, without a shell unless they use shell syntax. Their
+ * output goes in the reply subindex, or by the os command output mode is streamed into a file in fread_cache while
+ * they run.
+ */
+void os_command_extension_init(OD_t *od, fcache_t *fread_cache);
 void os_command_extension_free(void);
+// same as a write to the command subindex, returns -EBUSY when the queue of commands to run is full
+int os_command_run(const char *cmd);
 
 #endif
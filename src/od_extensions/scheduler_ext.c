@@ -0,0 +1,101 @@
+#include "scheduler_ext.h"
+#include "301/CO_ODinterface.h"
+#include "OD.h"
+#include "logger.h"
+#include "od_ext.h"
+#include "scheduler.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ADD_BUFFER_LEN (SCHED_PACKED_HEADER_LEN + SCHEDULER_DATA_MAX_LEN)
+
+static uint8_t add_buffer[ADD_BUFFER_LEN]; // only written from the CANopen thread
+
+static ODR_t scheduler_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
+static ODR_t scheduler_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
+
+static OD_extension_t ext = {
+    .object = NULL,
+    .read = scheduler_read,
+    .write = scheduler_write,
+};
+
+void scheduler_extension_init(OD_t *od) {
+    OD_entry_t *entry = OD_find(od, OD_INDEX_SCHEDULER);
+    if (entry == NULL) {
+        log_critical("could not find scheduler enty 0x(%X)", OD_INDEX_SCHEDULER);
+        return;
+    }
+    OD_extension_init(entry, &ext);
+}
+
+static ODR_t scheduler_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
+    ODR_t r = ODR_OK;
+    scheduler_stats_t stats;
+    scheduler_stats(&stats);
+    switch (stream->subIndex) {
+    case 0:
+        r = OD_readOriginal(stream, buf, count, countRead);
+        break;
+    case OD_SUBINDEX_SCHEDULER_PENDING:
+        memcpy(buf, &stats.pending, sizeof(stats.pending));
+        *countRead = sizeof(stats.pending);
+        break;
+    case OD_SUBINDEX_SCHEDULER_NEXT:
+        memcpy(buf, &stats.next_scet, sizeof(stats.next_scet));
+        *countRead = sizeof(stats.next_scet);
+        break;
+    case OD_SUBINDEX_SCHEDULER_FIRED:
+        memcpy(buf, &stats.fired, sizeof(stats.fired));
+        *countRead = sizeof(stats.fired);
+        break;
+    case OD_SUBINDEX_SCHEDULER_LATE_MAX:
+        memcpy(buf, &stats.late_max_us, sizeof(stats.late_max_us));
+        *countRead = sizeof(stats.late_max_us);
+        break;
+    case OD_SUBINDEX_SCHEDULER_LATE_LAST:
+        memcpy(buf, &stats.late_last_us, sizeof(stats.late_last_us));
+        *countRead = sizeof(stats.late_last_us);
+        break;
+    case OD_SUBINDEX_SCHEDULER_DROPPED:
+        memcpy(buf, &stats.dropped, sizeof(stats.dropped));
+        *countRead = sizeof(stats.dropped);
+        break;
+    case OD_SUBINDEX_SCHEDULER_ADD:
+    case OD_SUBINDEX_SCHEDULER_CANCEL:
+        r = ODR_WRITEONLY;
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
+
+static ODR_t scheduler_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
+    ODR_t r = ODR_READONLY;
+    if (stream->subIndex == OD_SUBINDEX_SCHEDULER_ADD) {
+        size_t len = 0;
+        r = od_ext_write_data(stream, buf, count, countWritten, add_buffer, ADD_BUFFER_LEN, &len);
+        if ((r == ODR_OK) && (len > 0)) { // the last segment
+            int e = scheduler_add_packed(add_buffer, len);
+            if (e < 0) {
+                log_error("failed to schedule uploaded action: %d", -e);
+                r = (e == -ENOSPC) ? ODR_OUT_OF_MEM : ODR_INVALID_VALUE;
+            }
+        }
+    } else if (stream->subIndex == OD_SUBINDEX_SCHEDULER_CANCEL) {
+        uint32_t id;
+        if (count != sizeof(id)) {
+            return ODR_TYPE_MISMATCH;
+        }
+        memcpy(&id, buf, sizeof(id));
+        log_info("canceled %u scheduled actions with id %u", scheduler_cancel(id), id);
+        *countWritten = sizeof(id);
+        r = ODR_OK;
+    } else if (stream->subIndex > OD_SUBINDEX_SCHEDULER_DROPPED) {
+        r = ODR_SUB_NOT_EXIST;
+    }
+    return r;
+}
@@ -0,0 +1,9 @@
+#ifndef _SCHEDULER_EXT_H_
+#define _SCHEDULER_EXT_H_
+
+#include "301/CO_ODinterface.h"
+
+// ground uploads of scheduled actions, the scheduler itself is started with scheduler_init()
+void scheduler_extension_init(OD_t *od);
+
+#endif
@@ -0,0 +1,119 @@
+#include "stats_ext.h"
+#include "301/CO_ODinterface.h"
+#include "OD.h"
+#include "histogram.h"
+#include "latency.h"
+#include "logger.h"
+#include "od_ext.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+static ODR_t stats_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
+static ODR_t stats_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
+
+static OD_extension_t ext = {
+    .object = NULL,
+    .read = stats_read,
+    .write = stats_write,
+};
+
+static uint8_t selected = LATENCY_RT_CYCLE;
+static histogram_summary_t summary_bin[LATENCY_LEN]; // uint32 fields only, so no padding
+
+void stats_extension_init(OD_t *od) {
+    OD_entry_t *entry = OD_find(od, OD_INDEX_LATENCY_STATS);
+    if (entry != NULL) {
+        OD_extension_init(entry, &ext);
+    } else {
+        log_critical("could not find latency stats entry 0x(%X)", OD_INDEX_LATENCY_STATS);
+    }
+}
+
+static ODR_t read_u32(void *buf, OD_size_t *countRead, uint32_t value) {
+    memcpy(buf, &value, sizeof(value));
+    *countRead = sizeof(value);
+    return ODR_OK;
+}
+
+static ODR_t stats_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
+    ODR_t r = ODR_OK;
+    histogram_summary_t summary;
+    switch (stream->subIndex) {
+    case 0:
+        r = OD_readOriginal(stream, buf, count, countRead);
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_SELECT:
+        memcpy(buf, &selected, sizeof(selected));
+        *countRead = sizeof(selected);
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_NAME: {
+        const char *name = latency_name(selected);
+        r = od_ext_read_data(stream, buf, count, countRead, (void *)name, strlen(name) + 1);
+        break;
+    }
+    case OD_SUBINDEX_LATENCY_STATS_COUNT:
+        histogram_summary(latency_get(selected), &summary);
+        r = read_u32(buf, countRead, summary.count);
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_MEAN:
+        histogram_summary(latency_get(selected), &summary);
+        r = read_u32(buf, countRead, summary.mean);
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_P50:
+        r = read_u32(buf, countRead, histogram_percentile(latency_get(selected), 50.0));
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_P99:
+        r = read_u32(buf, countRead, histogram_percentile(latency_get(selected), 99.0));
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_P999:
+        r = read_u32(buf, countRead, histogram_percentile(latency_get(selected), 99.9));
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_MAX:
+        histogram_summary(latency_get(selected), &summary);
+        r = read_u32(buf, countRead, summary.max);
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_RESET:
+        r = ODR_WRITEONLY;
+        break;
+    case OD_SUBINDEX_LATENCY_STATS_SUMMARY_BIN:
+        // snapshot on the first segment so a multi-segment read is consistent
+        if (stream->dataOffset == 0) {
+            for (uint32_t i = 0; i < LATENCY_LEN; i++) {
+                histogram_summary(latency_get(i), &summary_bin[i]);
+            }
+        }
+        r = od_ext_read_data(stream, buf, count, countRead, summary_bin, sizeof(summary_bin));
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
+
+static ODR_t stats_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
+    ODR_t r = ODR_OK;
+    switch (stream->subIndex) {
+    case OD_SUBINDEX_LATENCY_STATS_SELECT: {
+        uint8_t value = 0;
+        r = od_ext_write_data(stream, buf, count, countWritten, &value, sizeof(value), NULL);
+        if ((r == ODR_OK) && (value >= LATENCY_LEN)) {
+            r = ODR_VALUE_HIGH;
+        } else if (r == ODR_OK) {
+            selected = value;
+        }
+        break;
+    }
+    case OD_SUBINDEX_LATENCY_STATS_RESET:
+        if (*(bool *)buf) {
+            latency_reset(selected);
+        }
+        *countWritten = 1;
+        break;
+    default:
+        r = ODR_READONLY;
+        break;
+    }
+    return r;
+}
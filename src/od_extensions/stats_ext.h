@@ -0,0 +1,8 @@
+#ifndef _STATS_EXT_H_
+#define _STATS_EXT_H_
+
+#include "CO_ODinterface.h"
+
+void stats_extension_init(OD_t *od);
+
+#endif
@@ -2,14 +2,12 @@
 #include "301/CO_ODinterface.h"
 #include "OD.h"
 #include "logger.h"
+#include "metrics.h"
+#include "od_ext.h"
 #include "system.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
-#include <sys/param.h>
-#include <sys/statvfs.h>
-#include <sys/sysinfo.h>
-#include <unistd.h>
 
 static ODR_t system_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
 static ODR_t system_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
@@ -29,8 +27,11 @@ void system_extension_init(OD_t *od) {
     }
 }
 
+// only loads the metrics snapshot, this is read from the CANopen thread for TPDOs
 static ODR_t system_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
     ODR_t r = ODR_OK;
+    metrics_t metrics;
+    metrics_get(&metrics);
     switch (stream->subIndex) {
     case 0: {
         r = OD_readOriginal(stream, buf, count, countRead);
@@ -41,49 +42,57 @@ static ODR_t system_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_siz
         break;
     }
     case OD_SUBINDEX_SYSTEM_STORAGE_PERCENT: {
-        struct statvfs fiData;
-        uint8_t usage = 0;
-        if ((statvfs("/", &fiData)) >= 0) {
-            usage = (uint8_t)(((fiData.f_blocks - fiData.f_bavail) * 100) / fiData.f_blocks);
-        }
-        memcpy(buf, &usage, 1);
-        *countRead = sizeof(usage);
+        memcpy(buf, &metrics.storage_percent, sizeof(metrics.storage_percent));
+        *countRead = sizeof(metrics.storage_percent);
         break;
     }
     case OD_SUBINDEX_SYSTEM_RAM_PERCENT: {
-        struct sysinfo info;
-        uint8_t usage = 0;
-        if ((sysinfo(&info)) >= 0) {
-            usage = (uint8_t)(((info.totalram - info.freeram) * 100) / info.totalram);
-        }
-        memcpy(buf, &usage, 1);
-        *countRead = sizeof(usage);
+        memcpy(buf, &metrics.ram_percent, sizeof(metrics.ram_percent));
+        *countRead = sizeof(metrics.ram_percent);
         break;
     }
     case OD_SUBINDEX_SYSTEM_UNIX_TIME: {
         uint32_t unix_time = get_unix_time_s();
-        memcpy(buf, &unix_time, 1);
+        memcpy(buf, &unix_time, sizeof(unix_time));
         *countRead = sizeof(unix_time);
         break;
     }
     case OD_SUBINDEX_SYSTEM_UPTIME: {
         uint32_t uptime = get_uptime_s();
-        memcpy(buf, &uptime, 1);
+        memcpy(buf, &uptime, sizeof(uptime));
         *countRead = sizeof(uptime);
         break;
     }
     case OD_SUBINDEX_SYSTEM_POWER_CYCLES: {
         uint16_t powercycles = 0;
-        memcpy(buf, &powercycles, 1);
+        memcpy(buf, &powercycles, sizeof(powercycles));
         *countRead = sizeof(powercycles);
         break;
     }
+    case OD_SUBINDEX_SYSTEM_TEMPERATURE: {
+        memcpy(buf, &metrics.temperature, sizeof(metrics.temperature));
+        *countRead = sizeof(metrics.temperature);
+        break;
+    }
+    case OD_SUBINDEX_SYSTEM_CPU_PERCENT: {
+        memcpy(buf, &metrics.cpu_percent, sizeof(metrics.cpu_percent));
+        *countRead = sizeof(metrics.cpu_percent);
+        break;
+    }
     case OD_SUBINDEX_SYSTEM_BOOT_SELECT: {
         uint8_t boot_select = 0;
-        memcpy(buf, &boot_select, 1);
+        memcpy(buf, &boot_select, sizeof(boot_select));
         *countRead = sizeof(boot_select);
         break;
     }
+    case OD_SUBINDEX_SYSTEM_CORE_PERCENTS: {
+        r = od_ext_read_data(stream, buf, count, countRead, metrics.core_percent, metrics.cores);
+        break;
+    }
+    case OD_SUBINDEX_SYSTEM_TEMPERATURES: {
+        r = od_ext_read_data(stream, buf, count, countRead, metrics.zone_temperature, metrics.zones);
+        break;
+    }
     default:
         r = ODR_SUB_NOT_EXIST;
         break;
@@ -101,7 +110,11 @@ static ODR_t system_write(OD_stream_t *stream, const void *buf, OD_size_t count,
     case OD_SUBINDEX_SYSTEM_UNIX_TIME:
     case OD_SUBINDEX_SYSTEM_UPTIME:
     case OD_SUBINDEX_SYSTEM_POWER_CYCLES:
+    case OD_SUBINDEX_SYSTEM_TEMPERATURE:
+    case OD_SUBINDEX_SYSTEM_CPU_PERCENT:
     case OD_SUBINDEX_SYSTEM_BOOT_SELECT:
+    case OD_SUBINDEX_SYSTEM_CORE_PERCENTS:
+    case OD_SUBINDEX_SYSTEM_TEMPERATURES:
         r = ODR_READONLY;
         break;
     case OD_SUBINDEX_SYSTEM_RESET:
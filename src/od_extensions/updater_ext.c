@@ -0,0 +1,457 @@
+#include "updater_ext.h"
+#include "301/CO_ODinterface.h"
+#include "OD.h"
+#include "fcache.h"
+#include "logger.h"
+#include "od_ext.h"
+#include "system.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UPDATE_PREFIX     "update_"
+#define UPDATE_SUFFIX     ".tar.xz"
+#define WORK_DIR          "/tmp/oresat-updater"
+#define INSTRUCTIONS_FILE "instructions.txt"
+#define DPKG_STATUS_CMD   "dpkg-query -W -f='${Package} ${Version} ${db:Status-Abbrev}\\n'"
+#define STREAM_CHUNK_LEN  (64 * 1024)
+#define LINE_LEN          512
+#define CMD_LEN           8192
+#define STEP_ARGS_MAX     16
+
+typedef struct {
+    const char *name;
+    bool file_args;  // args are files in the archive
+    int max_args;    // 0 for up to STEP_ARGS_MAX
+    int (*run)(char **args, int len);
+} step_t;
+
+static int dpkg_install(char **args, int len);
+static int debdelta_install(char **args, int len);
+static int dpkg_remove(char **args, int len);
+static int bash_script(char **args, int len);
+
+static const step_t steps[] = {
+    {"DPKG_INSTALL", true, 0, dpkg_install},
+    {"DEBDELTA", true, 0, debdelta_install},
+    {"DPKG_REMOVE", false, 0, dpkg_remove},
+    {"BASH_SCRIPT", true, 1, bash_script},
+};
+
+static bool running;
+static pthread_t thread_id;
+static fcache_t *updates = NULL;      // the fwrite cache, updates are the files matching update_filter
+static fcache_t *status_cache = NULL; // the fread cache
+static updater_status_cb_t status_changed = NULL;
+static uint8_t status = UPDATER_STATUS_SUCCESSFUL;
+static bool update_requested = false;
+static bool status_file_requested = false;
+static char *files_json = NULL;
+static char cmd[CMD_LEN];
+static const fcache_filter_t update_filter = {
+    .prefix = UPDATE_PREFIX,
+};
+
+static ODR_t updater_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead);
+static ODR_t updater_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten);
+static void *updater_thread(void *arg);
+
+static OD_extension_t ext = {
+    .object = NULL,
+    .read = updater_read,
+    .write = updater_write,
+};
+
+void updater_extension_init(OD_t *od, fcache_t *fread_cache, fcache_t *fwrite_cache, updater_status_cb_t status_cb) {
+    OD_entry_t *entry = OD_find(od, OD_INDEX_UPDATER);
+    if (entry != NULL) {
+        updates = fwrite_cache;
+        status_cache = fread_cache;
+        status_changed = status_cb;
+        OD_extension_init(entry, &ext);
+        running = true;
+        pthread_create(&thread_id, NULL, updater_thread, NULL);
+    } else {
+        log_critical("could not find updater enty 0x(%X)", OD_INDEX_UPDATER);
+    }
+}
+
+void updater_extension_free(void) {
+    if (!running) {
+        return;
+    }
+    running = false; // an update step already running is finished first
+    pthread_join(thread_id, NULL);
+    free(files_json);
+    files_json = NULL;
+}
+
+static void set_status(uint8_t new_status) {
+    if (__atomic_exchange_n(&status, new_status, __ATOMIC_ACQ_REL) != new_status) {
+        log_info("updater status 0x%X", new_status);
+        if (status_changed) {
+            status_changed(new_status);
+        }
+    }
+}
+
+// runs cmd with its output logged, 0 if it exited with 0
+static int run_command(const char *command) {
+    char full_command[CMD_LEN + 8];
+    snprintf(full_command, sizeof(full_command), "%s 2>&1", command);
+    log_info("updater running: %s", command);
+
+    FILE *pipe = popen(full_command, "r");
+    if (pipe == NULL) {
+        return -errno;
+    }
+    char line[LINE_LEN];
+    while (fgets(line, sizeof(line), pipe) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        log_debug("%s", line);
+    }
+    int r = pclose(pipe);
+    if (r == -1) {
+        return -errno;
+    }
+    return (WIFEXITED(r) && (WEXITSTATUS(r) == 0)) ? 0 : -EIO;
+}
+
+int updater_parse_update_name(const char *name, uint32_t *crc) {
+    char crc_str[9] = {0};
+    int n = 0;
+    if ((sscanf(name, UPDATE_PREFIX "%*[0-9]_%8[0-9a-fA-F]%n", crc_str, &n) != 1) || (strlen(crc_str) != 8) ||
+        (strcmp(&name[n], UPDATE_SUFFIX) != 0)) {
+        return -EINVAL;
+    }
+    *crc = strtoul(crc_str, NULL, 16);
+    return 0;
+}
+
+// a write to tar's stdin after it exited is raised on this thread, consume it so it never reaches the process
+static void clear_sigpipe(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    struct timespec no_wait = {0};
+    while (sigtimedwait(&set, NULL, &no_wait) > 0) {
+    }
+}
+
+// the archive is read once, each chunk is fed to the crc and to tar, so verifying it costs no extra pass
+static int extract_verified(const char *archive_path, uint32_t expect_crc) {
+    int fd = open(archive_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    sigset_t set;
+    sigset_t old_set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+    int r = 0;
+    FILE *tar = popen("tar -xJf - -C " WORK_DIR, "w");
+    if (tar == NULL) {
+        r = -errno;
+    } else {
+        static uint8_t chunk[STREAM_CHUNK_LEN];
+        uint32_t crc = 0;
+        ssize_t n;
+        while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+            crc = crc32_update(crc, chunk, n);
+            if (fwrite(chunk, 1, n, tar) != (size_t)n) {
+                r = -EPIPE;
+                break;
+            }
+        }
+        if ((r == 0) && (n < 0)) {
+            r = -errno;
+        }
+        int tar_status = pclose(tar);
+        if ((r == 0) && (crc != expect_crc)) {
+            log_error("update crc32 is 0x%08X, expected 0x%08X", crc, expect_crc);
+            r = -EBADMSG;
+        } else if ((r == 0) && ((tar_status == -1) || !WIFEXITED(tar_status) || (WEXITSTATUS(tar_status) != 0))) {
+            r = -EIO;
+        }
+    }
+
+    clear_sigpipe();
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    close(fd);
+    return r;
+}
+
+bool updater_is_safe_arg(const char *arg) {
+    size_t len = strlen(arg);
+    if ((len == 0) || (len > (NAME_MAX - 4)) || !isalnum((unsigned char)arg[0])) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)arg[i]) && !strchr("._+~-", arg[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_work_file(const char *dir, const char *name) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return is_file(path);
+}
+
+// appends " <dir>/<arg><suffix>" per arg (or " <arg>" when dir is NULL) to cmd
+static int append_args(int offset, char **args, int len, const char *dir, const char *suffix) {
+    for (int i = 0; (i < len) && (offset >= 0); i++) {
+        int n = dir ? snprintf(&cmd[offset], CMD_LEN - offset, " %s/%s%s", dir, args[i], suffix)
+                    : snprintf(&cmd[offset], CMD_LEN - offset, " %s", args[i]);
+        offset = ((n < 0) || (n >= (CMD_LEN - offset))) ? -ENAMETOOLONG : (offset + n);
+    }
+    return offset;
+}
+
+static int dpkg_install(char **args, int len) {
+    int r = append_args(snprintf(cmd, CMD_LEN, "dpkg -i --force-confdef --force-confold"), args, len, WORK_DIR, "");
+    return (r < 0) ? r : run_command(cmd);
+}
+
+// debpatch rebuilds the new deb from the files of the installed package ("/") and the delta
+static int debdelta_install(char **args, int len) {
+    for (int i = 0; i < len; i++) {
+        snprintf(cmd, CMD_LEN, "debpatch %s/%s / %s/%s.deb", WORK_DIR, args[i], WORK_DIR, args[i]);
+        int r = run_command(cmd);
+        if (r < 0) {
+            return r;
+        }
+    }
+    int r = append_args(snprintf(cmd, CMD_LEN, "dpkg -i --force-confdef --force-confold"), args, len, WORK_DIR, ".deb");
+    return (r < 0) ? r : run_command(cmd);
+}
+
+static int dpkg_remove(char **args, int len) {
+    int r = append_args(snprintf(cmd, CMD_LEN, "dpkg -r"), args, len, NULL, "");
+    return (r < 0) ? r : run_command(cmd);
+}
+
+static int bash_script(char **args, int len) {
+    (void)len;
+    snprintf(cmd, CMD_LEN, "bash %s/%s", WORK_DIR, args[0]);
+    return run_command(cmd);
+}
+
+// checks every step (run false) or runs them (run true); -EINVAL/-ENOENT for a bad step, -EIO if one failed
+static int run_instructions(const char *dir, bool run) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, INSTRUCTIONS_FILE);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        log_error("update has no %s", INSTRUCTIONS_FILE);
+        return -ENOENT;
+    }
+
+    int r = 0;
+    char line[LINE_LEN];
+    for (int line_num = 1; (running || !run) && (r == 0) && (fgets(line, sizeof(line), fp) != NULL); line_num++) {
+        char *args[STEP_ARGS_MAX + 1];
+        int len = 0;
+        char *save = NULL;
+        char *arg = strtok_r(line, " \t\r\n", &save);
+        for (; arg && (len <= STEP_ARGS_MAX); arg = strtok_r(NULL, " \t\r\n", &save)) {
+            args[len++] = arg;
+        }
+        if ((len == 0) || (args[0][0] == '#')) {
+            continue;
+        }
+
+        const step_t *step = NULL;
+        for (size_t i = 0; i < (sizeof(steps) / sizeof(steps[0])); i++) {
+            if (strcmp(args[0], steps[i].name) == 0) {
+                step = &steps[i];
+            }
+        }
+        int max_args = (step && step->max_args) ? step->max_args : STEP_ARGS_MAX;
+        if (!step || (len < 2) || ((len - 1) > max_args) || arg) { // arg is left over past the max, never dropped
+            r = -EINVAL;
+        }
+        for (int i = 1; (r == 0) && (i < len); i++) {
+            if (!updater_is_safe_arg(args[i])) {
+                r = -EINVAL;
+            } else if (step->file_args && !is_work_file(dir, args[i])) {
+                r = -ENOENT;
+            }
+        }
+        if ((r == 0) && run) {
+            r = step->run(&args[1], len - 1);
+        }
+        if (r < 0) {
+            log_error("%s line %d (%s) failed: %d", INSTRUCTIONS_FILE, line_num, args[0], -r);
+        }
+    }
+    fclose(fp);
+    return r;
+}
+
+int updater_check_instructions(const char *dir) {
+    return run_instructions(dir, false);
+}
+
+static uint8_t run_update(char *name) {
+    uint32_t crc;
+    char path[PATH_MAX];
+    if (updater_parse_update_name(name, &crc) < 0) {
+        log_error("%s is not named %s<unix-time>_<crc32>%s", name, UPDATE_PREFIX, UPDATE_SUFFIX);
+        return UPDATER_STATUS_PRE_PROCESS_ERROR;
+    }
+    if ((path_join(updates->dir_path, name, path, sizeof(path)) < 0) || (run_command("rm -rf " WORK_DIR) < 0) ||
+        (mkdir_path(WORK_DIR, S_IRWXU) < 0)) {
+        return UPDATER_STATUS_PRE_PROCESS_ERROR;
+    }
+
+    int r = extract_verified(path, crc);
+    if (r < 0) {
+        log_error("failed to extract %s: %d", name, -r);
+        return UPDATER_STATUS_PRE_PROCESS_ERROR;
+    }
+    if (updater_check_instructions(WORK_DIR) < 0) {
+        return UPDATER_STATUS_PRE_PROCESS_ERROR;
+    }
+    if (run_instructions(WORK_DIR, true) < 0) {
+        return UPDATER_STATUS_RUN_ERROR;
+    }
+    return UPDATER_STATUS_SUCCESSFUL;
+}
+
+static void run_updates(void) {
+    char name[NAME_MAX + 1];
+    uint8_t result = UPDATER_STATUS_SUCCESSFUL;
+
+    set_status(UPDATER_STATUS_IN_PROGRESS);
+    while (running && (result == UPDATER_STATUS_SUCCESSFUL) && (fcache_count(updates, &update_filter, name) > 0)) {
+        log_info("running update %s", name);
+        result = run_update(name);
+        fcache_delete(updates, name);
+    }
+    if (result != UPDATER_STATUS_SUCCESSFUL) { // the later updates were made on top of the failed one
+        while (fcache_count(updates, &update_filter, name) > 0) {
+            log_info("dropping update %s", name);
+            fcache_delete(updates, name);
+        }
+    }
+    run_command("rm -rf " WORK_DIR);
+    set_status(result);
+}
+
+static void make_status_file(void) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/tmp/updater_status_%u.txt", get_unix_time_s());
+    snprintf(cmd, CMD_LEN, "%s > %s", DPKG_STATUS_CMD, path);
+    if ((run_command(cmd) < 0) || (fcache_add(status_cache, path, true) < 0)) {
+        log_error("failed to make updater status file");
+        remove(path);
+    }
+}
+
+static void *updater_thread(void *arg) {
+    (void)arg;
+    while (running) {
+        sleep_ms(250);
+        if (__atomic_exchange_n(&status_file_requested, false, __ATOMIC_ACQ_REL)) {
+            make_status_file();
+        }
+        if (__atomic_exchange_n(&update_requested, false, __ATOMIC_ACQ_REL)) {
+            run_updates();
+        }
+    }
+    return NULL;
+}
+
+static ODR_t updater_read(OD_stream_t *stream, void *buf, OD_size_t count, OD_size_t *countRead) {
+    ODR_t r = ODR_OK;
+    switch (stream->subIndex) {
+    case 0:
+        r = OD_readOriginal(stream, buf, count, countRead);
+        break;
+    case OD_SUBINDEX_UPDATER_STATUS: {
+        uint8_t value = __atomic_load_n(&status, __ATOMIC_ACQUIRE);
+        memcpy(buf, &value, sizeof(value));
+        *countRead = sizeof(value);
+        break;
+    }
+    case OD_SUBINDEX_UPDATER_CACHE_LENGTH: {
+        uint8_t len = MIN(fcache_count(updates, &update_filter, NULL), 0xFF);
+        memcpy(buf, &len, sizeof(len));
+        *countRead = sizeof(len);
+        break;
+    }
+    case OD_SUBINDEX_UPDATER_CACHE_FILES_JSON: {
+        if (stream->dataOffset == 0) { // only list once per transfer, not per segment
+            free(files_json);
+            files_json = fcache_list_files_as_json(updates, &update_filter);
+        }
+        if (files_json != NULL) {
+            r = od_ext_read_data(stream, buf, count, countRead, files_json, strlen(files_json) + 1);
+        } else {
+            r = ODR_OUT_OF_MEM;
+        }
+        break;
+    }
+    case OD_SUBINDEX_UPDATER_UPDATE:
+    case OD_SUBINDEX_UPDATER_MAKE_STATUS_FILE:
+        r = ODR_WRITEONLY;
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
+
+static ODR_t updater_write(OD_stream_t *stream, const void *buf, OD_size_t count, OD_size_t *countWritten) {
+    ODR_t r = ODR_OK;
+    bool value = false;
+    switch (stream->subIndex) {
+    case OD_SUBINDEX_UPDATER_UPDATE:
+        if (__atomic_load_n(&status, __ATOMIC_ACQUIRE) == UPDATER_STATUS_IN_PROGRESS) {
+            return ODR_DATA_LOC_CTRL;
+        }
+        r = OD_writeOriginal(stream, buf, count, countWritten);
+        memcpy(&value, buf, sizeof(value));
+        if ((r == ODR_OK) && value) {
+            __atomic_store_n(&update_requested, true, __ATOMIC_RELEASE);
+        }
+        break;
+    case OD_SUBINDEX_UPDATER_MAKE_STATUS_FILE:
+        r = OD_writeOriginal(stream, buf, count, countWritten);
+        memcpy(&value, buf, sizeof(value));
+        if ((r == ODR_OK) && value) {
+            __atomic_store_n(&status_file_requested, true, __ATOMIC_RELEASE);
+        }
+        break;
+    case 0:
+    case OD_SUBINDEX_UPDATER_STATUS:
+    case OD_SUBINDEX_UPDATER_CACHE_LENGTH:
+    case OD_SUBINDEX_UPDATER_CACHE_FILES_JSON:
+        r = ODR_READONLY;
+        break;
+    default:
+        r = ODR_SUB_NOT_EXIST;
+        break;
+    }
+    return r;
+}
@@ -0,0 +1,35 @@
+#ifndef _UPDATER_EXT_H_
+#define _UPDATER_EXT_H_
+
+#include "301/CO_ODinterface.h"
+#include "fcache.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Update archives are written to the fwrite cache as update_<unix-time>_<crc32>.tar.xz and run oldest first. The
+ * crc32 (8 hex digits) of the whole archive is checked while it is extracted, in the same pass. The archive has an
+ * instructions.txt, one step per line, run in order:
+ *
+ *   DPKG_INSTALL <deb> ...       install debs from the archive
+ *   DEBDELTA <debdelta> ...      rebuild debs from the installed packages plus a delta, then install them
+ *   DPKG_REMOVE <package> ...    remove packages
+ *   BASH_SCRIPT <script>         run a script from the archive
+ */
+
+typedef void (*updater_status_cb_t)(uint8_t status);
+
+// status_cb is called from the updater thread on every status change, it must be thread safe, can be NULL
+void updater_extension_init(OD_t *od, fcache_t *fread_cache, fcache_t *fwrite_cache, updater_status_cb_t status_cb);
+void updater_extension_free(void);
+
+// update_<unix-time>_<crc32>.tar.xz, gets the crc32; -EINVAL for any other name
+int updater_parse_update_name(const char *name, uint32_t *crc);
+
+// args are joined into shell commands, so only plain file and package names are allowed
+bool updater_is_safe_arg(const char *arg);
+
+// checks every step of dir's instructions.txt without running any; -EINVAL for a bad step, -ENOENT for a missing file
+int updater_check_instructions(const char *dir);
+
+#endif
@@ -0,0 +1,60 @@
+#include "bus_stats.h"
+#include <assert.h>
+#include <linux/can.h>
+#include <linux/can/error.h>
+#include <stdint.h>
+#include <string.h>
+
+void test_bus_stats_snapshot(void) {
+    bus_stats_t stats;
+    uint8_t data[CAN_MAX_DLEN] = {0};
+
+    assert(bus_stats_init("lo", 1000000) == 0);
+
+    bus_stats_frame(0x000, data, 2, true);
+    bus_stats_frame(0x080, data, 0, false);
+    bus_stats_frame(0x08C, data, 8, false);
+    bus_stats_frame(0x18C, data, 8, false);
+    bus_stats_frame(0x28C, data, 8, false);
+    bus_stats_frame(0x60C, data, 8, true);
+    bus_stats_frame(0x58C, data, 8, false);
+    bus_stats_frame(0x70C, data, 1, false);
+    bus_stats_frame(0x7E5, data, 8, false);
+    bus_stats_frame(0x1234 | CAN_EFF_FLAG, data, 8, false);
+
+    data[1] = CAN_ERR_CRTL_TX_PASSIVE;
+    bus_stats_frame(CAN_ERR_FLAG | CAN_ERR_CRTL, data, CAN_ERR_DLC, false);
+    bus_stats_frame(CAN_ERR_FLAG | CAN_ERR_BUSOFF, data, CAN_ERR_DLC, false);
+
+    // only rising edges count
+    bus_stats_overflow(true, false);
+    bus_stats_overflow(true, false);
+    bus_stats_overflow(false, true);
+
+    bus_stats_snapshot(&stats);
+    assert(stats.frames[BUS_STATS_NMT] == 1);
+    assert(stats.frames[BUS_STATS_SYNC] == 1);
+    assert(stats.frames[BUS_STATS_EMCY] == 1);
+    assert(stats.frames[BUS_STATS_TIME] == 0);
+    assert(stats.frames[BUS_STATS_PDO] == 2);
+    assert(stats.frames[BUS_STATS_SDO] == 2);
+    assert(stats.frames[BUS_STATS_HB] == 1);
+    assert(stats.frames[BUS_STATS_OTHER] == 2);
+    assert(stats.node_frames[0x0C] == 6);
+    assert(stats.node_frames[0x00] == 0);
+    assert(stats.tx_frames == 2);
+    assert(stats.err_frames == 2);
+    assert(stats.err_passive == 1);
+    assert(stats.bus_off == 1);
+    assert(stats.tx_overflow == 1);
+    assert(stats.rx_overflow == 1);
+
+    // counters restart after a snapshot
+    bus_stats_snapshot(&stats);
+    assert(stats.frames[BUS_STATS_PDO] == 0);
+    assert(stats.node_frames[0x0C] == 0);
+    assert(stats.err_frames == 0);
+    assert(stats.load == 0);
+
+    bus_stats_free();
+}
@@ -0,0 +1,166 @@
+#include "fcache.h"
+#include "logger.h"
+#include "system.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+
+#define CACHE_DIR "/tmp/test_fcache"
+#define SRC_PATH  "/tmp/test_fcache_src.bin"
+
+static uint8_t data[100];
+
+static fcache_t *start(uint64_t max_bytes, uint32_t max_files) {
+    char dir[] = CACHE_DIR;
+    mkdir_path(dir, 0755);
+    clear_dir(dir);
+    fcache_t *cache = fcache_init(dir);
+    assert(cache != NULL);
+    assert(fcache_set_limits(cache, max_bytes, max_files, 0) == 0);
+    return cache;
+}
+
+static int add(fcache_t *cache, const char *name, uint32_t len) {
+    char file_name[NAME_MAX + 1];
+    snprintf(file_name, sizeof(file_name), "%s", name);
+    return fcache_add_new(cache, file_name, data, len);
+}
+
+static bool exist(fcache_t *cache, const char *name) {
+    char file_name[NAME_MAX + 1];
+    snprintf(file_name, sizeof(file_name), "%s", name);
+    return fcache_file_exist(cache, file_name);
+}
+
+// adds land in the same second, so the LRU order is set by hand
+static void set_last_used(fcache_t *cache, const char *name, time_t last_used) {
+    for (uint32_t i = 0; i < cache->files_len; i++) {
+        if (strcmp(cache->files[i].name, name) == 0) {
+            cache->files[i].last_used = last_used;
+            return;
+        }
+    }
+    assert(false);
+}
+
+void test_fcache_byte_quota(void) {
+    fcache_t *cache = start(250, 0);
+    assert(add(cache, "a", 100) == 0);
+    assert(add(cache, "b", 100) == 0);
+    assert(fcache_bytes(cache) == 200);
+    set_last_used(cache, "b", 100);
+    set_last_used(cache, "a", 200);
+
+    assert(add(cache, "c", 100) == 0); // 300 bytes is over, the least recently used goes
+    assert(fcache_size(cache) == 2);
+    assert(fcache_bytes(cache) == 200);
+    assert(exist(cache, "a") && !exist(cache, "b") && exist(cache, "c"));
+
+    assert(add(cache, "d", 50) == 0); // fits as is
+    assert(fcache_size(cache) == 3);
+    assert(fcache_bytes(cache) == 250);
+    fcache_free(cache);
+}
+
+void test_fcache_file_quota(void) {
+    fcache_t *cache = start(0, 2);
+    assert(add(cache, "a", 1) == 0);
+    assert(add(cache, "b", 1) == 0);
+    assert(add(cache, "c", 1) == 0);
+    assert(fcache_size(cache) == 2);
+    assert(fcache_bytes(cache) == 2);
+    assert(!exist(cache, "a"));
+    fcache_free(cache);
+}
+
+void test_fcache_victim_order(void) {
+    fcache_t *cache = start(0, 4);
+    assert(fcache_add_priority(cache, "keep_", 1) == 0);
+    assert(fcache_add_priority(cache, "drop_", -1) == 0);
+    assert(add(cache, "keep_old", 1) == 0);
+    assert(add(cache, "drop_new", 1) == 0);
+    assert(add(cache, "drop_old", 1) == 0);
+    assert(add(cache, "mid_old", 1) == 0);
+    set_last_used(cache, "keep_old", 100);
+    set_last_used(cache, "drop_new", 300);
+    set_last_used(cache, "drop_old", 200);
+    set_last_used(cache, "mid_old", 100);
+
+    // lowest priority first, then least recently used, whatever the name order
+    const char *order[] = {"drop_old", "drop_new", "mid_old"};
+    char name[16];
+    for (int i = 0; i < 3; i++) {
+        snprintf(name, sizeof(name), "new_%d", i);
+        assert(add(cache, name, 1) == 0);
+        set_last_used(cache, name, 1000 + i);
+        assert(!exist(cache, order[i]));
+        for (int j = i + 1; j < 3; j++) {
+            assert(exist(cache, order[j]));
+        }
+    }
+
+    assert(add(cache, "new_3", 1) == 0); // the oldest file left has a higher priority than the new ones
+    assert(exist(cache, "keep_old") && !exist(cache, "new_0"));
+    fcache_free(cache);
+}
+
+void test_fcache_replace(void) {
+    fcache_t *cache = start(250, 2);
+    assert(add(cache, "a", 100) == 0);
+    assert(add(cache, "b", 100) == 0);
+
+    // the old copy's bytes and file don't count against the new one, so nothing is evicted
+    assert(add(cache, "b", 100) == 0);
+    assert(add(cache, "b", 150) == 0);
+    assert(fcache_size(cache) == 2);
+    assert(fcache_bytes(cache) == 250);
+    assert(exist(cache, "a"));
+
+    assert(add(cache, "b", 10) == 0);
+    assert(fcache_bytes(cache) == 110);
+    fcache_free(cache);
+}
+
+void test_fcache_too_big(void) {
+    fcache_t *cache = start(50, 0);
+    assert(add(cache, "a", 50) == 0);
+    assert(add(cache, "b", 51) == -EFBIG);
+    assert(exist(cache, "a") && !exist(cache, "b")); // nothing is evicted for a file that never fits
+    assert(fcache_bytes(cache) == 50);
+
+    // replacing with one too big keeps the old copy
+    assert(add(cache, "a", 51) == -EFBIG);
+    assert(exist(cache, "a"));
+    assert(fcache_bytes(cache) == 50);
+    fcache_free(cache);
+}
+
+void test_fcache_add_last_used(void) {
+    FILE *fp = fopen(SRC_PATH, "w");
+    assert(fp != NULL);
+    fputs("old", fp);
+    fclose(fp);
+    struct utimbuf times = {.actime = 1000, .modtime = 1000};
+    assert(utime(SRC_PATH, &times) == 0);
+
+    fcache_t *cache = start(0, 0);
+    time_t before = time(NULL);
+    char path[] = SRC_PATH;
+    assert(fcache_add(cache, path, true) == 0); // moved, so it keeps its mtime
+    assert(cache->files_len == 1);
+    assert(cache->files[0].last_used >= before); // just added, not as old as its mtime
+    fcache_free(cache);
+
+    // at init only the mtime is known
+    char dir[] = CACHE_DIR;
+    char cache_path[] = CACHE_DIR "/test_fcache_src.bin";
+    assert(utime(cache_path, &times) == 0);
+    cache = fcache_init(dir);
+    assert(cache->files_len == 1);
+    assert(cache->files[0].last_used == 1000);
+    fcache_free(cache);
+}
@@ -0,0 +1,60 @@
+#include "histogram.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// percentiles are the top of a bucket, so within 1/8 above the real value
+static void assert_near(uint32_t got, uint32_t expect) {
+    assert(got >= expect);
+    assert(got <= (expect + (expect / 8)));
+}
+
+void test_histogram_percentile(void) {
+    histogram_t hist;
+    memset(&hist, 0, sizeof(hist));
+
+    assert(histogram_percentile(&hist, 50.0) == 0);
+
+    for (uint32_t i = 1; i <= 10000; i++) {
+        histogram_record(&hist, i);
+    }
+    assert(hist.count == 10000);
+    assert(hist.max == 10000);
+    assert_near(histogram_percentile(&hist, 50.0), 5000);
+    assert_near(histogram_percentile(&hist, 99.0), 9900);
+    assert(histogram_percentile(&hist, 100.0) == 10000); // clamped to max
+
+    // small values are exact
+    histogram_reset(&hist);
+    histogram_record(&hist, 3);
+    histogram_record(&hist, 5);
+    assert(histogram_percentile(&hist, 50.0) == 3);
+    assert(histogram_percentile(&hist, 100.0) == 5);
+
+    // full range
+    histogram_record(&hist, UINT32_MAX);
+    assert(histogram_percentile(&hist, 100.0) == UINT32_MAX);
+}
+
+void test_histogram_summary(void) {
+    histogram_t hist;
+    histogram_summary_t summary;
+    memset(&hist, 0, sizeof(hist));
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        histogram_record(&hist, 100);
+    }
+    histogram_record(&hist, 20000);
+    histogram_summary(&hist, &summary);
+    assert(summary.count == 1001);
+    assert(summary.mean == 119);
+    assert_near(summary.p50, 100);
+    assert_near(summary.p99, 100);
+    assert(summary.max == 20000);
+
+    histogram_reset(&hist);
+    histogram_summary(&hist, &summary);
+    assert(summary.count == 0);
+    assert(summary.mean == 0);
+    assert(summary.max == 0);
+}
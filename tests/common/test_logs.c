@@ -0,0 +1,51 @@
+#include "301/CO_ODinterface.h"
+#include "OD.h"
+#include "fcache.h"
+#include "logger.h"
+#include "logs_ext.h"
+#include "od_ext.h"
+#include "system.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+void test_logs_is_valid_cursor(void) {
+    assert(logs_is_valid_cursor("s=0123abcd;i=1f;b=9e;m=2a;t=5f;x=77"));
+    assert(logs_is_valid_cursor(""));
+    assert(!logs_is_valid_cursor("s=1'; rm -rf /; '"));
+    assert(!logs_is_valid_cursor("s=1$(reboot)"));
+    assert(!logs_is_valid_cursor("s=ABC"));
+    assert(!logs_is_valid_cursor("s=1 i=2"));
+    assert(!logs_is_valid_cursor("s=1\n"));
+}
+
+void test_logs_tail(void) {
+    char buf[16];
+    bool dropped = false;
+
+    size_t len = logs_tail_append(buf, 0, sizeof(buf), "one\ntwo\n", 8, &dropped);
+    assert((len == 8) && !dropped);
+    assert(logs_tail_trim(buf, len, dropped) == 8); // nothing dropped, the first line is whole
+    assert(memcmp(buf, "one\ntwo\n", 8) == 0);
+
+    len = logs_tail_append(buf, len, sizeof(buf), "three\nfour\n", 11, &dropped);
+    assert((len == sizeof(buf)) && dropped);
+    assert(memcmp(buf, "\ntwo\nthree\nfour\n", len) == 0); // the newest bytes are kept
+    len = logs_tail_trim(buf, len, dropped);
+    assert(len == 15); // up to the first newline, what is left of "one\n"
+    assert(memcmp(buf, "two\nthree\nfour\n", len) == 0);
+
+    // one chunk bigger than the buffer
+    dropped = false;
+    const char *big = "aaaaaaaaaaaa\nbbbbbbbbbbbbbbb\n";
+    len = logs_tail_append(buf, 0, sizeof(buf), big, strlen(big), &dropped);
+    assert((len == sizeof(buf)) && dropped);
+    assert(memcmp(buf, &big[strlen(big) - sizeof(buf)], sizeof(buf)) == 0);
+    len = logs_tail_trim(buf, len, dropped);
+    assert(len == 0); // the first line kept may be cut, so it goes
+
+    // dropped with no newline left keeps what there is
+    dropped = true;
+    memcpy(buf, "partial", 7);
+    assert(logs_tail_trim(buf, 7, dropped) == 7);
+}
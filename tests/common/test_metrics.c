@@ -0,0 +1,33 @@
+#include "fcache.h"
+#include "logger.h"
+#include "metrics.h"
+#include "system.h"
+#include <assert.h>
+#include <stdint.h>
+
+void test_parse_cpu_times(void) {
+    int core;
+    cpu_times_t times;
+
+    assert(parse_cpu_times("cpu  100 0 50 800 50 0 0 0 0 0\n", &core, &times) == 0);
+    assert(core == -1);
+    assert(times.total == 1000);
+    assert(times.busy == 150); // idle and iowait are not busy
+
+    assert(parse_cpu_times("cpu3 10 0 10 70 10\n", &core, &times) == 0);
+    assert(core == 3);
+    assert(times.total == 100);
+    assert(times.busy == 20);
+
+    assert(parse_cpu_times("intr 1234 0 0\n", &core, &times) < 0);
+    assert(parse_cpu_times("cpux 1 2 3 4\n", &core, &times) < 0);
+    assert(parse_cpu_times("cpu 1 2\n", &core, &times) < 0);
+}
+
+void test_cpu_busy_percent(void) {
+    cpu_times_t prev = {.busy = 100, .total = 1000};
+    cpu_times_t now = {.busy = 150, .total = 1200};
+    assert(cpu_busy_percent(&prev, &now) == 25);
+    assert(cpu_busy_percent(&prev, &prev) == 0); // no time passed
+    assert(cpu_busy_percent(&now, &prev) == 0);  // counters went backwards
+}
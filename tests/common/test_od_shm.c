@@ -0,0 +1,74 @@
+#include "od_shm.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TEST_NAME "/oresat-cand-od-test"
+
+typedef struct {
+    od_shm_header_t header;
+    od_shm_entry_t entries[2];
+    uint8_t data[16];
+} segment_t;
+
+static segment_t *make_segment(void) {
+    shm_unlink(TEST_NAME);
+    int fd = shm_open(TEST_NAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+    assert(fd >= 0);
+    assert(ftruncate(fd, sizeof(segment_t)) == 0);
+    segment_t *seg = mmap(NULL, sizeof(segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    assert(seg != MAP_FAILED);
+
+    seg->header = (od_shm_header_t){
+        .magic = OD_SHM_MAGIC,
+        .version = OD_SHM_VERSION,
+        .entry_size = sizeof(od_shm_entry_t),
+        .entries_len = 2,
+        .data_offset = offsetof(segment_t, data),
+        .data_len = sizeof(seg->data),
+    };
+    seg->entries[0] = (od_shm_entry_t){.index = 0x4000, .subindex = 0, .offset = 0, .len = 4};
+    seg->entries[1] = (od_shm_entry_t){.index = 0x4001, .subindex = 2, .offset = 8, .len = 8};
+    uint32_t value = 1234;
+    memcpy(&seg->data[0], &value, sizeof(value));
+    memcpy(&seg->data[8], "abc", 4);
+    return seg;
+}
+
+void test_od_shm_read(void) {
+    segment_t *seg = make_segment();
+    od_shm_t shm;
+    assert(od_shm_open(&shm, TEST_NAME) == 0);
+
+    uint32_t value = 0;
+    assert(od_shm_read(&shm, 0x4000, 0, &value, sizeof(value)) == 4);
+    assert(value == 1234);
+    char str[8];
+    assert(od_shm_read(&shm, 0x4001, 2, str, sizeof(str)) == 8);
+    assert(strcmp(str, "abc") == 0);
+    assert(od_shm_read(&shm, 0x4001, 1, str, sizeof(str)) == -ENOENT);
+
+    uint32_t seq;
+    int pos = od_shm_find(&shm, 0x4000, 0);
+    assert(pos == 0);
+    seg->entries[0].seq = 1; // mid write
+    value = 99;
+    memcpy(&seg->data[0], &value, sizeof(value));
+    assert(od_shm_read_pos(&shm, pos, &value, sizeof(value), &seq) == -EAGAIN);
+    seg->entries[0].seq = 2;
+    assert(od_shm_read_pos(&shm, pos, &value, sizeof(value), &seq) == 4);
+    assert((value == 99) && (seq == 2));
+
+    seg->header.magic = 0; // the daemon stopped
+    assert(od_shm_read_pos(&shm, pos, &value, sizeof(value), NULL) == -ESTALE);
+
+    od_shm_close(&shm);
+    assert(od_shm_open(&shm, TEST_NAME) == -EPROTO);
+    munmap(seg, sizeof(segment_t));
+    shm_unlink(TEST_NAME);
+}
@@ -0,0 +1,145 @@
+#include "301/CO_ODinterface.h"
+#include "OD.h"
+#include "fcache.h"
+#include "logger.h"
+#include "od_ext.h"
+#include "os_command_ext.h"
+#include "subprocess.h"
+#include "system.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CACHE_DIR     "/tmp/test_os_command"
+#define WAIT_MAX_MS   5000
+#define BIG_CMD       "seq 1 5000" // more output than fits in the reply
+#define BIG_CMD_BYTES 23893
+
+static void clean_cache_dir(void) {
+    char dir[] = CACHE_DIR;
+    mkdir_path(dir, 0755);
+    clear_dir(dir);
+}
+
+static fcache_t *start(uint8_t mode) {
+    char dir[] = CACHE_DIR;
+    fcache_t *cache = fcache_init(dir);
+    assert(cache != NULL);
+    os_command_extension_init(OD, cache);
+    OD_entry_t *entry = OD_find(OD, OD_INDEX_OS_COMMAND_OUTPUT);
+    assert(OD_set_u8(entry, OD_SUBINDEX_OS_COMMAND_OUTPUT_MODE, mode, false) == ODR_OK);
+    return cache;
+}
+
+static void stop(fcache_t *cache) {
+    os_command_extension_free();
+    fcache_free(cache);
+}
+
+// runs cmd and returns its status once done
+static uint8_t run(const char *cmd) {
+    OD_entry_t *entry = OD_find(OD, OD_INDEX_OS_COMMAND);
+    assert(os_command_run(cmd) == 0);
+    uint8_t status = OS_COMMAND_STATUS_EXECUTING;
+    for (uint32_t ms = 0; (status == OS_COMMAND_STATUS_EXECUTING) && (ms < WAIT_MAX_MS); ms += 10) {
+        sleep_ms(10);
+        assert(OD_get_u8(entry, OD_SUBINDEX_OS_COMMAND_STATUS, &status, false) == ODR_OK);
+    }
+    return status;
+}
+
+static ODR_t read_str(uint16_t index, uint8_t subindex, char *str, size_t len) {
+    OD_IO_t io;
+    OD_size_t n = 0;
+    ODR_t r = OD_getSub(OD_find(OD, index), subindex, &io, false);
+    if (r == ODR_OK) {
+        r = io.read(&io.stream, str, len - 1, &n);
+    }
+    str[(r == ODR_OK) ? n : 0] = '\0';
+    return r;
+}
+
+static uint32_t output_size(void) {
+    uint32_t size = 0;
+    assert(OD_get_u32(OD_find(OD, OD_INDEX_OS_COMMAND_OUTPUT), OD_SUBINDEX_OS_COMMAND_OUTPUT_SIZE, &size, false) ==
+           ODR_OK);
+    return size;
+}
+
+void test_os_command_reply(void) {
+    clean_cache_dir();
+    fcache_t *cache = start(OS_COMMAND_OUTPUT_MODE_REPLY);
+    char reply[16384];
+
+    assert(run("echo hello") == OS_COMMAND_STATUS_NO_ERROR_REPLY);
+    assert(read_str(OD_INDEX_OS_COMMAND, OD_SUBINDEX_OS_COMMAND_REPLY, reply, sizeof(reply)) == ODR_OK);
+    assert(strcmp(reply, "hello\n") == 0);
+    assert(output_size() == 6);
+
+    assert(run("false") == OS_COMMAND_STATUS_ERROR_NO_REPLY);
+    assert(fcache_size(cache) == 0);
+    stop(cache);
+}
+
+void test_os_command_reply_truncated(void) {
+    clean_cache_dir();
+    fcache_t *cache = start(OS_COMMAND_OUTPUT_MODE_REPLY);
+    char reply[16384];
+
+    assert(run(BIG_CMD) == OS_COMMAND_STATUS_NO_ERROR_REPLY);
+    assert(read_str(OD_INDEX_OS_COMMAND, OD_SUBINDEX_OS_COMMAND_REPLY, reply, sizeof(reply)) == ODR_OK);
+    assert(strncmp(reply, "1\n2\n3\n", 6) == 0);
+    assert((strlen(reply) > 0) && (strlen(reply) < BIG_CMD_BYTES));
+    assert(output_size() == BIG_CMD_BYTES); // all of it is counted
+    assert(fcache_size(cache) == 0);
+    stop(cache);
+}
+
+void test_os_command_file(void) {
+    clean_cache_dir();
+    FILE *fp = fopen(CACHE_DIR "/.os_command_1.txt.gz", "w"); // left by a daemon stopped mid command
+    assert(fp != NULL);
+    fclose(fp);
+
+    fcache_t *cache = start(OS_COMMAND_OUTPUT_MODE_FILE);
+    assert(access(CACHE_DIR "/.os_command_1.txt.gz", F_OK) != 0);
+    char reply[16384];
+    char name[64];
+
+    assert(run(BIG_CMD) == OS_COMMAND_STATUS_NO_ERROR_REPLY);
+    assert(read_str(OD_INDEX_OS_COMMAND_OUTPUT, OD_SUBINDEX_OS_COMMAND_OUTPUT_FILE_NAME, name, sizeof(name)) ==
+           ODR_OK);
+    assert(strncmp(name, "os_command_", strlen("os_command_")) == 0);
+    assert(fcache_file_exist(cache, name));
+    assert(read_str(OD_INDEX_OS_COMMAND, OD_SUBINDEX_OS_COMMAND_REPLY, reply, sizeof(reply)) == ODR_OK);
+    assert(strncmp(reply, name, strlen(name)) == 0); // the reply says where it went
+    assert(output_size() == BIG_CMD_BYTES);
+
+    assert(run("true") == OS_COMMAND_STATUS_NO_ERROR_REPLY); // an empty file, still there to fetch
+    assert(fcache_size(cache) == 2);
+    assert(output_size() == 0);
+    stop(cache);
+}
+
+void test_os_command_auto(void) {
+    clean_cache_dir();
+    fcache_t *cache = start(OS_COMMAND_OUTPUT_MODE_AUTO);
+    char reply[16384];
+    char name[64];
+
+    assert(run("echo small") == OS_COMMAND_STATUS_NO_ERROR_REPLY);
+    assert(read_str(OD_INDEX_OS_COMMAND, OD_SUBINDEX_OS_COMMAND_REPLY, reply, sizeof(reply)) == ODR_OK);
+    assert(strcmp(reply, "small\n") == 0);
+    assert(fcache_size(cache) == 0);
+
+    assert(run(BIG_CMD) == OS_COMMAND_STATUS_NO_ERROR_REPLY); // outgrows the reply, moved to a file
+    assert(read_str(OD_INDEX_OS_COMMAND_OUTPUT, OD_SUBINDEX_OS_COMMAND_OUTPUT_FILE_NAME, name, sizeof(name)) ==
+           ODR_OK);
+    assert(fcache_file_exist(cache, name));
+    assert(read_str(OD_INDEX_OS_COMMAND, OD_SUBINDEX_OS_COMMAND_REPLY, reply, sizeof(reply)) == ODR_OK);
+    assert(strncmp(reply, name, strlen(name)) == 0);
+    assert(output_size() == BIG_CMD_BYTES);
+    stop(cache);
+}
@@ -0,0 +1,73 @@
+#include "ecss_time.h"
+#include "logger.h"
+#include "scheduler.h"
+#include "system.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define FIRED_MAX 8
+
+static uint32_t fired_ids[FIRED_MAX];
+static uint8_t fired_len = 0;
+
+static void fired(const sched_action_t *action, int64_t late_ns) {
+    assert(late_ns >= 0);
+    if (fired_len < FIRED_MAX) {
+        fired_ids[fired_len++] = action->id;
+    }
+}
+
+static void scet_in_ms(uint32_t ms, ecss_scet_t *scet) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ecss_scet_from_ns(((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec + (ms * 1000000ULL), scet);
+}
+
+void test_scheduler_order(void) {
+    assert(scheduler_init(fired, 0) == 0);
+
+    ecss_scet_t scet;
+    uint8_t tpdo = 0;
+    scet_in_ms(60, &scet);
+    assert(scheduler_add(3, &scet, SCHED_TPDO, &tpdo, sizeof(tpdo)) == 0);
+    assert(scheduler_add(4, &scet, SCHED_TPDO, &tpdo, sizeof(tpdo)) == 0); // same time, after 3
+    scet_in_ms(20, &scet);
+    assert(scheduler_add(1, &scet, SCHED_TPDO, &tpdo, sizeof(tpdo)) == 0);
+    scet_in_ms(40, &scet);
+    assert(scheduler_add(2, &scet, SCHED_TPDO, &tpdo, sizeof(tpdo)) == 0);
+    assert(scheduler_add(5, &scet, SCHED_TPDO, &tpdo, sizeof(tpdo)) == 0);
+    assert(scheduler_cancel(5) == 1);
+
+    // the packed layout from ipc and the OD record
+    uint8_t packed[SCHED_PACKED_HEADER_LEN + 1] = {0};
+    uint32_t id = 6;
+    scet_in_ms(80, &scet);
+    memcpy(packed, &id, sizeof(id));
+    memcpy(&packed[sizeof(id)], &scet.raw, sizeof(scet.raw));
+    packed[sizeof(id) + sizeof(scet.raw)] = SCHED_TPDO;
+    assert(scheduler_add_packed(packed, sizeof(packed)) == 0);
+    assert(scheduler_add_packed(packed, SCHED_PACKED_HEADER_LEN - 1) < 0);
+
+    scheduler_stats_t stats;
+    scheduler_stats(&stats);
+    assert(stats.pending == 5);
+
+    sleep_ms(200);
+    scheduler_stats(&stats);
+    assert(stats.pending == 0);
+    assert(stats.fired == 5);
+    assert(fired_len == 5);
+    for (uint8_t i = 0; i < fired_len; i++) {
+        uint32_t expect[] = {1, 2, 3, 4, 6};
+        assert(fired_ids[i] == expect[i]);
+    }
+
+    scet_in_ms(1000, &scet);
+    assert(scheduler_add(7, &scet, SCHED_TPDO, &tpdo, sizeof(tpdo)) == 0);
+    scheduler_free(); // drops the pending action
+    scheduler_stats(&stats);
+    assert(stats.pending == 0);
+    assert(fired_len == 5);
+}
@@ -0,0 +1,59 @@
+#include "seqlock.h"
+#include "system.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WRITES 200000
+
+typedef struct {
+    uint64_t a;
+    uint64_t b; // always the same as a when read whole
+} pair_t;
+
+static seqlock_t lock = SEQLOCK_INIT;
+static pair_t shared;
+
+static void *writer(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < WRITES; i++) {
+        seqlock_write_begin(&lock);
+        shared.a++; // read-modify-write, so two writers lose counts unless they exclude each other
+        shared.b = shared.a;
+        seqlock_write_end(&lock);
+    }
+    return NULL;
+}
+
+void test_seqlock_concurrent(void) {
+    pthread_t writers[2];
+    for (int i = 0; i < 2; i++) {
+        assert(pthread_create(&writers[i], NULL, writer, NULL) == 0);
+    }
+
+    uint32_t reads = 0;
+    pair_t copy = {0};
+    while (copy.a < (2 * WRITES)) {
+        seqlock_read(&lock, &copy, &shared, sizeof(copy));
+        assert(copy.a == copy.b);
+        reads++;
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    assert(shared.a == (2 * WRITES));
+    assert(reads > 0);
+    assert((lock.seq & 1) == 0);
+}
+
+void test_seqlock_retry(void) {
+    seqlock_t l = SEQLOCK_INIT;
+    uint32_t seq = seqlock_read_begin(&l);
+    assert(!seqlock_read_retry(&l, seq));
+    uint64_t value = 1;
+    uint64_t data = 0;
+    seqlock_write(&l, &data, &value, sizeof(value));
+    assert(seqlock_read_retry(&l, seq)); // written since the read began
+    assert(data == 1);
+}
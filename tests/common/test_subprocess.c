@@ -0,0 +1,81 @@
+#include "subprocess.h"
+#include "system.h"
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+typedef struct {
+    char data[256];
+    size_t len;
+} output_t;
+
+static void append(void *arg, const char *data, size_t len) {
+    output_t *out = (output_t *)arg;
+    size_t n = (len < (sizeof(out->data) - 1 - out->len)) ? len : (sizeof(out->data) - 1 - out->len);
+    memcpy(&out->data[out->len], data, n);
+    out->len += n;
+    out->data[out->len] = '\0';
+}
+
+static int run(const char *cmd, output_t *out, uint32_t timeout_ms) {
+    subprocess_t proc;
+    *out = (output_t){0};
+    int r = subprocess_spawn(&proc, cmd);
+    return (r < 0) ? r : subprocess_wait(&proc, append, out, timeout_ms, -1);
+}
+
+void test_subprocess_split(void) {
+    char *argv[SUBPROCESS_ARGS_MAX];
+    char cmd[] = "  ls -l 'a b' \"c \\\"d\\\"\" e\\ f  ";
+    assert(subprocess_split(cmd, argv, SUBPROCESS_ARGS_MAX) == 5);
+    assert(strcmp(argv[0], "ls") == 0);
+    assert(strcmp(argv[1], "-l") == 0);
+    assert(strcmp(argv[2], "a b") == 0);
+    assert(strcmp(argv[3], "c \"d\"") == 0);
+    assert(strcmp(argv[4], "e f") == 0);
+    assert(argv[5] == NULL);
+
+    char pipe_cmd[] = "dmesg | tail";
+    assert(subprocess_split(pipe_cmd, argv, SUBPROCESS_ARGS_MAX) == -ENOEXEC);
+    char var_cmd[] = "echo \"$HOME\"";
+    assert(subprocess_split(var_cmd, argv, SUBPROCESS_ARGS_MAX) == -ENOEXEC);
+    char env_cmd[] = "A=1 env";
+    assert(subprocess_split(env_cmd, argv, SUBPROCESS_ARGS_MAX) == -ENOEXEC);
+    char quoted[] = "echo 'a | b'";
+    assert(subprocess_split(quoted, argv, SUBPROCESS_ARGS_MAX) == 2);
+    char open_quote[] = "echo 'a";
+    assert(subprocess_split(open_quote, argv, SUBPROCESS_ARGS_MAX) == -EINVAL);
+    char empty[] = "   ";
+    assert(subprocess_split(empty, argv, SUBPROCESS_ARGS_MAX) == -EINVAL);
+    char too_many[] = "a b c d";
+    assert(subprocess_split(too_many, argv, 4) == -E2BIG);
+}
+
+void test_subprocess_run(void) {
+    output_t out;
+    assert(run("echo hello 'big world'", &out, 0) == 0);
+    assert(strcmp(out.data, "hello big world\n") == 0);
+
+    assert(run("echo abc | tr a-c x-z; echo err >&2", &out, 0) == 0); // shell
+    assert(strcmp(out.data, "xyz\nerr\n") == 0);
+
+    char many[SUBPROCESS_ARGS_MAX * 2 + 8] = "echo";
+    for (int i = 0; i < SUBPROCESS_ARGS_MAX; i++) {
+        strcat(many, " x");
+    }
+    assert(run(many, &out, 0) == 0); // too many words to split, run by the shell
+    assert(out.len == (SUBPROCESS_ARGS_MAX * 2));
+
+    assert(run("false", &out, 0) == 1);
+    assert(run("no-such-command-here", &out, 0) == -ENOENT);
+
+    uint64_t start_ms = get_uptime_ms();
+    assert(run("sleep 5", &out, 100) == -ETIMEDOUT);
+    assert((get_uptime_ms() - start_ms) < 2000);
+
+    // exits while a background process still holds the output open
+    start_ms = get_uptime_ms();
+    assert(run("sleep 5 & echo done", &out, 0) == 0);
+    assert(strcmp(out.data, "done\n") == 0);
+    assert((get_uptime_ms() - start_ms) < 2000);
+}
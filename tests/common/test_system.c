@@ -0,0 +1,68 @@
+#include "system.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#define CHECK_STR "123456789"
+#define CHECK_CRC 0xCBF43926 // crc32 check value
+
+void test_crc32_update(void) {
+    assert(crc32_update(0, CHECK_STR, strlen(CHECK_STR)) == CHECK_CRC);
+    assert(crc32_update(0, NULL, 0) == 0);
+
+    // chunked must match one-shot
+    uint32_t crc = crc32_update(0, CHECK_STR, 4);
+    crc = crc32_update(crc, &CHECK_STR[4], strlen(CHECK_STR) - 4);
+    assert(crc == CHECK_CRC);
+
+    uint8_t buf[100000];
+    for (unsigned int i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t)(i * 7);
+    }
+    assert(crc32_update(0, buf, sizeof(buf)) == crc32(0L, buf, sizeof(buf)));
+}
+
+void test_get_file_crc32(void) {
+    char path_1[] = "/tmp/test_system_crc_1";
+    char path_2[] = "/tmp/test_system_crc_2";
+    uint32_t crc = 0;
+
+    FILE *fp = fopen(path_1, "w");
+    fputs(CHECK_STR, fp);
+    fclose(fp);
+    fp = fopen(path_2, "w");
+    fputs(CHECK_STR "0", fp);
+    fclose(fp);
+
+    assert(get_file_crc32(path_1, &crc) == 0);
+    assert(crc == CHECK_CRC);
+    assert(get_file_crc32("/tmp/test_system_crc_missing", &crc) < 0);
+
+    assert(check_file_crc32_match(path_1, path_1));
+    assert(!check_file_crc32_match(path_1, path_2));
+
+    remove(path_1);
+    remove(path_2);
+}
+
+void test_parse_cpu_list(void) {
+    uint64_t cpus = 0;
+
+    assert(parse_cpu_list("1", &cpus) == 0);
+    assert(cpus == 0x2);
+    assert(parse_cpu_list("0,2-3", &cpus) == 0);
+    assert(cpus == 0xD);
+    assert(parse_cpu_list("63", &cpus) == 0);
+    assert(cpus == (1ULL << 63));
+
+    cpus = 0x1;
+    assert(parse_cpu_list("", &cpus) < 0);
+    assert(parse_cpu_list("64", &cpus) < 0);
+    assert(parse_cpu_list("3-2", &cpus) < 0);
+    assert(parse_cpu_list("1,", &cpus) < 0);
+    assert(parse_cpu_list("a", &cpus) < 0);
+    assert(parse_cpu_list("1-", &cpus) < 0);
+    assert(cpus == 0x1); // untouched on error
+}
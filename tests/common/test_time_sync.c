@@ -0,0 +1,60 @@
+#include "logger.h"
+#include "system.h"
+#include "time_sync.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define DRIFT_PPB 20000 // the local clock is 20 ppm slow
+
+/*
+ * A master and a local clock, one sample per second. The local clock gains freq_ppb - DRIFT_PPB ns a second on the
+ * master, so the offset (master - local) is corrected only once the servo has found the drift.
+ */
+typedef struct {
+    time_sync_servo_t servo;
+    int64_t offset_ns;
+    uint64_t local_ns;
+    double freq_ppb;
+} sim_t;
+
+static time_sync_action_t sim_step(sim_t *sim, int64_t delay_ns) {
+    int64_t step_ns = 0;
+    double freq_ppb = sim->freq_ppb;
+    time_sync_action_t action =
+        time_sync_servo_sample(&sim->servo, sim->offset_ns - delay_ns, sim->local_ns, &step_ns, &freq_ppb);
+    if (action == TIME_SYNC_STEP) {
+        sim->offset_ns -= step_ns;
+        sim->local_ns += step_ns;
+    }
+    sim->freq_ppb = freq_ppb;
+    sim->offset_ns -= (int64_t)(sim->freq_ppb - DRIFT_PPB);
+    sim->local_ns += 1000000000LL + (int64_t)(sim->freq_ppb - DRIFT_PPB);
+    return action;
+}
+
+void test_time_sync_servo(void) {
+    sim_t sim = {
+        .offset_ns = 500000000, // 0.5 s behind, past the step threshold
+        .local_ns = 1700000000ULL * 1000000000ULL,
+    };
+
+    assert(sim_step(&sim, 0) == TIME_SYNC_STEP);
+    assert(sim.servo.state == TIME_SYNC_ACQUIRING);
+    assert(sim.servo.steps == 1);
+
+    for (int i = 0; i < 60; i++) {
+        assert(sim_step(&sim, 0) != TIME_SYNC_STEP);
+    }
+    assert(sim.servo.state == TIME_SYNC_LOCKED);
+    assert(llabs(sim.offset_ns) < 1000);
+    assert(llabs((int64_t)sim.freq_ppb - DRIFT_PPB) < 100);
+
+    // a frame delayed 5 ms is dropped, the clock is left alone
+    uint32_t spikes = sim.servo.spikes;
+    assert(sim_step(&sim, 5000000) == TIME_SYNC_NONE);
+    assert(sim.servo.spikes == (spikes + 1));
+    assert(sim_step(&sim, 0) == TIME_SYNC_SLEW);
+    assert(llabs(sim.offset_ns) < 1000);
+    assert(sim.servo.steps == 1);
+}
@@ -0,0 +1,55 @@
+#include "logger.h"
+#include "trace.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_PATH    "/tmp/test_trace.bin"
+#define TRACE_RECORDS 8
+
+static void read_trace(trace_header_t *header, trace_record_t *records) {
+    FILE *fp = fopen(TRACE_PATH, "rb");
+    assert(fp != NULL);
+    assert(fread(header, sizeof(trace_header_t), 1, fp) == 1);
+    assert(fread(records, sizeof(trace_record_t), TRACE_RECORDS, fp) == TRACE_RECORDS);
+    fclose(fp);
+}
+
+void test_trace_record(void) {
+    trace_header_t header;
+    trace_record_t records[TRACE_RECORDS];
+    uint8_t frame[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+    unlink(TRACE_PATH);
+    trace_record(TRACE_CAN_RX, 0x181, 0x181, frame, sizeof(frame)); // no-op before init
+    assert(trace_init(TRACE_PATH, TRACE_RECORDS) == 0);
+
+    trace_record(TRACE_CAN_RX, 0x181, 0x181, frame, sizeof(frame));
+    trace_record(TRACE_NMT, 0, 5, NULL, 0);
+    trace_free();
+
+    read_trace(&header, records);
+    assert(header.magic == TRACE_MAGIC);
+    assert(header.records == TRACE_RECORDS);
+    assert(header.head == 2);
+    assert((records[0].seq == 1) && (records[0].type == TRACE_CAN_RX) && (records[0].id == 0x181));
+    assert((records[0].len == sizeof(frame)) && !memcmp(records[0].data, frame, sizeof(frame)));
+    assert((records[1].seq == 2) && (records[1].type == TRACE_NMT) && (records[1].arg == 5));
+    assert(records[2].seq == 0);
+
+    // reopening appends and the ring wraps
+    assert(trace_init(TRACE_PATH, TRACE_RECORDS) == 0);
+    for (uint32_t i = 0; i < TRACE_RECORDS; i++) {
+        trace_record(TRACE_IPC_MSG, 1, i, NULL, 0);
+    }
+    trace_free();
+
+    read_trace(&header, records);
+    assert(header.head == TRACE_RECORDS + 2);
+    assert((records[0].seq == TRACE_RECORDS + 1) && (records[0].arg == TRACE_RECORDS - 2));
+    assert((records[2].seq == 3) && (records[2].arg == 0));
+
+    unlink(TRACE_PATH);
+}
@@ -0,0 +1,81 @@
+#include "logger.h"
+#include "system.h"
+#include "unit_monitor.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static int changes = 0;
+static char last_unit[UNIT_NAME_MAX_LEN];
+static unit_state_t last_state;
+static unit_counts_t last_counts;
+
+static void changed(const char *unit, unit_state_t state, unit_counts_t counts) {
+    changes++;
+    strcpy(last_unit, unit);
+    last_state = state;
+    last_counts = counts;
+}
+
+static void assert_counts(unit_monitor_t *mon, uint8_t total, uint8_t active, uint8_t failed) {
+    unit_counts_t counts = unit_monitor_counts(mon);
+    assert(counts.total == total);
+    assert(counts.active == active);
+    assert(counts.failed == failed);
+}
+
+void test_unit_monitor_counts(void) {
+    unit_monitor_t *mon = unit_monitor_init("oresat*.service", changed);
+    assert(mon != NULL);
+    assert_counts(mon, 0, 0, 0);
+
+    assert(unit_monitor_set_state(mon, "oresat-a.service", UNIT_ACTIVE) == 1);
+    assert(unit_monitor_set_state(mon, "oresat-b.service", UNIT_INACTIVE) == 1);
+    assert(unit_monitor_set_state(mon, "sshd.service", UNIT_ACTIVE) == 0); // not matching
+    assert(unit_monitor_set_state(mon, "oresat-a.socket", UNIT_ACTIVE) == 0);
+    assert_counts(mon, 2, 1, 0);
+    assert(changes == 2);
+
+    // same state again is not a change
+    assert(unit_monitor_set_state(mon, "oresat-a.service", UNIT_ACTIVE) == 0);
+    assert(changes == 2);
+
+    assert(unit_monitor_set_state(mon, "oresat-a.service", UNIT_FAILED) == 1);
+    assert_counts(mon, 2, 0, 1);
+    assert(changes == 3);
+    assert(strcmp(last_unit, "oresat-a.service") == 0);
+    assert(last_state == UNIT_FAILED);
+    assert((last_counts.total == 2) && (last_counts.active == 0) && (last_counts.failed == 1));
+
+    assert(unit_monitor_set_state(mon, "oresat-b.service", UNIT_ACTIVE) == 1);
+    assert_counts(mon, 2, 1, 1);
+
+    assert(unit_monitor_remove(mon, "oresat-a.service") == 1);
+    assert(unit_monitor_remove(mon, "oresat-a.service") == 0);
+    assert_counts(mon, 1, 1, 0);
+    assert(changes == 5);
+
+    unit_monitor_free(mon);
+}
+
+void test_unit_monitor_full(void) {
+    unit_monitor_t *mon = unit_monitor_init("*", NULL);
+    char name[UNIT_NAME_MAX_LEN];
+    for (int i = 0; i < UNIT_MONITOR_MAX_UNITS; i++) {
+        snprintf(name, sizeof(name), "unit%d.service", i);
+        assert(unit_monitor_set_state(mon, name, UNIT_ACTIVE) == 1);
+    }
+    assert(unit_monitor_set_state(mon, "one-more.service", UNIT_ACTIVE) == -ENOSPC);
+    assert_counts(mon, UNIT_MONITOR_MAX_UNITS, UNIT_MONITOR_MAX_UNITS, 0);
+    unit_monitor_free(mon);
+}
+
+void test_unit_state_from_str(void) {
+    assert(unit_state_from_str("active") == UNIT_ACTIVE);
+    assert(unit_state_from_str("reloading") == UNIT_ACTIVE);
+    assert(unit_state_from_str("failed") == UNIT_FAILED);
+    assert(unit_state_from_str("activating") == UNIT_INACTIVE);
+    assert(unit_state_from_str("inactive") == UNIT_INACTIVE);
+}
@@ -0,0 +1,70 @@
+#include "301/CO_ODinterface.h"
+#include "OD.h"
+#include "fcache.h"
+#include "logger.h"
+#include "od_ext.h"
+#include "system.h"
+#include "updater_ext.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define WORK_DIR "/tmp/test_updater"
+
+static void write_file(const char *name, const char *data) {
+    char path[128];
+    snprintf(path, sizeof(path), WORK_DIR "/%s", name);
+    FILE *fp = fopen(path, "w");
+    assert(fp != NULL);
+    fputs(data, fp);
+    fclose(fp);
+}
+
+static int check(const char *instructions) {
+    write_file("instructions.txt", instructions);
+    return updater_check_instructions(WORK_DIR);
+}
+
+void test_updater_parse_update_name(void) {
+    uint32_t crc = 0;
+    assert(updater_parse_update_name("update_1700000000_0123abCD.tar.xz", &crc) == 0);
+    assert(crc == 0x0123ABCD);
+    assert(updater_parse_update_name("update_1700000000_0123abc.tar.xz", &crc) == -EINVAL);
+    assert(updater_parse_update_name("update_1700000000_0123abcdef.tar.xz", &crc) == -EINVAL);
+    assert(updater_parse_update_name("update_1700000000_0123abcd.tar.gz", &crc) == -EINVAL);
+    assert(updater_parse_update_name("update_1700000000_0123abcd.tar.xz.part", &crc) == -EINVAL);
+    assert(updater_parse_update_name("update__0123abcd.tar.xz", &crc) == -EINVAL);
+    assert(updater_parse_update_name("other_1700000000_0123abcd.tar.xz", &crc) == -EINVAL);
+}
+
+void test_updater_is_safe_arg(void) {
+    assert(updater_is_safe_arg("oresat-cand_1.2.3+git~1_armhf.deb"));
+    assert(updater_is_safe_arg("setup.sh"));
+    assert(!updater_is_safe_arg(""));
+    assert(!updater_is_safe_arg("-rf"));
+    assert(!updater_is_safe_arg(".hidden"));
+    assert(!updater_is_safe_arg("../etc/passwd"));
+    assert(!updater_is_safe_arg("a;reboot"));
+    assert(!updater_is_safe_arg("a$(reboot)"));
+    assert(!updater_is_safe_arg("a b"));
+}
+
+void test_updater_check_instructions(void) {
+    char dir[] = WORK_DIR;
+    mkdir_path(dir, 0755);
+    clear_dir(dir);
+    assert(updater_check_instructions(WORK_DIR) == -ENOENT); // no instructions.txt
+    write_file("a.deb", "");
+    write_file("setup.sh", "");
+
+    assert(check("# comment\n\nDPKG_INSTALL a.deb\nDPKG_REMOVE b\nBASH_SCRIPT setup.sh\n") == 0);
+    assert(check("DPKG_UPGRADE a.deb\n") == -EINVAL);                            // unknown step
+    assert(check("DPKG_INSTALL\n") == -EINVAL);                                  // no args
+    assert(check("BASH_SCRIPT setup.sh setup.sh\n") == -EINVAL);                 // over the step's max
+    assert(check("DPKG_REMOVE a b c d e f g h i j k l m n o p\n") == 0);
+    assert(check("DPKG_REMOVE a b c d e f g h i j k l m n o p q\n") == -EINVAL); // not silently cut at the max
+    assert(check("DPKG_REMOVE a;reboot\n") == -EINVAL);                          // unsafe arg
+    assert(check("DPKG_INSTALL a.deb missing.deb\n") == -ENOENT);                // not in the archive
+    assert(check("DPKG_REMOVE missing\n") == 0);                                 // packages, not files
+}
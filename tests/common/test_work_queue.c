@@ -0,0 +1,116 @@
+#include "logger.h"
+#include "system.h"
+#include "work_queue.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WAIT_MS 2000
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static bool gate_open = false;
+static int order[8];
+static int order_len = 0;
+static int started = 0;
+
+typedef struct {
+    int id;
+    bool gated;
+} job_t;
+
+static void job_run(void *arg) {
+    job_t *job = (job_t *)arg;
+    pthread_mutex_lock(&mutex);
+    started++;
+    while (job->gated && !gate_open) {
+        pthread_cond_wait(&cond, &mutex);
+    }
+    order[order_len++] = job->id;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    free(job);
+}
+
+static void submit(work_queue_t *wq, work_class_t class, int id, bool gated) {
+    job_t *job = malloc(sizeof(job_t));
+    job->id = id;
+    job->gated = gated;
+    assert(work_queue_submit(wq, class, job_run, job) == 0);
+}
+
+static void reset(void) {
+    gate_open = false;
+    order_len = 0;
+    started = 0;
+}
+
+static void open_gate(void) {
+    pthread_mutex_lock(&mutex);
+    gate_open = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+static bool wait_for(const int *count, int len) {
+    uint32_t start_ms = get_uptime_ms();
+    pthread_mutex_lock(&mutex);
+    while ((*count < len) && ((get_uptime_ms() - start_ms) < WAIT_MS)) {
+        pthread_mutex_unlock(&mutex);
+        sleep_ms(1);
+        pthread_mutex_lock(&mutex);
+    }
+    bool done = *count >= len;
+    pthread_mutex_unlock(&mutex);
+    return done;
+}
+
+void test_work_queue_inline(void) {
+    reset();
+    work_queue_t *wq = work_queue_init(0);
+    assert(wq != NULL);
+    assert(work_queue_workers(wq) == 0);
+
+    submit(wq, WORK_BULK, 1, false);
+    assert(order_len == 1); // ran in submit
+
+    work_queue_free(wq);
+}
+
+void test_work_queue_priority(void) {
+    reset();
+    work_queue_t *wq = work_queue_init(1);
+    assert(wq != NULL);
+
+    submit(wq, WORK_INTERACTIVE, 0, true); // keeps the only worker busy
+    assert(wait_for(&started, 1));
+    submit(wq, WORK_BULK, 3, false);
+    submit(wq, WORK_INTERACTIVE, 2, false);
+    submit(wq, WORK_IMMEDIATE, 1, false);
+    open_gate();
+
+    assert(wait_for(&order_len, 4));
+    for (int i = 0; i < 4; i++) {
+        assert(order[i] == i);
+    }
+    work_queue_free(wq);
+}
+
+void test_work_queue_bulk_limit(void) {
+    reset();
+    work_queue_t *wq = work_queue_init(2);
+    assert(wq != NULL);
+
+    // only one of the two workers takes bulk jobs, the other stays free for interactive ones
+    submit(wq, WORK_BULK, 1, true);
+    submit(wq, WORK_BULK, 2, true);
+    submit(wq, WORK_INTERACTIVE, 0, false);
+    assert(wait_for(&order_len, 1));
+    assert(order[0] == 0);
+
+    open_gate();
+    assert(wait_for(&order_len, 3));
+    work_queue_free(wq);
+}